@@ -0,0 +1,146 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+struct LinearArena::Overflow {
+    Overflow* next;
+};
+
+LinearArena::LinearArena(size_t capacity)
+    : block(static_cast<unsigned char*>(::operator new(capacity)))
+    , blockSize(capacity)
+    , offset(0)
+    , overflow(NULL)
+    , overflowBytes(0)
+    , peakBytes(0)
+{
+}
+
+LinearArena::~LinearArena()
+{
+    this->reset();
+    ::operator delete(this->block);
+}
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void* LinearArena::allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t base = reinterpret_cast<uintptr_t>(this->block);
+    size_t start = alignUp(base + this->offset, alignment) - base;
+    if (start + bytes <= this->blockSize) {
+        this->offset = start + bytes;
+        this->peakBytes = std::max(this->peakBytes, this->offset + this->overflowBytes);
+        return this->block + start;
+    }
+
+    // Out of block: a heap allocation of its own, with the list link in
+    // front and room to align the start.
+    size_t header = alignUp(sizeof(Overflow), alignof(Overflow));
+    unsigned char* memory = static_cast<unsigned char*>(::operator new(header + bytes + alignment));
+    Overflow* link = reinterpret_cast<Overflow*>(memory);
+    link->next = this->overflow;
+    this->overflow = link;
+    this->overflowBytes += bytes + alignment;
+    this->peakBytes = std::max(this->peakBytes, this->offset + this->overflowBytes);
+    return reinterpret_cast<void*>(alignUp(reinterpret_cast<uintptr_t>(memory + header), alignment));
+}
+
+void LinearArena::reset()
+{
+    bool overflowed = this->overflow != NULL;
+    while (this->overflow) {
+        Overflow* next = this->overflow->next;
+        ::operator delete(this->overflow);
+        this->overflow = next;
+    }
+    this->overflowBytes = 0;
+    this->offset = 0;
+    if (overflowed && this->peakBytes > this->blockSize) {
+        ::operator delete(this->block);
+        this->blockSize = this->peakBytes;
+        this->block = static_cast<unsigned char*>(::operator new(this->blockSize));
+    }
+}
+
+size_t LinearArena::capacity() const
+{
+    return this->blockSize;
+}
+
+size_t LinearArena::used() const
+{
+    return this->offset + this->overflowBytes;
+}
+
+size_t LinearArena::peak() const
+{
+    return this->peakBytes;
+}
+
+// Heap Allocation Counting
+// ========================
+
+static std::atomic<GLuint64> heapAllocations(0);
+
+GLuint64 heapAllocationCount()
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+static void* countedAllocate(size_t bytes)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(bytes ? bytes : 1);
+}
+
+void* operator new(size_t bytes)
+{
+    void* memory = countedAllocate(bytes);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(bytes);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(bytes);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Linear Arenas
+// =============
+// A bump allocator: allocate() hands out the next aligned bytes of one
+// block, nothing is freed on its own, and reset() releases everything at
+// once. For data with a known end: the frame arena is reset after every
+// frame (render graph nodes and pass closures), a scratch arena when an
+// import is done with it.
+//
+// An allocation the block can't fit comes from the heap instead and is
+// freed by the next reset(), which then grows the block to the most ever
+// used between two resets. After the first few frames a steady frame
+// touches the heap for none of it.
+//
+// Objects placed in an arena aren't destroyed by reset(): containers
+// (ArenaVector) destroy their elements as usual, anything placed by hand
+// must be destroyed by hand.
+class LinearArena
+{
+public:
+    explicit LinearArena(size_t capacity);
+    ~LinearArena();
+
+    void* allocate(size_t bytes, size_t alignment);
+    template <class T>
+    T* allocate(size_t count = 1)
+    {
+        return static_cast<T*>(this->allocate(count * sizeof(T), alignof(T)));
+    }
+    void reset();
+
+    size_t capacity() const;
+    // Bytes handed out since the last reset / at most between two resets.
+    size_t used() const;
+    size_t peak() const;
+
+private:
+    struct Overflow;
+
+    unsigned char* block;
+    size_t blockSize;
+    size_t offset;
+    Overflow* overflow;     // heap allocations since the last reset
+    size_t overflowBytes;
+    size_t peakBytes;
+
+    LinearArena(const LinearArena&);
+    LinearArena& operator=(const LinearArena&);
+};
+
+// STL allocator on a LinearArena; deallocate() is a no-op, the memory
+// comes back at the arena's reset(). A container using one must be
+// destroyed (or at least not grown) before that reset.
+template <class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    ArenaAllocator(LinearArena& arena) : arena(&arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count)
+    {
+        return this->arena->template allocate<T>(count);
+    }
+    void deallocate(T*, size_t) {}
+
+    LinearArena* arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena == b.arena;
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena != b.arena;
+}
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+// Heap Allocation Counting
+// ========================
+// Global operator new is replaced (arena.cpp) to count every call, from
+// any thread, so a frame can be checked for heap allocations: read the
+// count before and after. C malloc (drivers, SOIL, assimp's C parts) goes
+// uncounted.
+GLuint64 heapAllocationCount();
+
+#endif // ARENA_H
@@ -0,0 +1,44 @@
+#include "benchmark.h"
+
+#include "camera.h"
+
+// Camera
+// ======
+// getViewMatrix runs once per frame (and per late latch); the camera
+// vectors are recomputed on every mouse event and path keyframe.
+
+struct ViewMatrix {
+    Camera* camera;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            this->camera->position.x += 0.001f;
+            glm::mat4 viewMatrix = this->camera->getViewMatrix();
+            benchmarkSink(viewMatrix[3][0]);
+        }
+    }
+};
+
+struct CameraVectors {
+    Camera* camera;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            this->camera->processMouseMovement(0.5f, (n & 1) ? 0.25f : -0.25f);
+            benchmarkSink(this->camera->front.x);
+        }
+    }
+};
+
+void benchmarkCamera(BenchmarkRunner& runner)
+{
+    Camera camera(glm::vec3(0.0f, 0.0f, 6.0f));
+
+    ViewMatrix viewMatrix = { &camera };
+    runner.run("camera_view_matrix", BenchmarkParameters(), 1, viewMatrix);
+
+    CameraVectors cameraVectors = { &camera };
+    runner.run("camera_update_vectors", BenchmarkParameters(), 1, cameraVectors);
+}
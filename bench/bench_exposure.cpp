@@ -0,0 +1,59 @@
+#include "benchmark.h"
+
+#include <cmath>
+#include <iostream>
+
+#include "exposure.h"
+
+// Auto Exposure
+// =============
+// Not timed: the CPU reference of the exposure math (exposure.h) checked
+// against values worked out by hand, so a change to the metering that
+// breaks it fails the bench run instead of only showing on screen.
+
+static bool near(const char* name, GLfloat value, GLfloat expected)
+{
+    if (std::fabs(value - expected) <= 1.0e-3f * std::max(std::fabs(expected), 1.0e-3f)) {
+        return true;
+    }
+    std::cout << "ERROR::BENCHMARK::CHECK_FAILED " << name << ": " << value
+              << ", expected " << expected << std::endl;
+    return false;
+}
+
+bool checkExposure()
+{
+    bool ok = true;
+    ok &= near("luminance white", luminance(1.0f, 1.0f, 1.0f), 1.0f);
+    ok &= near("luminance red", luminance(1.0f, 0.0f, 0.0f), 0.2126f);
+
+    // Uniform middle grey: the log-average is the grey itself (plus the
+    // epsilon that keeps log() finite).
+    std::vector<GLfloat> rgb(64 * 64 * 3, 0.18f);
+    ok &= near("log-average grey", referenceLogAverageLuminance(&rgb[0], 64, 64), 0.1801f);
+
+    // Left half black, right half white, with the half boundary on a tap
+    // boundary: the geometric mean sqrt(1e-4 * (1 + 1e-4)).
+    const GLuint width = 2 * AutoExposure::REDUCTION_SIZE, height = AutoExposure::REDUCTION_SIZE;
+    rgb.assign(width * height * 3, 0.0f);
+    for (GLuint y = 0; y < height; y++) {
+        for (GLuint x = width / 2; x < width; x++) {
+            for (GLuint c = 0; c < 3; c++) {
+                rgb[(y * width + x) * 3 + c] = 1.0f;
+            }
+        }
+    }
+    ok &= near("log-average split", referenceLogAverageLuminance(&rgb[0], width, height), 0.0100005f);
+
+    // Adaptation: a rate of ln 2 per second halves the gap in one second,
+    // and no time passing changes nothing.
+    ok &= near("adapt half", referenceAdaptLuminance(1.0f, 0.0f, 1.0f, std::log(2.0f)), 0.5f);
+    ok &= near("adapt two seconds", referenceAdaptLuminance(1.0f, 0.0f, 2.0f, std::log(2.0f)), 0.25f);
+    ok &= near("adapt no time", referenceAdaptLuminance(0.3f, 2.0f, 0.0f, 1.5f), 0.3f);
+
+    // Exposure: middle grey maps to 1, clamped at both ends.
+    ok &= near("exposure key", referenceExposure(0.18f, 0.18f, 0.1f, 8.0f), 1.0f);
+    ok &= near("exposure dark", referenceExposure(0.01f, 0.18f, 0.1f, 8.0f), 8.0f);
+    ok &= near("exposure bright", referenceExposure(10.0f, 0.18f, 0.1f, 8.0f), 0.1f);
+    return ok;
+}
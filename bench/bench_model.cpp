@@ -0,0 +1,223 @@
+#include "benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+#include <assimp/scene.h>
+
+#include "model.h"
+#include "gpumemory.h"
+#include "pngencode.h"
+
+// Model Loading
+// =============
+// Scenes are built in memory (no importer time in the numbers) and turned
+// into Models: mesh conversion to Vertex / index arrays, the geometry
+// registry's hashing and the (stubbed) uploads. Textures are real PNG
+// files written to bench-data/ in the working directory.
+
+static const char* DATA_DIRECTORY = "bench-data";
+
+// Model's cache of loaded textures (model.cpp).
+extern std::vector<Texture> textures_loaded;
+
+static void clearLoadedTextures()
+{
+    for (GLuint i = 0; i < textures_loaded.size(); i++) {
+        untrackTexture(textures_loaded[i].id);
+    }
+    textures_loaded.clear();
+}
+
+static std::string textureName(GLuint index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "material%04u.png", index);
+    return name;
+}
+
+// An image with smooth gradients and some noise, so it compresses
+// roughly like a photograph rather than like a flat color.
+static void writeTestImage(const std::string& path, GLuint size)
+{
+    std::vector<GLubyte> pixels(size * size * 3);
+    srand(size);
+    for (GLuint y = 0; y < size; y++) {
+        for (GLuint x = 0; x < size; x++) {
+            GLubyte* pixel = &pixels[(y * size + x) * 3];
+            pixel[0] = (x * 255 / size + rand() % 16) & 0xFF;
+            pixel[1] = (y * 255 / size + rand() % 16) & 0xFF;
+            pixel[2] = ((x + y) * 127 / size + rand() % 16) & 0xFF;
+        }
+    }
+    writePng(path, &pixels[0], size, size, 3, false);
+}
+
+// About `vertices` vertices as a square grid in the xz plane, raised by
+// `height` so that every mesh of a scene is distinct.
+static aiMesh* gridMesh(GLuint vertices, GLuint material, GLfloat height)
+{
+    GLuint side = std::max((GLuint) sqrt((GLdouble) vertices), 2u);
+    aiMesh* mesh = new aiMesh();
+    mesh->mNumVertices = side * side;
+    mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+    mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+    mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+    mesh->mNumUVComponents[0] = 2;
+    for (GLuint z = 0; z < side; z++) {
+        for (GLuint x = 0; x < side; x++) {
+            GLuint i = z * side + x;
+            mesh->mVertices[i] = aiVector3D(x, height, z);
+            mesh->mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+            mesh->mTextureCoords[0][i] = aiVector3D((GLfloat) x / side, (GLfloat) z / side, 0.0f);
+        }
+    }
+    mesh->mNumFaces = (side - 1) * (side - 1) * 2;
+    mesh->mFaces = new aiFace[mesh->mNumFaces];
+    GLuint face = 0;
+    for (GLuint z = 0; z + 1 < side; z++) {
+        for (GLuint x = 0; x + 1 < side; x++) {
+            GLuint corner = z * side + x;
+            GLuint triangles[2][3] = { { corner, corner + side, corner + 1 },
+                                       { corner + 1, corner + side, corner + side + 1 } };
+            for (GLuint t = 0; t < 2; t++, face++) {
+                mesh->mFaces[face].mNumIndices = 3;
+                mesh->mFaces[face].mIndices = new unsigned int[3];
+                for (GLuint k = 0; k < 3; k++) {
+                    mesh->mFaces[face].mIndices[k] = triangles[t][k];
+                }
+            }
+        }
+    }
+    mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    mesh->mMaterialIndex = material;
+    return mesh;
+}
+
+// `meshes` grids of `vertices` vertices under the root node; with
+// `textures` > 0, as many materials each with its own diffuse map
+// (textureName()), assigned to the meshes round robin.
+static aiScene* buildScene(GLuint meshes, GLuint vertices, GLuint textures)
+{
+    aiScene* scene = new aiScene();
+    scene->mNumMaterials = std::max(textures, 1u);
+    scene->mMaterials = new aiMaterial*[scene->mNumMaterials];
+    for (GLuint i = 0; i < scene->mNumMaterials; i++) {
+        scene->mMaterials[i] = new aiMaterial();
+        if (textures > 0) {
+            aiString path;
+            path.Set(textureName(i));
+            scene->mMaterials[i]->AddProperty(&path, AI_MATKEY_TEXTURE_DIFFUSE(0));
+        }
+    }
+    scene->mNumMeshes = meshes;
+    scene->mMeshes = new aiMesh*[meshes];
+    scene->mRootNode = new aiNode();
+    scene->mRootNode->mNumMeshes = meshes;
+    scene->mRootNode->mMeshes = new unsigned int[meshes];
+    for (GLuint i = 0; i < meshes; i++) {
+        scene->mMeshes[i] = gridMesh(vertices, i % scene->mNumMaterials, (GLfloat) i);
+        scene->mRootNode->mMeshes[i] = i;
+    }
+    return scene;
+}
+
+struct ModelBuild {
+    const aiScene* scene;
+    std::string directory;
+    JobSystem* jobs;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            Model model(this->scene, this->directory, this->jobs);
+            benchmarkSink(model.meshes.size());
+        }
+    }
+};
+
+struct TextureDecode {
+    std::string filename;
+    std::string directory;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            GLuint texture = textureFromFile(this->filename.c_str(), this->directory);
+            untrackTexture(texture);
+            benchmarkSink(texture);
+        }
+    }
+};
+
+void benchmarkModel(BenchmarkRunner& runner)
+{
+    mkdir(DATA_DIRECTORY, 0755);
+
+    // Serial import: one large mesh, and many small ones.
+    static const GLuint MESH_SIZES[][2] = { { 1, 1024 }, { 1, 16384 }, { 1, 262144 }, { 64, 256 } };
+    for (GLuint i = 0; i < sizeof(MESH_SIZES) / sizeof(MESH_SIZES[0]); i++) {
+        GLuint meshes = MESH_SIZES[i][0], vertices = MESH_SIZES[i][1];
+        if (!runner.selected("model_process_mesh")) {
+            break;
+        }
+        aiScene* scene = buildScene(meshes, vertices, 0);
+        ModelBuild body = { scene, DATA_DIRECTORY, NULL };
+        BenchmarkParameters parameters = { { "meshes", meshes }, { "vertices", vertices } };
+        runner.run("model_process_mesh", parameters, meshes * scene->mMeshes[0]->mNumVertices, body);
+        delete scene;
+    }
+
+    // The same, with mesh conversion spread over a job system.
+    static const GLuint THREAD_COUNTS[] = { 1, 2, 4, 8 };
+    if (runner.selected("model_import_parallel")) {
+        const GLuint meshes = 256, vertices = 1024;
+        aiScene* scene = buildScene(meshes, vertices, 0);
+        for (GLuint i = 0; i < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); i++) {
+            JobSystem jobs(THREAD_COUNTS[i]);
+            ModelBuild body = { scene, DATA_DIRECTORY, &jobs };
+            BenchmarkParameters parameters = { { "meshes", meshes }, { "vertices", vertices },
+                                               { "threads", THREAD_COUNTS[i] } };
+            runner.run("model_import_parallel", parameters, meshes * scene->mMeshes[0]->mNumVertices, body);
+        }
+        delete scene;
+    }
+
+    // loadMaterialTextures: every mesh looks its texture up among those
+    // already loaded. The first build loads them; the timed ones hit the
+    // cache.
+    static const GLuint TEXTURE_COUNTS[] = { 16, 256, 1024 };
+    for (GLuint i = 0; i < sizeof(TEXTURE_COUNTS) / sizeof(TEXTURE_COUNTS[0]); i++) {
+        GLuint textures = TEXTURE_COUNTS[i];
+        if (!runner.selected("model_load_material_textures")) {
+            break;
+        }
+        for (GLuint t = 0; t < textures; t++) {
+            writeTestImage(std::string(DATA_DIRECTORY) + "/" + textureName(t), 4);
+        }
+        aiScene* scene = buildScene(textures, 4, textures);
+        ModelBuild body = { scene, DATA_DIRECTORY, NULL };
+        BenchmarkParameters parameters = { { "textures", textures } };
+        runner.run("model_load_material_textures", parameters, textures, body);
+        delete scene;
+        clearLoadedTextures();
+    }
+
+    // textureFromFile: decode, upload (stubbed) and mipmap request.
+    static const GLuint IMAGE_SIZES[] = { 256, 1024, 2048 };
+    for (GLuint i = 0; i < sizeof(IMAGE_SIZES) / sizeof(IMAGE_SIZES[0]); i++) {
+        GLuint size = IMAGE_SIZES[i];
+        if (!runner.selected("texture_from_file")) {
+            break;
+        }
+        char filename[32];
+        snprintf(filename, sizeof(filename), "decode%u.png", size);
+        writeTestImage(std::string(DATA_DIRECTORY) + "/" + filename, size);
+        TextureDecode body = { filename, DATA_DIRECTORY };
+        BenchmarkParameters parameters = { { "size", size } };
+        runner.run("texture_from_file", parameters, size * size, body);
+    }
+}
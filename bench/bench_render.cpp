@@ -0,0 +1,143 @@
+#include "benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "matrixbatch.h"
+
+// Render Loop
+// ===========
+// Per-object matrix math (the glm path and the batched kernel) over
+// object counts, and the uniform name strings built every frame: the SSAO
+// pass's kernelSamples[i] and Mesh::Draw's material.texture_diffuseN.
+
+static std::vector<glm::mat4> randomModelMatrices(GLuint count)
+{
+    std::vector<glm::mat4> modelMatrices;
+    srand(7);
+    for (GLuint i = 0; i < count; i++) {
+        glm::mat4 modelMatrix = glm::mat4();
+        modelMatrix = glm::translate(modelMatrix, glm::vec3(rand() % 100, rand() % 100, rand() % 100));
+        modelMatrix = glm::scale(modelMatrix, glm::vec3((rand() % 100) / 100.0f + 0.1f));
+        modelMatrix = glm::rotate(modelMatrix, glm::radians((GLfloat) (rand() % 360)), glm::vec3(0.3f, 0.5f, 0.8f));
+        modelMatrices.push_back(modelMatrix);
+    }
+    return modelMatrices;
+}
+
+struct GlmObjectMatrices {
+    const std::vector<glm::mat4>* modelMatrices;
+    glm::mat4 viewMatrix, projectionMatrix;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            GLfloat checksum = 0.0f;
+            for (GLuint i = 0; i < this->modelMatrices->size(); i++) {
+                glm::mat4 modelViewMatrix = this->viewMatrix * (*this->modelMatrices)[i];
+                glm::mat4 modelViewMatrixInverseTranspose = glm::inverse(glm::transpose(modelViewMatrix));
+                glm::mat4 modelViewProjectionMatrix = this->projectionMatrix * modelViewMatrix;
+                checksum += modelViewMatrix[3][0] + modelViewMatrixInverseTranspose[0][0] + modelViewProjectionMatrix[3][3];
+            }
+            benchmarkSink(checksum);
+        }
+    }
+};
+
+struct BatchedObjectMatrices {
+    const std::vector<glm::mat4>* modelMatrices;
+    glm::mat4 viewMatrix, projectionMatrix;
+    NormalMatrixMode normalMode;
+    ObjectMatrixArrays out;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            computeObjectMatrices(&(*this->modelMatrices)[0], NULL, this->modelMatrices->size(),
+                                  this->viewMatrix, this->projectionMatrix, this->normalMode, this->out);
+            benchmarkSink(this->out.modelView[0]);
+        }
+    }
+};
+
+// As the SSAO pass names its kernel uniforms.
+struct KernelUniformNames {
+    GLuint samples;
+
+    void operator()(GLuint iterations)
+    {
+        for (GLuint n = 0; n < iterations; n++) {
+            for (GLuint i = 0; i < this->samples; i++) {
+                char name[32];
+                benchmarkSink(snprintf(name, sizeof(name), "kernelSamples[%u]", i));
+            }
+        }
+    }
+};
+
+// As Mesh::Draw names its texture uniforms, half diffuse, half specular.
+struct MaterialUniformNames {
+    GLuint textures;
+
+    void operator()(GLuint iterations)
+    {
+        // Texture::type, held by the mesh.
+        static const std::string TYPES[] = { "texture_diffuse", "texture_specular" };
+        for (GLuint n = 0; n < iterations; n++) {
+            GLuint diffuseNr = 1;
+            GLuint specularNr = 1;
+            for (GLuint i = 0; i < this->textures; i++) {
+                const std::string& name = TYPES[i & 1];
+                GLuint number = 0;
+                if (name == "texture_diffuse") {
+                    number = diffuseNr++;
+                }
+                else if (name == "texture_specular") {
+                    number = specularNr++;
+                }
+                char uniformName[64];
+                benchmarkSink(snprintf(uniformName, sizeof(uniformName), "material.%s%u", name.c_str(), number));
+            }
+        }
+    }
+};
+
+void benchmarkRenderLoop(BenchmarkRunner& runner)
+{
+    glm::mat4 viewMatrix = glm::lookAt(glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 15.0f);
+
+    static const GLuint OBJECT_COUNTS[] = { 100, 1000, 10000, 100000 };
+    for (GLuint i = 0; i < sizeof(OBJECT_COUNTS) / sizeof(OBJECT_COUNTS[0]); i++) {
+        GLuint objects = OBJECT_COUNTS[i];
+        std::vector<glm::mat4> modelMatrices = randomModelMatrices(objects);
+        BenchmarkParameters parameters = { { "objects", objects } };
+
+        GlmObjectMatrices glmMatrices = { &modelMatrices, viewMatrix, projectionMatrix };
+        runner.run("object_matrices_glm", parameters, objects, glmMatrices);
+
+        std::vector<GLfloat> modelView(objects * 16), modelViewProjection(objects * 16), normal(objects * 9);
+        ObjectMatrixArrays out = { &modelView[0], &modelViewProjection[0], &normal[0] };
+        BatchedObjectMatrices general = { &modelMatrices, viewMatrix, projectionMatrix, NORMAL_MATRIX_GENERAL, out };
+        runner.run("object_matrices_batched", parameters, objects, general);
+        BatchedObjectMatrices uniformScale = { &modelMatrices, viewMatrix, projectionMatrix, NORMAL_MATRIX_UNIFORM_SCALE, out };
+        runner.run("object_matrices_batched_uniform_scale", parameters, objects, uniformScale);
+    }
+
+    static const GLuint KERNEL_SIZES[] = { 16, 64 };
+    for (GLuint i = 0; i < sizeof(KERNEL_SIZES) / sizeof(KERNEL_SIZES[0]); i++) {
+        KernelUniformNames body = { KERNEL_SIZES[i] };
+        BenchmarkParameters parameters = { { "samples", KERNEL_SIZES[i] } };
+        runner.run("uniform_names_kernel", parameters, KERNEL_SIZES[i], body);
+    }
+
+    static const GLuint TEXTURE_COUNTS[] = { 2, 8 };
+    for (GLuint i = 0; i < sizeof(TEXTURE_COUNTS) / sizeof(TEXTURE_COUNTS[0]); i++) {
+        MaterialUniformNames body = { TEXTURE_COUNTS[i] };
+        BenchmarkParameters parameters = { { "textures", TEXTURE_COUNTS[i] } };
+        runner.run("uniform_names_material", parameters, TEXTURE_COUNTS[i], body);
+    }
+}
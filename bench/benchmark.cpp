@@ -0,0 +1,111 @@
+#include "benchmark.h"
+
+#include <cstdio>
+#include <iostream>
+
+static volatile GLfloat sink;
+
+void benchmarkSink(GLfloat value)
+{
+    sink = sink + value;
+}
+
+BenchmarkRunner::BenchmarkRunner(const std::string& filter)
+    : filter(filter)
+{
+}
+
+bool BenchmarkRunner::selected(const std::string& name) const
+{
+    return name.find(this->filter) != std::string::npos;
+}
+
+void BenchmarkRunner::record(const std::string& name, const BenchmarkParameters& parameters, GLuint items,
+                             GLuint iterations, std::vector<GLdouble>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+    BenchmarkResult result;
+    result.name = name;
+    result.parameters = parameters;
+    result.iterations = iterations;
+    result.medianNanoseconds = samples[samples.size() / 2];
+    result.minNanoseconds = samples.front();
+    result.maxNanoseconds = samples.back();
+    result.items = items;
+    this->benchmarkResults.push_back(result);
+
+    std::cout << "BENCHMARK::" << name;
+    for (GLuint i = 0; i < parameters.size(); i++) {
+        std::cout << " " << parameters[i].name << "=" << parameters[i].value;
+    }
+    std::cout << ": " << result.medianNanoseconds << " ns (min " << result.minNanoseconds
+              << ", max " << result.maxNanoseconds << ")";
+    if (items > 1) {
+        std::cout << ", " << items * 1000.0 / result.medianNanoseconds << " M items/s";
+    }
+    std::cout << std::endl;
+}
+
+const std::vector<BenchmarkResult>& BenchmarkRunner::results() const
+{
+    return this->benchmarkResults;
+}
+
+bool BenchmarkRunner::writeJson(const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        std::cout << "ERROR::BENCHMARK::FILE_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (GLuint i = 0; i < this->benchmarkResults.size(); i++) {
+        const BenchmarkResult& result = this->benchmarkResults[i];
+        fprintf(file, "    {\"name\": \"%s\", \"parameters\": {", result.name.c_str());
+        for (GLuint p = 0; p < result.parameters.size(); p++) {
+            fprintf(file, "%s\"%s\": %u", p > 0 ? ", " : "",
+                    result.parameters[p].name.c_str(), result.parameters[p].value);
+        }
+        fprintf(file, "}, \"iterations\": %u, \"ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f, "
+                      "\"items\": %u, \"items_per_second\": %.0f}%s\n",
+                result.iterations, result.medianNanoseconds, result.minNanoseconds, result.maxNanoseconds,
+                result.items, result.items * 1e9 / result.medianNanoseconds,
+                i + 1 < this->benchmarkResults.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// ****
+// Main
+// ****
+int main(int argc, char *argv[])
+{
+    std::string filter, jsonPath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        if (std::string(argv[i]) == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        }
+    }
+
+    if (!checkExposure()) {
+        return -1;
+    }
+
+    installGlStubs();
+    BenchmarkRunner runner(filter);
+    benchmarkModel(runner);
+    benchmarkCamera(runner);
+    benchmarkRenderLoop(runner);
+
+    if (!jsonPath.empty()) {
+        if (!runner.writeJson(jsonPath)) {
+            return -1;
+        }
+        std::cout << "BENCHMARK:: " << runner.results().size() << " results in " << jsonPath << std::endl;
+    }
+    return 0;
+}
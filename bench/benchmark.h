@@ -0,0 +1,112 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// CPU Benchmarks
+// ==============
+// Micro-benchmarks of the CPU hot paths, built as learn-opengl-bench and
+// run without a GL context (glstubs.cpp). Each case is a name, a few
+// integer parameters (mesh size, object count, ...) and a body that does
+// the work `iterations` times. The iteration count is doubled until one
+// sample takes MIN_SAMPLE_TIME; then SAMPLES samples are timed and the
+// median, minimum and maximum per iteration reported.
+//
+//   learn-opengl-bench [--filter <substring>] [--json <file>]
+//
+// The JSON file lists the cases in a fixed order, one per line, so runs
+// from two commits can be diffed directly (`make bench` writes
+// bench.json in the build directory).
+struct BenchmarkParameter {
+    std::string name;
+    GLuint value;
+};
+typedef std::vector<BenchmarkParameter> BenchmarkParameters;
+
+struct BenchmarkResult {
+    std::string name;
+    BenchmarkParameters parameters;
+    GLuint iterations;              // per sample
+    GLdouble medianNanoseconds;     // per iteration
+    GLdouble minNanoseconds;
+    GLdouble maxNanoseconds;
+    GLuint items;                   // vertices, objects, ... per iteration
+};
+
+class BenchmarkRunner
+{
+public:
+    static const GLuint SAMPLES = 7;
+    static const GLuint MAX_ITERATIONS = 1 << 24;
+    static const GLuint MIN_SAMPLE_TIME = 20000000;    // ns
+
+    // Only cases whose name contains `filter` run.
+    BenchmarkRunner(const std::string& filter);
+
+    bool selected(const std::string& name) const;
+
+    // `body(iterations)` does the measured work `iterations` times;
+    // `items` is how many vertices, objects, ... one iteration processes,
+    // for the items per second column.
+    template <typename Body>
+    void run(const std::string& name, const BenchmarkParameters& parameters, GLuint items, Body& body)
+    {
+        if (!this->selected(name)) {
+            return;
+        }
+        typedef std::chrono::high_resolution_clock Clock;
+        GLuint iterations = 1;
+        for (;;) {
+            Clock::time_point start = Clock::now();
+            body(iterations);
+            GLdouble elapsed = std::chrono::duration<GLdouble, std::nano>(Clock::now() - start).count();
+            if (elapsed >= MIN_SAMPLE_TIME || iterations >= MAX_ITERATIONS) {
+                break;
+            }
+            iterations *= 2;
+        }
+        std::vector<GLdouble> samples;
+        for (GLuint i = 0; i < SAMPLES; i++) {
+            Clock::time_point start = Clock::now();
+            body(iterations);
+            samples.push_back(std::chrono::duration<GLdouble, std::nano>(Clock::now() - start).count() / iterations);
+        }
+        this->record(name, parameters, items, iterations, samples);
+    }
+
+    const std::vector<BenchmarkResult>& results() const;
+    // Returns false (and prints an error) if the file cannot be written.
+    bool writeJson(const std::string& path) const;
+
+private:
+    std::string filter;
+    std::vector<BenchmarkResult> benchmarkResults;
+
+    void record(const std::string& name, const BenchmarkParameters& parameters, GLuint items,
+                GLuint iterations, std::vector<GLdouble>& samples);
+};
+
+// Keeps a result alive so the compiler can't drop the work producing it.
+void benchmarkSink(GLfloat value);
+
+// Install no-op GL entry points (glstubs.cpp).
+void installGlStubs();
+
+// Cases
+// -----
+void benchmarkModel(BenchmarkRunner& runner);       // bench_model.cpp
+void benchmarkCamera(BenchmarkRunner& runner);      // bench_camera.cpp
+void benchmarkRenderLoop(BenchmarkRunner& runner);  // bench_render.cpp
+
+// Checks
+// ------
+// Run before the cases, whatever the filter; false (with the failures
+// printed) fails the run.
+bool checkExposure();                               // bench_exposure.cpp
+
+#endif // BENCHMARK_H
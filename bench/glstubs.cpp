@@ -0,0 +1,65 @@
+#include "benchmark.h"
+
+// GL Stubs
+// ========
+// The benchmarks never create a context. GL 1.1 entry points, which libGL
+// exports directly, are defined here (the executable's definitions win
+// over the library's); everything newer goes through GLEW's function
+// pointers, which installGlStubs() aims at no-ops. Object names are
+// handed out from a counter so the registries in geometry.cpp and
+// gpumemory.cpp see distinct objects. Only what the benchmarked code calls
+// is stubbed.
+
+static GLuint nextName = 1;
+
+static void generateNames(GLsizei count, GLuint* names)
+{
+    for (GLsizei i = 0; i < count; i++) {
+        names[i] = nextName++;
+    }
+}
+
+extern "C" {
+void GLAPIENTRY glGenTextures(GLsizei n, GLuint* textures) { generateNames(n, textures); }
+void GLAPIENTRY glDeleteTextures(GLsizei n, const GLuint* textures) {}
+void GLAPIENTRY glBindTexture(GLenum target, GLuint texture) {}
+void GLAPIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                             GLint border, GLenum format, GLenum type, const void* pixels) {}
+void GLAPIENTRY glTexParameteri(GLenum target, GLenum name, GLint value) {}
+void GLAPIENTRY glPixelStorei(GLenum name, GLint value) {}
+void GLAPIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {}
+}
+
+static void GLAPIENTRY stubGenBuffers(GLsizei n, GLuint* buffers) { generateNames(n, buffers); }
+static void GLAPIENTRY stubDeleteBuffers(GLsizei n, const GLuint* buffers) {}
+static void GLAPIENTRY stubBindBuffer(GLenum target, GLuint buffer) {}
+static void GLAPIENTRY stubBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {}
+static void GLAPIENTRY stubGenVertexArrays(GLsizei n, GLuint* arrays) { generateNames(n, arrays); }
+static void GLAPIENTRY stubDeleteVertexArrays(GLsizei n, const GLuint* arrays) {}
+static void GLAPIENTRY stubBindVertexArray(GLuint array) {}
+static void GLAPIENTRY stubEnableVertexAttribArray(GLuint index) {}
+static void GLAPIENTRY stubVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                               GLsizei stride, const void* pointer) {}
+static void GLAPIENTRY stubGenerateMipmap(GLenum target) {}
+static void GLAPIENTRY stubActiveTexture(GLenum texture) {}
+static GLint GLAPIENTRY stubGetUniformLocation(GLuint program, const GLchar* name) { return 0; }
+static void GLAPIENTRY stubUniform1i(GLint location, GLint value) {}
+static void GLAPIENTRY stubUniform1f(GLint location, GLfloat value) {}
+
+void installGlStubs()
+{
+    glGenBuffers = stubGenBuffers;
+    glDeleteBuffers = stubDeleteBuffers;
+    glBindBuffer = stubBindBuffer;
+    glBufferData = stubBufferData;
+    glGenVertexArrays = stubGenVertexArrays;
+    glDeleteVertexArrays = stubDeleteVertexArrays;
+    glBindVertexArray = stubBindVertexArray;
+    glEnableVertexAttribArray = stubEnableVertexAttribArray;
+    glVertexAttribPointer = stubVertexAttribPointer;
+    glGenerateMipmap = stubGenerateMipmap;
+    glActiveTexture = stubActiveTexture;
+    glGetUniformLocation = stubGetUniformLocation;
+    glUniform1i = stubUniform1i;
+    glUniform1f = stubUniform1f;
+}
@@ -0,0 +1,182 @@
+#include "bloom.h"
+
+#include <iostream>
+
+#include "gpumemory.h"
+
+Bloom::Bloom(GLuint width, GLuint height, GLuint levels, GLuint reportInterval)
+    : intensity(0.5f)
+    , width(width)
+    , height(height)
+    , reportInterval(reportInterval)
+    , downsampleShader("../learn-opengl/shaders/screen.vert",
+                       "../learn-opengl/shaders/bloom-downsample.frag",
+                       ShaderDefines(), true)
+    , upsampleShader("../learn-opengl/shaders/screen.vert",
+                     "../learn-opengl/shaders/bloom-upsample.frag",
+                     ShaderDefines(), true)
+    , nextQuery(0)
+    , gpuTime(0.0)
+    , timedFrames(0)
+    , frames(0)
+{
+    glGenQueries(2 * QUERIES_IN_FLIGHT, &this->queries[0][0]);
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        this->queryBusy[i] = false;
+    }
+    this->createLevels(levels);
+}
+
+Bloom::~Bloom()
+{
+    this->deleteLevels();
+    glDeleteQueries(2 * QUERIES_IN_FLIGHT, &this->queries[0][0]);
+}
+
+void Bloom::setLevels(GLuint levels)
+{
+    if (levels != this->levels()) {
+        this->deleteLevels();
+        this->createLevels(levels);
+    }
+}
+
+GLuint Bloom::levels() const
+{
+    return this->textures.size();
+}
+
+void Bloom::createLevels(GLuint levels)
+{
+    // R11F_G11F_B10F: HDR range at half the bandwidth of RGBA16F, which is
+    // most of this stage's cost.
+    GLuint levelWidth = this->width;
+    GLuint levelHeight = this->height;
+    levels = levels > 0 ? levels : 1;
+    for (GLuint i = 0; i < levels; i++) {
+        if (levelWidth == 1 && levelHeight == 1) {
+            break;
+        }
+        levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+        levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, levelWidth, levelHeight, 0, GL_RGB, GL_FLOAT, NULL);
+        trackTexture(texture, GPU_MEMORY_POST, "bloom level", levelWidth, levelHeight, GL_R11F_G11F_B10F);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        GLuint framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR::BLOOM::FRAMEBUFFER_INCOMPLETE level " << i + 1 << std::endl;
+        }
+
+        this->textures.push_back(texture);
+        this->framebuffers.push_back(framebuffer);
+        this->levelWidths.push_back(levelWidth);
+        this->levelHeights.push_back(levelHeight);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Bloom::deleteLevels()
+{
+    if (this->textures.empty()) {
+        return;
+    }
+    glDeleteFramebuffers(this->framebuffers.size(), &this->framebuffers[0]);
+    for (GLuint i = 0; i < this->textures.size(); i++) {
+        untrackTexture(this->textures[i]);
+    }
+    glDeleteTextures(this->textures.size(), &this->textures[0]);
+    this->framebuffers.clear();
+    this->textures.clear();
+    this->levelWidths.clear();
+    this->levelHeights.clear();
+}
+
+GLuint Bloom::apply(GLuint brightTexture, GLuint screenVAO)
+{
+    this->pollQueries();
+    bool timed = !this->queryBusy[this->nextQuery];
+    if (timed) {
+        glQueryCounter(this->queries[this->nextQuery][0], GL_TIMESTAMP);
+    }
+
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(screenVAO);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Downsample
+    // ----------
+    this->downsampleShader.Use();
+    glUniform1i(glGetUniformLocation(this->downsampleShader.Program, "image"), 0);
+    GLuint source = brightTexture;
+    for (GLuint i = 0; i < this->textures.size(); i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+        glViewport(0, 0, this->levelWidths[i], this->levelHeights[i]);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        source = this->textures[i];
+    }
+
+    // Upsample
+    // --------
+    this->upsampleShader.Use();
+    glUniform1i(glGetUniformLocation(this->upsampleShader.Program, "image"), 0);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    for (GLint i = (GLint) this->textures.size() - 2; i >= 0; i--) {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[i]);
+        glViewport(0, 0, this->levelWidths[i], this->levelHeights[i]);
+        glBindTexture(GL_TEXTURE_2D, this->textures[i + 1]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glDisable(GL_BLEND);
+
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, this->width, this->height);
+
+    if (timed) {
+        glQueryCounter(this->queries[this->nextQuery][1], GL_TIMESTAMP);
+        this->queryBusy[this->nextQuery] = true;
+        this->nextQuery = (this->nextQuery + 1) % QUERIES_IN_FLIGHT;
+    }
+    if (++this->frames % this->reportInterval == 0 && this->timedFrames > 0) {
+        std::cout << "BLOOM:: " << this->levels() << " levels, "
+                  << this->gpuTime / this->timedFrames << " ms GPU ("
+                  << this->width << "x" << this->height << ")" << std::endl;
+        this->gpuTime = 0.0;
+        this->timedFrames = 0;
+    }
+    return this->textures[0];
+}
+
+void Bloom::pollQueries()
+{
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        if (!this->queryBusy[i]) {
+            continue;
+        }
+        // The end timestamp is written after the start one.
+        GLint available = 0;
+        glGetQueryObjectiv(this->queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(this->queries[i][0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(this->queries[i][1], GL_QUERY_RESULT, &end);
+            this->gpuTime += (end - start) * 1.0e-6;
+            this->timedFrames++;
+            this->queryBusy[i] = false;
+        }
+    }
+}
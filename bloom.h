@@ -0,0 +1,75 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+// Bloom
+// =====
+// Blurs the lighting pass's bright-pass output (the pixels above the bloom
+// threshold) over a mip chain of progressively halved targets, dual-Kawase
+// style: each downsample and each upsample is a single 5- or 8-tap filter,
+// and the wide blur comes from the chain rather than from wide kernels.
+//
+//   bright (full) -> 1/2 -> 1/4 -> ... -> 1/2^levels      downsample
+//                    1/2 <- 1/4 <- ... <- 1/2^levels      upsample, additive
+//
+// Upsampling blends onto the next larger level (GL_ONE, GL_ONE), so every
+// level's blur contributes to the result in level 1, which the composite
+// pass scales by `intensity` and adds to the scene.
+//
+// The stage's GPU time is measured with a pair of GL_TIMESTAMP queries
+// (polled, never waited on) and printed every `reportInterval` frames.
+// Timestamps rather than GL_TIME_ELAPSED, which allows one active query:
+// the whole-frame query of a --replay / --batch run (FrameTimingLog) is
+// open around the bloom stage.
+class Bloom
+{
+public:
+    Bloom(GLuint width, GLuint height, GLuint levels = 5, GLuint reportInterval = 300);
+    ~Bloom();
+
+    // Rebuild the chain with a new level count (at least 1; clamped so the
+    // smallest level is at least 1 x 1).
+    void setLevels(GLuint levels);
+    GLuint levels() const;
+
+    // Run the chain on `brightTexture`, drawing with `screenVAO` (a
+    // full-screen quad, as for screen.vert). Returns the blurred texture,
+    // at half resolution. Leaves framebuffer 0 bound and the viewport at
+    // full size.
+    GLuint apply(GLuint brightTexture, GLuint screenVAO);
+
+    GLfloat intensity;
+
+private:
+    static const GLuint QUERIES_IN_FLIGHT = 4;
+
+    GLuint width, height;
+    GLuint reportInterval;
+    std::vector<GLuint> textures;
+    std::vector<GLuint> framebuffers;
+    std::vector<GLuint> levelWidths;
+    std::vector<GLuint> levelHeights;
+    Shader downsampleShader;
+    Shader upsampleShader;
+
+    GLuint queries[QUERIES_IN_FLIGHT][2];   // start, end
+    bool queryBusy[QUERIES_IN_FLIGHT];
+    GLuint nextQuery;
+    GLdouble gpuTime;
+    GLuint timedFrames;
+    GLuint frames;
+
+    void createLevels(GLuint levels);
+    void deleteLevels();
+    void pollQueries();
+
+    Bloom(const Bloom&);
+    Bloom& operator=(const Bloom&);
+};
+
+#endif // BLOOM_H
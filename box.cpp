@@ -2,7 +2,13 @@
 
 Box::Box()
 {
-    this->vertices = {
+    boxGeometry(this->vertices, this->indices);
+    this->setupMesh();
+}
+
+void boxGeometry(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    vertices = {
         { {-0.5f, -0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}, {0.0f,  0.0f}, { 1.0f, 0.0f, 0.0f}, {0.0f,  1.0f,  0.0f} }, //  0
         { { 0.5f,  0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}, {1.0f,  1.0f}, { 1.0f, 0.0f, 0.0f}, {0.0f,  1.0f,  0.0f} }, //  1
         { { 0.5f, -0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}, {1.0f,  0.0f}, { 1.0f, 0.0f, 0.0f}, {0.0f,  1.0f,  0.0f} }, //  2
@@ -33,7 +39,7 @@ Box::Box()
         { { 0.5f,  0.5f,  0.5f}, { 0.0f,  1.0f,  0.0f}, {1.0f,  0.0f}, { 1.0f, 0.0f, 0.0f}, {0.0f,  0.0f, -1.0f} }, // 22
         { {-0.5f,  0.5f,  0.5f}, { 0.0f,  1.0f,  0.0f}, {0.0f,  0.0f}, { 1.0f, 0.0f, 0.0f}, {0.0f,  0.0f, -1.0f} }, // 23
     };
-    this->indices = {
+    indices = {
          0,  1,  2,
          3,  1,  0,
          4,  5,  6,
@@ -47,5 +53,4 @@ Box::Box()
         20, 22, 21,
         20, 23, 22
     };
-    this->setupMesh();
 }
@@ -6,3 +6,7 @@ class Box : public Mesh {
 public:
     Box();
 };
+
+// The unit box's vertices and indices, without uploading them (for the
+// software renderer).
+void boxGeometry(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
@@ -128,6 +128,13 @@ void Camera::processMouseScroll(GLfloat yOff)
     }
 }
 
+void Camera::setOrientation(GLfloat yaw, GLfloat pitch)
+{
+    this->yaw   = yaw;
+    this->pitch = pitch;
+    this->updateCameraVectors();
+}
+
 void Camera::updateCameraVectors()
 {
     glm::vec3 front;
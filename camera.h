@@ -55,6 +55,8 @@ public:
     void processMouseMovement(GLfloat xOff, GLfloat yOff,
                               GLboolean constrainPitch=true);
     void processMouseScroll(GLfloat yOff);
+    // Set yaw and pitch directly (degrees), e.g. from a recorded path.
+    void setOrientation(GLfloat yaw, GLfloat pitch);
 
 private:
     void updateCameraVectors();
@@ -0,0 +1,211 @@
+#include "camerapath.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Camera Path Recorder
+// ====================
+
+CameraPathRecorder::CameraPathRecorder(const std::string& path)
+    : file(path.c_str(), std::ios::trunc)
+{
+    if (!this->file) {
+        std::cout << "ERROR::CAMERA_PATH::CANNOT_WRITE " << path << std::endl;
+        return;
+    }
+    this->file << "time,x,y,z,yaw,pitch,fov" << std::endl;
+    this->file << std::fixed << std::setprecision(6);
+}
+
+bool CameraPathRecorder::isOpen() const
+{
+    return this->file.is_open() && this->file.good();
+}
+
+void CameraPathRecorder::record(GLdouble time, const Camera& camera)
+{
+    if (!this->isOpen()) {
+        return;
+    }
+    this->file << time << ","
+               << camera.position.x << "," << camera.position.y << "," << camera.position.z << ","
+               << camera.yaw << "," << camera.pitch << "," << camera.fov << "\n";
+}
+
+// Camera Path Player
+// ==================
+
+bool CameraPathPlayer::load(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cout << "ERROR::CAMERA_PATH::FILE_NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    this->keyframes.clear();
+    std::string line;
+    std::getline(file, line);   // header
+    while (std::getline(file, line)) {
+        CameraKeyframe keyframe;
+        if (std::sscanf(line.c_str(), "%lf,%f,%f,%f,%f,%f,%f",
+                        &keyframe.time,
+                        &keyframe.position.x, &keyframe.position.y, &keyframe.position.z,
+                        &keyframe.yaw, &keyframe.pitch, &keyframe.fov) == 7) {
+            this->keyframes.push_back(keyframe);
+        }
+    }
+    if (this->keyframes.empty()) {
+        std::cout << "ERROR::CAMERA_PATH::EMPTY " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+GLdouble CameraPathPlayer::duration() const
+{
+    return this->keyframes.empty() ? 0.0 : this->keyframes.back().time;
+}
+
+bool CameraPathPlayer::apply(GLdouble time, Camera& camera) const
+{
+    if (this->keyframes.empty() || time > this->duration()) {
+        return false;
+    }
+    // First keyframe at or after `time`.
+    GLuint low = 0, high = this->keyframes.size() - 1;
+    while (low < high) {
+        GLuint mid = (low + high) / 2;
+        if (this->keyframes[mid].time < time) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    const CameraKeyframe& b = this->keyframes[low];
+    const CameraKeyframe& a = this->keyframes[low > 0 ? low - 1 : 0];
+    GLfloat t = (b.time > a.time) ? (GLfloat) ((time - a.time) / (b.time - a.time)) : 1.0f;
+
+    camera.position = glm::mix(a.position, b.position, t);
+    camera.fov = a.fov + (b.fov - a.fov) * t;
+    camera.setOrientation(a.yaw + (b.yaw - a.yaw) * t, a.pitch + (b.pitch - a.pitch) * t);
+    return true;
+}
+
+GLuint CameraPathPlayer::keyframeCount() const
+{
+    return this->keyframes.size();
+}
+
+GLdouble CameraPathPlayer::applyKeyframe(GLuint index, Camera& camera) const
+{
+    const CameraKeyframe& keyframe = this->keyframes[index];
+    camera.position = keyframe.position;
+    camera.fov = keyframe.fov;
+    camera.setOrientation(keyframe.yaw, keyframe.pitch);
+    return keyframe.time;
+}
+
+// Frame Timing Log
+// ================
+
+FrameTimingLog::FrameTimingLog()
+    : nextQuery(0)
+    , queriesCreated(false)
+    , queryActive(false)
+    , lastCpuTime(-1.0)
+{
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        this->queries[i] = 0;
+        this->queryRows[i] = -1;
+    }
+}
+
+void FrameTimingLog::beginFrame(GLuint frame, GLdouble pathTime, GLdouble cpuTime)
+{
+    if (!this->queriesCreated) {
+        glGenQueries(QUERIES_IN_FLIGHT, this->queries);
+        this->queriesCreated = true;
+    }
+    // The previous row's CPU time ends now.
+    if (!this->rows.empty() && this->lastCpuTime >= 0.0) {
+        this->rows.back().cpuMilliseconds = (cpuTime - this->lastCpuTime) * 1000.0;
+    }
+    this->lastCpuTime = cpuTime;
+
+    Row row = { frame, pathTime, 0.0, 0.0 };
+    this->rows.push_back(row);
+
+    GLuint query = this->nextQuery;
+    if (this->queryRows[query] >= 0) {
+        // Lapped the GPU by QUERIES_IN_FLIGHT frames; this wait is the only
+        // one, and only happens when the GPU is that far behind.
+        this->collect(query, true);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, this->queries[query]);
+    this->queryRows[query] = this->rows.size() - 1;
+    this->queryActive = true;
+}
+
+void FrameTimingLog::endFrame()
+{
+    if (!this->queryActive) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    this->queryActive = false;
+    this->nextQuery = (this->nextQuery + 1) % QUERIES_IN_FLIGHT;
+    // Harvest whatever has finished without blocking.
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        if (this->queryRows[i] >= 0) {
+            this->collect(i, false);
+        }
+    }
+}
+
+void FrameTimingLog::collect(GLuint query, bool wait)
+{
+    if (!wait) {
+        GLint available = 0;
+        glGetQueryObjectiv(this->queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return;
+        }
+    }
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(this->queries[query], GL_QUERY_RESULT, &elapsed);
+    this->rows[this->queryRows[query]].gpuMilliseconds = elapsed * 1.0e-6;
+    this->queryRows[query] = -1;
+}
+
+bool FrameTimingLog::write(const std::string& path, GLdouble cpuTime)
+{
+    if (this->queryActive) {
+        this->endFrame();
+    }
+    // No beginFrame follows the last frame, so its CPU time ends here.
+    if (!this->rows.empty() && this->lastCpuTime >= 0.0) {
+        this->rows.back().cpuMilliseconds = (cpuTime - this->lastCpuTime) * 1000.0;
+        this->lastCpuTime = -1.0;
+    }
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        if (this->queryRows[i] >= 0) {
+            this->collect(i, true);
+        }
+    }
+    std::ofstream file(path.c_str(), std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::CAMERA_PATH::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    file << "frame,time,cpu_ms,gpu_ms" << std::endl;
+    file << std::fixed << std::setprecision(4);
+    for (GLuint i = 0; i < this->rows.size(); i++) {
+        const Row& row = this->rows[i];
+        file << row.frame << "," << row.pathTime << ","
+             << row.cpuMilliseconds << "," << row.gpuMilliseconds << "\n";
+    }
+    return true;
+}
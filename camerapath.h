@@ -0,0 +1,97 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+// Camera Paths
+// ============
+// A camera path is a CSV file of timestamped camera states,
+//
+//   time,x,y,z,yaw,pitch,fov
+//   0.000000,0.000000,0.000000,6.000000,-90.000000,0.000000,45.000000
+//   ...
+//
+// written by CameraPathRecorder while flying around live, and played back
+// by CameraPathPlayer at a fixed timestep so that every run renders exactly
+// the same sequence of views. FrameTimingLog then writes one row of CPU/GPU
+// timings per replayed frame, so two builds can be diffed frame by frame.
+
+struct CameraKeyframe {
+    GLdouble time;
+    glm::vec3 position;
+    GLfloat yaw, pitch, fov;
+};
+
+class CameraPathRecorder
+{
+public:
+    CameraPathRecorder(const std::string& path);
+    bool isOpen() const;
+    // `time` in seconds since recording started.
+    void record(GLdouble time, const Camera& camera);
+private:
+    std::ofstream file;
+};
+
+class CameraPathPlayer
+{
+public:
+    // Returns false (and prints an error) if the file is missing or empty.
+    bool load(const std::string& path);
+    GLdouble duration() const;
+    // Put `camera` where the path is at `time`, interpolating linearly
+    // between keyframes. Returns false once `time` is past the end.
+    bool apply(GLdouble time, Camera& camera) const;
+    // The keyframes as a list of poses, one per frame (batch rendering).
+    GLuint keyframeCount() const;
+    // Put `camera` exactly at keyframe `index`; returns its time.
+    GLdouble applyKeyframe(GLuint index, Camera& camera) const;
+private:
+    std::vector<CameraKeyframe> keyframes;
+};
+
+// Frame Timings
+// -------------
+// CPU time is the wall time from one beginFrame to the next; GPU time is a
+// GL_TIME_ELAPSED query around the frame's commands, read back a few
+// frames later so the CPU never waits on it.
+class FrameTimingLog
+{
+public:
+    FrameTimingLog();
+    void beginFrame(GLuint frame, GLdouble pathTime, GLdouble cpuTime);
+    void endFrame();
+    // End the last frame at `cpuTime`, collect outstanding queries (waits)
+    // and write
+    //   frame,time,cpu_ms,gpu_ms
+    // Returns false if the file cannot be written.
+    bool write(const std::string& path, GLdouble cpuTime);
+private:
+    static const GLuint QUERIES_IN_FLIGHT = 4;
+
+    struct Row {
+        GLuint frame;
+        GLdouble pathTime;
+        GLdouble cpuMilliseconds;
+        GLdouble gpuMilliseconds;
+    };
+
+    std::vector<Row> rows;
+    GLuint queries[QUERIES_IN_FLIGHT];
+    GLint queryRows[QUERIES_IN_FLIGHT];     // row waiting on each query, or -1
+    GLuint nextQuery;
+    bool queriesCreated;
+    bool queryActive;
+    GLdouble lastCpuTime;
+
+    void collect(GLuint query, bool wait);
+};
+
+#endif // CAMERAPATH_H
@@ -0,0 +1,553 @@
+#include "conestep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include <SOIL.h>
+#include <glm/glm.hpp>
+
+#include "gpumemory.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define CONESTEP_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Texels per block of the row minimum-depth table: a block no higher than
+// the texel being processed cannot bound its cone and is skipped whole.
+static const GLuint BLOCK_SIZE = 16;
+
+struct ConeStepJob {
+    const GLfloat* depth;
+    const GLfloat* blockMin;
+    GLuint width, height;
+    GLuint blocksPerRow;
+    GLubyte* out;
+    bool simd;
+
+    void operator()(GLuint begin, GLuint end);
+    GLfloat coneRatio(GLuint x, GLuint y) const;
+    GLfloat scanRow(GLuint row, GLint x, GLint lo, GLint hi,
+                    GLfloat rowDistance2, GLfloat texelDepth, GLfloat best) const;
+    GLfloat scanSpan(const GLfloat* rowDepth, GLint texel, GLint count, GLfloat firstDx,
+                     GLfloat rowDistance2, GLfloat texelDepth, GLfloat best) const;
+};
+
+// Minimum squared cone ratio over texels [0, count) of `depth`, whose
+// horizontal UV offsets are (firstDx + i) * invWidth and rowDistance2
+// (squared). Only texels above `texelDepth` count.
+static GLfloat scanSegmentScalar(const GLfloat* depth, GLuint count, GLfloat firstDx, GLfloat invWidth,
+                                 GLfloat rowDistance2, GLfloat texelDepth, GLfloat best)
+{
+    for (GLuint i = 0; i < count; i++) {
+        GLfloat rise = texelDepth - depth[i];
+        if (rise <= 0.0f) {
+            continue;
+        }
+        GLfloat dx = (firstDx + i) * invWidth;
+        GLfloat ratio2 = (dx * dx + rowDistance2) / (rise * rise);
+        best = std::min(best, ratio2);
+    }
+    return best;
+}
+
+#ifdef CONESTEP_SSE
+static GLfloat scanSegmentSSE(const GLfloat* depth, GLuint count, GLfloat firstDx, GLfloat invWidth,
+                              GLfloat rowDistance2, GLfloat texelDepth, GLfloat best)
+{
+    // Compare distance^2 < best * rise^2 instead of dividing; the rare
+    // lanes that improve on `best` are then divided out in scalar.
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 texel = _mm_set1_ps(texelDepth);
+    const __m128 scale = _mm_set1_ps(invWidth);
+    const __m128 row = _mm_set1_ps(rowDistance2);
+    const __m128 four = _mm_set1_ps(4.0f);
+    __m128 dx = _mm_setr_ps(firstDx, firstDx + 1.0f, firstDx + 2.0f, firstDx + 3.0f);
+    __m128 bound = _mm_set1_ps(best);
+
+    GLuint i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 rise = _mm_sub_ps(texel, _mm_loadu_ps(depth + i));
+        __m128 offset = _mm_mul_ps(dx, scale);
+        __m128 distance2 = _mm_add_ps(_mm_mul_ps(offset, offset), row);
+        __m128 better = _mm_and_ps(_mm_cmpgt_ps(rise, zero),
+                                   _mm_cmplt_ps(distance2, _mm_mul_ps(bound, _mm_mul_ps(rise, rise))));
+        GLint lanes = _mm_movemask_ps(better);
+        if (lanes) {
+            GLfloat rises[4], distances2[4];
+            _mm_storeu_ps(rises, rise);
+            _mm_storeu_ps(distances2, distance2);
+            for (GLuint lane = 0; lane < 4; lane++) {
+                if (lanes & (1 << lane)) {
+                    best = std::min(best, distances2[lane] / (rises[lane] * rises[lane]));
+                }
+            }
+            bound = _mm_set1_ps(best);
+        }
+        dx = _mm_add_ps(dx, four);
+    }
+
+    return scanSegmentScalar(depth + i, count - i, firstDx + i, invWidth, rowDistance2, texelDepth, best);
+}
+#endif
+
+GLfloat ConeStepJob::scanSpan(const GLfloat* rowDepth, GLint texel, GLint count, GLfloat firstDx,
+                              GLfloat rowDistance2, GLfloat texelDepth, GLfloat best) const
+{
+    GLfloat invWidth = 1.0f / this->width;
+#ifdef CONESTEP_SSE
+    if (this->simd) {
+        return scanSegmentSSE(rowDepth + texel, count, firstDx, invWidth, rowDistance2, texelDepth, best);
+    }
+#endif
+    return scanSegmentScalar(rowDepth + texel, count, firstDx, invWidth, rowDistance2, texelDepth, best);
+}
+
+GLfloat ConeStepJob::scanRow(GLuint row, GLint x, GLint lo, GLint hi,
+                             GLfloat rowDistance2, GLfloat texelDepth, GLfloat best) const
+{
+    // [x + lo, x + hi] in unwrapped coordinates, cut where it wraps into
+    // pieces of the real row; within a piece, runs of blocks that may hold
+    // a higher texel are scanned in one go.
+    const GLfloat* rowDepth = this->depth + row * this->width;
+    const GLfloat* rowBlocks = this->blockMin + row * this->blocksPerRow;
+    GLint w = this->width;
+    GLint block = BLOCK_SIZE;
+    GLint start = x + lo;
+    while (start <= x + hi) {
+        GLint first = ((start % w) + w) % w;
+        GLint last = std::min(first + (x + hi - start), w - 1);
+        GLint runStart = -1;
+        for (GLint b = first / block; b <= last / block; b++) {
+            GLint blockFirst = std::max(b * block, first);
+            if (rowBlocks[b] < texelDepth) {
+                if (runStart < 0) {
+                    runStart = blockFirst;
+                }
+                continue;
+            }
+            if (runStart >= 0) {
+                best = this->scanSpan(rowDepth, runStart, blockFirst - runStart,
+                                      (GLfloat) (start + runStart - first - x), rowDistance2, texelDepth, best);
+                runStart = -1;
+            }
+        }
+        if (runStart >= 0) {
+            best = this->scanSpan(rowDepth, runStart, last + 1 - runStart,
+                                  (GLfloat) (start + runStart - first - x), rowDistance2, texelDepth, best);
+        }
+        start += last - first + 1;
+    }
+    return best;
+}
+
+GLfloat ConeStepJob::coneRatio(GLuint x, GLuint y) const
+{
+    GLfloat texelDepth = this->depth[y * this->width + x];
+    if (texelDepth <= 0.0f) {
+        return 1.0f;
+    }
+    // Rows outward from the texel's own: a texel at horizontal distance d
+    // can at best give d / texelDepth, so the search radius shrinks as
+    // better cones are found and stops at the first row beyond it.
+    GLfloat invHeight = 1.0f / this->height;
+    GLfloat best = 1.0f;
+    for (GLuint dy = 0; dy <= this->height / 2; dy++) {
+        GLfloat rowDistance2 = (dy * invHeight) * (dy * invHeight);
+        GLfloat reach2 = best * texelDepth * texelDepth;
+        if (rowDistance2 >= reach2) {
+            break;
+        }
+        GLint dxMax = (GLint) (std::sqrt(reach2 - rowDistance2) * this->width);
+        GLint lo = -dxMax;
+        GLint hi = dxMax;
+        if (hi - lo + 1 >= (GLint) this->width) {
+            lo = -(GLint) (this->width / 2);
+            hi = lo + this->width - 1;
+        }
+        best = this->scanRow((y + dy) % this->height, x, lo, hi, rowDistance2, texelDepth, best);
+        if (dy != 0 && 2 * dy != this->height) {
+            best = this->scanRow((y + this->height - dy) % this->height, x, lo, hi, rowDistance2, texelDepth, best);
+        }
+    }
+    return std::sqrt(best);
+}
+
+void ConeStepJob::operator()(GLuint begin, GLuint end)
+{
+    for (GLuint y = begin; y < end; y++) {
+        for (GLuint x = 0; x < this->width; x++) {
+            GLuint i = y * this->width + x;
+            this->out[i * 2 + 0] = (GLubyte) (this->depth[i] * 255.0f + 0.5f);
+            this->out[i * 2 + 1] = (GLubyte) (std::sqrt(this->coneRatio(x, y)) * 255.0f);
+        }
+    }
+}
+
+void computeConeStepMap(const GLubyte* depth, GLuint width, GLuint height, GLuint channels,
+                        JobSystem& jobs, ConeStepMap& out, bool simd)
+{
+    GLuint blocksPerRow = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<GLfloat> depths(width * height);
+    std::vector<GLfloat> blockMin(blocksPerRow * height, 1.0f);
+    for (GLuint y = 0; y < height; y++) {
+        for (GLuint x = 0; x < width; x++) {
+            GLfloat value = depth[(y * width + x) * channels] / 255.0f;
+            depths[y * width + x] = value;
+            GLfloat& minimum = blockMin[y * blocksPerRow + x / BLOCK_SIZE];
+            minimum = std::min(minimum, value);
+        }
+    }
+
+    out.width = width;
+    out.height = height;
+    out.texels.resize(width * height * 2);
+    ConeStepJob job;
+    job.depth = &depths[0];
+    job.blockMin = &blockMin[0];
+    job.width = width;
+    job.height = height;
+    job.blocksPerRow = blocksPerRow;
+    job.out = &out.texels[0];
+    job.simd = simd;
+    jobs.parallelFor(height, 4, job);
+}
+
+// Cache
+// -----
+// <depth map>.cone: "CONE", width, height (GLuint), then the RG8 texels.
+// Rebuilt whenever the depth map is newer than the cache.
+
+static const char CACHE_MAGIC[4] = { 'C', 'O', 'N', 'E' };
+
+// False for a cache that isn't whole: a bad magic, a zero size, a size
+// other than the height map's (`width` x `height`, 0 x 0 when only the
+// cache is there), or fewer or more texels than its size says.
+static bool readConeStepCache(const std::string& path, GLuint width, GLuint height, ConeStepMap& out)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[4];
+    GLuint cacheWidth, cacheHeight;
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, CACHE_MAGIC, 4) == 0
+           && fread(&cacheWidth, sizeof(GLuint), 1, file) == 1
+           && fread(&cacheHeight, sizeof(GLuint), 1, file) == 1
+           && cacheWidth > 0 && cacheHeight > 0
+           && (width == 0 || (cacheWidth == width && cacheHeight == height));
+    if (ok) {
+        long start = ftell(file);
+        fseek(file, 0, SEEK_END);
+        long end = ftell(file);
+        fseek(file, start, SEEK_SET);
+        GLuint64 bytes = (GLuint64) cacheWidth * cacheHeight * 2;
+        ok = start >= 0 && end >= start && (GLuint64) (end - start) == bytes;
+        if (ok) {
+            out.width = cacheWidth;
+            out.height = cacheHeight;
+            out.texels.resize(bytes);
+            ok = fread(&out.texels[0], 1, bytes, file) == bytes;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+static void writeConeStepCache(const std::string& path, const ConeStepMap& map)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "ERROR::CONE_STEP::CACHE_NOT_WRITTEN " << path << std::endl;
+        return;
+    }
+    fwrite(CACHE_MAGIC, 1, 4, file);
+    fwrite(&map.width, sizeof(GLuint), 1, file);
+    fwrite(&map.height, sizeof(GLuint), 1, file);
+    fwrite(&map.texels[0], 1, map.texels.size(), file);
+    fclose(file);
+}
+
+bool loadConeStepMap(const std::string& depthMapPath, JobSystem& jobs, ConeStepMap& out)
+{
+    std::string cachePath = depthMapPath + ".cone";
+    struct stat imageStat, cacheStat;
+    bool cacheFresh = stat(cachePath.c_str(), &cacheStat) == 0
+                   && (stat(depthMapPath.c_str(), &imageStat) != 0 || cacheStat.st_mtime >= imageStat.st_mtime);
+    // The height map is decoded either way, to check the cache's size
+    // against; that is a small part of what computing the map costs.
+    int width = 0, height = 0;
+    unsigned char* image = SOIL_load_image(depthMapPath.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+    if (cacheFresh && readConeStepCache(cachePath, image ? width : 0, image ? height : 0, out)) {
+        if (image) {
+            SOIL_free_image_data(image);
+        }
+        return true;
+    }
+    if (!image) {
+        std::cout << "ERROR::CONE_STEP::DEPTH_MAP_NOT_LOADED " << depthMapPath << std::endl;
+        return false;
+    }
+    if (cacheFresh) {
+        std::cout << "ERROR::CONE_STEP::CACHE_INVALID " << cachePath << std::endl;
+    }
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    computeConeStepMap(image, width, height, 3, jobs, out);
+    GLdouble time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    SOIL_free_image_data(image);
+    std::cout << "CONE_STEP:: built " << depthMapPath << " (" << width << "x" << height
+              << ") in " << time << " ms" << std::endl;
+    writeConeStepCache(cachePath, out);
+    return true;
+}
+
+GLuint createConeStepTexture(const ConeStepMap& map)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, map.width, map.height, 0, GL_RG, GL_UNSIGNED_BYTE, &map.texels[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    trackTexture(texture, GPU_MEMORY_MATERIAL, "cone step map", map.width, map.height, GL_RG8);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+// Benchmark
+// ---------
+
+// Bricks with bevelled edges, mortar at full depth and a little noise on
+// the faces: flat regions, walls and small bumps, like bricks2_disp.
+static void makeBrickDepthMap(GLuint size, std::vector<GLubyte>& texels)
+{
+    GLuint brickWidth = size / 4;
+    GLuint brickHeight = size / 8;
+    GLuint mortar = std::max(size / 128, 1u);
+    GLuint bevel = std::max(size / 64, 1u);
+    texels.resize(size * size);
+    srand(36);
+    for (GLuint y = 0; y < size; y++) {
+        GLuint row = y / brickHeight;
+        GLuint by = y % brickHeight;
+        for (GLuint x = 0; x < size; x++) {
+            GLuint bx = (x + (row % 2) * brickWidth / 2) % brickWidth;
+            GLuint edge = std::min(std::min(bx, brickWidth - 1 - bx), std::min(by, brickHeight - 1 - by));
+            GLfloat depth;
+            if (edge < mortar) {
+                depth = 1.0f;
+            }
+            else if (edge < mortar + bevel) {
+                depth = 0.2f + 0.6f * (mortar + bevel - edge) / (GLfloat) bevel;
+            }
+            else {
+                depth = 0.1f + 0.1f * (rand() % 100) / 100.0f;
+            }
+            texels[y * size + x] = (GLubyte) (std::min(depth, 1.0f) * 255.0f);
+        }
+    }
+}
+
+// Bilinear, repeating lookups matching the GL samplers.
+static GLfloat sampleChannel(const GLubyte* texels, GLuint width, GLuint height, GLuint channels,
+                             GLuint channel, GLfloat u, GLfloat v)
+{
+    GLfloat x = u * width - 0.5f;
+    GLfloat y = v * height - 0.5f;
+    GLfloat fx = std::floor(x);
+    GLfloat fy = std::floor(y);
+    GLfloat tx = x - fx;
+    GLfloat ty = y - fy;
+    GLint x0 = (((GLint) fx % (GLint) width) + width) % width;
+    GLint y0 = (((GLint) fy % (GLint) height) + height) % height;
+    GLint x1 = (x0 + 1) % width;
+    GLint y1 = (y0 + 1) % height;
+    GLfloat a = texels[(y0 * width + x0) * channels + channel];
+    GLfloat b = texels[(y0 * width + x1) * channels + channel];
+    GLfloat c = texels[(y1 * width + x0) * channels + channel];
+    GLfloat d = texels[(y1 * width + x1) * channels + channel];
+    return ((a * (1.0f - tx) + b * tx) * (1.0f - ty) + (c * (1.0f - tx) + d * tx) * ty) / 255.0f;
+}
+
+// deferred-geom.frag's linear march: uv moves by -p per unit of depth.
+static void marchLinear(const ConeStepMap& map, GLfloat u, GLfloat v, GLfloat px, GLfloat py,
+                        GLuint layers, GLfloat& outU, GLfloat& outV, GLuint& fetches)
+{
+    const GLubyte* texels = &map.texels[0];
+    GLfloat layerDepth = 1.0f / layers;
+    GLfloat layer = 0.0f;
+    GLfloat depth = sampleChannel(texels, map.width, map.height, 2, 0, u, v);
+    fetches = 1;
+    while (layer < depth) {
+        layer += layerDepth;
+        u -= px / layers;
+        v -= py / layers;
+        depth = sampleChannel(texels, map.width, map.height, 2, 0, u, v);
+        fetches++;
+    }
+    GLfloat previousU = u + px / layers;
+    GLfloat previousV = v + py / layers;
+    GLfloat previousDepth = sampleChannel(texels, map.width, map.height, 2, 0, previousU, previousV);
+    fetches++;
+    GLfloat after = depth - layer;
+    GLfloat before = previousDepth - (layer - layerDepth);
+    GLfloat weight = after - before != 0.0f ? after / (after - before) : 0.0f;
+    outU = previousU * weight + u * (1.0f - weight);
+    outV = previousV * weight + v * (1.0f - weight);
+}
+
+// deferred-geom.frag's CONE_STEP_MAPPING march: cone steps (at least
+// minStep deep, so thin cones along walls still make progress) until the
+// ray is at or below the surface, then a binary search back to it.
+static void marchConeStep(const ConeStepMap& map, GLfloat u, GLfloat v, GLfloat px, GLfloat py,
+                          GLuint steps, GLfloat minStep, GLuint refinements,
+                          GLfloat& outU, GLfloat& outV, GLuint& fetches)
+{
+    const GLubyte* texels = &map.texels[0];
+    GLfloat rayRatio = std::sqrt(px * px + py * py);
+    GLfloat z = 0.0f;
+    GLfloat previousZ = 0.0f;
+    bool below = false;
+    fetches = 0;
+    for (GLuint i = 0; i < steps; i++) {
+        GLfloat depth = sampleChannel(texels, map.width, map.height, 2, 0, u - px * z, v - py * z);
+        GLfloat cone = sampleChannel(texels, map.width, map.height, 2, 1, u - px * z, v - py * z);
+        fetches++;
+        if (depth <= z) {
+            below = true;
+            break;
+        }
+        cone *= cone;
+        previousZ = z;
+        z += std::max(cone * (depth - z) / (rayRatio + cone), minStep);
+    }
+    if (below) {
+        for (GLuint i = 0; i < refinements; i++) {
+            GLfloat middle = 0.5f * (previousZ + z);
+            GLfloat depth = sampleChannel(texels, map.width, map.height, 2, 0, u - px * middle, v - py * middle);
+            fetches++;
+            if (depth <= middle) {
+                z = middle;
+            }
+            else {
+                previousZ = middle;
+            }
+        }
+    }
+    outU = u - px * z;
+    outV = v - py * z;
+}
+
+void benchmarkConeStepMaps(GLuint size)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const GLuint THREAD_COUNTS[] = { 1, 2, 4, 8, 16 };
+    const GLuint RAYS = 20000;
+    const GLuint REFERENCE_LAYERS = 1024;
+    // Steps, minimum step, refinements.
+    const GLfloat CONE_VARIANTS[][3] = {
+        {  8.0f, 1.0f / 16.0f, 4.0f },
+        { 12.0f, 1.0f / 32.0f, 4.0f },
+        { 16.0f, 1.0f / 64.0f, 4.0f },    // deferred-geom.frag defaults
+        { 24.0f, 1.0f / 64.0f, 5.0f },
+    };
+
+    std::vector<GLubyte> depth;
+    makeBrickDepthMap(size, depth);
+    std::cout << "BENCHMARK::CONE_STEP preprocess " << size << "x" << size << std::endl;
+    ConeStepMap map;
+    GLdouble scalarTime = 0.0;
+    {
+        JobSystem jobs(1);
+        Clock::time_point start = Clock::now();
+        computeConeStepMap(&depth[0], size, size, 1, jobs, map, false);
+        scalarTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::cout << "    scalar, 1 thread: " << scalarTime << " ms" << std::endl;
+    }
+    for (GLuint t = 0; t < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); t++) {
+        JobSystem jobs(THREAD_COUNTS[t]);
+        ConeStepMap simdMap;
+        Clock::time_point start = Clock::now();
+        computeConeStepMap(&depth[0], size, size, 1, jobs, simdMap, true);
+        GLdouble time = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::cout << "    SSE, " << THREAD_COUNTS[t] << " threads: " << time << " ms ("
+                  << scalarTime / time << "x)" << (simdMap.texels == map.texels ? "" : " MISMATCH") << std::endl;
+    }
+
+    // Validation: UV error against a 1024-layer linear march, in texels.
+    std::vector<GLfloat> rays(RAYS * 4);
+    srand(360);
+    for (GLuint i = 0; i < RAYS; i++) {
+        // View direction in tangent space, 0-80 degrees off the normal, at
+        // 1-6 units from the camera (the shader's ray is not normalized).
+        GLfloat angle = glm::radians(80.0f) * (rand() % 1000) / 1000.0f;
+        GLfloat azimuth = glm::radians(360.0f) * (rand() % 1000) / 1000.0f;
+        GLfloat distance = 1.0f + 5.0f * (rand() % 1000) / 1000.0f;
+        rays[i * 4 + 0] = (rand() % 1000) / 1000.0f;
+        rays[i * 4 + 1] = (rand() % 1000) / 1000.0f;
+        rays[i * 4 + 2] = std::sin(angle) * std::cos(azimuth) * distance * PARALLAX_HEIGHT_SCALE;
+        rays[i * 4 + 3] = std::sin(angle) * std::sin(azimuth) * distance * PARALLAX_HEIGHT_SCALE;
+    }
+    std::vector<GLfloat> reference(RAYS * 2);
+    for (GLuint i = 0; i < RAYS; i++) {
+        GLuint fetches;
+        marchLinear(map, rays[i * 4], rays[i * 4 + 1], rays[i * 4 + 2], rays[i * 4 + 3],
+                    REFERENCE_LAYERS, reference[i * 2], reference[i * 2 + 1], fetches);
+    }
+
+    std::cout << "BENCHMARK::CONE_STEP validation, " << RAYS << " rays vs "
+              << REFERENCE_LAYERS << "-layer march (error in texels)" << std::endl;
+    for (GLint variant = -1; variant < (GLint) (sizeof(CONE_VARIANTS) / sizeof(CONE_VARIANTS[0])); variant++) {
+        std::vector<GLfloat> errors(RAYS);
+        GLuint totalFetches = 0;
+        GLuint maxFetches = 0;
+        for (GLuint i = 0; i < RAYS; i++) {
+            GLfloat u, v;
+            if (variant < 0) {
+                GLuint fetches;
+                marchLinear(map, rays[i * 4], rays[i * 4 + 1], rays[i * 4 + 2], rays[i * 4 + 3], 30, u, v, fetches);
+                totalFetches += fetches;
+                maxFetches = std::max(maxFetches, fetches);
+            }
+            else {
+                const GLfloat* cone = CONE_VARIANTS[variant];
+                GLuint fetches;
+                marchConeStep(map, rays[i * 4], rays[i * 4 + 1], rays[i * 4 + 2], rays[i * 4 + 3],
+                              (GLuint) cone[0], cone[1], (GLuint) cone[2], u, v, fetches);
+                totalFetches += fetches;
+                maxFetches = std::max(maxFetches, fetches);
+            }
+            GLfloat du = (u - reference[i * 2]) * size;
+            GLfloat dv = (v - reference[i * 2 + 1]) * size;
+            errors[i] = std::sqrt(du * du + dv * dv);
+        }
+        GLfloat mean = 0.0f;
+        GLuint withinTexel = 0;
+        for (GLuint i = 0; i < RAYS; i++) {
+            mean += errors[i] / RAYS;
+            withinTexel += errors[i] <= 1.0f;
+        }
+        std::nth_element(errors.begin(), errors.begin() + RAYS * 95 / 100, errors.end());
+        if (variant < 0) {
+            std::cout << "    linear, 30 layers: ";
+        }
+        else {
+            std::cout << "    cone step, " << CONE_VARIANTS[variant][0] << " steps >= 1/"
+                      << 1.0f / CONE_VARIANTS[variant][1] << " + " << CONE_VARIANTS[variant][2] << " refinements: ";
+        }
+        std::cout << (GLfloat) totalFetches / RAYS << " fetches (max " << maxFetches << "), mean " << mean
+                  << ", p95 " << errors[RAYS * 95 / 100] << ", "
+                  << 100.0f * withinTexel / RAYS << "% within 1 texel" << std::endl;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef CONESTEP_H
+#define CONESTEP_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "jobs.h"
+
+// Cone Step Maps
+// ==============
+// Preprocesses a depth map (0 = top surface, 1 = deepest, as sampled by the
+// parallax shaders) into a cone step map: for every texel, the widest
+// upward-opening cone with its apex on the surface that contains no part of
+// the height field. A ray marching through the map can then advance, from
+// any point above the surface, straight to where it leaves that cone ---
+// large steps over flat areas, small ones near walls --- and converge in a
+// handful of fetches instead of a fixed 30 linear layers.
+//
+// Cone ratios are horizontal distance (in UV) over depth, clamped to 1, and
+// stored as sqrt(ratio) for precision near 0, rounded down so the cones
+// stay conservative. The map tiles (distances wrap around the edges), like
+// the GL_REPEAT textures it is made for.
+//
+// Texels: RG8, R = depth, G = sqrt(cone ratio).
+//
+// The parallax shaders' ray moves viewDir.xy * PARALLAX_HEIGHT_SCALE in UV
+// per unit of depth; deferred-geom.frag gets it as HEIGHT_SCALE, and the
+// benchmark's rays use it too, so neither drifts from the other.
+static const GLfloat PARALLAX_HEIGHT_SCALE = 0.1f;
+
+struct ConeStepMap {
+    GLuint width;
+    GLuint height;
+    std::vector<GLubyte> texels;
+};
+
+// Build from `channels`-interleaved 8-bit texels, using channel 0 as the
+// depth. Rows run in parallel on `jobs`; `simd` selects the SSE kernel
+// where available (scalar otherwise).
+void computeConeStepMap(const GLubyte* depth, GLuint width, GLuint height, GLuint channels,
+                        JobSystem& jobs, ConeStepMap& out, bool simd = true);
+
+// Load `depthMapPath`'s cone step map from its cache file next to it
+// (<path>.cone), or compute it from the image and write the cache.
+bool loadConeStepMap(const std::string& depthMapPath, JobSystem& jobs, ConeStepMap& out);
+
+// Upload as a repeating, linearly filtered GL_RG8 texture. No mipmaps:
+// averaged cones are no longer conservative.
+GLuint createConeStepTexture(const ConeStepMap& map);
+
+// Time the preprocessor on large synthetic maps (scalar vs SSE, 1-16
+// threads), then check on CPU that the cone-step march lands where a fine
+// linear march does, against the shaders' current 30-layer march.
+void benchmarkConeStepMaps(GLuint size);
+
+#endif // CONESTEP_H
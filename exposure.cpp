@@ -0,0 +1,195 @@
+#include "exposure.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "gpumemory.h"
+
+// Keeps log() finite on black pixels; matches exposure-luminance.frag.
+static const GLfloat LUMINANCE_EPSILON = 1.0e-4f;
+
+static void createAdaptedTexture(GLuint& texture, GLuint& framebuffer)
+{
+    GLfloat one = 1.0f;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &one);
+    trackTexture(texture, GPU_MEMORY_POST, "adapted luminance", 1, 1, GL_R32F);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::EXPOSURE::FRAMEBUFFER_INCOMPLETE adapted" << std::endl;
+    }
+}
+
+AutoExposure::AutoExposure()
+    : keyValue(0.18f)
+    , adaptationRate(1.5f)
+    , minExposure(0.05f)
+    , maxExposure(8.0f)
+    , current(0)
+    , resetPending(true)
+    , luminanceShader("../learn-opengl/shaders/screen.vert",
+                      "../learn-opengl/shaders/exposure-luminance.frag",
+                      ShaderDefines(), true)
+    , adaptShader("../learn-opengl/shaders/screen.vert",
+                  "../learn-opengl/shaders/exposure-adapt.frag",
+                  ShaderDefines(), true)
+{
+    GLuint levels = 1;
+    while ((REDUCTION_SIZE >> (levels - 1)) > 1) {
+        levels++;
+    }
+    this->reductionLevels = levels;
+    glGenTextures(1, &this->logLuminance);
+    glBindTexture(GL_TEXTURE_2D, this->logLuminance);
+    for (GLuint level = 0; level < levels; level++) {
+        GLuint size = REDUCTION_SIZE >> level;
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R16F, size, size, 0, GL_RED, GL_FLOAT, NULL);
+    }
+    trackTexture(this->logLuminance, GPU_MEMORY_POST, "log luminance", REDUCTION_SIZE, REDUCTION_SIZE, GL_R16F, levels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    glGenFramebuffers(1, &this->logLuminanceFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->logLuminanceFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->logLuminance, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::EXPOSURE::FRAMEBUFFER_INCOMPLETE log luminance" << std::endl;
+    }
+
+    createAdaptedTexture(this->adapted[0], this->adaptedFramebuffers[0]);
+    createAdaptedTexture(this->adapted[1], this->adaptedFramebuffers[1]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+AutoExposure::~AutoExposure()
+{
+    glDeleteFramebuffers(2, this->adaptedFramebuffers);
+    untrackTexture(this->adapted[0]);
+    untrackTexture(this->adapted[1]);
+    glDeleteTextures(2, this->adapted);
+    glDeleteFramebuffers(1, &this->logLuminanceFramebuffer);
+    untrackTexture(this->logLuminance);
+    glDeleteTextures(1, &this->logLuminance);
+}
+
+void AutoExposure::update(GLuint sceneTexture, GLuint screenVAO, GLfloat deltaTime)
+{
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(screenVAO);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Log Luminance
+    // -------------
+    glBindFramebuffer(GL_FRAMEBUFFER, this->logLuminanceFramebuffer);
+    glViewport(0, 0, REDUCTION_SIZE, REDUCTION_SIZE);
+    this->luminanceShader.Use();
+    glUniform1i(glGetUniformLocation(this->luminanceShader.Program, "scene"), 0);
+    glBindTexture(GL_TEXTURE_2D, sceneTexture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Reduction
+    // ---------
+    glBindTexture(GL_TEXTURE_2D, this->logLuminance);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Adaptation
+    // ----------
+    GLuint previous = this->current;
+    this->current = 1 - this->current;
+    glBindFramebuffer(GL_FRAMEBUFFER, this->adaptedFramebuffers[this->current]);
+    glViewport(0, 0, 1, 1);
+    this->adaptShader.Use();
+    glUniform1i(glGetUniformLocation(this->adaptShader.Program, "logLuminance"), 0);
+    glUniform1i(glGetUniformLocation(this->adaptShader.Program, "previousLuminance"), 1);
+    glUniform1f(glGetUniformLocation(this->adaptShader.Program, "lastLevel"), this->reductionLevels - 1.0f);
+    glUniform1f(glGetUniformLocation(this->adaptShader.Program, "adaptation"),
+                this->resetPending ? 1.0f : 1.0f - std::exp(-deltaTime * this->adaptationRate));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, this->adapted[previous]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    this->resetPending = false;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint AutoExposure::luminanceTexture() const
+{
+    return this->adapted[this->current];
+}
+
+void AutoExposure::reset()
+{
+    this->resetPending = true;
+}
+
+// CPU Reference
+// -------------
+
+GLfloat luminance(GLfloat r, GLfloat g, GLfloat b)
+{
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+GLfloat referenceLogAverageLuminance(const GLfloat* rgb, GLuint width, GLuint height)
+{
+    const GLuint size = AutoExposure::REDUCTION_SIZE;
+    std::vector<GLfloat> level(size * size);
+    for (GLuint y = 0; y < size; y++) {
+        for (GLuint x = 0; x < size; x++) {
+            // Bilinear, clamp to edge, at the centre of reduction texel (x, y).
+            GLfloat sx = (x + 0.5f) / size * width - 0.5f;
+            GLfloat sy = (y + 0.5f) / size * height - 0.5f;
+            sx = std::min(std::max(sx, 0.0f), width - 1.0f);
+            sy = std::min(std::max(sy, 0.0f), height - 1.0f);
+            GLuint x0 = (GLuint) sx;
+            GLuint y0 = (GLuint) sy;
+            GLuint x1 = std::min(x0 + 1, width - 1);
+            GLuint y1 = std::min(y0 + 1, height - 1);
+            GLfloat tx = sx - x0;
+            GLfloat ty = sy - y0;
+            GLfloat color[3];
+            for (GLuint c = 0; c < 3; c++) {
+                GLfloat a = rgb[(y0 * width + x0) * 3 + c];
+                GLfloat b = rgb[(y0 * width + x1) * 3 + c];
+                GLfloat d = rgb[(y1 * width + x0) * 3 + c];
+                GLfloat e = rgb[(y1 * width + x1) * 3 + c];
+                color[c] = (a * (1.0f - tx) + b * tx) * (1.0f - ty) + (d * (1.0f - tx) + e * tx) * ty;
+            }
+            level[y * size + x] = std::log(LUMINANCE_EPSILON + luminance(color[0], color[1], color[2]));
+        }
+    }
+    for (GLuint levelSize = size / 2; levelSize >= 1; levelSize /= 2) {
+        GLuint parentSize = levelSize * 2;
+        for (GLuint y = 0; y < levelSize; y++) {
+            for (GLuint x = 0; x < levelSize; x++) {
+                level[y * levelSize + x] = 0.25f * (level[(2 * y) * parentSize + 2 * x]
+                                                  + level[(2 * y) * parentSize + 2 * x + 1]
+                                                  + level[(2 * y + 1) * parentSize + 2 * x]
+                                                  + level[(2 * y + 1) * parentSize + 2 * x + 1]);
+            }
+        }
+    }
+    return std::exp(level[0]);
+}
+
+GLfloat referenceAdaptLuminance(GLfloat adapted, GLfloat target, GLfloat deltaTime, GLfloat adaptationRate)
+{
+    return adapted + (target - adapted) * (1.0f - std::exp(-deltaTime * adaptationRate));
+}
+
+GLfloat referenceExposure(GLfloat adapted, GLfloat keyValue, GLfloat minExposure, GLfloat maxExposure)
+{
+    return std::min(std::max(keyValue / adapted, minExposure), maxExposure);
+}
@@ -0,0 +1,80 @@
+#ifndef EXPOSURE_H
+#define EXPOSURE_H
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+// Automatic Exposure
+// ==================
+// Meters the HDR scene entirely on the GPU:
+//
+//   1. The scene's log luminance, log(LUMINANCE_EPSILON + L), is drawn into
+//      a REDUCTION_SIZE^2 R16F texture (bilinear taps of the scene).
+//   2. glGenerateMipmap reduces it; the 1 x 1 level is the mean log
+//      luminance, i.e. the log of the scene's log-average luminance.
+//   3. A 1 x 1 pass moves the adapted luminance towards that target with
+//      an exponential falloff, frame-rate independent:
+//        adapted += (target - adapted) * (1 - exp(-dt * adaptationRate))
+//      ping-ponging between two 1 x 1 R32F textures.
+//
+// The composite pass samples the adapted luminance and exposes with
+// keyValue / adapted, so nothing is ever read back to the CPU.
+class AutoExposure
+{
+public:
+    static const GLuint REDUCTION_SIZE = 256;
+
+    AutoExposure();
+    ~AutoExposure();
+
+    // Meter `sceneTexture` and adapt over `deltaTime` seconds; drawing with
+    // `screenVAO` (a full-screen quad, as for screen.vert). Leaves
+    // framebuffer 0 bound; the caller restores its viewport.
+    void update(GLuint sceneTexture, GLuint screenVAO, GLfloat deltaTime);
+    // The adapted luminance (1 x 1 R32F) for the composite pass.
+    GLuint luminanceTexture() const;
+    // Jump straight to the metered value on the next update (first frame,
+    // camera cuts).
+    void reset();
+
+    // Middle grey the adapted luminance is mapped to.
+    GLfloat keyValue;
+    // Per second; higher adapts faster.
+    GLfloat adaptationRate;
+    // Exposure range, as multipliers.
+    GLfloat minExposure, maxExposure;
+
+private:
+    GLuint logLuminance;
+    GLuint reductionLevels;
+    GLuint logLuminanceFramebuffer;
+    GLuint adapted[2];
+    GLuint adaptedFramebuffers[2];
+    GLuint current;
+    bool resetPending;
+    Shader luminanceShader;
+    Shader adaptShader;
+
+    AutoExposure(const AutoExposure&);
+    AutoExposure& operator=(const AutoExposure&);
+};
+
+// CPU Reference
+// =============
+// The same metering on CPU data, for checking the GPU path headlessly;
+// learn-opengl-bench checks it against known values first thing
+// (bench/bench_exposure.cpp).
+
+// Rec. 709 luminance, as in the shaders.
+GLfloat luminance(GLfloat r, GLfloat g, GLfloat b);
+// Log-average luminance of `width` x `height` RGB floats, computed as the
+// GPU does: bilinear taps at the centres of a REDUCTION_SIZE^2 grid, log,
+// then 2 x 2 box reductions down to one value.
+GLfloat referenceLogAverageLuminance(const GLfloat* rgb, GLuint width, GLuint height);
+// One adaptation step, as exposure-adapt.frag.
+GLfloat referenceAdaptLuminance(GLfloat adapted, GLfloat target, GLfloat deltaTime, GLfloat adaptationRate);
+// Exposure multiplier for an adapted luminance, as composite.frag.
+GLfloat referenceExposure(GLfloat adapted, GLfloat keyValue, GLfloat minExposure, GLfloat maxExposure);
+
+#endif // EXPOSURE_H
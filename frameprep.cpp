@@ -0,0 +1,251 @@
+#include "frameprep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+FramePrep::FramePrep(JobSystem* jobs, TransformHierarchy* transforms)
+    : jobs(jobs), transforms(transforms),
+      firstObject(0), objectCount(0), firstLight(0), lightCount(0),
+      normalMode(NORMAL_MATRIX_GENERAL), merged(true)
+{
+    this->instanceOut.modelView = NULL;
+    this->instanceOut.modelViewProjection = NULL;
+    this->instanceOut.normal = NULL;
+}
+
+void FramePrep::setObjects(GLuint first, GLuint count)
+{
+    this->firstObject = first;
+    this->objectCount = count;
+}
+
+void FramePrep::setLights(GLuint first, GLuint count)
+{
+    this->firstLight = first;
+    this->lightCount = count;
+}
+
+void FramePrep::begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+    this->viewMatrix = viewMatrix;
+    this->projectionMatrix = projectionMatrix;
+    this->viewProjectionMatrix = projectionMatrix * viewMatrix;
+    this->merged = false;
+
+    this->jobs->run(&FramePrep::collectJob, this, 0, 0, &this->updateDone);
+    this->jobs->runAfter(&this->updateDone, &FramePrep::cullJob, this, 0, 0, &this->cullDone);
+}
+
+const std::vector<GLuint>& FramePrep::visibleObjects()
+{
+    this->mergeVisible();
+    return this->visibleObjectList;
+}
+
+const std::vector<GLuint>& FramePrep::visibleLights()
+{
+    this->mergeVisible();
+    return this->visibleLightList;
+}
+
+void FramePrep::latchView(const glm::mat4& viewMatrix)
+{
+    this->viewMatrix = viewMatrix;
+}
+
+void FramePrep::computeInstances(ObjectMatrixArrays out, NormalMatrixMode normalMode)
+{
+    this->mergeVisible();
+    this->instanceOut = out;
+    this->normalMode = normalMode;
+    if (!out.modelView) {
+        return;
+    }
+    GLuint count = this->visibleObjectList.size();
+    for (GLuint begin = 0; begin < count; begin += INSTANCE_GRAIN) {
+        GLuint end = std::min(begin + INSTANCE_GRAIN, count);
+        this->jobs->run(&FramePrep::instanceJob, this, begin, end, &this->instancesDone);
+    }
+}
+
+void FramePrep::finish()
+{
+    this->jobs->wait(&this->updateDone);
+    this->jobs->wait(&this->cullDone);
+    this->jobs->wait(&this->instancesDone);
+}
+
+void FramePrep::mergeVisible()
+{
+    this->jobs->wait(&this->cullDone);
+    if (this->merged) {
+        return;
+    }
+    this->visibleObjectList.clear();
+    for (GLuint i = 0; i < this->objectChunks.size(); i++) {
+        this->visibleObjectList.insert(this->visibleObjectList.end(),
+                                       this->objectChunks[i].begin(), this->objectChunks[i].end());
+    }
+    this->visibleLightList.clear();
+    for (GLuint i = 0; i < this->lightChunks.size(); i++) {
+        this->visibleLightList.insert(this->visibleLightList.end(),
+                                      this->lightChunks[i].begin(), this->lightChunks[i].end());
+    }
+    this->merged = true;
+}
+
+// Jobs
+// ----
+
+void FramePrep::collectJob(void* data, GLuint, GLuint)
+{
+    // Group the dirty subtrees into jobs of about UPDATE_GRAIN nodes. A
+    // single huge dirty subtree (e.g. the root moved) stays one job, since
+    // its nodes depend on each other in order.
+    FramePrep* prep = (FramePrep*) data;
+    const std::vector<NodeRange>& ranges = prep->transforms->collectDirtyRanges();
+    GLuint batchBegin = 0;
+    GLuint batchNodes = 0;
+    for (GLuint i = 0; i < ranges.size(); i++) {
+        batchNodes += ranges[i].end - ranges[i].begin;
+        if (batchNodes >= UPDATE_GRAIN || i + 1 == ranges.size()) {
+            prep->jobs->run(&FramePrep::updateJob, prep, batchBegin, i + 1, &prep->updateDone);
+            batchBegin = i + 1;
+            batchNodes = 0;
+        }
+    }
+}
+
+void FramePrep::updateJob(void* data, GLuint begin, GLuint end)
+{
+    FramePrep* prep = (FramePrep*) data;
+    const std::vector<NodeRange>& ranges = prep->transforms->updatedRanges();
+    for (GLuint i = begin; i < end; i++) {
+        prep->transforms->updateRange(ranges[i]);
+    }
+}
+
+void FramePrep::cullJob(void* data, GLuint, GLuint)
+{
+    FramePrep* prep = (FramePrep*) data;
+    GLuint objectJobs = (prep->objectCount + CULL_GRAIN - 1) / CULL_GRAIN;
+    GLuint lightJobs = (prep->lightCount + CULL_GRAIN - 1) / CULL_GRAIN;
+    prep->objectChunks.resize(objectJobs);
+    prep->lightChunks.resize(lightJobs);
+    for (GLuint i = 0; i < objectJobs; i++) {
+        GLuint begin = prep->firstObject + i * CULL_GRAIN;
+        GLuint end = std::min(begin + CULL_GRAIN, prep->firstObject + prep->objectCount);
+        prep->jobs->run(&FramePrep::cullObjectsJob, prep, begin, end, &prep->cullDone);
+    }
+    for (GLuint i = 0; i < lightJobs; i++) {
+        GLuint begin = prep->firstLight + i * CULL_GRAIN;
+        GLuint end = std::min(begin + CULL_GRAIN, prep->firstLight + prep->lightCount);
+        prep->jobs->run(&FramePrep::cullLightsJob, prep, begin, end, &prep->cullDone);
+    }
+}
+
+void FramePrep::cullObjectsJob(void* data, GLuint begin, GLuint end)
+{
+    FramePrep* prep = (FramePrep*) data;
+    std::vector<GLuint>& visible = prep->objectChunks[(begin - prep->firstObject) / CULL_GRAIN];
+    visible.clear();
+    prep->transforms->cull(prep->viewProjectionMatrix, begin, end, visible);
+}
+
+void FramePrep::cullLightsJob(void* data, GLuint begin, GLuint end)
+{
+    FramePrep* prep = (FramePrep*) data;
+    std::vector<GLuint>& visible = prep->lightChunks[(begin - prep->firstLight) / CULL_GRAIN];
+    visible.clear();
+    prep->transforms->cull(prep->viewProjectionMatrix, begin, end, visible);
+}
+
+void FramePrep::instanceJob(void* data, GLuint begin, GLuint end)
+{
+    FramePrep* prep = (FramePrep*) data;
+    ObjectMatrixArrays out = prep->instanceOut;
+    out.modelView           += begin * 16;
+    out.modelViewProjection += begin * 16;
+    out.normal              += begin * 9;
+    computeObjectMatrices(prep->transforms->worldMatrices(),
+                          &prep->visibleObjectList[begin], end - begin,
+                          prep->viewMatrix, prep->projectionMatrix,
+                          prep->normalMode, out);
+}
+
+// Benchmark
+// ---------
+
+void benchmarkFramePrep(GLuint objectCount, GLuint frames)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const GLuint OBJECTS_PER_GROUP = 100;
+    const GLuint THREAD_COUNTS[] = { 1, 2, 4, 8, 16 };
+
+    // Scene: root -> groups of OBJECTS_PER_GROUP objects, plus a light group.
+    // Every group spins each frame, so every object's world matrix changes.
+    TransformHierarchy transforms;
+    GLuint root = transforms.addNode(TransformHierarchy::NO_PARENT, glm::mat4());
+    std::vector<GLuint> groups;
+    std::vector<glm::mat4> groupMatrices;
+    srand(7);
+    for (GLuint i = 0; i < objectCount; i++) {
+        if (i % OBJECTS_PER_GROUP == 0) {
+            glm::mat4 groupMatrix = glm::translate(glm::mat4(), glm::vec3(rand() % 200 - 100.0f, rand() % 20 - 10.0f, rand() % 200 - 100.0f));
+            groups.push_back(transforms.addNode(root, groupMatrix));
+            groupMatrices.push_back(groupMatrix);
+        }
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(), glm::vec3(rand() % 10 - 5.0f, rand() % 10 - 5.0f, rand() % 10 - 5.0f));
+        GLuint node = transforms.addNode(groups.back(), modelMatrix);
+        transforms.setBoundingSphere(node, glm::vec3(0.0f), 0.87f);
+    }
+    GLuint firstObject = groups[0] + 1;
+    GLuint lightCount = objectCount / 100;
+    GLuint lightsNode = transforms.addNode(root, glm::mat4());
+    for (GLuint i = 0; i < lightCount; i++) {
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(), glm::vec3(rand() % 200 - 100.0f, rand() % 20 - 10.0f, rand() % 200 - 100.0f));
+        GLuint node = transforms.addNode(lightsNode, modelMatrix);
+        transforms.setBoundingSphere(node, glm::vec3(0.0f), 5.0f);
+    }
+    transforms.update();
+
+    glm::mat4 viewMatrix = glm::lookAt(glm::vec3(0.0f, 30.0f, 120.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projectionMatrix = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+    std::vector<GLfloat> modelView(objectCount * 16);
+    std::vector<GLfloat> modelViewProjection(objectCount * 16);
+    std::vector<GLfloat> normal(objectCount * 9);
+    ObjectMatrixArrays out = { &modelView[0], &modelViewProjection[0], &normal[0] };
+
+    std::cout << "BENCHMARK::FRAME_PREP " << objectCount << " objects, " << lightCount
+              << " lights x " << frames << " frames" << std::endl;
+    GLdouble singleThreadTime = 0.0;
+    for (GLuint t = 0; t < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); t++) {
+        JobSystem jobs(THREAD_COUNTS[t]);
+        FramePrep prep(&jobs, &transforms);
+        prep.setObjects(firstObject, objectCount + groups.size() - 1);
+        prep.setLights(lightsNode + 1, lightCount);
+
+        GLuint visible = 0;
+        Clock::time_point start = Clock::now();
+        for (GLuint frame = 0; frame < frames; frame++) {
+            GLfloat angle = 0.01f * frame;
+            for (GLuint g = 0; g < groups.size(); g++) {
+                transforms.setLocalMatrix(groups[g], glm::rotate(groupMatrices[g], angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+            }
+            prep.begin(viewMatrix, projectionMatrix);
+            visible = prep.visibleObjects().size();
+            prep.computeInstances(out, NORMAL_MATRIX_UNIFORM_SCALE);
+            prep.finish();
+        }
+        GLdouble frameTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+        if (t == 0) {
+            singleThreadTime = frameTime;
+        }
+        std::cout << "    " << THREAD_COUNTS[t] << " threads: " << frameTime << " ms/frame ("
+                  << singleThreadTime / frameTime << "x, " << visible << " visible)" << std::endl;
+    }
+}
@@ -0,0 +1,97 @@
+#include "geometry.h"
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "gpumemory.h"
+
+static std::unordered_map<GLuint64, std::weak_ptr<const GeometryBuffers> > registry;
+static GeometryRegistryStats stats = { 0, 0, 0, 0, 0, 0 };
+
+// FNV-1a, 64 bit
+static GLuint64 hashBytes(GLuint64 hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+GeometryBuffers::GeometryBuffers()
+    : VAO(0), VBO(0), EBO(0), bytes(0), key(0)
+{
+}
+
+GeometryBuffers::~GeometryBuffers()
+{
+    registry.erase(this->key);
+    stats.live--;
+    stats.liveBytes -= this->bytes;
+    untrackBuffer(this->VBO);
+    untrackBuffer(this->EBO);
+    glDeleteVertexArrays(1, &this->VAO);
+    glDeleteBuffers(1, &this->VBO);
+    glDeleteBuffers(1, &this->EBO);
+}
+
+GLuint64 geometryKey(const char* layout,
+                     const void* vertices, GLsizeiptr vertexBytes,
+                     const void* indices, GLsizeiptr indexBytes)
+{
+    // Sizes first, so the vertex/index split can't shift between meshes.
+    GLuint64 hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, layout, std::strlen(layout) + 1);
+    hash = hashBytes(hash, &vertexBytes, sizeof(vertexBytes));
+    hash = hashBytes(hash, &indexBytes, sizeof(indexBytes));
+    hash = hashBytes(hash, vertices, vertexBytes);
+    hash = hashBytes(hash, indices, indexBytes);
+    return hash;
+}
+
+GeometryHandle findGeometry(GLuint64 key)
+{
+    std::unordered_map<GLuint64, std::weak_ptr<const GeometryBuffers> >::iterator it = registry.find(key);
+    if (it == registry.end()) {
+        return GeometryHandle();
+    }
+    GeometryHandle geometry = it->second.lock();
+    if (geometry) {
+        stats.duplicates++;
+        stats.bytesSaved += geometry->bytes;
+    }
+    return geometry;
+}
+
+GeometryHandle registerGeometry(GLuint64 key, GLuint VAO, GLuint VBO, GLuint EBO, GLsizeiptr bytes)
+{
+    GeometryBuffers* buffers = new GeometryBuffers();
+    buffers->VAO = VAO;
+    buffers->VBO = VBO;
+    buffers->EBO = EBO;
+    buffers->bytes = bytes;
+    buffers->key = key;
+    GeometryHandle geometry(buffers);
+    registry[key] = geometry;
+
+    stats.uploads++;
+    stats.bytesUploaded += bytes;
+    stats.live++;
+    stats.liveBytes += bytes;
+    return geometry;
+}
+
+GeometryRegistryStats geometryRegistryStats()
+{
+    return stats;
+}
+
+void printGeometryRegistryStats()
+{
+    std::cout << "GEOMETRY_REGISTRY:: " << stats.uploads + stats.duplicates << " meshes, "
+              << stats.uploads << " uploaded (" << stats.bytesUploaded / 1024.0 << " KB), "
+              << stats.duplicates << " duplicates shared (" << stats.bytesSaved / 1024.0 << " KB saved), "
+              << stats.live << " live (" << stats.liveBytes / 1024.0 << " KB)" << std::endl;
+}
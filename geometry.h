@@ -0,0 +1,58 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <memory>
+
+#include <GL/glew.h>
+
+// Geometry Registry
+// =================
+// Meshes are keyed by a hash of their vertex layout, vertex bytes and index
+// bytes at upload time. A mesh whose key is already registered shares the
+// existing VAO/VBO/EBO instead of uploading its own copy; the buffers are
+// refcounted through GeometryHandle and deleted with the last mesh holding
+// them. As with the program cache, equal keys are trusted to mean equal
+// content (64-bit FNV-1a).
+//
+// The VAO is shared too, so state attached to it (the instance matrix
+// attributes) is seen by every mesh with the same content. Shaders that
+// don't read those attributes are unaffected.
+struct GeometryBuffers {
+    GLuint VAO, VBO, EBO;
+    GLsizeiptr bytes;
+    GLuint64 key;
+
+    GeometryBuffers();
+    ~GeometryBuffers();
+
+private:
+    GeometryBuffers(const GeometryBuffers&);
+    GeometryBuffers& operator=(const GeometryBuffers&);
+};
+
+typedef std::shared_ptr<const GeometryBuffers> GeometryHandle;
+
+struct GeometryRegistryStats {
+    GLuint uploads;         // meshes given their own buffers
+    GLuint duplicates;      // meshes that shared an existing upload
+    GLsizeiptr bytesUploaded;
+    GLsizeiptr bytesSaved;  // what the duplicates would have uploaded
+    GLuint live;            // buffer sets currently allocated
+    GLsizeiptr liveBytes;
+};
+
+// `layout` names the vertex format, so equal bytes in different formats
+// never match.
+GLuint64 geometryKey(const char* layout,
+                     const void* vertices, GLsizeiptr vertexBytes,
+                     const void* indices, GLsizeiptr indexBytes);
+// The registered buffers for `key`, or an empty handle (upload, then
+// registerGeometry).
+GeometryHandle findGeometry(GLuint64 key);
+// Takes ownership of the buffers.
+GeometryHandle registerGeometry(GLuint64 key, GLuint VAO, GLuint VBO, GLuint EBO, GLsizeiptr bytes);
+
+GeometryRegistryStats geometryRegistryStats();
+void printGeometryRegistryStats();
+
+#endif // GEOMETRY_H
@@ -0,0 +1,197 @@
+#include "gpumemory.h"
+
+#include <iostream>
+#include <map>
+#include <utility>
+
+struct GpuAllocation {
+    GpuMemoryCategory category;
+    const char* label;
+    GLsizeiptr bytes;
+};
+
+// Keyed by (GL_TEXTURE / GL_BUFFER / GL_RENDERBUFFER, name).
+typedef std::map<std::pair<GLenum, GLuint>, GpuAllocation> GpuAllocationMap;
+
+static const char* CATEGORY_NAMES[GPU_MEMORY_CATEGORIES] = {
+    "G-buffer", "SSAO", "post", "shadow", "mesh", "material", "upload", "other"
+};
+
+static GpuAllocationMap allocations;
+static GpuMemoryStats stats = { {0}, {0}, 0, 0, 0 };
+static GLsizeiptr budget = 0;
+
+static void track(GLenum kind, GLuint name, GpuMemoryCategory category, const char* label, GLsizeiptr bytes)
+{
+    std::pair<GLenum, GLuint> key(kind, name);
+    GpuAllocationMap::iterator it = allocations.find(key);
+    if (it != allocations.end()) {
+        stats.live[it->second.category] -= it->second.bytes;
+        stats.totalLive -= it->second.bytes;
+    }
+    GpuAllocation allocation = { category, label, bytes };
+    allocations[key] = allocation;
+    stats.allocations = allocations.size();
+
+    GLsizeiptr previousTotal = stats.totalLive;
+    stats.live[category] += bytes;
+    stats.totalLive += bytes;
+    if (stats.live[category] > stats.highWater[category]) {
+        stats.highWater[category] = stats.live[category];
+    }
+    if (stats.totalLive > stats.totalHighWater) {
+        stats.totalHighWater = stats.totalLive;
+    }
+    if (budget > 0 && previousTotal <= budget && stats.totalLive > budget) {
+        std::cout << "WARNING::GPU_MEMORY::OVER_BUDGET " << stats.totalLive / 1048576.0
+                  << " MB live, budget " << budget / 1048576.0 << " MB (after "
+                  << label << ", " << bytes / 1024.0 << " KB)" << std::endl;
+    }
+}
+
+static void untrack(GLenum kind, GLuint name)
+{
+    GpuAllocationMap::iterator it = allocations.find(std::make_pair(kind, name));
+    if (it == allocations.end()) {
+        return;
+    }
+    stats.live[it->second.category] -= it->second.bytes;
+    stats.totalLive -= it->second.bytes;
+    allocations.erase(it);
+    stats.allocations = allocations.size();
+}
+
+GLuint gpuTexelSize(GLenum internalFormat)
+{
+    switch (internalFormat) {
+    case GL_R8:
+    case GL_RED:
+        return 1;
+    case GL_R16F:
+    case GL_RG8:
+    case GL_RG:
+    case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RGB8:
+    case GL_RGB:
+    case GL_SRGB8:
+    case GL_DEPTH_COMPONENT24:
+        return 3;
+    case GL_RGB16F:
+        return 6;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+        return 8;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        // RGBA8, SRGB8_ALPHA8, RG16F, R32F, R11F_G11F_B10F, DEPTH24_STENCIL8,
+        // DEPTH_COMPONENT32F.
+        return 4;
+    }
+}
+
+GLsizeiptr gpuTextureBytes(GLsizei width, GLsizei height, GLenum internalFormat,
+                           GLuint levels, GLuint layers)
+{
+    GLsizeiptr bytes = 0;
+    GLuint texelSize = gpuTexelSize(internalFormat);
+    for (GLuint level = 0; levels == 0 || level < levels; level++) {
+        bytes += (GLsizeiptr) width * height * texelSize;
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return bytes * layers;
+}
+
+void trackTexture(GLuint texture, GpuMemoryCategory category, const char* label,
+                  GLsizei width, GLsizei height, GLenum internalFormat,
+                  GLuint levels, GLuint layers)
+{
+    track(GL_TEXTURE, texture, category, label, gpuTextureBytes(width, height, internalFormat, levels, layers));
+}
+
+void trackBuffer(GLuint buffer, GpuMemoryCategory category, const char* label, GLsizeiptr bytes)
+{
+    track(GL_BUFFER, buffer, category, label, bytes);
+}
+
+void trackRenderbuffer(GLuint renderbuffer, GpuMemoryCategory category, const char* label,
+                       GLsizei width, GLsizei height, GLenum internalFormat)
+{
+    track(GL_RENDERBUFFER, renderbuffer, category, label, gpuTextureBytes(width, height, internalFormat));
+}
+
+void untrackTexture(GLuint texture)
+{
+    untrack(GL_TEXTURE, texture);
+}
+
+void untrackBuffer(GLuint buffer)
+{
+    untrack(GL_BUFFER, buffer);
+}
+
+void untrackRenderbuffer(GLuint renderbuffer)
+{
+    untrack(GL_RENDERBUFFER, renderbuffer);
+}
+
+void setGpuMemoryBudget(GLsizeiptr bytes)
+{
+    budget = bytes;
+    if (budget > 0 && stats.totalLive > budget) {
+        std::cout << "WARNING::GPU_MEMORY::OVER_BUDGET " << stats.totalLive / 1048576.0
+                  << " MB live, budget " << budget / 1048576.0 << " MB" << std::endl;
+    }
+}
+
+GpuMemoryStats gpuMemoryStats()
+{
+    return stats;
+}
+
+const char* gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+    return CATEGORY_NAMES[category];
+}
+
+void printGpuMemoryReport()
+{
+    std::cout << "GPU_MEMORY:: " << stats.allocations << " objects, "
+              << stats.totalLive / 1048576.0 << " MB live, "
+              << stats.totalHighWater / 1048576.0 << " MB peak";
+    if (budget > 0) {
+        std::cout << ", budget " << budget / 1048576.0 << " MB";
+    }
+    std::cout << std::endl;
+    for (GLuint i = 0; i < GPU_MEMORY_CATEGORIES; i++) {
+        if (stats.highWater[i] == 0) {
+            continue;
+        }
+        std::cout << "    " << CATEGORY_NAMES[i] << ": " << stats.live[i] / 1048576.0
+                  << " MB live, " << stats.highWater[i] / 1048576.0 << " MB peak" << std::endl;
+    }
+}
+
+void printGpuMemoryLeaks()
+{
+    if (allocations.empty()) {
+        return;
+    }
+    std::cout << "GPU_MEMORY::LEAKS " << allocations.size() << " objects, "
+              << stats.totalLive / 1048576.0 << " MB still allocated at exit" << std::endl;
+    for (GpuAllocationMap::iterator it = allocations.begin(); it != allocations.end(); ++it) {
+        const char* kind = it->first.first == GL_TEXTURE ? "texture"
+                         : it->first.first == GL_BUFFER ? "buffer" : "renderbuffer";
+        std::cout << "    " << kind << " " << it->first.second << " " << it->second.label
+                  << " (" << CATEGORY_NAMES[it->second.category] << ", "
+                  << it->second.bytes / 1024.0 << " KB)" << std::endl;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef GPUMEMORY_H
+#define GPUMEMORY_H
+
+#include <GL/glew.h>
+
+// GPU Memory Accounting
+// =====================
+// Every texture, buffer and renderbuffer is recorded with its size (derived
+// from format, dimensions and mip levels: what the driver must at least
+// allocate, not what it actually does) and a category. Live totals and
+// high-water marks are kept per category and overall; a warning is printed
+// whenever the live total crosses the budget.
+//
+// Track an object right after allocating its storage (tracking the same
+// object again replaces its entry, e.g. after re-specifying a texture) and
+// untrack it right before deleting it. Whatever is still tracked once the
+// program has released its objects is reported by printGpuMemoryLeaks().
+enum GpuMemoryCategory {
+    GPU_MEMORY_GBUFFER,
+    GPU_MEMORY_SSAO,
+    GPU_MEMORY_POST,        // HDR scene, bloom, exposure
+    GPU_MEMORY_SHADOW,
+    GPU_MEMORY_MESH,
+    GPU_MEMORY_MATERIAL,
+    GPU_MEMORY_UPLOAD,      // per-frame streaming and uniform buffers
+    GPU_MEMORY_OTHER,
+    GPU_MEMORY_CATEGORIES
+};
+
+struct GpuMemoryStats {
+    GLsizeiptr live[GPU_MEMORY_CATEGORIES];
+    GLsizeiptr highWater[GPU_MEMORY_CATEGORIES];
+    GLsizeiptr totalLive;
+    GLsizeiptr totalHighWater;
+    GLuint allocations;
+};
+
+// Bytes per texel of an internal format (3 for GL_RGB, 6 for GL_RGB16F,
+// even though drivers usually pad those to 4 and 8).
+GLuint gpuTexelSize(GLenum internalFormat);
+// `levels` = 0 for a full mip chain.
+GLsizeiptr gpuTextureBytes(GLsizei width, GLsizei height, GLenum internalFormat,
+                           GLuint levels = 1, GLuint layers = 1);
+
+// `label` must outlive the allocation (a string literal).
+void trackTexture(GLuint texture, GpuMemoryCategory category, const char* label,
+                  GLsizei width, GLsizei height, GLenum internalFormat,
+                  GLuint levels = 1, GLuint layers = 1);
+void trackBuffer(GLuint buffer, GpuMemoryCategory category, const char* label, GLsizeiptr bytes);
+void trackRenderbuffer(GLuint renderbuffer, GpuMemoryCategory category, const char* label,
+                       GLsizei width, GLsizei height, GLenum internalFormat);
+void untrackTexture(GLuint texture);
+void untrackBuffer(GLuint buffer);
+void untrackRenderbuffer(GLuint renderbuffer);
+
+// 0 (the default) for no budget.
+void setGpuMemoryBudget(GLsizeiptr bytes);
+
+GpuMemoryStats gpuMemoryStats();
+const char* gpuMemoryCategoryName(GpuMemoryCategory category);
+void printGpuMemoryReport();
+// Every object still tracked; prints nothing if there are none.
+void printGpuMemoryLeaks();
+
+#endif // GPUMEMORY_H
@@ -0,0 +1,225 @@
+#include "jobs.h"
+
+#include <iostream>
+
+// Which worker of which system the current thread is; threads that belong
+// to no system submit to queue 0.
+static thread_local const JobSystem* currentSystem = NULL;
+static thread_local GLuint currentIndex = 0;
+
+// Spins on an empty queue before a worker goes to sleep.
+static const GLuint IDLE_SPINS = 64;
+
+JobCounter::JobCounter()
+    : value(0), continuationCount(0)
+{
+}
+
+bool JobCounter::done() const
+{
+    return this->value.load() == 0;
+}
+
+JobSystem::JobSystem(GLuint threadCount)
+    : queuedJobs(0), stopping(false)
+{
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+    }
+    for (GLuint i = 0; i < threadCount; i++) {
+        this->queues.push_back(new WorkerQueue());
+    }
+    currentSystem = this;
+    currentIndex = 0;
+    for (GLuint i = 1; i < threadCount; i++) {
+        this->threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->sleepLock);
+        this->stopping = true;
+    }
+    this->wakeUp.notify_all();
+    for (GLuint i = 0; i < this->threads.size(); i++) {
+        this->threads[i].join();
+    }
+    for (GLuint i = 0; i < this->queues.size(); i++) {
+        delete this->queues[i];
+    }
+    if (currentSystem == this) {
+        currentSystem = NULL;
+    }
+}
+
+GLuint JobSystem::threadCount() const
+{
+    return this->queues.size();
+}
+
+void JobSystem::run(JobFunction function, void* data, GLuint begin, GLuint end, JobCounter* counter)
+{
+    if (counter) {
+        counter->value.fetch_add(1);
+    }
+    Job job = { function, data, begin, end, counter };
+    this->push(job);
+}
+
+void JobSystem::runAfter(JobCounter* dependency,
+                         JobFunction function, void* data, GLuint begin, GLuint end, JobCounter* counter)
+{
+    if (counter) {
+        counter->value.fetch_add(1);
+    }
+    Job job = { function, data, begin, end, counter };
+    {
+        std::lock_guard<std::mutex> guard(dependency->lock);
+        if (dependency->value.load() != 0) {
+            if (dependency->continuationCount < JobCounter::MAX_CONTINUATIONS) {
+                dependency->continuations[dependency->continuationCount++] = job;
+                return;
+            }
+        }
+    }
+    // Already satisfied, or out of continuation slots: in the latter case
+    // help until it is satisfied rather than drop the job.
+    this->wait(dependency);
+    this->push(job);
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+    GLuint worker = this->currentWorker();
+    while (!counter->done()) {
+        if (!this->runOne(worker)) {
+            std::this_thread::yield();
+        }
+    }
+    // The job that zeroed the counter releases its lock last; taking it
+    // here makes it safe for the caller to destroy the counter.
+    std::lock_guard<std::mutex> guard(counter->lock);
+}
+
+GLuint JobSystem::currentWorker() const
+{
+    return currentSystem == this ? currentIndex : 0;
+}
+
+void JobSystem::push(const Job& job)
+{
+    WorkerQueue* queue = this->queues[this->currentWorker()];
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (queue->tail - queue->head < QUEUE_CAPACITY) {
+            queue->jobs[queue->tail % QUEUE_CAPACITY] = job;
+            queue->tail++;
+            this->queuedJobs.fetch_add(1);
+        }
+        else {
+            queue = NULL;
+        }
+    }
+    if (!queue) {
+        // Full: run it here instead. Correct, just not parallel.
+        this->execute(job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(this->sleepLock);
+    }
+    this->wakeUp.notify_one();
+}
+
+bool JobSystem::pop(GLuint worker, Job& job)
+{
+    WorkerQueue* queue = this->queues[worker];
+    std::lock_guard<std::mutex> guard(queue->lock);
+    if (queue->tail == queue->head) {
+        return false;
+    }
+    queue->tail--;
+    job = queue->jobs[queue->tail % QUEUE_CAPACITY];
+    this->queuedJobs.fetch_sub(1);
+    return true;
+}
+
+bool JobSystem::steal(GLuint thief, Job& job)
+{
+    GLuint count = this->queues.size();
+    for (GLuint i = 1; i < count; i++) {
+        WorkerQueue* queue = this->queues[(thief + i) % count];
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (queue->tail != queue->head) {
+            job = queue->jobs[queue->head % QUEUE_CAPACITY];
+            queue->head++;
+            this->queuedJobs.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::runOne(GLuint worker)
+{
+    Job job;
+    if (this->pop(worker, job) || this->steal(worker, job)) {
+        this->execute(job);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(const Job& job)
+{
+    job.function(job.data, job.begin, job.end);
+    if (job.counter) {
+        this->finish(job.counter);
+    }
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    Job released[JobCounter::MAX_CONTINUATIONS];
+    GLuint releasedCount = 0;
+    {
+        std::lock_guard<std::mutex> guard(counter->lock);
+        if (counter->value.fetch_sub(1) == 1) {
+            releasedCount = counter->continuationCount;
+            for (GLuint i = 0; i < releasedCount; i++) {
+                released[i] = counter->continuations[i];
+            }
+            counter->continuationCount = 0;
+        }
+    }
+    for (GLuint i = 0; i < releasedCount; i++) {
+        this->push(released[i]);
+    }
+}
+
+void JobSystem::workerLoop(GLuint worker)
+{
+    currentSystem = this;
+    currentIndex = worker;
+    GLuint idle = 0;
+    while (!this->stopping.load()) {
+        if (this->runOne(worker)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(this->sleepLock);
+        while (this->queuedJobs.load() == 0 && !this->stopping.load()) {
+            this->wakeUp.wait(lock);
+        }
+        idle = 0;
+    }
+}
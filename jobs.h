@@ -0,0 +1,131 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Job System
+// ==========
+// A fixed pool of worker threads, each with its own job deque. A thread
+// pushes and pops at the back of its own deque (newest first, cache-warm)
+// and, when that is empty, steals from the front of someone else's.
+//
+// Jobs are plain function pointers plus a data pointer and an index range,
+// so submitting one never allocates. Completion is tracked with
+// JobCounters: every job decrements its counter when done, and jobs may be
+// queued to start only once another counter reaches zero.
+//
+// The thread that created the JobSystem (the GL thread) counts as worker 0:
+// it only runs jobs while inside wait(), so GL calls never leave it. That
+// may be any queued job, not only those of the counter waited on, so long
+// blocking work (file I/O, decoding) belongs on a JobSystem of its own
+// that frame work is never waited on through.
+
+typedef void (*JobFunction)(void* data, GLuint begin, GLuint end);
+
+struct Job {
+    JobFunction function;
+    void* data;
+    GLuint begin;
+    GLuint end;
+    struct JobCounter* counter;
+};
+
+struct JobCounter {
+    static const GLuint MAX_CONTINUATIONS = 8;
+
+    std::atomic<GLint> value;
+    // Jobs released when `value` drops to zero (see JobSystem::runAfter).
+    std::mutex lock;
+    Job continuations[MAX_CONTINUATIONS];
+    GLuint continuationCount;
+
+    JobCounter();
+    // Polling only; join with JobSystem::wait before destroying a counter,
+    // since the last job may still be releasing it.
+    bool done() const;
+};
+
+class JobSystem
+{
+public:
+    // `threadCount` includes the calling thread; 0 uses every hardware thread.
+    JobSystem(GLuint threadCount = 0);
+    ~JobSystem();
+
+    GLuint threadCount() const;
+
+    // Queue a job; `counter` (may be NULL) is incremented now and
+    // decremented when the job finishes.
+    void run(JobFunction function, void* data, GLuint begin, GLuint end, JobCounter* counter);
+    // Queue a job that may only start once `dependency` reaches zero.
+    void runAfter(JobCounter* dependency,
+                  JobFunction function, void* data, GLuint begin, GLuint end, JobCounter* counter);
+    // Block until `counter` reaches zero, running queued jobs meanwhile.
+    void wait(JobCounter* counter);
+
+    // Split [0, count) into chunks of at most `grainSize` and run
+    // body(begin, end) on each in parallel; returns once all are done.
+    template <typename Body>
+    void parallelFor(GLuint count, GLuint grainSize, Body& body)
+    {
+        JobCounter counter;
+        this->parallelFor(count, grainSize, body, &counter);
+        this->wait(&counter);
+    }
+    // Non-blocking variant; wait on `counter` to join.
+    template <typename Body>
+    void parallelFor(GLuint count, GLuint grainSize, Body& body, JobCounter* counter)
+    {
+        if (grainSize == 0) {
+            grainSize = 1;
+        }
+        for (GLuint begin = 0; begin < count; begin += grainSize) {
+            GLuint end = begin + grainSize < count ? begin + grainSize : count;
+            this->run(&JobSystem::invokeRange<Body>, &body, begin, end, counter);
+        }
+    }
+
+private:
+    static const GLuint QUEUE_CAPACITY = 4096;
+
+    struct WorkerQueue {
+        std::mutex lock;
+        Job jobs[QUEUE_CAPACITY];
+        GLuint head;    // steal end
+        GLuint tail;    // owner end
+        WorkerQueue() : head(0), tail(0) {}
+    };
+
+    std::vector<WorkerQueue*> queues;
+    std::vector<std::thread> threads;
+    std::atomic<GLint> queuedJobs;
+    std::atomic<bool> stopping;
+    std::mutex sleepLock;
+    std::condition_variable wakeUp;
+
+    template <typename Body>
+    static void invokeRange(void* data, GLuint begin, GLuint end)
+    {
+        (*(Body*) data)(begin, end);
+    }
+
+    GLuint currentWorker() const;
+    void push(const Job& job);
+    bool pop(GLuint worker, Job& job);
+    bool steal(GLuint thief, Job& job);
+    bool runOne(GLuint worker);
+    void execute(const Job& job);
+    void finish(JobCounter* counter);
+    void workerLoop(GLuint worker);
+
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+};
+
+#endif // JOBS_H
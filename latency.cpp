@@ -0,0 +1,120 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <iostream>
+
+static GLdouble percentile(std::vector<GLdouble>& samples, GLdouble p)
+{
+    if (samples.empty()) {
+        return 0.0;
+    }
+    GLuint index = (GLuint) (p * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+LatencyTracker::LatencyTracker(GLuint reportInterval)
+    : reportInterval(reportInterval)
+    , queriesCreated(false)
+    , nextQuery(0)
+    , hasInput(false)
+    , inputTime(0.0)
+{
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        this->pending[i].query = 0;
+        this->pending[i].busy = false;
+    }
+    // Room for a whole report's samples: measuring doesn't allocate.
+    this->swapLatencies.reserve(reportInterval);
+    this->gpuLatencies.reserve(reportInterval + QUERIES_IN_FLIGHT);
+}
+
+LatencyTracker::~LatencyTracker()
+{
+    // May outlive the context (it is a global in main.cpp), so the queries
+    // are left to the context's destruction.
+}
+
+void LatencyTracker::inputEvent(GLdouble time)
+{
+    if (!this->hasInput) {
+        this->hasInput = true;
+        this->inputTime = time;
+    }
+}
+
+void LatencyTracker::inputLatched(GLdouble time)
+{
+    this->hasInput = true;
+    this->inputTime = time;
+}
+
+void LatencyTracker::frameSwapped(GLdouble time)
+{
+    if (!this->queriesCreated) {
+        for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+            glGenQueries(1, &this->pending[i].query);
+        }
+        this->queriesCreated = true;
+    }
+    this->pollQueries();
+    if (!this->hasInput) {
+        return;
+    }
+    this->hasInput = false;
+    this->swapLatencies.push_back((time - this->inputTime) * 1000.0);
+
+    // If every query is still in flight the GPU is far behind; skip the GPU
+    // measurement for this frame rather than wait.
+    PendingFrame& frame = this->pending[this->nextQuery];
+    if (!frame.busy) {
+        glQueryCounter(frame.query, GL_TIMESTAMP);
+        glGetInteger64v(GL_TIMESTAMP, &frame.gpuTime);
+        frame.cpuTime = time;
+        frame.inputTime = this->inputTime;
+        frame.busy = true;
+        this->nextQuery = (this->nextQuery + 1) % QUERIES_IN_FLIGHT;
+    }
+
+    if (this->swapLatencies.size() >= this->reportInterval) {
+        this->report();
+    }
+}
+
+void LatencyTracker::pollQueries()
+{
+    for (GLuint i = 0; i < QUERIES_IN_FLIGHT; i++) {
+        PendingFrame& frame = this->pending[i];
+        if (!frame.busy) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 completed = 0;
+        glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &completed);
+        GLdouble completedTime = frame.cpuTime + (GLdouble) ((GLint64) completed - frame.gpuTime) * 1.0e-9;
+        this->gpuLatencies.push_back((completedTime - frame.inputTime) * 1000.0);
+        frame.busy = false;
+    }
+}
+
+void LatencyTracker::report()
+{
+    if (this->swapLatencies.empty()) {
+        return;
+    }
+    std::cout << "LATENCY:: " << this->swapLatencies.size() << " frames with input, ms p50/p95/p99"
+              << "  input->swap "
+              << percentile(this->swapLatencies, 0.50) << " / "
+              << percentile(this->swapLatencies, 0.95) << " / "
+              << percentile(this->swapLatencies, 0.99)
+              << "  input->gpu "
+              << percentile(this->gpuLatencies, 0.50) << " / "
+              << percentile(this->gpuLatencies, 0.95) << " / "
+              << percentile(this->gpuLatencies, 0.99) << std::endl;
+    this->swapLatencies.clear();
+    this->gpuLatencies.clear();
+}
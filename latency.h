@@ -0,0 +1,66 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// Input Latency Tracking
+// ======================
+// Measures how old the input behind each frame is by the time the frame
+// leaves the application (glfwSwapBuffers returns) and by the time the GPU
+// has finished it (a GL_TIMESTAMP query after the swap, converted to CPU
+// time). Completion is polled on later frames, so nothing ever stalls.
+//
+// Input times are taken in the GLFW callbacks, i.e. when the application
+// sees an event during glfwPollEvents rather than when the OS received it,
+// and "GPU complete" is not yet scan-out; so both figures are lower bounds
+// on true input-to-photon latency (by up to a poll interval and a refresh).
+//
+// All times are in seconds on the glfwGetTime clock.
+class LatencyTracker
+{
+public:
+    // Print percentiles every `reportInterval` measured frames.
+    LatencyTracker(GLuint reportInterval = 300);
+    ~LatencyTracker();
+
+    // An input event was delivered (callbacks). The frame's input time is
+    // the oldest event not yet consumed by a frame.
+    void inputEvent(GLdouble time);
+    // Input was re-sampled late in the frame (late latching): the view the
+    // frame shows is now as of `time`.
+    void inputLatched(GLdouble time);
+    // Call right after glfwSwapBuffers. Frames without input are ignored.
+    void frameSwapped(GLdouble time);
+
+    void report();
+
+private:
+    static const GLuint QUERIES_IN_FLIGHT = 8;
+
+    struct PendingFrame {
+        GLuint   query;
+        bool     busy;
+        GLdouble inputTime;
+        // Clock pair for converting the GPU timestamp to CPU time.
+        GLdouble cpuTime;
+        GLint64  gpuTime;
+    };
+
+    GLuint reportInterval;
+    bool queriesCreated;
+    PendingFrame pending[QUERIES_IN_FLIGHT];
+    GLuint nextQuery;
+
+    bool hasInput;
+    GLdouble inputTime;
+
+    // Milliseconds, since the last report.
+    std::vector<GLdouble> swapLatencies;
+    std::vector<GLdouble> gpuLatencies;
+
+    void pollQueries();
+};
+
+#endif // LATENCY_H
@@ -50,3 +50,19 @@ struct ConeLight {
     float linearFalloff;
     float quadraticFalloff;
 };
+
+// std140 layout of `Light` in the `Lights` block of deferred-light.frag.
+struct DeferredLight {
+    glm::vec3 position;
+    float pad12;
+    glm::vec3 color;
+    // Next FLOAT gets packed here.
+
+    float constFalloff;
+    float linFalloff;
+    float quadFalloff;
+    float pad40;
+    float pad44;
+    // Shadow atlas tile, see ShadowAtlas::shadowTile.
+    glm::vec4 shadowTile;
+};
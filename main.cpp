@@ -5,7 +5,12 @@
 // ********
 // Includes
 // ********
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <math.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +24,28 @@
 #include "box.h"
 #include "plane.h"
 #include "lights.h"
+#include "transform.h"
+#include "matrixbatch.h"
+#include "shadercache.h"
+#include "ringbuffer.h"
+#include "jobs.h"
+#include "frameprep.h"
+#include "latency.h"
+#include "camerapath.h"
+#include "shadowatlas.h"
+#include "pointshadow.h"
+#include "conestep.h"
+#include "bloom.h"
+#include "exposure.h"
+#include "rendergraph.h"
+#include "geometry.h"
+#include "gpumemory.h"
+#include "texturestreaming.h"
+#include "softrender.h"
+#include "readback.h"
+#include "sceneloader.h"
+#include "arena.h"
+#include "material.h"
 
 using namespace std;
 
@@ -29,8 +56,13 @@ void doMovement();
 void mouseCallback(GLFWwindow*, double xPos, double yPos);
 void scrollCallback(GLFWwindow* window, double xOff, double yOff);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
+void applyMouseMovement(double xPos, double yPos);
+void bindUniformBlock(const Shader& shader, const char* blockName, GLuint bindingPoint);
 float clip(float a, float min, float max);
 float lerp(float a, float b, float f);
+glm::mat4 randomCubeMatrix();
+void randomLight(glm::vec3& position, glm::vec3& color);
+void ssaoSamples(std::vector<glm::vec3>& kernel, std::vector<glm::vec3>& noise);
 
 // *****
 // Input
@@ -40,6 +72,11 @@ bool firstMouseMovement = true;
 bool keys[1024];
 const glm::vec3 CAMERA_START_POS = glm::vec3(0.0f, 0.0f, 6.0f);
 Camera camera(CAMERA_START_POS);
+LatencyTracker latency;
+// Re-sample the cursor just before the geometry pass ("L" to toggle).
+bool lateLatch = false;
+// Camera driven by a recorded path; live input is ignored.
+bool replaying = false;
 
 // *****************
 // Global Properties
@@ -50,12 +87,169 @@ GLfloat lastFrame = 0.0f;
 bool visualizeDepth = false;
 bool visualizeTexture = false;
 bool ambientOcclusionOn = true;
+bool ssaoHighQuality = true;
+bool ssaoTemporal = true;
+bool bloomOn = true;
+bool autoExposureOn = true;
+bool exposureReset = false;
+
+// *****
+// Scene
+// *****
+// Shared by the GL and software renderers.
+const unsigned int NR_CUBES = 40;
+const unsigned int NR_LIGHTS = 20;
+const GLfloat LIGHT_CONST_FALLOFF = 0.3f;
+const GLfloat LIGHT_LIN_FALLOFF   = 0.7f;
+const GLfloat LIGHT_QUAD_FALLOFF  = 1.8f;
+const unsigned int SSAO_KERNEL_SIZE = 32;
 
 // ****
 // Main
 // ****
 int main(int argc, char *argv[])
 {
+    // Command Line
+    // ============
+    // --bench-transforms : time per-object matrix math and exit.
+    // --bench-jobs       : time frame preparation at 1-16 threads and exit.
+    // --bench-shadows    : time single-pass vs six-pass point shadows, exit.
+    // --bench-cone-step  : time cone step map preprocessing, validate the
+    //                      cone-step march against linear ones, exit.
+    // --bloom-levels <n> : bloom mip chain length (default 5).
+    // --bloom-intensity <x> : bloom strength in the composite (default 0.5).
+    // --vram-budget <MB> : warn when tracked GPU memory exceeds <MB>.
+    // --record <file>    : write the camera path to <file> while flying.
+    // --replay <file>    : fly the recorded path at a fixed 60 Hz timestep,
+    //                      vsync off, then exit.
+    // --timings <file>   : per-frame timings of a replay
+    //                      (default <replay file>.timings.csv).
+    // --software <file>  : render the start view on the CPU, without a GPU,
+    //                      save it to <file> (BMP) and exit.
+    // --batch <file> <prefix> : render one frame per pose in the camera path
+    //                      <file>, in a hidden window, to <prefix>NNNNN.png;
+    //                      timings go to <prefix>timings.csv. For machines
+    //                      without a GPU, run under a software GL driver,
+    //                      e.g. LIBGL_ALWAYS_SOFTWARE=1 xvfb-run.
+    // --model <file>     : stream in a model (any format assimp reads) at
+    //                      the origin, a box standing in until it's loaded.
+    // --upload-budget <ms> : time the scene loader may spend uploading
+    //                      per frame (default 2).
+    std::string recordPath, replayPath, timingsPath, softwarePath, batchPath, batchPrefix, modelPath;
+    GLdouble uploadBudget = 2.0;
+    bool benchShadows = false;
+    GLuint bloomLevels = 5;
+    GLfloat bloomIntensity = 0.5f;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--bench-transforms") {
+            benchmarkObjectMatrices(100000, 20);
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-jobs") {
+            benchmarkFramePrep(100000, 60);
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-cone-step") {
+            benchmarkConeStepMaps(1024);
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-shadows") {
+            benchShadows = true;
+        }
+        if (std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--timings" && i + 1 < argc) {
+            timingsPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--software" && i + 1 < argc) {
+            softwarePath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--batch" && i + 2 < argc) {
+            batchPath = argv[++i];
+            batchPrefix = argv[++i];
+        }
+        if (std::string(argv[i]) == "--model" && i + 1 < argc) {
+            modelPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--upload-budget" && i + 1 < argc) {
+            uploadBudget = atof(argv[++i]);
+        }
+        if (std::string(argv[i]) == "--bloom-levels" && i + 1 < argc) {
+            bloomLevels = atoi(argv[++i]);
+        }
+        if (std::string(argv[i]) == "--bloom-intensity" && i + 1 < argc) {
+            bloomIntensity = atof(argv[++i]);
+        }
+        if (std::string(argv[i]) == "--vram-budget" && i + 1 < argc) {
+            setGpuMemoryBudget((GLsizeiptr) (atof(argv[++i]) * 1048576.0));
+        }
+    }
+    CameraPathPlayer cameraPathPlayer;
+    if (!replayPath.empty()) {
+        if (!cameraPathPlayer.load(replayPath)) {
+            return -1;
+        }
+        replaying = true;
+        if (timingsPath.empty()) {
+            timingsPath = replayPath + ".timings.csv";
+        }
+    }
+    if (!batchPath.empty()) {
+        if (!cameraPathPlayer.load(batchPath)) {
+            return -1;
+        }
+        replaying = true;
+        if (timingsPath.empty()) {
+            timingsPath = batchPrefix + "timings.csv";
+        }
+    }
+
+    WINDOW_WIDTH  = 800;
+    WINDOW_HEIGHT = 600;
+
+    // Software Rendering
+    // ==================
+    // The same scene through the CPU pipeline (softrender.h); no window or
+    // GL context is created. The view is rendered SOFTWARE_FRAMES times
+    // for the throughput report.
+    if (!softwarePath.empty()) {
+        const unsigned int SOFTWARE_FRAMES = 10;
+        JobSystem jobSystem;
+        SoftwareScene scene;
+        boxGeometry(scene.vertices, scene.indices);
+        for (unsigned int i=0; i<NR_CUBES; ++i) {
+            scene.objectMatrices.push_back(randomCubeMatrix());
+        }
+        srand(12);
+        for (unsigned int i=0; i<NR_LIGHTS; ++i) {
+            glm::vec3 lightPosition, lightColor;
+            randomLight(lightPosition, lightColor);
+            scene.lightPositions.push_back(lightPosition);
+            scene.lightColors.push_back(lightColor);
+        }
+        scene.constFalloff = LIGHT_CONST_FALLOFF;
+        scene.linFalloff   = LIGHT_LIN_FALLOFF;
+        scene.quadFalloff  = LIGHT_QUAD_FALLOFF;
+        ssaoSamples(scene.ssaoKernel, scene.ssaoNoise);
+        scene.ambientOcclusion = ambientOcclusionOn;
+        if (!scene.diffuse.load("../learn-opengl/assets/bricks2.jpg")
+            || !scene.normal.load("../learn-opengl/assets/bricks2_normal.jpg")) {
+            return -1;
+        }
+
+        glm::mat4 projectionMatrix = glm::perspective(glm::radians(camera.fov), (GLfloat) WINDOW_WIDTH / (GLfloat) WINDOW_HEIGHT, 0.1f, 15.0f);
+        SoftwareRenderer softwareRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, jobSystem);
+        for (unsigned int i=0; i<SOFTWARE_FRAMES; ++i) {
+            softwareRenderer.render(scene, camera.getViewMatrix(), projectionMatrix);
+        }
+        softwareRenderer.printStats();
+        return softwareRenderer.save(softwarePath) ? 0 : -1;
+    }
+
     // GLFW Setup
     // ==========
     glfwInit();
@@ -63,8 +257,9 @@ int main(int argc, char *argv[])
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-    WINDOW_WIDTH  = 800;
-    WINDOW_HEIGHT = 600;
+    if (!batchPath.empty()) {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    }
 
     // Window Setup
     // ============
@@ -76,6 +271,9 @@ int main(int argc, char *argv[])
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if (replaying) {
+        glfwSwapInterval(0);
+    }
     glfwSetKeyCallback(window, keyCallback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouseCallback);
@@ -93,528 +291,1012 @@ int main(int argc, char *argv[])
     // ==============
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
-    // Geometry Creation
-    // =================
-    Plane plane = Plane();
-    Box light = Box();
-    Box cube = Box();
-    std::vector<glm::mat4> cubeModelMatrices;
-    const unsigned int NR_CUBES = 40;
-    for (unsigned int i=0; i<NR_CUBES; ++i) {
-        float px = ((rand() % 100) / 100.0) * 4.0 - 2.0;
-        float py = ((rand() % 100) / 100.0) * 4.0 - 2.0;
-        float pz = ((rand() % 100) / 100.0) * 4.0 - 2.0;
-        float rx = ((rand() % 100) / 100.0);
-        float ry = ((rand() % 100) / 100.0);
-        float rz = ((rand() % 100) / 100.0);
-        float r  = ((rand() % 100) / 100.0) * 90;
-        float s  = ((rand() % 100) / 100.0);
-        glm::mat4 modelMatrix = glm::mat4();
-        modelMatrix = glm::translate(modelMatrix, glm::vec3(px, py, pz));
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(s));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(r), glm::vec3(rx, ry, rz));
-        cubeModelMatrices.push_back(modelMatrix);
-    }
-
-    // Texture Loading
-    // ===============
-
-    // Brick Diffuse Map
-    // -----------------
-    int floorDiffuseMapImgWidth, floorDiffuseMapImgHeight;
-    const char* floorDiffuseMapImgPath = "../learn-opengl/assets/bricks2.jpg";
-    unsigned char* floorDiffuseMapImg = SOIL_load_image(floorDiffuseMapImgPath, &floorDiffuseMapImgWidth, &floorDiffuseMapImgHeight, 0, SOIL_LOAD_RGB);
-    GLuint floorDiffuseMap;
-    glGenTextures(1, & floorDiffuseMap);
-    glBindTexture(GL_TEXTURE_2D, floorDiffuseMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                 floorDiffuseMapImgWidth, floorDiffuseMapImgHeight,
-                 0, GL_RGB, GL_UNSIGNED_BYTE, floorDiffuseMapImg);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    SOIL_free_image_data(floorDiffuseMapImg);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // Brick Specular Map
-    // ------------------
-    GLuint floorSpecularMap;
-    glGenTextures(1, & floorSpecularMap);
-    glBindTexture(GL_TEXTURE_2D, floorSpecularMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                 100, 100,
-                 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // Brick Normal Map
-    // ----------------
-    int floorNormalMapImgWidth, floorNormalMapImgHeight;
-    const char* floorNormalMapImgPath = "../learn-opengl/assets/bricks2_normal.jpg";
-    unsigned char* floorNormalMapImg = SOIL_load_image(floorNormalMapImgPath, &floorNormalMapImgWidth, &floorNormalMapImgHeight, 0, SOIL_LOAD_RGB);
-    GLuint floorNormalMap;
-    glGenTextures(1, & floorNormalMap);
-    glBindTexture(GL_TEXTURE_2D, floorNormalMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                 floorNormalMapImgWidth, floorNormalMapImgHeight,
-                 0, GL_RGB, GL_UNSIGNED_BYTE, floorNormalMapImg);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    SOIL_free_image_data(floorNormalMapImg);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // Brick Height Map
-    // ----------------
-    int floorHeightMapImgWidth, floorHeightMapImgHeight;
-    const char* floorHeightMapImgPath = "../learn-opengl/assets/bricks2_disp.jpg";
-    unsigned char* floorHeightMapImg = SOIL_load_image(floorHeightMapImgPath, &floorHeightMapImgWidth, &floorHeightMapImgHeight, 0, SOIL_LOAD_RGB);
-    GLuint floorHeightMap;
-    glGenTextures(1, & floorHeightMap);
-    glBindTexture(GL_TEXTURE_2D, floorHeightMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-                 floorHeightMapImgWidth, floorHeightMapImgHeight,
-                 0, GL_RGB, GL_UNSIGNED_BYTE, floorHeightMapImg);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    SOIL_free_image_data(floorHeightMapImg);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // Shader Compilation
-    // ==================
-    Shader shaderDeferredGeom("../learn-opengl/shaders/deferred-geom.vert",
-                              "../learn-opengl/shaders/deferred-geom.frag");
-//    Shader shaderDeferredLight("../learn-opengl/shaders/post.vert",
-//                               "../learn-opengl/shaders/post.frag");
-    Shader shaderDeferredLight("../learn-opengl/shaders/deferred-light.vert",
-                               "../learn-opengl/shaders/deferred-light.frag");
-    Shader shaderForwardConst("../learn-opengl/shaders/base.vert",
-                              "../learn-opengl/shaders/constant.frag");
-    Shader shaderSSAO("../learn-opengl/shaders/screen.vert",
-                      "../learn-opengl/shaders/ssao.frag");
-    Shader shaderSSAOBlur("../learn-opengl/shaders/screen.vert",
-                          "../learn-opengl/shaders/ssao-blur.frag");
-    Shader shaderImage("../learn-opengl/shaders/screen.vert",
-                       "../learn-opengl/shaders/image.frag");
-
-    // Uniform Buffer Setup
-    // ====================
-
-    // Transformation Matrix UBO
-    // -------------------------
-    GLuint uboMatrices;
-    glGenBuffers(1, &uboMatrices);
-    glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-    glBufferData(GL_UNIFORM_BUFFER, 128, NULL, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 128);
-
-    GLuint uboMatricesIndexPhongBase = glGetUniformBlockIndex(shaderDeferredGeom.Program, "Matrices");
-    glUniformBlockBinding(shaderDeferredGeom.Program, uboMatricesIndexPhongBase, 0);
-
-    // Frame Buffer Setup
-    // ==================
+    // Point Shadow Benchmark
+    // ======================
+    if (benchShadows) {
+        {
+            Box cube = Box();
+            benchmarkPointShadows(cube, 2000, 20);
+        }
+        glfwTerminate();
+        return 0;
+    }
 
-    // Geometry Buffer
-    // ---------------
-    GLuint geometryBuffer;
-    glGenFramebuffers(1, &geometryBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, geometryBuffer);
-
-    GLuint geometryPositionBuffer;
-    glGenTextures(1, &geometryPositionBuffer);
-    glBindTexture(GL_TEXTURE_2D, geometryPositionBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, geometryPositionBuffer, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    GLuint geometryNormalBuffer;
-    glGenTextures(1, &geometryNormalBuffer);
-    glBindTexture(GL_TEXTURE_2D, geometryNormalBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, geometryNormalBuffer, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    GLuint geometryAlbedoSpecularBuffer;
-    glGenTextures(1, &geometryAlbedoSpecularBuffer);
-    glBindTexture(GL_TEXTURE_2D, geometryAlbedoSpecularBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, geometryAlbedoSpecularBuffer, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    GLuint sceneRBO;
-    glGenRenderbuffers(1, &sceneRBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, sceneRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, WINDOW_WIDTH, WINDOW_HEIGHT);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, sceneRBO);
-
-    unsigned int attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
-    glDrawBuffers(3, attachments);
-
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // SSAO Setup
-    // ==========
+    // Everything below owning GL objects (meshes, buffers, render targets,
+    // shaders) is scoped to this block, so it is all destroyed while the
+    // context is still current, before glfwTerminate().
+    {
+        // Geometry Creation
+        // =================
+        // The light and cube boxes share one upload (see geometry.h).
+        Plane plane = Plane();
+        Box light = Box();
+        Box cube = Box();
+        printGeometryRegistryStats();
+        const GLfloat CUBE_BOUNDING_RADIUS = 0.87f; // sqrt(3) / 2
+
+        // Scene Transforms
+        // ----------------
+        // Root -> Cubes -> Cube[i]
+        //      -> Lights -> Light[i]
+        TransformHierarchy sceneTransforms;
+        GLuint sceneRoot = sceneTransforms.addNode(TransformHierarchy::NO_PARENT, glm::mat4());
+
+        GLuint cubesNode = sceneTransforms.addNode(sceneRoot, glm::mat4());
+        GLuint firstCubeNode = cubesNode + 1;
+        for (unsigned int i=0; i<NR_CUBES; ++i) {
+            GLuint cubeNode = sceneTransforms.addNode(cubesNode, randomCubeMatrix());
+            sceneTransforms.setBoundingSphere(cubeNode, glm::vec3(0.0f), CUBE_BOUNDING_RADIUS);
+        }
 
-    // Buffer Creation
-    // ---------------
-    GLuint ssaoFBO;
-    glGenFramebuffers(1, &ssaoFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
-
-    GLuint ssaoColorBuffer;
-    glGenTextures(1, &ssaoColorBuffer);
-    glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBuffer, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // Blur Buffer Creation
-    // --------------------
-    GLuint ssaoBlurFBO;
-    glGenFramebuffers(1, &ssaoBlurFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
-
-    GLuint ssaoBlurColorBuffer;
-    glGenTextures(1, &ssaoBlurColorBuffer);
-    glBindTexture(GL_TEXTURE_2D, ssaoBlurColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoBlurColorBuffer, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // Sampling Kernel
-    // ---------------
-    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
-    std::default_random_engine generator;
-    std::vector<glm::vec3> ssaoKernel;
-    for (unsigned int i=0; i<32; ++i) {
-        glm::vec3 sample(randomFloats(generator) * 2.0 - 1.0,
-                         randomFloats(generator) * 2.0 - 1.0,
-                         randomFloats(generator));
-        sample  = glm::normalize(sample);
-        sample *= randomFloats(generator);
-        float scale = (float)i/64.0;
-        scale   = lerp(0.1, 1.0, scale * scale);
-        sample *= scale;
-        ssaoKernel.push_back(sample);
-    }
+        // Job System
+        // ==========
+        // Frame work (culling, transforms, instance matrices) and anything
+        // the render thread waits on go on jobSystem. File reads, decoding
+        // and encoding go on ioJobs: wait() runs whatever is queued, so on a
+        // shared pool the render thread could pick up a whole image decode
+        // while waiting for frame preparation.
+        JobSystem jobSystem;
+        const GLuint IO_THREADS = 3;    // the GL thread and two workers
+        JobSystem ioJobs(IO_THREADS);
+
+        // Texture Loading
+        // ===============
+        // Image textures keep only their coarse mips resident; finer ones are
+        // streamed in from disk as the cubes come close enough to need them.
+        TextureStreamer textureStreamer(ioJobs);
+
+        // Brick Diffuse Map
+        // -----------------
+        const char* floorDiffuseMapImgPath = "../learn-opengl/assets/bricks2.jpg";
+        GLuint floorDiffuseMap = textureStreamer.load(floorDiffuseMapImgPath, "floorDiffuseMap");
+
+        // Brick Normal Map
+        // ----------------
+        const char* floorNormalMapImgPath = "../learn-opengl/assets/bricks2_normal.jpg";
+        GLuint floorNormalMap = textureStreamer.load(floorNormalMapImgPath, "floorNormalMap");
 
-    // Sampling Noise
-    // --------------
-    std::vector<glm::vec3> ssaoNoise;
-    for (unsigned int i=0; i<16; ++i) {
-        glm::vec3 noise(randomFloats(generator) * 2.0 - 1.0,
-                        randomFloats(generator) * 2.0 - 1.0,
-                        0.0);
-        ssaoNoise.push_back(noise);
-    }
-    GLuint ssaoNoiseTexture;
-    glGenTextures(1, &ssaoNoiseTexture);
-    glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-
-    // Post Processing Setup
-    // =====================
-
-    // Screen Geometry Creation
-    // ------------------------
-    GLfloat screenVertices[] = {
-        -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-        -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-         1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-         1.0f, -1.0f, 0.0f, 1.0f, 0.0f
-    };
-    GLuint screenVBO, screenVAO;
-    glGenVertexArrays(1, &screenVAO);
-    glGenBuffers(1, &screenVBO);
-    glBindVertexArray(screenVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, screenVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(screenVertices), &screenVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-    glBindBuffer(GL_BUFFER, 0);
-
-    // Lighting Setup
-    // ==============
-    const unsigned int NR_LIGHTS = 20;
-    std::vector<glm::vec3> lightPositions;
-    std::vector<glm::vec3> lightColors;
-    srand(12);
-    for (unsigned int i=0; i<NR_LIGHTS; ++i) {
-        float x = ((rand() % 100) / 100.0) * 6.0 - 3.0;
-        float y = ((rand() % 100) / 100.0) * 6.0 - 3.0;
-        float z = ((rand() % 100) / 100.0) * 6.0 - 3.0;
-        lightPositions.push_back(glm::vec3(x, y, z));
-        float r = ((rand() % 100) / 100.0);
-        float g = ((rand() % 100) / 100.0);
-        float b = ((rand() % 100) / 100.0);
-        lightColors.push_back(glm::vec3(r, g, b));
-    }
-
-    // Render Loop
-    // ===========
-    while(!glfwWindowShouldClose(window)) {
-
-        glEnable(GL_CULL_FACE);
-
-        // Event Processing
+        // Brick Height Map
+        // ----------------
+        const char* floorHeightMapImgPath = "../learn-opengl/assets/bricks2_disp.jpg";
+        GLuint floorHeightMap = textureStreamer.load(floorHeightMapImgPath, "floorHeightMap");
+
+        // Brick Cone Step Map
+        // -------------------
+        // The height map preprocessed for cone-stepping parallax (cached on disk
+        // next to it); the linear march on floorHeightMap is the fallback.
+        ConeStepMap floorConeStepMapData;
+        bool coneStepMapping = loadConeStepMap(floorHeightMapImgPath, jobSystem, floorConeStepMapData);
+        GLuint floorConeStepMap = coneStepMapping ? createConeStepTexture(floorConeStepMapData) : 0;
+
+        // Scene Loading
+        // =============
+        // Models are imported on job workers and uploaded over the first
+        // frames, within the per-frame upload budget (see sceneloader.h).
+        SceneLoader sceneLoader(ioJobs, uploadBudget);
+        Model* sceneModel = NULL;
+        if (!modelPath.empty()) {
+            sceneLoader.loadModel(modelPath, [&](Model* model) { sceneModel = model; });
+        }
+
+        // Shader Compilation
+        // ==================
+        // Programs are specialized with defines for the active configuration
+        // and built asynchronously: the driver compiles them in parallel (with
+        // KHR_parallel_shader_compile) and each one is finished on first use.
+        const unsigned int SSAO_LOW_KERNEL_SIZE = 8;
+        // Temporal SSAO: a quarter of the kernel per frame, cycling through
+        // interleaved subsets, accumulated over frames.
+        const unsigned int SSAO_TEMPORAL_KERNEL_SIZE = 8;
+        const unsigned int SSAO_TEMPORAL_PHASES = SSAO_KERNEL_SIZE / SSAO_TEMPORAL_KERNEL_SIZE;
+
+        ShaderDefines geomDefines;
+        geomDefines.push_back(shaderDefine("PARALLAX_MAPPING", "1"));
+        geomDefines.push_back(shaderDefine("PARALLAX_LAYERS", 30.0f));
+        geomDefines.push_back(shaderDefine("HEIGHT_SCALE", PARALLAX_HEIGHT_SCALE));
+        if (coneStepMapping) {
+            geomDefines.push_back(shaderDefine("CONE_STEP_MAPPING", "1"));
+        }
+
+        const GLfloat BLOOM_THRESHOLD = 1.0f;
+
+        ShaderDefines lightDefines;
+        lightDefines.push_back(shaderDefine("NR_LIGHTS", (GLint) NR_LIGHTS));
+        lightDefines.push_back(shaderDefine("BLOOM_THRESHOLD", BLOOM_THRESHOLD));
+
+        ShaderDefines constDefines;
+        constDefines.push_back(shaderDefine("BLOOM_THRESHOLD", BLOOM_THRESHOLD));
+
+        ShaderDefines ssaoDefines;
+        ssaoDefines.push_back(shaderDefine("SCREEN_WIDTH", (GLfloat) WINDOW_WIDTH));
+        ssaoDefines.push_back(shaderDefine("SCREEN_HEIGHT", (GLfloat) WINDOW_HEIGHT));
+        ssaoDefines.push_back(shaderDefine("NOISE_SIZE", 4.0f));
+        ShaderDefines ssaoHighDefines = ssaoDefines;
+        ssaoHighDefines.push_back(shaderDefine("KERNEL_SIZE", (GLint) SSAO_KERNEL_SIZE));
+        ShaderDefines ssaoLowDefines = ssaoDefines;
+        ssaoLowDefines.push_back(shaderDefine("KERNEL_SIZE", (GLint) SSAO_LOW_KERNEL_SIZE));
+        ShaderDefines ssaoTemporalDefines = ssaoDefines;
+        ssaoTemporalDefines.push_back(shaderDefine("KERNEL_SIZE", (GLint) SSAO_TEMPORAL_KERNEL_SIZE));
+        ssaoTemporalDefines.push_back(shaderDefine("TEMPORAL", "1"));
+
+        Shader shaderDeferredGeom("../learn-opengl/shaders/deferred-geom.vert",
+                                  "../learn-opengl/shaders/deferred-geom.frag",
+                                  geomDefines, true);
+        Shader shaderDeferredLight("../learn-opengl/shaders/deferred-light.vert",
+                                   "../learn-opengl/shaders/deferred-light.frag",
+                                   lightDefines, true);
+        Shader shaderForwardConst("../learn-opengl/shaders/base.vert",
+                                  "../learn-opengl/shaders/constant.frag",
+                                  constDefines, true);
+        Shader shaderSSAOHigh("../learn-opengl/shaders/screen.vert",
+                              "../learn-opengl/shaders/ssao.frag",
+                              ssaoHighDefines, true);
+        Shader shaderSSAOLow("../learn-opengl/shaders/screen.vert",
+                             "../learn-opengl/shaders/ssao.frag",
+                             ssaoLowDefines, true);
+        Shader shaderSSAOTemporal("../learn-opengl/shaders/screen.vert",
+                                  "../learn-opengl/shaders/ssao.frag",
+                                  ssaoTemporalDefines, true);
+        Shader shaderSSAOResolve("../learn-opengl/shaders/screen.vert",
+                                 "../learn-opengl/shaders/ssao-temporal.frag",
+                                 ShaderDefines(), true);
+        Shader shaderSSAOBlur("../learn-opengl/shaders/screen.vert",
+                              "../learn-opengl/shaders/ssao-blur.frag",
+                              ShaderDefines(), true);
+        Shader shaderImage("../learn-opengl/shaders/screen.vert",
+                           "../learn-opengl/shaders/image.frag",
+                           ShaderDefines(), true);
+        Shader shaderComposite("../learn-opengl/shaders/screen.vert",
+                               "../learn-opengl/shaders/composite.frag",
+                               ShaderDefines(), true);
+        Shader shaderShadowDepth("../learn-opengl/shaders/shadow-depth.vert",
+                                 "../learn-opengl/shaders/shadow-depth.frag",
+                                 ShaderDefines(), true);
+        // The SSAO variant in use; switched only once the requested one is ready.
+        Shader* shaderSSAO = &shaderSSAOHigh;
+        unsigned int ssaoKernelSize = SSAO_KERNEL_SIZE;
+
+        // Uniform Buffer Setup
+        // ====================
+
+        // Per-Frame Upload Ring
+        // ---------------------
+        // Matrices, instance data and lights are written straight into a
+        // triple-buffered, persistently mapped ring each frame (see ringbuffer.h)
+        // and bound with glBindBufferRange.
+        const GLuint MATRICES_BINDING = 0;
+        const GLuint LIGHTS_BINDING   = 1;
+        const GLuint MATERIALS_BINDING = 2;
+        const GLuint INSTANCE_MATERIALS_BINDING = 3;
+        FrameRingBuffer frameUploads(256 * 1024);
+        GLint uniformBufferAlignment;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+
+        // Every block starts out on binding point 0, which is where Matrices
+        // lives; only the other blocks need assigning (doing so waits for the
+        // program to finish linking).
+        bindUniformBlock(shaderDeferredLight, "Lights", LIGHTS_BINDING);
+        bindUniformBlock(shaderDeferredGeom, "Materials", MATERIALS_BINDING);
+        bindUniformBlock(shaderDeferredGeom, "InstanceMaterials", INSTANCE_MATERIALS_BINDING);
+
+        // Cube Materials
+        // ==============
+        // The bricks in CUBE_MATERIALS variants, each with a tint and a
+        // specular map of its own. The specular maps are generated here as
+        // layers of one texture array and the streamed maps are shared, so
+        // every cube is still drawn in one instanced call, picking its
+        // material per instance (see material.h).
+        const GLuint CUBE_MATERIALS = 4;
+        const GLuint SPECULAR_MAP_SIZE = 128;
+        const glm::vec3 CUBE_TINTS[CUBE_MATERIALS] = { glm::vec3(1.0f, 1.0f, 1.0f),
+                                                       glm::vec3(1.0f, 0.8f, 0.65f),
+                                                       glm::vec3(0.7f, 0.8f, 1.0f),
+                                                       glm::vec3(0.55f, 0.55f, 0.55f) };
+        MaterialLibrary materials(MATERIALS_BINDING, INSTANCE_MATERIALS_BINDING);
+        GLuint cubeMaterialIndices[CUBE_MATERIALS];
+        std::mt19937 specularGenerator(7);
+        std::uniform_real_distribution<GLfloat> specularNoise(0.0f, 1.0f);
+        std::vector<GLubyte> specularPixels(SPECULAR_MAP_SIZE * SPECULAR_MAP_SIZE);
+        for (unsigned int i=0; i<CUBE_MATERIALS; ++i) {
+            // Speckled, each variant glossier than the one before.
+            GLfloat gloss = (i + 1.0f) / CUBE_MATERIALS;
+            for (unsigned int j=0; j<specularPixels.size(); ++j) {
+                specularPixels[j] = (GLubyte) (255.0f * gloss * (0.5f + 0.5f * specularNoise(specularGenerator)));
+            }
+            Material material;
+            material.textures[MATERIAL_DIFFUSE]  = materialTexture2D(floorDiffuseMap);
+            material.textures[MATERIAL_SPECULAR] = materials.addLayer(SPECULAR_MAP_SIZE, SPECULAR_MAP_SIZE, GL_R8, GL_RED,
+                                                                      &specularPixels[0], "cubeSpecularMaps");
+            material.textures[MATERIAL_NORMAL]   = materialTexture2D(floorNormalMap);
+            material.textures[MATERIAL_DEPTH]    = materialTexture2D(coneStepMapping ? floorConeStepMap : floorHeightMap);
+            material.tint = CUBE_TINTS[i];
+            material.specular = 1.0f;
+            cubeMaterialIndices[i] = materials.create(material);
+        }
+        materials.build();
+        MaterialLibrary::assignSamplers(shaderDeferredGeom);
+        // A rejected variant (its error printed) is drawn as the first one
+        // created; with none, bindInstances() refuses and no cube is drawn.
+        GLuint fallbackCubeMaterial = MaterialLibrary::NO_MATERIAL;
+        for (unsigned int i=0; i<CUBE_MATERIALS && fallbackCubeMaterial == MaterialLibrary::NO_MATERIAL; ++i) {
+            fallbackCubeMaterial = cubeMaterialIndices[i];
+        }
+        std::vector<GLuint> cubeMaterials(NR_CUBES);
+        for (unsigned int i=0; i<NR_CUBES; ++i) {
+            GLuint index = cubeMaterialIndices[i % CUBE_MATERIALS];
+            cubeMaterials[i] = index != MaterialLibrary::NO_MATERIAL ? index : fallbackCubeMaterial;
+        }
+
+        // Render Graph
+        // ============
+        // The G-buffer, SSAO and HDR scene targets are declared every frame in
+        // the render loop; the graph allocates them, aliasing those whose
+        // lifetimes don't overlap. Its passes live in the frame arena, reset
+        // once the frame is drawn.
+        LinearArena frameArena(64 * 1024);
+        RenderGraph renderGraph(WINDOW_WIDTH, WINDOW_HEIGHT, frameArena);
+
+        // SSAO Setup
+        // ==========
+
+        // Temporal History
         // ----------------
-        glfwPollEvents();
-        doMovement();
-        GLfloat currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // Transformation Matrices
-        // -----------------------
-        glm::mat4 projectionMatrix;
-        glm::mat4 viewMatrix;
-        glm::mat4 viewMatrixInverse;
-        glm::mat4 modelMatrix;
-        glm::mat4 modelViewMatrix;
-        glm::mat4 modelViewMatrixInverseTranspose;
-        glm::mat4 modelViewProjectionMatrix;
-        GLuint viewMatrixInverseLocation;
-        GLuint modelMatrixLocation;
-        GLuint modelViewMatrixLocation;
-        GLuint modelViewMatrixInverseTransposeLocation;
-        GLuint modelViewProjectionMatrixLocation;
-
-        // Geometry Pass
+        // Ping-ponged between frames: accumulated AO and frame count (RG16F),
+        // and the world-space normal and view depth it was computed for
+        // (RGBA16F), to reject history on disocclusion.
+        GLuint ssaoHistoryBuffer[2];
+        GLuint ssaoHistoryGeometryBuffer[2];
+        glGenTextures(2, ssaoHistoryBuffer);
+        glGenTextures(2, ssaoHistoryGeometryBuffer);
+        for (unsigned int i=0; i<2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, ssaoHistoryBuffer[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RG, GL_FLOAT, NULL);
+            trackTexture(ssaoHistoryBuffer[i], GPU_MEMORY_SSAO, "ssaoHistoryBuffer", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RG16F);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            glBindTexture(GL_TEXTURE_2D, ssaoHistoryGeometryBuffer[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+            trackTexture(ssaoHistoryGeometryBuffer[i], GPU_MEMORY_SSAO, "ssaoHistoryGeometryBuffer", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        unsigned int ssaoHistoryCurrent = 0;
+        bool ssaoHistoryValid = false;
+        glm::mat4 previousViewMatrix;
+        glm::mat4 previousViewProjectionMatrix;
+
+        // Sampling Kernel and Noise
+        // -------------------------
+        std::vector<glm::vec3> ssaoKernel;
+        std::vector<glm::vec3> ssaoNoise;
+        ssaoSamples(ssaoKernel, ssaoNoise);
+        GLuint ssaoNoiseTexture;
+        glGenTextures(1, &ssaoNoiseTexture);
+        glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
+        trackTexture(ssaoNoiseTexture, GPU_MEMORY_SSAO, "ssaoNoiseTexture", 4, 4, GL_RGB16F);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+
+        // Post Processing Setup
+        // =====================
+
+        // Screen Geometry Creation
+        // ------------------------
+        GLfloat screenVertices[] = {
+            -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+            -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+             1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+             1.0f, -1.0f, 0.0f, 1.0f, 0.0f
+        };
+        GLuint screenVBO, screenVAO;
+        glGenVertexArrays(1, &screenVAO);
+        glGenBuffers(1, &screenVBO);
+        glBindVertexArray(screenVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, screenVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(screenVertices), &screenVertices, GL_STATIC_DRAW);
+        trackBuffer(screenVBO, GPU_MEMORY_OTHER, "screenVBO", sizeof(screenVertices));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+        glBindBuffer(GL_BUFFER, 0);
+
+        // Bloom
+        // -----
+        Bloom bloom(WINDOW_WIDTH, WINDOW_HEIGHT, bloomLevels);
+        bloom.intensity = bloomIntensity;
+
+        // Auto Exposure
         // -------------
+        AutoExposure autoExposure;
+
+        // Lighting Setup
+        // ==============
+        std::vector<glm::vec3> lightPositions;
+        std::vector<glm::vec3> lightColors;
+        ShadowAtlas shadowAtlas;
+        GLuint lightsNode = sceneTransforms.addNode(sceneRoot, glm::mat4());
+        GLuint firstLightNode = lightsNode + 1;
+        srand(12);
+        for (unsigned int i=0; i<NR_LIGHTS; ++i) {
+            glm::vec3 lightPosition, lightColor;
+            randomLight(lightPosition, lightColor);
+            lightPositions.push_back(lightPosition);
+            lightColors.push_back(lightColor);
+
+            glm::mat4 modelMatrix = glm::mat4();
+            modelMatrix = glm::translate(modelMatrix, lightPositions[i]);
+            modelMatrix = glm::scale(modelMatrix, glm::vec3(0.1f));
+            GLuint lightNode = sceneTransforms.addNode(lightsNode, modelMatrix);
+            sceneTransforms.setBoundingSphere(lightNode, glm::vec3(0.0f), CUBE_BOUNDING_RADIUS);
+
+            // Shadow radius: where the attenuated light drops below 5/256 of
+            // its brightest channel.
+            float brightest = std::max(std::max(lightColor.r, lightColor.g), lightColor.b);
+            float c = LIGHT_CONST_FALLOFF - brightest * 256.0f / 5.0f;
+            float radius = (-LIGHT_LIN_FALLOFF + sqrt(LIGHT_LIN_FALLOFF * LIGHT_LIN_FALLOFF - 4.0f * LIGHT_QUAD_FALLOFF * c))
+                         / (2.0f * LIGHT_QUAD_FALLOFF);
+            shadowAtlas.addLight(lightPositions[i], radius);
+        }
 
-        // Transformation Matrix Computation
-        projectionMatrix = glm::perspective(glm::radians(camera.fov), (GLfloat) WINDOW_WIDTH / (GLfloat) WINDOW_HEIGHT, 0.1f, 15.0f);
-        viewMatrix = camera.getViewMatrix();
-
-        // Transformation Matrix UBO Update
-        glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-        glBufferSubData(GL_UNIFORM_BUFFER,  0, 64, glm::value_ptr(projectionMatrix));
-        glBufferSubData(GL_UNIFORM_BUFFER, 64, 64, glm::value_ptr(viewMatrix));
-
-        // Draw
-        glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, geometryBuffer);
-            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glEnable(GL_DEPTH_TEST);
-
-            shaderDeferredGeom.Use();
-
-                viewMatrixInverse = glm::inverse(viewMatrix);
-                viewMatrixInverseLocation = glGetUniformLocation(shaderDeferredGeom.Program, "viewMatrixInverse");
-                glUniformMatrix4fv(viewMatrixInverseLocation, 1, GL_FALSE, glm::value_ptr(viewMatrixInverse));
-
-                glUniform1i(glGetUniformLocation(shaderDeferredGeom.Program, "material.diffuse"), 0);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, floorDiffuseMap);
-
-                glUniform1i(glGetUniformLocation(shaderDeferredGeom.Program, "material.specular"), 1);
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, floorSpecularMap);
-
-                glUniform1i(glGetUniformLocation(shaderDeferredGeom.Program, "material.normal"), 2);
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, floorNormalMap);
-
-                glUniform1i(glGetUniformLocation(shaderDeferredGeom.Program, "material.depth"), 3);
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, floorHeightMap);
-
-                GLuint materialShininessLoc = glGetUniformLocation(shaderDeferredGeom.Program, "material.shininess");
-                glUniform1f(materialShininessLoc, 32.0f);
-
-                // Draw Cube
-                for (unsigned int i=0; i<NR_CUBES; ++i) {
-                    modelMatrix = cubeModelMatrices[i];
-                    modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -1.0f, 0.0f));
-                    modelMatrix = glm::scale(modelMatrix, glm::vec3(1.0f));
-                    modelMatrix = glm::rotate(modelMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-                    modelMatrixLocation = glGetUniformLocation(shaderDeferredGeom.Program, "modelMatrix");
-                    glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-
-                    modelViewMatrix = viewMatrix * modelMatrix;
-                    modelViewMatrixLocation = glGetUniformLocation(shaderDeferredGeom.Program, "modelViewMatrix");
-                    glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-
-                    modelViewMatrixInverseTranspose = glm::inverse(glm::transpose(viewMatrix * modelMatrix));;
-                    modelViewMatrixInverseTransposeLocation = glGetUniformLocation(shaderDeferredGeom.Program, "modelViewMatrixInverseTranspose");
-                    glUniformMatrix4fv(modelViewMatrixInverseTransposeLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrixInverseTranspose));
-
-                    modelViewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
-                    modelViewProjectionMatrixLocation = glGetUniformLocation(shaderDeferredGeom.Program, "modelViewProjectionMatrix");
-                    glUniformMatrix4fv(modelViewProjectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
-
-                    cube.Draw(shaderDeferredGeom);
+        // Frame Preparation
+        // =================
+        // Transform update, culling and instance matrices run as jobs while this
+        // thread fills the uniform blocks.
+        FramePrep framePrep(&jobSystem, &sceneTransforms);
+        framePrep.setObjects(firstCubeNode, NR_CUBES);
+        framePrep.setLights(firstLightNode, NR_LIGHTS);
+
+        // Instance Buffer Setup
+        // =====================
+        // Cubes are drawn in one instanced call; their matrices are computed in a
+        // batch straight into this buffer.
+        InstanceMatrixBuffer cubeInstances(&frameUploads);
+        // Material of each visible cube, in instance order.
+        std::vector<GLuint> visibleCubeMaterials;
+        visibleCubeMaterials.reserve(NR_CUBES);
+        std::vector<GLuint> shadowCasters;
+
+        // Render Loop
+        // ===========
+        bool shaderStatsPrinted = false;
+        CameraPathRecorder* cameraPathRecorder = NULL;
+        if (!recordPath.empty()) {
+            cameraPathRecorder = new CameraPathRecorder(recordPath);
+        }
+        FrameTimingLog frameTimings;
+        FrameReadback* batchReadback = NULL;
+        if (!batchPath.empty()) {
+            batchReadback = new FrameReadback(ioJobs, WINDOW_WIDTH, WINDOW_HEIGHT, batchPrefix);
+        }
+        const GLfloat REPLAY_TIMESTEP = 1.0f / 60.0f;
+        GLuint frameIndex = 0;
+        GLdouble startTime = glfwGetTime();
+        // Heap allocations per frame, counted once warmed up (pools, caches and
+        // the frame arena have grown to size by then). A steady frame makes
+        // none; streaming and loading assets do.
+        const GLuint HEAP_WARMUP_FRAMES = 120;
+        GLuint heapSteadyFrames = 0;
+        GLuint heapAllocatingFrames = 0;
+        GLuint64 heapMaxFrameAllocations = 0;
+        while(!glfwWindowShouldClose(window)) {
+            GLuint64 heapAllocationsBefore = heapAllocationCount();
+
+            glEnable(GL_CULL_FACE);
+
+            // Event Processing
+            // ----------------
+            if (batchReadback) {
+                // One frame per pose, whatever their timestamps.
+                if (frameIndex == cameraPathPlayer.keyframeCount()) {
+                    break;
+                }
+                GLdouble pathTime = cameraPathPlayer.applyKeyframe(frameIndex, camera);
+                frameTimings.beginFrame(frameIndex, pathTime, glfwGetTime());
+            }
+            else if (replaying) {
+                // Fixed timestep: frame n always shows the path at n / 60 s.
+                GLdouble pathTime = frameIndex * REPLAY_TIMESTEP;
+                if (!cameraPathPlayer.apply(pathTime, camera)) {
+                    break;
                 }
+                frameTimings.beginFrame(frameIndex, pathTime, glfwGetTime());
+            }
+            frameUploads.beginFrame();
+            glfwPollEvents();
+            if (replaying) {
+                deltaTime = REPLAY_TIMESTEP;
+            }
+            else {
+                doMovement();
+                GLfloat currentFrame = glfwGetTime();
+                deltaTime = currentFrame - lastFrame;
+                lastFrame = currentFrame;
+            }
+            if (cameraPathRecorder) {
+                cameraPathRecorder->record(glfwGetTime() - startTime, camera);
+            }
+            frameIndex++;
+
+            // Transformation Matrices
+            // -----------------------
+            glm::mat4 projectionMatrix;
+            glm::mat4 viewMatrix;
+            glm::mat4 viewMatrixInverse;
+            glm::mat4 modelMatrix;
+            glm::mat4 modelViewMatrix;
+            glm::mat4 modelViewProjectionMatrix;
+            GLuint viewMatrixInverseLocation;
+            GLuint modelMatrixLocation;
+            GLuint modelViewMatrixLocation;
+            GLuint modelViewProjectionMatrixLocation;
+
+            // Frame Data
+            // ----------
+
+            // Transformation Matrix Computation
+            projectionMatrix = glm::perspective(glm::radians(camera.fov), (GLfloat) WINDOW_WIDTH / (GLfloat) WINDOW_HEIGHT, 0.1f, 15.0f);
+            viewMatrix = camera.getViewMatrix();
+
+            // Scene Transform Update and Culling
+            // Only subtrees whose local matrices changed are recomputed.
+            framePrep.begin(viewMatrix, projectionMatrix);
+
+            // Transformation Matrix UBO Update
+            RingAllocation matricesBlock = frameUploads.allocate(128, uniformBufferAlignment);
+            if (matricesBlock.data) {
+                memcpy((char*) matricesBlock.data,      glm::value_ptr(projectionMatrix), 64);
+                memcpy((char*) matricesBlock.data + 64, glm::value_ptr(viewMatrix),       64);
+                glBindBufferRange(GL_UNIFORM_BUFFER, MATRICES_BINDING, frameUploads.buffer, matricesBlock.offset, 128);
+            }
 
-        // SSAO Pass
-        // ---------
-        if (ambientOcclusionOn) {
-            glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
-            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-            glClear(GL_COLOR_BUFFER_BIT);
-            shaderSSAO.Use();
-                for (unsigned int i = 0; i < 64; ++i) {
-                    GLuint kernelSampleLocation = glGetUniformLocation(shaderSSAO.Program, ("kernelSamples[" + std::to_string(i) + "]").c_str());
-                    glm::vec3 kernelSample = ssaoKernel[i];
-                    glUniform3f(kernelSampleLocation, kernelSample.x, kernelSample.y, kernelSample.z);
+            // Shadow Tile Sizes
+            shadowAtlas.update(camera.position, camera.fov);
+
+            // Light UBO Update
+            GLsizeiptr lightsBlockSize = NR_LIGHTS * sizeof(DeferredLight);
+            RingAllocation lightsBlock = frameUploads.allocate(lightsBlockSize, uniformBufferAlignment);
+            if (lightsBlock.data) {
+                DeferredLight* lights = (DeferredLight*) lightsBlock.data;
+                for (unsigned int i=0; i<NR_LIGHTS; ++i) {
+                    lights[i].position     = lightPositions[i];
+                    lights[i].color        = lightColors[i];
+                    lights[i].constFalloff = LIGHT_CONST_FALLOFF;
+                    lights[i].linFalloff   = LIGHT_LIN_FALLOFF;
+                    lights[i].quadFalloff  = LIGHT_QUAD_FALLOFF;
+                    lights[i].shadowTile   = shadowAtlas.shadowTile(i);
                 }
-                glBindVertexArray(screenVAO);
-                glUniform1i(glGetUniformLocation(shaderSSAO.Program, "gPosition"), 0);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, geometryPositionBuffer);
-                glUniform1i(glGetUniformLocation(shaderSSAO.Program, "gNormal"), 1);
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, geometryNormalBuffer);
-                glUniform1i(glGetUniformLocation(shaderSSAO.Program, "gAlbedoSpecular"), 2);
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, geometryAlbedoSpecularBuffer);
-                glUniform1i(glGetUniformLocation(shaderSSAO.Program, "kernelRotationTexture"), 3);
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);
-                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-                glBindVertexArray(0);
-            glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
-            glClear(GL_COLOR_BUFFER_BIT);
-            shaderSSAOBlur.Use();
-                glBindVertexArray(screenVAO);
-                glUniform1i(glGetUniformLocation(shaderSSAOBlur.Program, "image"), 0);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-                glBindVertexArray(0);
-        }
-
-        // Lighting Pass
-        // -------------
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(0.1f, 0.2f, 0.2f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glDisable(GL_DEPTH_TEST);
-        shaderDeferredLight.Use();
-            glBindVertexArray(screenVAO);
-
-            glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "gPosition"), 0);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, geometryPositionBuffer);
-
-            glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "gNormal"), 1);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, geometryNormalBuffer);
-
-            glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "gAlbedoSpecular"), 2);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, geometryAlbedoSpecularBuffer);
-
-            glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "ssao"), 3);
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, ssaoBlurColorBuffer);
-
-            GLuint ambientOcclusionSwitchLocation = glGetUniformLocation(shaderDeferredLight.Program, "ambientOcclusionOn");
-            glUniform1f(ambientOcclusionSwitchLocation, ambientOcclusionOn);
-
-            for (unsigned int i=0; i<NR_LIGHTS; ++i) {
-                GLuint lightPositionLocation = glGetUniformLocation(shaderDeferredLight.Program, ("lights[" + std::to_string(i) + "].position").c_str());
-                glUniform3f(lightPositionLocation, lightPositions[i].x, lightPositions[i].y, lightPositions[i].z);
-                GLuint lightColorLocation = glGetUniformLocation(shaderDeferredLight.Program, ("lights[" + std::to_string(i) + "].color").c_str());
-                glUniform3f(lightColorLocation, lightColors[i].x, lightColors[i].y, lightColors[i].z);
-                GLuint lightConstFalloffLocation = glGetUniformLocation(shaderDeferredLight.Program, ("lights[" + std::to_string(i) + "].constFalloff").c_str());
-                glUniform1f(lightConstFalloffLocation, 0.3);
-                GLuint lightLinFalloffLocation = glGetUniformLocation(shaderDeferredLight.Program, ("lights[" + std::to_string(i) + "].linFalloff").c_str());
-                glUniform1f(lightLinFalloffLocation, 0.7);
-                GLuint lightQuadFalloffLocation = glGetUniformLocation(shaderDeferredLight.Program, ("lights[" + std::to_string(i) + "].quadFalloff").c_str());
-                glUniform1f(lightQuadFalloffLocation, 1.8);
+                glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, frameUploads.buffer, lightsBlock.offset, lightsBlockSize);
             }
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-            glBindVertexArray(0);
 
-        // Forward Render Lights
-        // ---------------------
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, geometryBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBlitFramebuffer(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glEnable(GL_DEPTH_TEST);
-        shaderForwardConst.Use();
-            for (unsigned int i=0; i<NR_LIGHTS; ++i) {
-                glm::vec3 lightPosition = lightPositions[i];
-                glm::vec3 lightColor    = lightColors[i];
-
-                modelMatrix = glm::mat4();
-                modelMatrix = glm::translate(modelMatrix, lightPosition);
-                modelMatrix = glm::scale(modelMatrix, glm::vec3(0.1f));
-                modelMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelMatrix");
-                glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-
-                modelViewMatrix = viewMatrix * modelMatrix;
-                modelViewMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelViewMatrix");
-                glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-
-                modelViewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
-                modelViewProjectionMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelViewProjectionMatrix");
-                glUniformMatrix4fv(modelViewProjectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
-
-                GLuint lightColorLocation = glGetUniformLocation(shaderForwardConst.Program, "color");
-                glUniform3f(lightColorLocation, lightColor.r, lightColor.g, lightColor.b);
-
-                cube.Draw(shaderForwardConst);
+            // Cube Instance Matrices
+            GLuint visibleCubes = framePrep.visibleObjects().size();
+            if (visibleCubes > 0) {
+                ObjectMatrixArrays instanceMatrices = cubeInstances.allocate(visibleCubes);
+                framePrep.computeInstances(instanceMatrices, NORMAL_MATRIX_UNIFORM_SCALE);
+                if (instanceMatrices.modelView) {
+                    cubeInstances.attach(cube.VAO);
+                }
+                else {
+                    visibleCubes = 0;
+                }
+            }
+
+            // Cube Instance Materials
+            if (visibleCubes > 0) {
+                visibleCubeMaterials.clear();
+                for (unsigned int i=0; i<visibleCubes; ++i) {
+                    visibleCubeMaterials.push_back(cubeMaterials[framePrep.visibleObjects()[i] - firstCubeNode]);
+                }
+                if (!materials.bindInstances(frameUploads, uniformBufferAlignment, visibleCubeMaterials)) {
+                    visibleCubes = 0;
+                }
             }
+            framePrep.finish();
+            frameUploads.flush();
+
+            // Texture Streaming
+            // Every brick map is needed down to the mip the nearest visible cube
+            // samples; the box maps its texture once per unit face.
+            GLfloat projectionScale = WINDOW_HEIGHT / (2.0f * tan(glm::radians(camera.fov) * 0.5f));
+            const std::vector<GLuint>& visibleObjects = framePrep.visibleObjects();
+            for (unsigned int i=0; i<visibleObjects.size(); ++i) {
+                const glm::mat4& cubeMatrix = sceneTransforms.worldMatrix(visibleObjects[i]);
+                GLfloat cubeScale = glm::length(glm::vec3(cubeMatrix[0]));
+                GLfloat cubeDistance = glm::length(glm::vec3(cubeMatrix[3]) - camera.position) - CUBE_BOUNDING_RADIUS * cubeScale;
+                textureStreamer.request(floorDiffuseMap, cubeDistance, 1.0f / cubeScale, projectionScale);
+                textureStreamer.request(floorNormalMap, cubeDistance, 1.0f / cubeScale, projectionScale);
+                // The cone step map replaces the height map when there is one.
+                if (!coneStepMapping) {
+                    textureStreamer.request(floorHeightMap, cubeDistance, 1.0f / cubeScale, projectionScale);
+                }
+            }
+            textureStreamer.update();
+            sceneLoader.update();
+
+            // Frame Graph
+            // ===========
+            // Declared every frame, so culling follows the current toggles
+            // (SSAO is only kept while lighting or the texture view reads it).
+            renderGraph.begin();
+            RenderGraph::Resource gPosition = renderGraph.createTexture("gPosition", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F, GL_LINEAR, GPU_MEMORY_GBUFFER);
+            RenderGraph::Resource gNormal = renderGraph.createTexture("gNormal", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F, GL_LINEAR, GPU_MEMORY_GBUFFER);
+            RenderGraph::Resource gAlbedoSpecular = renderGraph.createTexture("gAlbedoSpecular", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA8, GL_LINEAR, GPU_MEMORY_GBUFFER);
+            RenderGraph::Resource sceneDepth = renderGraph.createTexture("sceneDepth", WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH24_STENCIL8, GL_NEAREST, GPU_MEMORY_GBUFFER);
+            RenderGraph::Resource ssao = renderGraph.createTexture("ssao", WINDOW_WIDTH, WINDOW_HEIGHT, GL_R8, GL_NEAREST, GPU_MEMORY_SSAO);
+            RenderGraph::Resource ssaoBlurred = renderGraph.createTexture("ssaoBlurred", WINDOW_WIDTH, WINDOW_HEIGHT, GL_R8, GL_NEAREST, GPU_MEMORY_SSAO);
+            RenderGraph::Resource sceneColor = renderGraph.createTexture("sceneColor", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F, GL_LINEAR, GPU_MEMORY_POST);
+            RenderGraph::Resource sceneBright = renderGraph.createTexture("sceneBright", WINDOW_WIDTH, WINDOW_HEIGHT, GL_R11F_G11F_B10F, GL_LINEAR, GPU_MEMORY_POST);
+            RenderGraph::Resource shadowMap = renderGraph.importTexture("shadowAtlas", shadowAtlas.texture,
+                                                                        shadowAtlas.size(), shadowAtlas.size(), GL_DEPTH_COMPONENT16);
+
+            // Shadow Pass
+            // -----------
+            // Only lights whose tile is stale are re-rendered: the light or its
+            // tile changed, or a cube moved within its radius.
+            RenderGraph::Pass shadowPass = renderGraph.addPass("Shadow", [&]() {
+                shadowAtlas.objectsMoved(sceneTransforms, firstCubeNode, firstCubeNode + NR_CUBES);
+                const std::vector<GLuint>& shadowRenders = shadowAtlas.collectRenders();
+                if (shadowRenders.empty()) {
+                    return;
+                }
+                shadowAtlas.beginRender();
+                glDisable(GL_CULL_FACE);
+                shaderShadowDepth.Use();
+                GLuint shadowModelMatrixLocation = glGetUniformLocation(shaderShadowDepth.Program, "modelMatrix");
+                GLuint shadowViewProjectionLocation = glGetUniformLocation(shaderShadowDepth.Program, "lightViewProjectionMatrix");
+                for (unsigned int i=0; i<shadowRenders.size(); ++i) {
+                    GLuint l = shadowRenders[i];
+                    glm::vec4 tile = shadowAtlas.shadowTile(l);
+                    glUniform3fv(glGetUniformLocation(shaderShadowDepth.Program, "lightPosition"), 1, glm::value_ptr(lightPositions[l]));
+                    glUniform1f(glGetUniformLocation(shaderShadowDepth.Program, "lightRadius"), tile.w);
+                    for (unsigned int face=0; face<6; ++face) {
+                        shadowAtlas.bindFace(l, face);
+                        glm::mat4 faceViewProjection = shadowAtlas.faceViewProjection(l, face);
+                        glUniformMatrix4fv(shadowViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(faceViewProjection));
+                        shadowCasters.clear();
+                        sceneTransforms.cull(faceViewProjection, firstCubeNode, firstCubeNode + NR_CUBES, shadowCasters);
+                        for (unsigned int j=0; j<shadowCasters.size(); ++j) {
+                            glUniformMatrix4fv(shadowModelMatrixLocation, 1, GL_FALSE, glm::value_ptr(sceneTransforms.worldMatrix(shadowCasters[j])));
+                            cube.DrawDepth();
+                        }
+                    }
+                }
+                shadowAtlas.endRender();
+                glEnable(GL_CULL_FACE);
+            });
+            renderGraph.write(shadowPass, shadowMap);
+
+            // Geometry Pass
+            // -------------
+            RenderGraph::Pass geometryPass = renderGraph.addPass("Geometry", [&]() {
+                // Late Latch
+                // Everything above used the camera as of glfwPollEvents. Sample
+                // the cursor once more and, if it moved, redo the view-dependent
+                // uploads (culling keeps the slightly older frustum).
+                if (lateLatch && !replaying) {
+                    double xPos, yPos;
+                    glfwGetCursorPos(window, &xPos, &yPos);
+                    if (!firstMouseMovement && (xPos != mouseXLast || yPos != mouseYLast)) {
+                        applyMouseMovement(xPos, yPos);
+                        latency.inputLatched(glfwGetTime());
+                        viewMatrix = camera.getViewMatrix();
+                        matricesBlock = frameUploads.allocate(128, uniformBufferAlignment);
+                        if (matricesBlock.data) {
+                            memcpy((char*) matricesBlock.data,      glm::value_ptr(projectionMatrix), 64);
+                            memcpy((char*) matricesBlock.data + 64, glm::value_ptr(viewMatrix),       64);
+                            glBindBufferRange(GL_UNIFORM_BUFFER, MATRICES_BINDING, frameUploads.buffer, matricesBlock.offset, 128);
+                        }
+                        if (visibleCubes > 0) {
+                            ObjectMatrixArrays instanceMatrices = cubeInstances.allocate(visibleCubes);
+                            framePrep.latchView(viewMatrix);
+                            framePrep.computeInstances(instanceMatrices, NORMAL_MATRIX_UNIFORM_SCALE);
+                            framePrep.finish();
+                            if (instanceMatrices.modelView) {
+                                cubeInstances.attach(cube.VAO);
+                            }
+                        }
+                        frameUploads.flush();
+                    }
+                }
 
-        // Draw Texture
-        // ------------
-        if (visualizeTexture) {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glDisable(GL_DEPTH_TEST);
-            glClear(GL_COLOR_BUFFER_BIT);
-            shaderImage.Use();
-                glBindVertexArray(screenVAO);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, ssaoBlurColorBuffer);
-                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-                glBindVertexArray(0);
+                // Draw
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glEnable(GL_DEPTH_TEST);
+
+                shaderDeferredGeom.Use();
+
+                    viewMatrixInverse = glm::inverse(viewMatrix);
+                    viewMatrixInverseLocation = glGetUniformLocation(shaderDeferredGeom.Program, "viewMatrixInverse");
+                    glUniformMatrix4fv(viewMatrixInverseLocation, 1, GL_FALSE, glm::value_ptr(viewMatrixInverse));
+
+                    // Draw Cube
+                    // Every cube material binds the same textures; each
+                    // instance's layers and tint come from its record.
+                    if (visibleCubes) {
+                        materials.bindTextures(visibleCubeMaterials[0]);
+                        cube.DrawInstanced(shaderDeferredGeom, visibleCubes);
+                    }
+            });
+            renderGraph.writeColor(geometryPass, gPosition, 0);
+            renderGraph.writeColor(geometryPass, gNormal, 1);
+            renderGraph.writeColor(geometryPass, gAlbedoSpecular, 2);
+            renderGraph.writeDepthStencil(geometryPass, sceneDepth);
+
+            // SSAO Pass
+            // ---------
+            // Swap SSAO variants only once the requested one has finished
+            // compiling, so a quality change never stalls the frame.
+            Shader* requestedSSAO = ssaoTemporal ? &shaderSSAOTemporal
+                                  : ssaoHighQuality ? &shaderSSAOHigh : &shaderSSAOLow;
+            if (requestedSSAO != shaderSSAO && requestedSSAO->isReady()) {
+                shaderSSAO = requestedSSAO;
+                ssaoKernelSize = ssaoTemporal ? SSAO_TEMPORAL_KERNEL_SIZE
+                               : ssaoHighQuality ? SSAO_KERNEL_SIZE : SSAO_LOW_KERNEL_SIZE;
+                ssaoHistoryValid = false;
+            }
+            bool ssaoTemporalActive = shaderSSAO == &shaderSSAOTemporal;
+            RenderGraph::Pass ssaoPass = renderGraph.addPass("SSAO", [&]() {
+                glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                shaderSSAO->Use();
+                    // Temporal: this frame's interleaved subset of the kernel
+                    // (every SSAO_TEMPORAL_PHASES-th sample, so each subset
+                    // spans all radii) and a golden-angle noise rotation.
+                    unsigned int kernelPhase = ssaoTemporalActive ? frameIndex % SSAO_TEMPORAL_PHASES : 0;
+                    unsigned int kernelStride = ssaoTemporalActive ? SSAO_TEMPORAL_PHASES : 1;
+                    for (unsigned int i = 0; i < ssaoKernelSize; ++i) {
+                        char kernelSampleName[32];
+                        snprintf(kernelSampleName, sizeof(kernelSampleName), "kernelSamples[%u]", i);
+                        GLuint kernelSampleLocation = glGetUniformLocation(shaderSSAO->Program, kernelSampleName);
+                        glm::vec3 kernelSample = ssaoKernel[i * kernelStride + kernelPhase];
+                        glUniform3f(kernelSampleLocation, kernelSample.x, kernelSample.y, kernelSample.z);
+                    }
+                    if (ssaoTemporalActive) {
+                        glUniform1f(glGetUniformLocation(shaderSSAO->Program, "kernelRotation"), (frameIndex % 1024) * 2.39996323f);
+                    }
+                    glBindVertexArray(screenVAO);
+                    glUniform1i(glGetUniformLocation(shaderSSAO->Program, "gPosition"), 0);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gPosition));
+                    glUniform1i(glGetUniformLocation(shaderSSAO->Program, "gNormal"), 1);
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gNormal));
+                    glUniform1i(glGetUniformLocation(shaderSSAO->Program, "gAlbedoSpecular"), 2);
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gAlbedoSpecular));
+                    glUniform1i(glGetUniformLocation(shaderSSAO->Program, "kernelRotationTexture"), 3);
+                    glActiveTexture(GL_TEXTURE3);
+                    glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                    glBindVertexArray(0);
+            });
+            renderGraph.read(ssaoPass, gPosition);
+            renderGraph.read(ssaoPass, gNormal);
+            renderGraph.read(ssaoPass, gAlbedoSpecular);
+            renderGraph.writeColor(ssaoPass, ssao, 0);
+
+            // Temporal Resolve
+            // Accumulate into this frame's history, reprojecting the previous
+            // frame's.
+            RenderGraph::Resource ssaoBlurSource = ssao;
+            bool ssaoResolved = false;
+            if (ssaoTemporalActive) {
+                unsigned int ssaoHistoryPrevious = ssaoHistoryCurrent;
+                unsigned int ssaoHistoryNext = 1 - ssaoHistoryCurrent;
+                RenderGraph::Resource historyIn = renderGraph.importTexture("ssaoHistory", ssaoHistoryBuffer[ssaoHistoryPrevious],
+                                                                            WINDOW_WIDTH, WINDOW_HEIGHT, GL_RG16F);
+                RenderGraph::Resource historyGeometryIn = renderGraph.importTexture("ssaoHistoryGeometry", ssaoHistoryGeometryBuffer[ssaoHistoryPrevious],
+                                                                                    WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F);
+                RenderGraph::Resource historyOut = renderGraph.importTexture("ssaoHistory", ssaoHistoryBuffer[ssaoHistoryNext],
+                                                                             WINDOW_WIDTH, WINDOW_HEIGHT, GL_RG16F);
+                RenderGraph::Resource historyGeometryOut = renderGraph.importTexture("ssaoHistoryGeometry", ssaoHistoryGeometryBuffer[ssaoHistoryNext],
+                                                                                     WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F);
+                RenderGraph::Pass ssaoResolvePass = renderGraph.addPass("SSAO Resolve", [&, historyIn, historyGeometryIn, ssaoHistoryNext]() {
+                    shaderSSAOResolve.Use();
+                        glBindVertexArray(screenVAO);
+                        glUniform1i(glGetUniformLocation(shaderSSAOResolve.Program, "currentAO"), 0);
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_2D, renderGraph.texture(ssao));
+                        glUniform1i(glGetUniformLocation(shaderSSAOResolve.Program, "gPosition"), 1);
+                        glActiveTexture(GL_TEXTURE1);
+                        glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gPosition));
+                        glUniform1i(glGetUniformLocation(shaderSSAOResolve.Program, "gNormal"), 2);
+                        glActiveTexture(GL_TEXTURE2);
+                        glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gNormal));
+                        glUniform1i(glGetUniformLocation(shaderSSAOResolve.Program, "historyAO"), 3);
+                        glActiveTexture(GL_TEXTURE3);
+                        glBindTexture(GL_TEXTURE_2D, renderGraph.texture(historyIn));
+                        glUniform1i(glGetUniformLocation(shaderSSAOResolve.Program, "historyGeometry"), 4);
+                        glActiveTexture(GL_TEXTURE4);
+                        glBindTexture(GL_TEXTURE_2D, renderGraph.texture(historyGeometryIn));
+                        glUniformMatrix4fv(glGetUniformLocation(shaderSSAOResolve.Program, "inverseViewMatrix"),
+                                           1, GL_FALSE, glm::value_ptr(viewMatrixInverse));
+                        glUniformMatrix4fv(glGetUniformLocation(shaderSSAOResolve.Program, "previousViewMatrix"),
+                                           1, GL_FALSE, glm::value_ptr(previousViewMatrix));
+                        glUniformMatrix4fv(glGetUniformLocation(shaderSSAOResolve.Program, "previousViewProjectionMatrix"),
+                                           1, GL_FALSE, glm::value_ptr(previousViewProjectionMatrix));
+                        glUniform1i(glGetUniformLocation(shaderSSAOResolve.Program, "historyValid"), ssaoHistoryValid);
+                        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                        glBindVertexArray(0);
+                    ssaoHistoryCurrent = ssaoHistoryNext;
+                    ssaoResolved = true;
+                });
+                renderGraph.read(ssaoResolvePass, ssao);
+                renderGraph.read(ssaoResolvePass, gPosition);
+                renderGraph.read(ssaoResolvePass, gNormal);
+                renderGraph.read(ssaoResolvePass, historyIn);
+                renderGraph.read(ssaoResolvePass, historyGeometryIn);
+                renderGraph.writeColor(ssaoResolvePass, historyOut, 0);
+                renderGraph.writeColor(ssaoResolvePass, historyGeometryOut, 1);
+                ssaoBlurSource = historyOut;
+            }
 
-        }
+            // Blur
+            RenderGraph::Pass ssaoBlurPass = renderGraph.addPass("SSAO Blur", [&]() {
+                glClear(GL_COLOR_BUFFER_BIT);
+                shaderSSAOBlur.Use();
+                    glBindVertexArray(screenVAO);
+                    glUniform1i(glGetUniformLocation(shaderSSAOBlur.Program, "image"), 0);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(ssaoBlurSource));
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                    glBindVertexArray(0);
+            });
+            renderGraph.read(ssaoBlurPass, ssaoBlurSource);
+            renderGraph.writeColor(ssaoBlurPass, ssaoBlurred, 0);
+
+            // Lighting Pass
+            // -------------
+            RenderGraph::Pass lightingPass = renderGraph.addPass("Lighting", [&]() {
+                glClearColor(0.1f, 0.2f, 0.2f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                glDisable(GL_DEPTH_TEST);
+                shaderDeferredLight.Use();
+                    glBindVertexArray(screenVAO);
+
+                    glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "gPosition"), 0);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gPosition));
+
+                    glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "gNormal"), 1);
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gNormal));
+
+                    glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "gAlbedoSpecular"), 2);
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(gAlbedoSpecular));
+
+                    glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "ssao"), 3);
+                    glActiveTexture(GL_TEXTURE3);
+                    glBindTexture(GL_TEXTURE_2D, ambientOcclusionOn ? renderGraph.texture(ssaoBlurred) : 0);
+
+                    glUniform1i(glGetUniformLocation(shaderDeferredLight.Program, "shadowAtlas"), 4);
+                    glActiveTexture(GL_TEXTURE4);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(shadowMap));
+
+                    GLuint ambientOcclusionSwitchLocation = glGetUniformLocation(shaderDeferredLight.Program, "ambientOcclusionOn");
+                    glUniform1f(ambientOcclusionSwitchLocation, ambientOcclusionOn);
+
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                    glBindVertexArray(0);
+            });
+            renderGraph.read(lightingPass, gPosition);
+            renderGraph.read(lightingPass, gNormal);
+            renderGraph.read(lightingPass, gAlbedoSpecular);
+            if (ambientOcclusionOn) {
+                renderGraph.read(lightingPass, ssaoBlurred);
+            }
+            renderGraph.read(lightingPass, shadowMap);
+            renderGraph.writeColor(lightingPass, sceneColor, 0);
+            renderGraph.writeColor(lightingPass, sceneBright, 1);
+
+            // Forward Render Lights
+            // ---------------------
+            // Still into the scene targets, depth-tested against the geometry
+            // pass depth.
+            RenderGraph::Pass forwardPass = renderGraph.addPass("Forward Lights", [&]() {
+                glEnable(GL_DEPTH_TEST);
+                shaderForwardConst.Use();
+                    const std::vector<GLuint>& visibleLights = framePrep.visibleLights();
+                    for (unsigned int i=0; i<visibleLights.size(); ++i) {
+                        glm::vec3 lightColor = lightColors[visibleLights[i] - firstLightNode];
+
+                        modelMatrix = sceneTransforms.worldMatrix(visibleLights[i]);
+                        modelMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelMatrix");
+                        glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+
+                        modelViewMatrix = viewMatrix * modelMatrix;
+                        modelViewMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelViewMatrix");
+                        glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
+
+                        modelViewProjectionMatrix = projectionMatrix * modelViewMatrix;
+                        modelViewProjectionMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelViewProjectionMatrix");
+                        glUniformMatrix4fv(modelViewProjectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
+
+                        GLuint lightColorLocation = glGetUniformLocation(shaderForwardConst.Program, "color");
+                        glUniform3f(lightColorLocation, lightColor.r, lightColor.g, lightColor.b);
+
+                        light.Draw(shaderForwardConst);
+                    }
+
+                    // Streamed Model
+                    // Unlit, like the lights; a box until it's resident.
+                    if (!modelPath.empty()) {
+                        GLuint modelColorLocation = glGetUniformLocation(shaderForwardConst.Program, "color");
+                        glUniform3f(modelColorLocation, 0.6f, 0.6f, 0.6f);
+                        if (sceneModel) {
+                            sceneModel->Draw(shaderForwardConst, glm::mat4(), viewMatrix, projectionMatrix);
+                        }
+                        else {
+                            modelMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelMatrix");
+                            glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(glm::mat4()));
+                            modelViewMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelViewMatrix");
+                            glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+                            modelViewProjectionMatrix = projectionMatrix * viewMatrix;
+                            modelViewProjectionMatrixLocation = glGetUniformLocation(shaderForwardConst.Program, "modelViewProjectionMatrix");
+                            glUniformMatrix4fv(modelViewProjectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
+                            light.Draw(shaderForwardConst);
+                        }
+                    }
+            });
+            renderGraph.read(forwardPass, sceneColor);
+            renderGraph.read(forwardPass, sceneBright);
+            renderGraph.read(forwardPass, sceneDepth);
+            renderGraph.writeColor(forwardPass, sceneColor, 0);
+            renderGraph.writeColor(forwardPass, sceneBright, 1);
+            renderGraph.writeDepthStencil(forwardPass, sceneDepth);
+
+            // Bloom, Exposure and Composite
+            // -----------------------------
+            RenderGraph::Pass compositePass = renderGraph.addPass("Composite", [&]() {
+                glDisable(GL_DEPTH_TEST);
+                GLuint bloomTexture = bloomOn ? bloom.apply(renderGraph.texture(sceneBright), screenVAO)
+                                              : renderGraph.texture(sceneBright);
+                if (exposureReset) {
+                    autoExposure.reset();
+                    exposureReset = false;
+                }
+                if (autoExposureOn) {
+                    autoExposure.update(renderGraph.texture(sceneColor), screenVAO, deltaTime);
+                    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+                }
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                shaderComposite.Use();
+                    glBindVertexArray(screenVAO);
+
+                    glUniform1i(glGetUniformLocation(shaderComposite.Program, "scene"), 0);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.texture(sceneColor));
+
+                    glUniform1i(glGetUniformLocation(shaderComposite.Program, "bloom"), 1);
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, bloomTexture);
+
+                    glUniform1i(glGetUniformLocation(shaderComposite.Program, "adaptedLuminance"), 2);
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, autoExposure.luminanceTexture());
+
+                    glUniform1f(glGetUniformLocation(shaderComposite.Program, "bloomIntensity"),
+                                bloomOn ? bloom.intensity : 0.0f);
+                    glUniform1i(glGetUniformLocation(shaderComposite.Program, "autoExposureOn"), autoExposureOn);
+                    glUniform1f(glGetUniformLocation(shaderComposite.Program, "keyValue"), autoExposure.keyValue);
+                    glUniform1f(glGetUniformLocation(shaderComposite.Program, "minExposure"), autoExposure.minExposure);
+                    glUniform1f(glGetUniformLocation(shaderComposite.Program, "maxExposure"), autoExposure.maxExposure);
+
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                    glBindVertexArray(0);
+                glEnable(GL_DEPTH_TEST);
+            });
+            renderGraph.read(compositePass, sceneColor);
+            renderGraph.read(compositePass, sceneBright);
+            renderGraph.writeScreen(compositePass);
+
+            // Draw Texture
+            // ------------
+            if (visualizeTexture) {
+                RenderGraph::Pass visualizePass = renderGraph.addPass("Draw Texture", [&]() {
+                    glDisable(GL_DEPTH_TEST);
+                    glClear(GL_COLOR_BUFFER_BIT);
+                    shaderImage.Use();
+                        glBindVertexArray(screenVAO);
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_2D, renderGraph.texture(ssaoBlurred));
+                        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                        glBindVertexArray(0);
+                });
+                renderGraph.read(visualizePass, ssaoBlurred);
+                renderGraph.writeScreen(visualizePass);
+            }
 
-        glfwSwapBuffers(window);
-    }
+            renderGraph.compile();
+            renderGraph.execute();
+            renderGraph.end();
+            frameArena.reset();
+            ssaoHistoryValid = ssaoResolved;
+            previousViewMatrix = viewMatrix;
+            previousViewProjectionMatrix = projectionMatrix * viewMatrix;
+
+            if (replaying) {
+                frameTimings.endFrame();
+            }
+            if (batchReadback) {
+                batchReadback->capture(frameIndex - 1);
+            }
+            glfwSwapBuffers(window);
+            latency.frameSwapped(glfwGetTime());
+            frameUploads.endFrame();
+            if (batchReadback) {
+                batchReadback->poll();
+            }
+
+            if (!shaderStatsPrinted) {
+                printProgramCacheStats();
+                printGpuMemoryReport();
+                textureStreamer.printStats();
+                shaderStatsPrinted = true;
+            }
 
-    // Clean Up
-    // ========
+            if (frameIndex > HEAP_WARMUP_FRAMES) {
+                GLuint64 heapAllocations = heapAllocationCount() - heapAllocationsBefore;
+                heapSteadyFrames++;
+                heapAllocatingFrames += heapAllocations > 0;
+                heapMaxFrameAllocations = std::max(heapMaxFrameAllocations, heapAllocations);
+            }
+        }
+        // The last frame ends where the next one would have begun.
+        GLdouble loopEndTime = glfwGetTime();
+
+        // Clean Up
+        // ========
+        latency.report();
+        if (replaying && frameTimings.write(timingsPath, loopEndTime)) {
+            std::cout << "CAMERA_PATH::REPLAYED " << frameIndex << " frames, timings in " << timingsPath << std::endl;
+        }
+        delete cameraPathRecorder;
+        if (batchReadback) {
+            batchReadback->finish();
+            batchReadback->printStats();
+            delete batchReadback;
+        }
+        sceneLoader.printStats();
+        materials.printStats();
+        delete sceneModel;
+        std::cout << "HEAP:: " << heapAllocatingFrames << " of " << heapSteadyFrames
+                  << " frames after warm-up allocated (at most " << heapMaxFrameAllocations
+                  << " allocations), frame arena peak " << frameArena.peak() / 1024.0 << " of "
+                  << frameArena.capacity() / 1024.0 << " KB" << std::endl;
+        printGpuMemoryReport();
+
+        GLuint mainTextures[] = { ssaoHistoryBuffer[0], ssaoHistoryBuffer[1],
+                                  ssaoHistoryGeometryBuffer[0], ssaoHistoryGeometryBuffer[1],
+                                  ssaoNoiseTexture };
+        for (unsigned int i=0; i<sizeof(mainTextures) / sizeof(mainTextures[0]); ++i) {
+            untrackTexture(mainTextures[i]);
+        }
+        glDeleteTextures(sizeof(mainTextures) / sizeof(mainTextures[0]), mainTextures);
+        if (floorConeStepMap) {
+            untrackTexture(floorConeStepMap);
+            glDeleteTextures(1, &floorConeStepMap);
+        }
+        untrackBuffer(screenVBO);
+        glDeleteBuffers(1, &screenVBO);
+        glDeleteVertexArrays(1, &screenVAO);
+    }
+    // Anything those objects didn't release is reported.
+    printGpuMemoryLeaks();
     glfwTerminate();
 
     // Exit
@@ -641,6 +1323,7 @@ void doMovement() {
 }
 
 void keyCallback(GLFWwindow* window, int key, int scandcode, int action, int mode) {
+    latency.inputEvent(glfwGetTime());
     if (action == GLFW_PRESS) {
         keys[key] = true;
     }
@@ -679,9 +1362,42 @@ void keyCallback(GLFWwindow* window, int key, int scandcode, int action, int mod
     if (key == GLFW_KEY_G && action == GLFW_PRESS) {
         ambientOcclusionOn ^= true;
     }
+    // "H" Key toggles between the high and low quality SSAO variants.
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        ssaoHighQuality ^= true;
+    }
+    // "B" Key toggles bloom.
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        bloomOn ^= true;
+    }
+    // "X" Key toggles automatic exposure; turning it back on re-meters
+    // without adapting.
+    if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+        autoExposureOn ^= true;
+        exposureReset = autoExposureOn;
+    }
+    // "J" Key toggles temporal SSAO (a quarter of the kernel per frame,
+    // accumulated over frames).
+    if (key == GLFW_KEY_J && action == GLFW_PRESS) {
+        ssaoTemporal ^= true;
+    }
+    // "L" Key toggles late latching of the camera.
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        lateLatch ^= true;
+        latency.report();
+        std::cout << "LATENCY::LATE_LATCH " << (lateLatch ? "ON" : "OFF") << std::endl;
+    }
 }
 
 void mouseCallback(GLFWwindow* window, double xPos, double yPos) {
+    if (replaying) {
+        return;
+    }
+    latency.inputEvent(glfwGetTime());
+    applyMouseMovement(xPos, yPos);
+}
+
+void applyMouseMovement(double xPos, double yPos) {
     if (firstMouseMovement) {
         mouseXLast = xPos;
         mouseYLast = yPos;
@@ -700,9 +1416,20 @@ void mouseCallback(GLFWwindow* window, double xPos, double yPos) {
 }
 
 void scrollCallback(GLFWwindow* window, double xOff, double yOff) {
+    if (replaying) {
+        return;
+    }
+    latency.inputEvent(glfwGetTime());
     camera.processMouseScroll(yOff);
 }
 
+void bindUniformBlock(const Shader& shader, const char* blockName, GLuint bindingPoint) {
+    GLuint blockIndex = glGetUniformBlockIndex(shader.Program, blockName);
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.Program, blockIndex, bindingPoint);
+    }
+}
+
 float clip(float a, float min, float max) {
     return a <= min ? min : a >= max ? max : a;
 }
@@ -710,3 +1437,58 @@ float clip(float a, float min, float max) {
 float lerp(float a, float b, float f) {
     return a + f*(b - a);
 }
+
+// Scene generation, shared by the GL and software renderers: cubes draw
+// from rand()'s default sequence, lights from the one after srand(12).
+glm::mat4 randomCubeMatrix() {
+    float px = ((rand() % 100) / 100.0) * 4.0 - 2.0;
+    float py = ((rand() % 100) / 100.0) * 4.0 - 2.0;
+    float pz = ((rand() % 100) / 100.0) * 4.0 - 2.0;
+    float rx = ((rand() % 100) / 100.0);
+    float ry = ((rand() % 100) / 100.0);
+    float rz = ((rand() % 100) / 100.0);
+    float r  = ((rand() % 100) / 100.0) * 90;
+    float s  = ((rand() % 100) / 100.0);
+    glm::mat4 modelMatrix = glm::mat4();
+    modelMatrix = glm::translate(modelMatrix, glm::vec3(px, py, pz));
+    modelMatrix = glm::scale(modelMatrix, glm::vec3(s));
+    modelMatrix = glm::rotate(modelMatrix, glm::radians(r), glm::vec3(rx, ry, rz));
+    modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -1.0f, 0.0f));
+    modelMatrix = glm::rotate(modelMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    return modelMatrix;
+}
+
+void randomLight(glm::vec3& position, glm::vec3& color) {
+    float x = ((rand() % 100) / 100.0) * 6.0 - 3.0;
+    float y = ((rand() % 100) / 100.0) * 6.0 - 3.0;
+    float z = ((rand() % 100) / 100.0) * 6.0 - 3.0;
+    position = glm::vec3(x, y, z);
+    float r = ((rand() % 100) / 100.0);
+    float g = ((rand() % 100) / 100.0);
+    float b = ((rand() % 100) / 100.0);
+    color = glm::vec3(r, g, b);
+}
+
+// SSAO_KERNEL_SIZE hemisphere samples, denser near the origin, and 4 x 4
+// rotation vectors in the tangent plane.
+void ssaoSamples(std::vector<glm::vec3>& kernel, std::vector<glm::vec3>& noise) {
+    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
+    std::default_random_engine generator;
+    for (unsigned int i=0; i<SSAO_KERNEL_SIZE; ++i) {
+        glm::vec3 sample(randomFloats(generator) * 2.0 - 1.0,
+                         randomFloats(generator) * 2.0 - 1.0,
+                         randomFloats(generator));
+        sample  = glm::normalize(sample);
+        sample *= randomFloats(generator);
+        float scale = (float)i/64.0;
+        scale   = lerp(0.1, 1.0, scale * scale);
+        sample *= scale;
+        kernel.push_back(sample);
+    }
+    for (unsigned int i=0; i<16; ++i) {
+        glm::vec3 rotation(randomFloats(generator) * 2.0 - 1.0,
+                           randomFloats(generator) * 2.0 - 1.0,
+                           0.0);
+        noise.push_back(rotation);
+    }
+}
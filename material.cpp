@@ -0,0 +1,280 @@
+#include "material.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "gpumemory.h"
+
+const GLenum MATERIAL_SLOT_TARGETS[MATERIAL_SLOTS] = {
+    GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D, GL_TEXTURE_2D
+};
+
+MaterialTexture materialTexture2D(GLuint texture)
+{
+    MaterialTexture materialTexture = { GL_TEXTURE_2D, texture, 0 };
+    return materialTexture;
+}
+
+MaterialLibrary::MaterialLibrary(GLuint materialsBinding, GLuint instancesBinding)
+    : materialsBinding(materialsBinding)
+    , instancesBinding(instancesBinding)
+    , materialsBuffer(0)
+    , built(false)
+    , draws(0)
+    , drawsMerged(0)
+    , bindsSaved(0)
+    , materialDraws(MAX_MATERIALS, 0)
+{
+    this->drawMaterials.reserve(MAX_MATERIALS);
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+    for (GLuint i = 0; i < this->arrays.size(); i++) {
+        if (this->built) {
+            untrackTexture(this->arrays[i].texture);
+        }
+        glDeleteTextures(1, &this->arrays[i].texture);
+    }
+    if (this->materialsBuffer) {
+        untrackBuffer(this->materialsBuffer);
+        glDeleteBuffers(1, &this->materialsBuffer);
+    }
+}
+
+// Creation
+// --------
+
+GLuint MaterialLibrary::texelBytes(GLenum format)
+{
+    switch (format) {
+    case GL_RED:  return 1;
+    case GL_RG:   return 2;
+    case GL_RGB:  return 3;
+    default:      return 4;
+    }
+}
+
+MaterialTexture MaterialLibrary::addLayer(GLuint width, GLuint height, GLenum internalFormat, GLenum format,
+                                          const GLubyte* pixels, const char* label)
+{
+    MaterialTexture layer = { GL_TEXTURE_2D_ARRAY, 0, 0 };
+    if (this->built) {
+        std::cout << "ERROR::MATERIAL::LAYER_AFTER_BUILD " << label << std::endl;
+        return layer;
+    }
+
+    GLuint index = 0;
+    while (index < this->arrays.size()
+           && !(this->arrays[index].width == width && this->arrays[index].height == height
+                && this->arrays[index].internalFormat == internalFormat)) {
+        index++;
+    }
+    if (index == this->arrays.size()) {
+        TextureArray array;
+        glGenTextures(1, &array.texture);
+        array.label = label;
+        array.width = width;
+        array.height = height;
+        array.internalFormat = internalFormat;
+        array.format = format;
+        array.layers = 0;
+        this->arrays.push_back(array);
+    }
+    TextureArray& array = this->arrays[index];
+    if (format != array.format) {
+        std::cout << "ERROR::MATERIAL::LAYER_FORMAT_MISMATCH " << label << std::endl;
+        return layer;
+    }
+
+    GLsizeiptr layerBytes = (GLsizeiptr) width * height * texelBytes(format);
+    array.pixels.insert(array.pixels.end(), pixels, pixels + layerBytes);
+    layer.texture = array.texture;
+    layer.layer = array.layers++;
+    return layer;
+}
+
+GLuint MaterialLibrary::create(const Material& material)
+{
+    if (this->materials.size() == MAX_MATERIALS) {
+        std::cout << "ERROR::MATERIAL::TOO_MANY_MATERIALS" << std::endl;
+        return NO_MATERIAL;
+    }
+    for (GLuint i = 0; i < MATERIAL_SLOTS; i++) {
+        if (!material.textures[i].texture) {
+            std::cout << "ERROR::MATERIAL::NO_TEXTURE slot " << i << std::endl;
+            return NO_MATERIAL;
+        }
+        if (material.textures[i].target != MATERIAL_SLOT_TARGETS[i]) {
+            std::cout << "ERROR::MATERIAL::SLOT_TARGET_MISMATCH slot " << i << std::endl;
+            return NO_MATERIAL;
+        }
+    }
+    this->materials.push_back(material);
+    GLuint index = this->materials.size() - 1;
+    if (this->built) {
+        this->uploadRecord(index);
+    }
+    return index;
+}
+
+const Material& MaterialLibrary::material(GLuint index) const
+{
+    return this->materials[index];
+}
+
+void MaterialLibrary::build()
+{
+    for (GLuint i = 0; i < this->arrays.size(); i++) {
+        TextureArray& array = this->arrays[i];
+        // Rows of 1- and 3-byte texels aren't 4-byte aligned.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, array.internalFormat, array.width, array.height, array.layers,
+                     0, array.format, GL_UNSIGNED_BYTE, &array.pixels[0]);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        trackTexture(array.texture, GPU_MEMORY_MATERIAL, array.label, array.width, array.height,
+                     array.internalFormat, 0, array.layers);
+        std::vector<GLubyte>().swap(array.pixels);
+    }
+
+    glGenBuffers(1, &this->materialsBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, this->materialsBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialRecord), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    trackBuffer(this->materialsBuffer, GPU_MEMORY_MATERIAL, "material records",
+                MAX_MATERIALS * sizeof(MaterialRecord));
+    glBindBufferBase(GL_UNIFORM_BUFFER, this->materialsBinding, this->materialsBuffer);
+    this->built = true;
+    for (GLuint i = 0; i < this->materials.size(); i++) {
+        this->uploadRecord(i);
+    }
+}
+
+void MaterialLibrary::uploadRecord(GLuint index)
+{
+    const Material& material = this->materials[index];
+    MaterialRecord record;
+    for (GLuint i = 0; i < MATERIAL_SLOTS; i++) {
+        record.layers[i] = material.textures[i].layer;
+    }
+    record.tint = material.tint;
+    record.specular = material.specular;
+    glBindBuffer(GL_UNIFORM_BUFFER, this->materialsBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, index * sizeof(MaterialRecord), sizeof(MaterialRecord), &record);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void MaterialLibrary::assignSamplers(Shader& shader)
+{
+    static const char* SAMPLER_NAMES[MATERIAL_SLOTS] = {
+        "material.diffuse", "material.specular", "material.normal", "material.depth"
+    };
+    shader.Use();
+    for (GLuint i = 0; i < MATERIAL_SLOTS; i++) {
+        glUniform1i(glGetUniformLocation(shader.Program, SAMPLER_NAMES[i]), i);
+    }
+}
+
+// Drawing
+// -------
+
+bool MaterialLibrary::sameTexture(const MaterialTexture& a, const MaterialTexture& b)
+{
+    return a.target == b.target && a.texture == b.texture;
+}
+
+bool MaterialLibrary::batchable(GLuint a, GLuint b) const
+{
+    for (GLuint i = 0; i < MATERIAL_SLOTS; i++) {
+        if (!sameTexture(this->materials[a].textures[i], this->materials[b].textures[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MaterialLibrary::bindTextures(GLuint material) const
+{
+    const Material& bound = this->materials[material];
+    for (GLuint i = 0; i < MATERIAL_SLOTS; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(bound.textures[i].target, bound.textures[i].texture);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+bool MaterialLibrary::bindInstances(FrameRingBuffer& ring, GLint alignment, const std::vector<GLuint>& materials)
+{
+    if (materials.empty() || materials.size() > MAX_INSTANCES) {
+        return false;
+    }
+    for (GLuint i = 0; i < materials.size(); i++) {
+        if (materials[i] >= this->materials.size() || !this->batchable(materials[0], materials[i])) {
+            return false;
+        }
+    }
+    RingAllocation block = ring.allocate(MAX_INSTANCES * sizeof(GLint), alignment);
+    if (!block.data) {
+        return false;
+    }
+    // std140 packs the ivec4 array tightly: instance i is int i.
+    GLint* instanceMaterials = (GLint*) block.data;
+    this->draws++;
+    this->drawMaterials.clear();
+    for (GLuint i = 0; i < materials.size(); i++) {
+        instanceMaterials[i] = materials[i];
+        if (this->materialDraws[materials[i]] != this->draws) {
+            this->materialDraws[materials[i]] = this->draws;
+            this->drawMaterials.push_back(materials[i]);
+        }
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, this->instancesBinding, ring.buffer, block.offset, block.size);
+
+    // Drawn one material at a time, each draw would rebind every slot whose
+    // layer the previous material doesn't share (a texture of its own,
+    // without arrays).
+    this->drawsMerged += this->drawMaterials.size() - 1;
+    for (GLuint i = 1; i < this->drawMaterials.size(); i++) {
+        const Material& previous = this->materials[this->drawMaterials[i - 1]];
+        const Material& next = this->materials[this->drawMaterials[i]];
+        for (GLuint j = 0; j < MATERIAL_SLOTS; j++) {
+            this->bindsSaved += previous.textures[j].layer != next.textures[j].layer;
+        }
+    }
+    return true;
+}
+
+MaterialStats MaterialLibrary::stats() const
+{
+    MaterialStats stats;
+    stats.materials = this->materials.size();
+    stats.arrays = this->arrays.size();
+    stats.layers = 0;
+    stats.arrayBytes = 0;
+    for (GLuint i = 0; i < this->arrays.size(); i++) {
+        const TextureArray& array = this->arrays[i];
+        stats.layers += array.layers;
+        stats.arrayBytes += gpuTextureBytes(array.width, array.height, array.internalFormat, 0, array.layers);
+    }
+    stats.draws = this->draws;
+    stats.drawsMerged = this->drawsMerged;
+    stats.bindsSaved = this->bindsSaved;
+    return stats;
+}
+
+void MaterialLibrary::printStats() const
+{
+    MaterialStats stats = this->stats();
+    GLdouble draws = std::max(stats.draws, 1u);
+    std::cout << "MATERIALS:: " << stats.materials << " materials, " << stats.layers << " layers in "
+              << stats.arrays << " texture arrays (" << stats.arrayBytes / 1048576.0 << " MB); per batched draw ("
+              << stats.draws << "): " << stats.drawsMerged / draws << " draws merged, "
+              << stats.bindsSaved / draws << " texture binds saved" << std::endl;
+}
@@ -0,0 +1,168 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "ringbuffer.h"
+
+// Materials
+// =========
+// A material is resolved once, when it is created: the texture each slot
+// samples, on a sampler unit fixed per slot (the slot's index), and its
+// parameters. Drawing with it looks nothing up by name.
+//
+// Textures of one size and format are packed as layers of a single
+// GL_TEXTURE_2D_ARRAY (addLayer), so materials that differ only in
+// layers and parameters bind the same textures. Their records (layer per
+// slot, parameters) sit in the `Materials` uniform block, and each
+// instance of a draw picks its material from `InstanceMaterials`
+// (shaders/common/materials.glsl): differently textured instances are
+// drawn in one call (bindInstances).
+//
+// Streamed textures (TextureStreamer) stay 2D textures of their own, as
+// each needs its own base level; every material sharing one still
+// batches.
+//
+// Each slot's sampler type is fixed in deferred-geom.frag, so each slot
+// takes one target (MATERIAL_SLOT_TARGETS): the specular maps are array
+// layers, the diffuse, normal and depth maps the streamed 2D textures.
+// create() rejects a material with a texture of another target in a slot.
+enum MaterialSlot {
+    MATERIAL_DIFFUSE,
+    MATERIAL_SPECULAR,
+    MATERIAL_NORMAL,
+    MATERIAL_DEPTH,
+    MATERIAL_SLOTS
+};
+
+// GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY per slot, as sampled by
+// deferred-geom.frag.
+extern const GLenum MATERIAL_SLOT_TARGETS[MATERIAL_SLOTS];
+
+// What a slot samples: a 2D texture, or one layer of an array.
+struct MaterialTexture {
+    GLenum target;      // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+    GLuint texture;
+    GLuint layer;       // 0 for 2D textures
+};
+
+MaterialTexture materialTexture2D(GLuint texture);
+
+struct Material {
+    MaterialTexture textures[MATERIAL_SLOTS];
+    glm::vec3 tint;     // multiplies the diffuse texture
+    GLfloat specular;   // multiplies the specular texture
+};
+
+// std140 layout of `MaterialRecord` in the `Materials` block.
+struct MaterialRecord {
+    GLint layers[MATERIAL_SLOTS];
+    glm::vec3 tint;
+    GLfloat specular;
+};
+
+struct MaterialStats {
+    GLuint materials;
+    GLuint arrays;
+    GLuint layers;
+    GLsizeiptr arrayBytes;
+    GLuint draws;               // instanced draws through bindInstances
+    GLuint64 drawsMerged;       // draws saved against one per material
+    GLuint64 bindsSaved;        // texture binds saved, likewise
+};
+
+class MaterialLibrary
+{
+public:
+    // Sizes of the blocks in materials.glsl.
+    static const GLuint MAX_MATERIALS = 64;
+    static const GLuint MAX_INSTANCES = 1024;
+    static const GLuint NO_MATERIAL = ~0u;
+
+    // The `Materials` / `InstanceMaterials` blocks are bound to these
+    // binding points.
+    MaterialLibrary(GLuint materialsBinding, GLuint instancesBinding);
+    ~MaterialLibrary();
+
+    // Creation
+    // --------
+    // A layer of the array of `width` x `height` `internalFormat` textures
+    // (created with its first layer), to be filled with `pixels` (`format`,
+    // GL_UNSIGNED_BYTE, copied) by build(). `label` must be a string
+    // literal (see trackTexture).
+    MaterialTexture addLayer(GLuint width, GLuint height, GLenum internalFormat, GLenum format,
+                             const GLubyte* pixels, const char* label);
+    // The material's index, as instances refer to it. NO_MATERIAL (with
+    // an error printed) if a slot has no texture (a failed addLayer()) or
+    // one not of the slot's target, or there are MAX_MATERIALS already.
+    GLuint create(const Material& material);
+    const Material& material(GLuint index) const;
+    // Allocate and fill the arrays (mipmapped, repeat-wrapped, trilinear)
+    // and upload the material records. Once, after the last addLayer();
+    // materials created later are uploaded as they come.
+    void build();
+
+    // Point `shader`'s material.diffuse / .specular / .normal / .depth
+    // samplers at their slots' units. Once per program; waits for it to
+    // finish linking.
+    static void assignSamplers(Shader& shader);
+
+    // Drawing
+    // -------
+    // Whether `a` and `b` bind the same textures, so their instances can
+    // share a draw.
+    bool batchable(GLuint a, GLuint b) const;
+    // Bind `material`'s textures, slot i to unit i.
+    void bindTextures(GLuint material) const;
+    // The materials of one instanced draw, instance i drawn with
+    // `materials[i]`: written to this frame's part of `ring` and bound as
+    // `InstanceMaterials`, and counted in the stats. False, with nothing
+    // bound, if one isn't a material (NO_MATERIAL), they don't all batch
+    // with the first, there are more than MAX_INSTANCES, or the ring is
+    // full.
+    bool bindInstances(FrameRingBuffer& ring, GLint alignment, const std::vector<GLuint>& materials);
+
+    MaterialStats stats() const;
+    // Per draw averages of the merged draws and saved binds.
+    void printStats() const;
+
+private:
+    struct TextureArray {
+        GLuint texture;
+        const char* label;
+        GLuint width, height;
+        GLenum internalFormat;
+        GLenum format;
+        GLuint layers;
+        std::vector<GLubyte> pixels;    // every layer, until build()
+    };
+
+    GLuint materialsBinding;
+    GLuint instancesBinding;
+    std::vector<TextureArray> arrays;
+    std::vector<Material> materials;
+    GLuint materialsBuffer;
+    bool built;
+
+    // Stats
+    GLuint draws;
+    GLuint64 drawsMerged;
+    GLuint64 bindsSaved;
+    // The last draw each material was seen in, and a draw's distinct
+    // materials in order of first use (reused, sized up front).
+    std::vector<GLuint> materialDraws;
+    std::vector<GLuint> drawMaterials;
+
+    static GLuint texelBytes(GLenum format);
+    static bool sameTexture(const MaterialTexture& a, const MaterialTexture& b);
+    void uploadRecord(GLuint index);
+
+    MaterialLibrary(const MaterialLibrary&);
+    MaterialLibrary& operator=(const MaterialLibrary&);
+};
+
+#endif // MATERIAL_H
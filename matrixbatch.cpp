@@ -0,0 +1,283 @@
+#include "matrixbatch.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE__) || defined(_M_X64)
+#define MATRIXBATCH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+static const GLuint MAT4_FLOATS = 16;
+static const GLuint MAT3_FLOATS = 9;
+
+// Kernels
+// =======
+
+#ifdef MATRIXBATCH_SSE
+
+// r = a * b, all column-major.
+static inline void multiply(const __m128 a[4], const GLfloat* b, __m128 r[4])
+{
+    for (int j = 0; j < 4; j++) {
+        __m128 column = _mm_mul_ps(a[0], _mm_set1_ps(b[4 * j + 0]));
+        column = _mm_add_ps(column, _mm_mul_ps(a[1], _mm_set1_ps(b[4 * j + 1])));
+        column = _mm_add_ps(column, _mm_mul_ps(a[2], _mm_set1_ps(b[4 * j + 2])));
+        column = _mm_add_ps(column, _mm_mul_ps(a[3], _mm_set1_ps(b[4 * j + 3])));
+        r[j] = column;
+    }
+}
+
+// (y, z, x, w) ordering for cross products.
+static inline __m128 yzx(__m128 v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static inline __m128 cross(__m128 a, __m128 b)
+{
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, yzx(b)), _mm_mul_ps(yzx(a), b));
+    return yzx(c);
+}
+
+static inline GLfloat dot3(__m128 a, __m128 b)
+{
+    GLfloat p[4];
+    _mm_storeu_ps(p, _mm_mul_ps(a, b));
+    return p[0] + p[1] + p[2];
+}
+
+static inline void storeVec3(GLfloat* dst, __m128 v)
+{
+    _mm_storel_pi((__m64*) dst, v);
+    _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+void computeObjectMatrices(const glm::mat4* modelMatrices,
+                           const GLuint* indices,
+                           GLuint count,
+                           const glm::mat4& viewMatrix,
+                           const glm::mat4& projectionMatrix,
+                           NormalMatrixMode normalMode,
+                           ObjectMatrixArrays out)
+{
+    glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+    __m128 view[4], viewProjection[4];
+    for (int i = 0; i < 4; i++) {
+        view[i] = _mm_loadu_ps(&viewMatrix[i][0]);
+        viewProjection[i] = _mm_loadu_ps(&viewProjectionMatrix[i][0]);
+    }
+
+    for (GLuint i = 0; i < count; i++) {
+        const GLfloat* model = glm::value_ptr(modelMatrices[indices ? indices[i] : i]);
+        __m128 modelView[4], modelViewProjection[4];
+        multiply(view, model, modelView);
+        multiply(viewProjection, model, modelViewProjection);
+
+        GLfloat* mv  = out.modelView + i * MAT4_FLOATS;
+        GLfloat* mvp = out.modelViewProjection + i * MAT4_FLOATS;
+        for (int j = 0; j < 4; j++) {
+            _mm_storeu_ps(mv + 4 * j, modelView[j]);
+            _mm_storeu_ps(mvp + 4 * j, modelViewProjection[j]);
+        }
+
+        // Normal Matrix
+        __m128 n0, n1, n2;
+        if (normalMode == NORMAL_MATRIX_UNIFORM_SCALE) {
+            __m128 inverseScale2 = _mm_set1_ps(1.0f / dot3(modelView[0], modelView[0]));
+            n0 = _mm_mul_ps(modelView[0], inverseScale2);
+            n1 = _mm_mul_ps(modelView[1], inverseScale2);
+            n2 = _mm_mul_ps(modelView[2], inverseScale2);
+        }
+        else {
+            // inverse(M)^T = cofactor(M) / det(M); the cofactor columns are
+            // the cross products of the other two columns.
+            n0 = cross(modelView[1], modelView[2]);
+            n1 = cross(modelView[2], modelView[0]);
+            n2 = cross(modelView[0], modelView[1]);
+            __m128 inverseDet = _mm_set1_ps(1.0f / dot3(modelView[0], n0));
+            n0 = _mm_mul_ps(n0, inverseDet);
+            n1 = _mm_mul_ps(n1, inverseDet);
+            n2 = _mm_mul_ps(n2, inverseDet);
+        }
+        GLfloat* normal = out.normal + i * MAT3_FLOATS;
+        storeVec3(normal + 0, n0);
+        storeVec3(normal + 3, n1);
+        storeVec3(normal + 6, n2);
+    }
+}
+
+#else
+
+void computeObjectMatrices(const glm::mat4* modelMatrices,
+                           const GLuint* indices,
+                           GLuint count,
+                           const glm::mat4& viewMatrix,
+                           const glm::mat4& projectionMatrix,
+                           NormalMatrixMode normalMode,
+                           ObjectMatrixArrays out)
+{
+    glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+    for (GLuint i = 0; i < count; i++) {
+        const glm::mat4& modelMatrix = modelMatrices[indices ? indices[i] : i];
+        glm::mat4 modelView = viewMatrix * modelMatrix;
+        glm::mat4 modelViewProjection = viewProjectionMatrix * modelMatrix;
+        glm::vec3 c0 = glm::vec3(modelView[0]);
+        glm::vec3 c1 = glm::vec3(modelView[1]);
+        glm::vec3 c2 = glm::vec3(modelView[2]);
+        glm::vec3 n0, n1, n2;
+        if (normalMode == NORMAL_MATRIX_UNIFORM_SCALE) {
+            GLfloat inverseScale2 = 1.0f / glm::dot(c0, c0);
+            n0 = c0 * inverseScale2;
+            n1 = c1 * inverseScale2;
+            n2 = c2 * inverseScale2;
+        }
+        else {
+            n0 = glm::cross(c1, c2);
+            n1 = glm::cross(c2, c0);
+            n2 = glm::cross(c0, c1);
+            GLfloat inverseDet = 1.0f / glm::dot(c0, n0);
+            n0 *= inverseDet;
+            n1 *= inverseDet;
+            n2 *= inverseDet;
+        }
+        const GLfloat* mv  = glm::value_ptr(modelView);
+        const GLfloat* mvp = glm::value_ptr(modelViewProjection);
+        for (GLuint j = 0; j < MAT4_FLOATS; j++) {
+            out.modelView[i * MAT4_FLOATS + j] = mv[j];
+            out.modelViewProjection[i * MAT4_FLOATS + j] = mvp[j];
+        }
+        GLfloat* normal = out.normal + i * MAT3_FLOATS;
+        for (int j = 0; j < 3; j++) {
+            normal[0 + j] = n0[j];
+            normal[3 + j] = n1[j];
+            normal[6 + j] = n2[j];
+        }
+    }
+}
+
+#endif
+
+// Instance Buffer
+// ===============
+
+InstanceMatrixBuffer::InstanceMatrixBuffer(FrameRingBuffer* ring)
+    : ring(ring)
+    , offset(0)
+    , count(0)
+{
+}
+
+ObjectMatrixArrays InstanceMatrixBuffer::allocate(GLuint count)
+{
+    RingAllocation allocation = this->ring->allocate(count * (2 * MAT4_FLOATS + MAT3_FLOATS) * sizeof(GLfloat),
+                                                     4 * sizeof(GLfloat));
+    GLfloat* data = (GLfloat*) allocation.data;
+    this->offset = allocation.offset;
+    this->count  = data ? count : 0;
+
+    ObjectMatrixArrays arrays = { NULL, NULL, NULL };
+    if (data) {
+        arrays.modelView           = data;
+        arrays.modelViewProjection = data + count * MAT4_FLOATS;
+        arrays.normal              = data + 2 * count * MAT4_FLOATS;
+    }
+    return arrays;
+}
+
+void InstanceMatrixBuffer::attach(GLuint VAO)
+{
+    GLintptr modelViewOffset           = this->offset;
+    GLintptr modelViewProjectionOffset = this->offset + this->count * MAT4_FLOATS * sizeof(GLfloat);
+    GLintptr normalOffset              = this->offset + 2 * this->count * MAT4_FLOATS * sizeof(GLfloat);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->ring->buffer);
+
+        for (GLuint column = 0; column < 4; column++) {
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                                  (GLvoid*) (modelViewOffset + column * 4 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribDivisor(5 + column, 1);
+
+            glVertexAttribPointer(9 + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+                                  (GLvoid*) (modelViewProjectionOffset + column * 4 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(9 + column);
+            glVertexAttribDivisor(9 + column, 1);
+        }
+        for (GLuint column = 0; column < 3; column++) {
+            glVertexAttribPointer(13 + column, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat),
+                                  (GLvoid*) (normalOffset + column * 3 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(13 + column);
+            glVertexAttribDivisor(13 + column, 1);
+        }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+// Benchmark
+// =========
+
+void benchmarkObjectMatrices(GLuint objectCount, GLuint iterations)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    std::vector<glm::mat4> modelMatrices;
+    srand(7);
+    for (GLuint i = 0; i < objectCount; i++) {
+        glm::mat4 modelMatrix = glm::mat4();
+        modelMatrix = glm::translate(modelMatrix, glm::vec3(rand() % 100, rand() % 100, rand() % 100));
+        modelMatrix = glm::scale(modelMatrix, glm::vec3((rand() % 100) / 100.0f + 0.1f));
+        modelMatrix = glm::rotate(modelMatrix, glm::radians((GLfloat) (rand() % 360)), glm::vec3(0.3f, 0.5f, 0.8f));
+        modelMatrices.push_back(modelMatrix);
+    }
+    glm::mat4 viewMatrix = glm::lookAt(glm::vec3(0.0f, 0.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 15.0f);
+
+    std::vector<GLfloat> modelView(objectCount * MAT4_FLOATS);
+    std::vector<GLfloat> modelViewProjection(objectCount * MAT4_FLOATS);
+    std::vector<GLfloat> normal(objectCount * MAT3_FLOATS);
+    ObjectMatrixArrays out = { &modelView[0], &modelViewProjection[0], &normal[0] };
+
+    // Per-object glm path, as the render loop used to do it, on the same
+    // prebuilt model matrices as the batched paths.
+    GLfloat checksum = 0.0f;
+    Clock::time_point start = Clock::now();
+    for (GLuint n = 0; n < iterations; n++) {
+        for (GLuint i = 0; i < objectCount; i++) {
+            glm::mat4 modelViewMatrix = viewMatrix * modelMatrices[i];
+            glm::mat4 modelViewMatrixInverseTranspose = glm::inverse(glm::transpose(modelViewMatrix));
+            glm::mat4 modelViewProjectionMatrix = projectionMatrix * modelViewMatrix;
+            checksum += modelViewMatrix[3][0] + modelViewMatrixInverseTranspose[0][0] + modelViewProjectionMatrix[3][3];
+        }
+    }
+    double glmTime = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (GLuint n = 0; n < iterations; n++) {
+        computeObjectMatrices(&modelMatrices[0], NULL, objectCount, viewMatrix, projectionMatrix,
+                              NORMAL_MATRIX_GENERAL, out);
+        checksum += modelView[0];
+    }
+    double batchTime = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (GLuint n = 0; n < iterations; n++) {
+        computeObjectMatrices(&modelMatrices[0], NULL, objectCount, viewMatrix, projectionMatrix,
+                              NORMAL_MATRIX_UNIFORM_SCALE, out);
+        checksum += modelView[0];
+    }
+    double uniformTime = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    GLdouble perObject = 1.0 / ((GLdouble) objectCount * iterations);
+    std::cout << "BENCHMARK::OBJECT_MATRICES " << objectCount << " objects x " << iterations << " iterations" << std::endl;
+    std::cout << "    glm per-object:        " << glmTime * perObject << " ns/object" << std::endl;
+    std::cout << "    batched (general):     " << batchTime * perObject << " ns/object" << std::endl;
+    std::cout << "    batched (uniform scale): " << uniformTime * perObject << " ns/object" << std::endl;
+    std::cout << "    (checksum " << checksum << ")" << std::endl;
+}
@@ -0,0 +1,74 @@
+#ifndef MATRIXBATCH_H
+#define MATRIXBATCH_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "ringbuffer.h"
+
+// Batched Object Matrices
+// =======================
+// Computes the per-object matrices the geometry shaders need --- model-view,
+// model-view-projection and the 3x3 normal matrix --- for a whole array of
+// model matrices at once, with SSE where available. Results are written as
+// three separate streams (structure of arrays), which is also the layout of
+// InstanceMatrixBuffer, so the kernel can write straight into mapped memory.
+
+// How the normal matrix (inverse-transpose of the model-view 3x3) is derived.
+enum NormalMatrixMode {
+    // Cofactor 3x3 inverse-transpose; correct for any affine model matrix.
+    NORMAL_MATRIX_GENERAL,
+    // Model matrices are rotation * uniform scale only, so the
+    // inverse-transpose is just the model-view 3x3 divided by the scale^2.
+    NORMAL_MATRIX_UNIFORM_SCALE
+};
+
+// Destination streams, 16 / 16 / 9 floats per object (column-major).
+struct ObjectMatrixArrays {
+    GLfloat* modelView;
+    GLfloat* modelViewProjection;
+    GLfloat* normal;
+};
+
+// Compute matrices for `count` objects. When `indices` is non-null the
+// model matrices are gathered as modelMatrices[indices[i]] (e.g. a culled
+// list of TransformHierarchy nodes); output i is always written densely.
+void computeObjectMatrices(const glm::mat4* modelMatrices,
+                           const GLuint* indices,
+                           GLuint count,
+                           const glm::mat4& viewMatrix,
+                           const glm::mat4& projectionMatrix,
+                           NormalMatrixMode normalMode,
+                           ObjectMatrixArrays out);
+
+// Per-Instance Matrices
+// =====================
+// Each frame's matrices are allocated from the frame's upload ring as the
+// three streams back to back:
+//   [ modelView x count | modelViewProjection x count | normal x count ]
+// attach() points a VAO's instanced attributes at them:
+//   location  5- 8  mat4 instanceModelView
+//   location  9-12  mat4 instanceModelViewProjection
+//   location 13-15  mat3 instanceNormalMatrix
+class InstanceMatrixBuffer
+{
+public:
+    InstanceMatrixBuffer(FrameRingBuffer* ring);
+    // Allocate this frame's streams for `count` instances. The returned
+    // pointers are NULL if the ring is out of space.
+    ObjectMatrixArrays allocate(GLuint count);
+    // Re-point the instanced attributes of `VAO` at this frame's streams.
+    void attach(GLuint VAO);
+private:
+    FrameRingBuffer* ring;
+    GLintptr offset;
+    GLuint count;
+};
+
+// Time the per-object glm path used by the render loop against the batched
+// kernel and print the per-object cost of each.
+void benchmarkObjectMatrices(GLuint objectCount, GLuint iterations);
+
+#endif // MATRIXBATCH_H
@@ -1,83 +1,146 @@
 #include "mesh.h"
 
-Mesh::Mesh() {}
+#include <cstdio>
+
+#include "gpumemory.h"
+
+Mesh::Mesh()
+    : samplerProgram(0)
+{
+}
 
 Mesh::Mesh(std::vector<Vertex>  vertices,
            std::vector<GLuint>  indices,
            std::vector<Texture> textures)
+    : samplerProgram(0)
 {
-    this->vertices = vertices;
-    this->indices  = indices;
-    this->textures = textures;
+    // Taken by value, so the caller can move its arrays in.
+    this->vertices.swap(vertices);
+    this->indices.swap(indices);
+    this->textures.swap(textures);
 
     this->setupMesh();
 }
 
-void Mesh::DrawInstanced(Shader shader, GLuint instanceCount)
+Mesh::Mesh(std::vector<Vertex>  vertices,
+           std::vector<GLuint>  indices,
+           std::vector<Texture> textures,
+           GLuint64 key)
+    : samplerProgram(0)
+{
+    this->vertices.swap(vertices);
+    this->indices.swap(indices);
+    this->textures.swap(textures);
+
+    this->setupMesh(key);
+}
+
+Mesh::Mesh(std::vector<Vertex>  vertices,
+           std::vector<GLuint>  indices,
+           std::vector<Texture> textures,
+           GeometryHandle geometry)
+    : geometry(geometry)
+    , samplerProgram(0)
+{
+    this->vertices.swap(vertices);
+    this->indices.swap(indices);
+    this->textures.swap(textures);
+
+    this->VAO = this->geometry->VAO;
+    this->VBO = this->geometry->VBO;
+    this->EBO = this->geometry->EBO;
+}
+
+GLuint64 Mesh::contentKey(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
 {
+    static const char* VERTEX_LAYOUT = "position3f normal3f texCoord2f tangent3f bitangent3f";
+    return geometryKey(VERTEX_LAYOUT, &vertices[0], vertices.size() * sizeof(Vertex),
+                       &indices[0], indices.size() * sizeof(GLuint));
+}
+
+void Mesh::vertexAttributes()
+{
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, texCoord));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, tangent));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, bitangent));
+    glEnableVertexAttribArray(4);
+}
+
+void Mesh::resolveSamplers(const Shader& shader)
+{
+    // material.texture_diffuseN / _specularN, numbered per type from 1.
     GLuint diffuseNr  = 1;
     GLuint specularNr = 1;
+    this->samplerLocations.resize(this->textures.size());
     for (GLuint i = 0; i < this->textures.size(); i ++)
     {
-        glActiveTexture(GL_TEXTURE0 + i);
-        // Retrieve Texture Number
-        std::stringstream ss;
-        std::string number;
-        std::string name;
-        name = this->textures[i].type;
+        const std::string& name = this->textures[i].type;
+        GLuint number = 0;
         if (name == "texture_diffuse")
         {
-            ss << diffuseNr++;
+            number = diffuseNr++;
         }
         else if (name == "texture_specular")
         {
-            ss << specularNr++;
+            number = specularNr++;
+        }
+
+        char uniformName[64];
+        if (number) {
+            snprintf(uniformName, sizeof(uniformName), "material.%s%u", name.c_str(), number);
+        }
+        else {
+            snprintf(uniformName, sizeof(uniformName), "material.%s", name.c_str());
         }
-        number = ss.str();
+        this->samplerLocations[i] = glGetUniformLocation(shader.Program, uniformName);
+    }
+    this->shininessLocation = glGetUniformLocation(shader.Program, "material.shininess");
+    this->samplerProgram = shader.Program;
+}
 
-        const char * uniformName = ("material." + name + number).c_str();
-        GLuint textureLoc = glGetUniformLocation(shader.Program, uniformName);
-        glUniform1i(textureLoc, i);
-        glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
+void Mesh::bindTextures(const Shader& shader)
+{
+    if (shader.Program != this->samplerProgram) {
+        this->resolveSamplers(shader);
+    }
+    for (GLuint i = 0; i < this->textures.size(); i ++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glUniform1i(this->samplerLocations[i], i);
         glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
     }
+    if (!this->textures.empty()) {
+        glUniform1f(this->shininessLocation, 16.0f);
+    }
     glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::DrawInstanced(const Shader& shader, GLuint instanceCount)
+{
+    this->bindTextures(shader);
 
     glBindVertexArray(this->VAO);
     glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
     glBindVertexArray(0);
 }
 
-void Mesh::Draw(Shader shader)
+void Mesh::Draw(const Shader& shader)
 {
-    GLuint diffuseNr  = 1;
-    GLuint specularNr = 1;
-    for (GLuint i = 0; i < this->textures.size(); i ++)
-    {
-        glActiveTexture(GL_TEXTURE0 + i);
-        // Retrieve Texture Number
-        std::stringstream ss;
-        std::string number;
-        std::string name;
-        name = this->textures[i].type;
-        if (name == "texture_diffuse")
-        {
-            ss << diffuseNr++;
-        }
-        else if (name == "texture_specular")
-        {
-            ss << specularNr++;
-        }
-        number = ss.str();
+    this->bindTextures(shader);
 
-        const char * uniformName = ("material." + name + number).c_str();
-        GLuint textureLoc = glGetUniformLocation(shader.Program, uniformName);
-        glUniform1i(textureLoc, i);
-        glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
-        glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-    }
-    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(this->VAO);
+    glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+}
 
+void Mesh::DrawDepth()
+{
     glBindVertexArray(this->VAO);
     glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
@@ -85,6 +148,21 @@ void Mesh::Draw(Shader shader)
 
 void Mesh::setupMesh()
 {
+    this->setupMesh(contentKey(this->vertices, this->indices));
+}
+
+void Mesh::setupMesh(GLuint64 key)
+{
+    GLsizeiptr vertexBytes = this->vertices.size() * sizeof(Vertex);
+    GLsizeiptr indexBytes  = this->indices.size() * sizeof(GLuint);
+    this->geometry = findGeometry(key);
+    if (this->geometry) {
+        this->VAO = this->geometry->VAO;
+        this->VBO = this->geometry->VBO;
+        this->EBO = this->geometry->EBO;
+        return;
+    }
+
     glGenBuffers(1, &this->VBO);
     glGenBuffers(1, &this->EBO);
     glGenVertexArrays(1, &this->VAO);
@@ -93,26 +171,22 @@ void Mesh::setupMesh()
 
         glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
         glBufferData(GL_ARRAY_BUFFER,
-                     this->vertices.size() * sizeof(Vertex),
+                     vertexBytes,
                      &this->vertices[0],
                      GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                     this->indices.size() * sizeof(GLuint),
+                     indexBytes,
                      &this->indices[0],
                      GL_STATIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) 0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, normal));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, texCoord));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, tangent));
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*) offsetof(Vertex, bitangent));
-        glEnableVertexAttribArray(4);
+        trackBuffer(this->VBO, GPU_MEMORY_MESH, "mesh vertices", vertexBytes);
+        trackBuffer(this->EBO, GPU_MEMORY_MESH, "mesh indices", indexBytes);
+
+        vertexAttributes();
 
     glBindVertexArray(0);
+
+    this->geometry = registerGeometry(key, this->VAO, this->VBO, this->EBO, vertexBytes + indexBytes);
 }
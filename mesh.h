@@ -9,6 +9,7 @@
 #include <assimp/scene.h>
 
 #include "shader.h"
+#include "geometry.h"
 
 struct Vertex {
     glm::vec3 position;
@@ -29,15 +30,45 @@ public:
     Mesh(std::vector<Vertex> vertices,
          std::vector<GLuint> indices,
          std::vector<Texture> textures);
-    void Draw(Shader shader);
-    void DrawInstanced(Shader shader, GLuint instanceCount);
+    // With `key` = contentKey(vertices, indices) computed beforehand, e.g.
+    // on a job worker during Model import.
+    Mesh(std::vector<Vertex> vertices,
+         std::vector<GLuint> indices,
+         std::vector<Texture> textures,
+         GLuint64 key);
+    // On buffers already uploaded with these arrays (SceneLoader).
+    Mesh(std::vector<Vertex> vertices,
+         std::vector<GLuint> indices,
+         std::vector<Texture> textures,
+         GeometryHandle geometry);
+    // The geometry registry key of a mesh's arrays (see geometry.h).
+    static GLuint64 contentKey(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+    // Point the bound VAO's attributes at the Vertex layout in the bound
+    // GL_ARRAY_BUFFER.
+    static void vertexAttributes();
+    void Draw(const Shader& shader);
+    void DrawInstanced(const Shader& shader, GLuint instanceCount);
+    // Geometry only, no textures or material uniforms (depth passes).
+    void DrawDepth();
+    // Shared with every mesh of identical content (see geometry.h).
     GLuint VAO, VBO, EBO;
 protected:
     Mesh();
     std::vector<Vertex>  vertices;
     std::vector<GLuint>  indices;
     std::vector<Texture> textures;
+    GeometryHandle geometry;
     void setupMesh();
+    void setupMesh(GLuint64 key);
+    // Sampler uniform of each texture in the program last drawn with,
+    // resolved from the textures' types when the program changes.
+    GLuint samplerProgram;
+    std::vector<GLint> samplerLocations;
+    GLint shininessLocation;
+    void resolveSamplers(const Shader& shader);
+    // Bind the textures to units 0.. and point the shader's
+    // material.texture_diffuseN / _specularN samplers at them.
+    void bindTextures(const Shader& shader);
 };
 
 #endif // MESH_H
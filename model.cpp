@@ -1,22 +1,61 @@
 #include "model.h"
 
+#include <utility>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "arena.h"
+#include "gpumemory.h"
+
 std::vector<Texture> textures_loaded;
-GLuint textureFromFile(const char * s, std::string directory);
 
-Model::Model(GLchar* path)
+ModelImport::ModelImport()
+    : scene(NULL)
+{
+}
+
+Model::Model(GLchar* path, JobSystem* jobs)
+{
+    ModelImport import;
+    if (importFile(path, import, jobs)) {
+        this->createMeshes(import);
+    }
+}
+
+Model::Model(const aiScene* scene, const std::string& directory, JobSystem* jobs)
 {
-    this->loadModel(path);
+    ModelImport import;
+    importScene(scene, directory, import, jobs);
+    this->createMeshes(import);
 }
 
-void Model::Draw(Shader shader)
+Model::Model(ModelImport& import)
 {
+    this->createMeshes(import);
+}
+
+void Model::Draw(const Shader& shader, glm::mat4 modelMatrix,
+                 glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+{
+    GLuint modelMatrixLocation = glGetUniformLocation(shader.Program, "modelMatrix");
+    GLuint modelViewMatrixLocation = glGetUniformLocation(shader.Program, "modelViewMatrix");
+    GLuint modelViewMatrixInverseTransposeLocation = glGetUniformLocation(shader.Program, "modelViewMatrixInverseTranspose");
+    GLuint modelViewProjectionMatrixLocation = glGetUniformLocation(shader.Program, "modelViewProjectionMatrix");
     for (GLuint i = 0; i < this->meshes.size(); i ++)
     {
+        glm::mat4 meshMatrix = modelMatrix * this->nodes.worldMatrix(this->meshNodes[i]);
+        glm::mat4 modelViewMatrix = viewMatrix * meshMatrix;
+        glm::mat4 modelViewMatrixInverseTranspose = glm::inverse(glm::transpose(modelViewMatrix));
+        glm::mat4 modelViewProjectionMatrix = projectionMatrix * modelViewMatrix;
+        glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(meshMatrix));
+        glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
+        glUniformMatrix4fv(modelViewMatrixInverseTransposeLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrixInverseTranspose));
+        glUniformMatrix4fv(modelViewProjectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
         this->meshes[i].Draw(shader);
     }
 }
 
-void Model::DrawInstanced(Shader shader, GLuint instanceCount)
+void Model::DrawInstanced(const Shader& shader, GLuint instanceCount)
 {
     for (GLuint i = 0; i < this->meshes.size(); i ++)
     {
@@ -24,106 +63,202 @@ void Model::DrawInstanced(Shader shader, GLuint instanceCount)
     }
 }
 
-void Model::loadModel(std::string path)
+bool Model::importFile(const std::string& path, ModelImport& import, JobSystem* jobs)
 {
-    Assimp::Importer importer;
     const aiScene * scene;
-    scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    scene = import.importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
     if (!scene
         || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE
         || !scene->mRootNode)
     {
-        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        std::cout << "ERROR::ASSIMP::" << import.importer.GetErrorString() << std::endl;
+        return false;
+    }
+    importScene(scene, path.substr(0, path.find_last_of('/')), import, jobs);
+    return true;
+}
+
+struct Model::MeshConversion {
+    std::vector<MeshImport>* imports;
+
+    void operator()(GLuint begin, GLuint end)
+    {
+        for (GLuint i = begin; i < end; i++) {
+            Model::convertMesh((*this->imports)[i]);
+        }
+    }
+};
+
+void Model::importScene(const aiScene* scene, const std::string& directory,
+                        ModelImport& import, JobSystem* jobs)
+{
+    import.scene = scene;
+    import.directory = directory;
+    // One import per mesh reference; usually each mesh is referenced once.
+    import.meshes.reserve(scene->mNumMeshes);
+    collectMeshes(import, scene->mRootNode, TransformHierarchy::NO_PARENT);
+    import.nodes.update();
+
+    MeshConversion conversion = { &import.meshes };
+    if (jobs) {
+        jobs->parallelFor(import.meshes.size(), 1, conversion);
+    }
+    else {
+        conversion(0, import.meshes.size());
+    }
+}
+
+std::vector<Texture> Model::materialTextures(const ModelImport& import)
+{
+    static const aiTextureType TYPES[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR };
+    static const char* TYPE_NAMES[] = { "texture_diffuse", "texture_specular" };
+    std::vector<Texture> textures;
+    for (GLuint m = 0; m < import.scene->mNumMaterials; m++)
+    {
+        aiMaterial * mat = import.scene->mMaterials[m];
+        for (GLuint t = 0; t < 2; t++)
+        {
+            for (GLuint i = 0; i < mat->GetTextureCount(TYPES[t]); i++)
+            {
+                Texture texture;
+                texture.id = 0;
+                texture.type = TYPE_NAMES[t];
+                mat->GetTexture(TYPES[t], i, &texture.path);
+                bool listed = false;
+                for (GLuint j = 0; j < textures.size() && !listed; j++)
+                {
+                    listed = std::strcmp(textures[j].path.C_Str(), texture.path.C_Str()) == 0;
+                }
+                if (!listed)
+                {
+                    textures.push_back(texture);
+                }
+            }
+        }
+    }
+    return textures;
+}
+
+// Textures and GL objects, on the context thread only.
+void Model::createMeshes(ModelImport& import)
+{
+    const aiScene * scene = import.scene;
+    this->directory = import.directory;
+    std::swap(this->nodes, import.nodes);
+
+    // Each material's textures, listed once in the scratch arena and
+    // copied into every mesh using it: [materialFirst, materialEnd) of
+    // materialTextures, materialFirst -1 until the material is loaded.
+    LinearArena scratch(IMPORT_SCRATCH_BYTES);
+    ArenaVector<GLint> materialFirst(scene->mNumMaterials, -1, scratch);
+    ArenaVector<GLuint> materialEnd(scene->mNumMaterials, 0, scratch);
+    ArenaVector<Texture> materialTextures(scratch);
+    std::vector<MeshImport>& imports = import.meshes;
+    this->meshes.reserve(this->meshes.size() + imports.size());
+    for (GLuint i = 0; i < imports.size(); i++)
+    {
+        GLuint material = imports[i].mesh->mMaterialIndex;
+        if (material < scene->mNumMaterials && materialFirst[material] < 0)
+        {
+            aiMaterial * mat = scene->mMaterials[material];
+            materialFirst[material] = materialTextures.size();
+            this->loadMaterialTextures(mat, aiTextureType_DIFFUSE, "texture_diffuse", materialTextures);
+            this->loadMaterialTextures(mat, aiTextureType_SPECULAR, "texture_specular", materialTextures);
+            materialEnd[material] = materialTextures.size();
+        }
+        std::vector<Texture> textures;
+        if (material < scene->mNumMaterials)
+        {
+            textures.assign(materialTextures.begin() + materialFirst[material],
+                            materialTextures.begin() + materialEnd[material]);
+        }
+        if (imports[i].geometry)
+        {
+            this->meshes.push_back(Mesh(std::move(imports[i].vertices), std::move(imports[i].indices),
+                                        std::move(textures), imports[i].geometry));
+        }
+        else
+        {
+            this->meshes.push_back(Mesh(std::move(imports[i].vertices), std::move(imports[i].indices),
+                                        std::move(textures), imports[i].key));
+        }
+        this->meshNodes.push_back(imports[i].node);
     }
-    this->directory = path.substr(0, path.find_last_of('/'));
-    this->processNode(scene->mRootNode, scene);
 }
 
-void Model::processNode(aiNode * node, const aiScene * scene)
+// Depth first, so meshes keep the order the recursive walk gave them.
+void Model::collectMeshes(ModelImport& import, const aiNode * node, GLuint parent)
 {
+    // Assimp matrices are row-major, glm's are column-major.
+    const aiMatrix4x4& t = node->mTransformation;
+    glm::mat4 localMatrix = glm::transpose(glm::mat4(t.a1, t.a2, t.a3, t.a4,
+                                                     t.b1, t.b2, t.b3, t.b4,
+                                                     t.c1, t.c2, t.c3, t.c4,
+                                                     t.d1, t.d2, t.d3, t.d4));
+    GLuint nodeIndex = import.nodes.addNode(parent, localMatrix);
+
     for (GLuint i = 0; i < node->mNumMeshes; i++)
     {
-        aiMesh * mesh = scene->mMeshes[node->mMeshes[i]];
-        this->meshes.push_back(this->processMesh(mesh, scene));
+        MeshImport mesh;
+        mesh.mesh = import.scene->mMeshes[node->mMeshes[i]];
+        mesh.node = nodeIndex;
+        import.meshes.push_back(mesh);
     }
 
     for (GLuint i = 0; i < node->mNumChildren; i++)
     {
-        this->processNode(node->mChildren[i], scene);
+        collectMeshes(import, node->mChildren[i], nodeIndex);
     }
 }
 
-Mesh Model::processMesh(aiMesh * mesh, const aiScene * scene)
+// Runs on a job worker: touches nothing but `import`.
+void Model::convertMesh(MeshImport& import)
 {
-    std::vector<Vertex>  vertices;
-    std::vector<GLuint>  indices;
-    std::vector<Texture> textures;
+    const aiMesh * mesh = import.mesh;
 
     // Process Vertices
+    import.vertices.resize(mesh->mNumVertices);
+    const aiVector3D * texCoords = mesh->mTextureCoords[0];
     for (GLuint i = 0; i < mesh->mNumVertices; i++)
     {
-        Vertex vertex;
-
-        glm::vec3 v;
-
-        v.x = mesh->mVertices[i].x;
-        v.y = mesh->mVertices[i].y;
-        v.z = mesh->mVertices[i].z;
-        vertex.position = v;
-
-        v.x = mesh->mNormals[i].x;
-        v.y = mesh->mNormals[i].y;
-        v.z = mesh->mNormals[i].z;
-        vertex.normal = v;
-
-        if (mesh->mTextureCoords[0])
+        Vertex& vertex = import.vertices[i];
+        vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        if (texCoords)
         {
-            glm::vec2 v;
-            v.x = mesh->mTextureCoords[0][i].x;
-            v.y = mesh->mTextureCoords[0][i].y;
-            vertex.texCoord = v;
+            vertex.texCoord = glm::vec2(texCoords[i].x, texCoords[i].y);
         }
         else
         {
             vertex.texCoord = glm::vec2(0.0f, 0.0f);
         }
-
-        vertices.push_back(vertex);
     }
 
     // Process Indices
+    GLuint indexCount = 0;
     for (GLuint i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        indexCount += mesh->mFaces[i].mNumIndices;
+    }
+    import.indices.resize(indexCount);
+    GLuint* index = import.indices.empty() ? NULL : &import.indices[0];
+    for (GLuint i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace& face = mesh->mFaces[i];
         for (GLuint j = 0; j < face.mNumIndices; j ++)
         {
-            indices.push_back(face.mIndices[j]);
+            *index++ = face.mIndices[j];
         }
     }
 
-    // Process Materials
-    if (mesh->mMaterialIndex >= 0)
-    {
-        aiMaterial * material = scene->mMaterials[mesh->mMaterialIndex];
-
-        // Diffuse Maps
-        std::vector<Texture> diffuseMaps = this->loadMaterialTextures(material,
-                                                                      aiTextureType_DIFFUSE,
-                                                                      "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-        // Specular Maps
-        std::vector<Texture> specularMaps = this->loadMaterialTextures(material,
-                                                                       aiTextureType_SPECULAR,
-                                                                       "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-    }
-    return Mesh(vertices, indices, textures);
+    // Hashing the arrays for the geometry registry is as much work as
+    // converting them, so it happens here too.
+    import.key = Mesh::contentKey(import.vertices, import.indices);
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial * mat, aiTextureType type, std::string typeName)
+void Model::loadMaterialTextures(aiMaterial * mat, aiTextureType type, const char* typeName,
+                                 ArenaVector<Texture>& textures)
 {
-    std::vector<Texture> textures;
     for (GLuint i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString s;
@@ -148,7 +283,23 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial * mat, aiTextureType
             textures_loaded.push_back(texture);
         }
     }
-    return textures;
+}
+
+void addLoadedTexture(const Texture& texture)
+{
+    textures_loaded.push_back(texture);
+}
+
+bool isTextureLoaded(const aiString& path)
+{
+    for (GLuint i = 0; i < textures_loaded.size(); i++)
+    {
+        if (std::strcmp(textures_loaded[i].path.C_Str(), path.C_Str()) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 GLuint textureFromFile(const char * filename, std::string directory) {
@@ -163,6 +314,7 @@ GLuint textureFromFile(const char * filename, std::string directory) {
     glBindTexture(GL_TEXTURE_2D, texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, textureImg);
     glGenerateMipmap(GL_TEXTURE_2D);
+    trackTexture(texture, GPU_MEMORY_MATERIAL, "model texture", width, height, GL_RGB, 0);
 
     // Parameters
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
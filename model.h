@@ -12,23 +12,97 @@
 
 #include "shader.h"
 #include "mesh.h"
+#include "transform.h"
+#include "jobs.h"
+#include "arena.h"
 
+// One mesh of a scene on its way to becoming a Mesh.
+struct MeshImport {
+    const aiMesh* mesh;
+    GLuint node;
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    GLuint64 key;           // Mesh::contentKey
+    GeometryHandle geometry;    // if already uploaded
+};
+
+// A scene read and converted, with nothing created on the GL side yet
+// (see Model::importFile).
+struct ModelImport {
+    Assimp::Importer importer;  // owns `scene` when read from a file
+    const aiScene* scene;
+    std::string directory;
+    TransformHierarchy nodes;
+    std::vector<MeshImport> meshes;
 
+    ModelImport();
+
+private:
+    ModelImport(const ModelImport&);
+    ModelImport& operator=(const ModelImport&);
+};
+
+// Model Import
+// ============
+// The node tree is flattened into one import per mesh first. With a
+// JobSystem, meshes are then converted to Vertex / index arrays in
+// parallel, each straight into buffers sized up front. Material textures
+// are loaded once per material and the GL objects are created at the end,
+// all on the calling (context) thread. Without one, the same pipeline runs
+// serially.
+//
+// The two halves can also be run apart: importFile / importScene touch no
+// GL and may run on any thread, Model(ModelImport&) then creates the GL
+// objects (SceneLoader spreads that part over frames).
 class Model
 {
 public:
-    Model(GLchar* path);
-    void Draw(Shader shader);
-    void DrawInstanced(Shader shader, GLuint instanceCount);
+    Model(GLchar* path, JobSystem* jobs = NULL);
+    // From a scene already in memory; texture paths are relative to
+    // `directory`.
+    Model(const aiScene* scene, const std::string& directory, JobSystem* jobs = NULL);
+    // From an import; its mesh arrays are moved out.
+    explicit Model(ModelImport& import);
+    // Each mesh at modelMatrix times its node's world matrix.
+    void Draw(const Shader& shader, glm::mat4 modelMatrix,
+              glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+    // Every mesh at the instance matrices alone: node transforms are NOT
+    // applied (the instanced shaders take one model matrix per instance,
+    // none per mesh), so only models whose meshes all hang off nodes with
+    // identity world matrices draw correctly this way.
+    void DrawInstanced(const Shader& shader, GLuint instanceCount);
     std::vector<Mesh> meshes;
+    // Node transforms from the file, and the node each mesh hangs off.
+    TransformHierarchy nodes;
+    std::vector<GLuint> meshNodes;
+
+    // False (with the importer's error printed) if `path` can't be read.
+    static bool importFile(const std::string& path, ModelImport& import, JobSystem* jobs = NULL);
+    static void importScene(const aiScene* scene, const std::string& directory,
+                            ModelImport& import, JobSystem* jobs = NULL);
+    // The texture files an import's materials reference, each once, with
+    // id 0: what the constructor loads unless addLoadedTexture() has them.
+    static std::vector<Texture> materialTextures(const ModelImport& import);
 private:
+    struct MeshConversion;
+
+    // Scratch for createMeshes' per-material texture lists; grows past this
+    // onto the heap for scenes with very many materials.
+    static const size_t IMPORT_SCRATCH_BYTES = 16 * 1024;
+
     std::string directory;
-    void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat,
-                                              aiTextureType type,
-                                              std::string typeName);
+    void createMeshes(ModelImport& import);
+    static void collectMeshes(ModelImport& import, const aiNode* node, GLuint parent);
+    static void convertMesh(MeshImport& import);
+    // Appends `mat`'s textures of `type` to `textures`.
+    void loadMaterialTextures(aiMaterial* mat, aiTextureType type, const char* typeName,
+                              ArenaVector<Texture>& textures);
 };
 
+// Load `filename` (relative to `directory`) as a mipmapped RGB texture.
+GLuint textureFromFile(const char* filename, std::string directory);
+// Have every later model use `texture` for its path instead of loading it.
+void addLoadedTexture(const Texture& texture);
+bool isTextureLoaded(const aiString& path);
+
 #endif // MODEL_H
@@ -0,0 +1,302 @@
+#include "pngencode.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+// Deflate
+// =======
+
+static const GLuint WINDOW_SIZE = 32768;
+static const GLuint HASH_BITS = 15;
+static const GLuint MAX_CHAIN = 16;
+static const GLuint MIN_MATCH = 3;
+static const GLuint MAX_MATCH = 258;
+
+static const GLushort LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const GLubyte LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const GLushort DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const GLubyte DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+struct BitWriter {
+    std::vector<GLubyte>& out;
+    GLuint buffer;
+    GLuint count;
+
+    BitWriter(std::vector<GLubyte>& out) : out(out), buffer(0), count(0) {}
+
+    // Least significant bit first, as deflate packs everything but
+    // Huffman codes.
+    void bits(GLuint value, GLuint length)
+    {
+        this->buffer |= value << this->count;
+        this->count += length;
+        while (this->count >= 8) {
+            this->out.push_back(this->buffer & 0xFF);
+            this->buffer >>= 8;
+            this->count -= 8;
+        }
+    }
+
+    // Huffman codes go most significant bit first.
+    void code(GLuint code, GLuint length)
+    {
+        GLuint reversed = 0;
+        for (GLuint i = 0; i < length; i++) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        this->bits(reversed, length);
+    }
+
+    void flush()
+    {
+        if (this->count > 0) {
+            this->out.push_back(this->buffer & 0xFF);
+        }
+        this->buffer = 0;
+        this->count = 0;
+    }
+};
+
+// The fixed literal/length code (RFC 1951, 3.2.6).
+static void writeSymbol(BitWriter& writer, GLuint symbol)
+{
+    if (symbol < 144) {
+        writer.code(0x30 + symbol, 8);
+    }
+    else if (symbol < 256) {
+        writer.code(0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280) {
+        writer.code(symbol - 256, 7);
+    }
+    else {
+        writer.code(0xC0 + symbol - 280, 8);
+    }
+}
+
+static void writeMatch(BitWriter& writer, GLuint length, GLuint distance)
+{
+    GLuint lengthCode = 28;
+    while (LENGTH_BASE[lengthCode] > length) {
+        lengthCode--;
+    }
+    writeSymbol(writer, 257 + lengthCode);
+    writer.bits(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+
+    GLuint distanceCode = 29;
+    while (DISTANCE_BASE[distanceCode] > distance) {
+        distanceCode--;
+    }
+    writer.code(distanceCode, 5);
+    writer.bits(distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+}
+
+static GLuint hash3(const GLubyte* p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// One final fixed-Huffman block.
+static void deflate(const std::vector<GLubyte>& data, std::vector<GLubyte>& out)
+{
+    BitWriter writer(out);
+    writer.bits(1, 1);      // BFINAL
+    writer.bits(1, 2);      // BTYPE = fixed Huffman
+
+    std::vector<GLint> head(1 << HASH_BITS, -1);
+    std::vector<GLint> previous(WINDOW_SIZE, -1);
+    GLuint size = data.size();
+    GLuint position = 0;
+    while (position < size) {
+        GLuint bestLength = 0, bestDistance = 0;
+        if (position + MIN_MATCH <= size) {
+            GLuint hash = hash3(&data[position]);
+            GLuint maxLength = std::min(MAX_MATCH, size - position);
+            GLint candidate = head[hash];
+            for (GLuint chain = 0; chain < MAX_CHAIN && candidate >= 0
+                                   && position - candidate <= WINDOW_SIZE; chain++) {
+                GLuint length = 0;
+                while (length < maxLength && data[candidate + length] == data[position + length]) {
+                    length++;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = position - candidate;
+                    if (length == maxLength) {
+                        break;
+                    }
+                }
+                candidate = previous[candidate % WINDOW_SIZE];
+            }
+        }
+
+        GLuint advance = 1;
+        if (bestLength >= MIN_MATCH) {
+            writeMatch(writer, bestLength, bestDistance);
+            advance = bestLength;
+        }
+        else {
+            writeSymbol(writer, data[position]);
+        }
+        for (GLuint end = position + advance; position < end; position++) {
+            if (position + MIN_MATCH <= size) {
+                GLuint hash = hash3(&data[position]);
+                previous[position % WINDOW_SIZE] = head[hash];
+                head[hash] = position;
+            }
+        }
+    }
+    writeSymbol(writer, 256);   // end of block
+    writer.flush();
+}
+
+// PNG
+// ===
+
+// Built before main, so concurrent encoders never race to fill it.
+static struct CrcTable {
+    GLuint entries[256];
+    CrcTable()
+    {
+        for (GLuint n = 0; n < 256; n++) {
+            GLuint c = n;
+            for (GLuint k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            this->entries[n] = c;
+        }
+    }
+} crcTable;
+
+static GLuint crc32(const GLubyte* data, size_t length, GLuint crc = 0xFFFFFFFFu)
+{
+    for (size_t i = 0; i < length; i++) {
+        crc = crcTable.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void writeUint(std::vector<GLubyte>& out, GLuint value)
+{
+    out.push_back(value >> 24);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+static void writeChunk(std::vector<GLubyte>& out, const char* type, const std::vector<GLubyte>& data)
+{
+    writeUint(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    writeUint(out, crc32(&out[start], out.size() - start) ^ 0xFFFFFFFFu);
+}
+
+static GLubyte paeth(GLint a, GLint b, GLint c)
+{
+    GLint p = a + b - c;
+    GLint pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+void encodePng(const GLubyte* pixels, GLuint width, GLuint height, GLuint channels,
+               bool bottomUp, std::vector<GLubyte>& out)
+{
+    // Scanlines: a filter type byte, then the filtered RGB row.
+    const GLuint rowBytes = width * 3;
+    std::vector<GLubyte> scanlines((rowBytes + 1) * height);
+    std::vector<GLubyte> row(rowBytes), above(rowBytes, 0);
+    std::vector<GLubyte> candidates[3];
+    for (GLuint i = 0; i < 3; i++) {
+        candidates[i].resize(rowBytes);
+    }
+    for (GLuint y = 0; y < height; y++) {
+        const GLubyte* source = pixels + (GLsizeiptr) (bottomUp ? height - 1 - y : y) * width * channels;
+        for (GLuint x = 0; x < width; x++) {
+            row[x * 3]     = source[x * channels];
+            row[x * 3 + 1] = source[x * channels + 1];
+            row[x * 3 + 2] = source[x * channels + 2];
+        }
+
+        // Sub, Up and Paeth; keep the one with the smallest residuals.
+        GLuint bestFilter = 0, bestCost = 0xFFFFFFFFu;
+        for (GLuint f = 0; f < 3; f++) {
+            GLuint cost = 0;
+            for (GLuint i = 0; i < rowBytes; i++) {
+                GLubyte left = i >= 3 ? row[i - 3] : 0;
+                GLubyte upLeft = i >= 3 ? above[i - 3] : 0;
+                GLubyte predicted = f == 0 ? left : f == 1 ? above[i] : paeth(left, above[i], upLeft);
+                GLubyte residual = row[i] - predicted;
+                candidates[f][i] = residual;
+                cost += residual < 128 ? residual : 256 - residual;
+            }
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestFilter = f;
+            }
+        }
+        static const GLubyte FILTER_TYPES[3] = { 1, 2, 4 };
+        GLubyte* scanline = &scanlines[y * (rowBytes + 1)];
+        scanline[0] = FILTER_TYPES[bestFilter];
+        std::copy(candidates[bestFilter].begin(), candidates[bestFilter].end(), scanline + 1);
+        row.swap(above);
+    }
+
+    // zlib stream: header, deflate data, Adler-32 of the scanlines.
+    std::vector<GLubyte> compressed;
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+    deflate(scanlines, compressed);
+    GLuint a = 1, b = 0;
+    for (size_t i = 0; i < scanlines.size(); i++) {
+        a = (a + scanlines[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    writeUint(compressed, b << 16 | a);
+
+    static const GLubyte SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.assign(SIGNATURE, SIGNATURE + 8);
+    std::vector<GLubyte> header;
+    writeUint(header, width);
+    writeUint(header, height);
+    header.push_back(8);    // bit depth
+    header.push_back(2);    // RGB
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // not interlaced
+    writeChunk(out, "IHDR", header);
+    writeChunk(out, "IDAT", compressed);
+    writeChunk(out, "IEND", std::vector<GLubyte>());
+}
+
+GLsizeiptr writePng(const std::string& path, const GLubyte* pixels, GLuint width, GLuint height,
+                    GLuint channels, bool bottomUp)
+{
+    std::vector<GLubyte> png;
+    encodePng(pixels, width, height, channels, bottomUp, png);
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file && fwrite(&png[0], 1, png.size(), file) == png.size();
+    if (file) {
+        ok = fclose(file) == 0 && ok;
+    }
+    if (!ok) {
+        std::cout << "ERROR::PNG::FILE_NOT_WRITTEN " << path << std::endl;
+        return 0;
+    }
+    return png.size();
+}
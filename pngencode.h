@@ -0,0 +1,28 @@
+#ifndef PNGENCODE_H
+#define PNGENCODE_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// PNG Encoding
+// ============
+// A self-contained 8-bit RGB PNG writer (SOIL only saves BMP, TGA and
+// DDS). Each row gets whichever of the Sub, Up and Paeth filters leaves the
+// smallest residuals; the image data is deflated with the fixed Huffman
+// code and an LZ77 matcher (hash chains over the 32 KB window). Not as
+// small as zlib's output, but several times smaller than a BMP and cheap
+// enough to run per frame on a worker.
+
+// `pixels` holds `height` rows of `width` texels of `channels` (3 or 4,
+// alpha dropped) bytes, tightly packed; bottom row first if `bottomUp` (as
+// glReadPixels returns them).
+void encodePng(const GLubyte* pixels, GLuint width, GLuint height, GLuint channels,
+               bool bottomUp, std::vector<GLubyte>& out);
+// Returns the file size, or 0 (and prints an error) if the file cannot be
+// written.
+GLsizeiptr writePng(const std::string& path, const GLubyte* pixels, GLuint width, GLuint height,
+                    GLuint channels, bool bottomUp);
+
+#endif // PNGENCODE_H
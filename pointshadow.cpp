@@ -0,0 +1,187 @@
+#include "pointshadow.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "shadowatlas.h"
+#include "gpumemory.h"
+
+static ShaderDefines singlePassDefines()
+{
+    ShaderDefines defines;
+    defines.push_back(shaderDefine("SINGLE_PASS", "1"));
+    return defines;
+}
+
+PointShadowMap::PointShadowMap(GLuint size, GLfloat nearDepth, GLfloat farDepth)
+    : size(size)
+    , nearDepth(nearDepth)
+    , farDepth(farDepth)
+    , singlePassShader("../learn-opengl/shaders/shadow-cube.vert",
+                       "../learn-opengl/shaders/shadow-cube.frag",
+                       "../learn-opengl/shaders/shadow-cube.geom",
+                       singlePassDefines())
+    , sixPassShader("../learn-opengl/shaders/shadow-depth.vert",
+                    "../learn-opengl/shaders/shadow-cube.frag")
+{
+    glGenTextures(1, &this->texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, this->texture);
+    for (GLuint face = 0; face < 6; face++) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24,
+                     size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    }
+    trackTexture(this->texture, GPU_MEMORY_SHADOW, "point shadow cube map", size, size, GL_DEPTH_COMPONENT24, 1, 6);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    // Layered attachment: all six faces, selected by gl_Layer.
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::POINT_SHADOW::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+PointShadowMap::~PointShadowMap()
+{
+    glDeleteFramebuffers(1, &this->framebuffer);
+    untrackTexture(this->texture);
+    glDeleteTextures(1, &this->texture);
+}
+
+GLuint PointShadowMap::render(glm::vec3 lightPosition, Mesh& mesh,
+                              const std::vector<glm::mat4>& casters, GLfloat casterRadius,
+                              PointShadowMode mode)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, this->nearDepth, this->farDepth);
+    glm::mat4 faceViewProjections[6];
+    glm::mat4 faceViews[6];
+    for (GLuint face = 0; face < 6; face++) {
+        faceViews[face] = cubeFaceViewMatrix(lightPosition, face);
+        faceViewProjections[face] = projection * faceViews[face];
+    }
+
+    GLint previousViewport[4];
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glViewport(0, 0, this->size, this->size);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glEnable(GL_DEPTH_TEST);
+    GLuint draws = 0;
+    GLfloat reach = this->farDepth + casterRadius;
+
+    if (mode == POINT_SHADOW_SINGLE_PASS) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->texture, 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        Shader& shader = this->singlePassShader;
+        shader.Use();
+        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "faceViewProjectionMatrices"),
+                           6, GL_FALSE, glm::value_ptr(faceViewProjections[0]));
+        glUniform3fv(glGetUniformLocation(shader.Program, "lightPosition"), 1, glm::value_ptr(lightPosition));
+        glUniform1f(glGetUniformLocation(shader.Program, "nearDepth"), this->nearDepth);
+        glUniform1f(glGetUniformLocation(shader.Program, "farDepth"), this->farDepth);
+        GLint modelMatrixLocation = glGetUniformLocation(shader.Program, "modelMatrix");
+        for (GLuint i = 0; i < casters.size(); i++) {
+            if (glm::length(glm::vec3(casters[i][3]) - lightPosition) > reach) {
+                continue;
+            }
+            glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(casters[i]));
+            mesh.DrawDepth();
+            draws++;
+        }
+    }
+    else {
+        Shader& shader = this->sixPassShader;
+        shader.Use();
+        glUniform3fv(glGetUniformLocation(shader.Program, "lightPosition"), 1, glm::value_ptr(lightPosition));
+        glUniform1f(glGetUniformLocation(shader.Program, "nearDepth"), this->nearDepth);
+        glUniform1f(glGetUniformLocation(shader.Program, "farDepth"), this->farDepth);
+        GLint modelMatrixLocation = glGetUniformLocation(shader.Program, "modelMatrix");
+        GLint viewProjectionLocation = glGetUniformLocation(shader.Program, "lightViewProjectionMatrix");
+        const GLfloat SQRT_2 = 1.41421356f;
+        for (GLuint face = 0; face < 6; face++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->texture, 0);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, glm::value_ptr(faceViewProjections[face]));
+            for (GLuint i = 0; i < casters.size(); i++) {
+                // In face view space the frustum is |x| <= -z, |y| <= -z;
+                // its side planes are at 45 degrees, hence the sqrt(2).
+                glm::vec4 center = faceViews[face] * casters[i][3];
+                GLfloat depth = -center.z;
+                if (depth + casterRadius < this->nearDepth || depth - casterRadius > this->farDepth
+                 || std::fabs(center.x) > depth + casterRadius * SQRT_2
+                 || std::fabs(center.y) > depth + casterRadius * SQRT_2) {
+                    continue;
+                }
+                glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(casters[i]));
+                mesh.DrawDepth();
+                draws++;
+            }
+        }
+        // Leave the layered attachment in place for the next single pass.
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, this->texture, 0);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    return draws;
+}
+
+void benchmarkPointShadows(Mesh& mesh, GLuint casterCount, GLuint iterations)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const GLfloat FAR_DEPTH = 25.0f;
+    const GLfloat CASTER_RADIUS = 0.87f;
+
+    std::vector<glm::mat4> casters;
+    srand(35);
+    for (GLuint i = 0; i < casterCount; i++) {
+        glm::vec3 position(rand() % 400 / 10.0f - 20.0f, rand() % 400 / 10.0f - 20.0f, rand() % 400 / 10.0f - 20.0f);
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(), position);
+        modelMatrix = glm::rotate(modelMatrix, glm::radians((GLfloat) (rand() % 360)), glm::vec3(0.3f, 0.5f, 0.8f));
+        casters.push_back(modelMatrix);
+    }
+
+    PointShadowMap shadowMap(1024, 0.1f, FAR_DEPTH);
+    GLuint query;
+    glGenQueries(1, &query);
+    const char* NAMES[2] = { "single pass (layered GS)", "six passes             " };
+    PointShadowMode MODES[2] = { POINT_SHADOW_SINGLE_PASS, POINT_SHADOW_SIX_PASS };
+
+    std::cout << "BENCHMARK::POINT_SHADOWS " << casterCount << " casters, "
+              << shadowMap.size << "^2 x 6, " << iterations << " iterations" << std::endl;
+    for (GLuint m = 0; m < 2; m++) {
+        // Warm up (first use finishes the program and allocates storage).
+        shadowMap.render(glm::vec3(0.0f), mesh, casters, CASTER_RADIUS, MODES[m]);
+        glFinish();
+
+        GLuint draws = 0;
+        Clock::time_point start = Clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (GLuint n = 0; n < iterations; n++) {
+            draws = shadowMap.render(glm::vec3(0.0f), mesh, casters, CASTER_RADIUS, MODES[m]);
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        GLdouble cpuTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        GLuint64 gpuTime = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuTime);
+
+        std::cout << "    " << NAMES[m] << ": GPU " << gpuTime * 1.0e-6 / iterations << " ms, "
+                  << "CPU submit " << cpuTime / iterations << " ms, "
+                  << draws << " draws per shadow map" << std::endl;
+    }
+    glDeleteQueries(1, &query);
+}
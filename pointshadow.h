@@ -0,0 +1,67 @@
+#ifndef POINTSHADOW_H
+#define POINTSHADOW_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "shader.h"
+
+// Point Shadow Map
+// ================
+// An omnidirectional shadow map in a depth cube map, storing linear distance
+// to the light mapped from [nearDepth, farDepth] to [0, 1] --- the
+// `depthMap` / `nearDepth` / `farDepth` convention of blinn.frag.
+//
+// Two ways to fill it:
+//   POINT_SHADOW_SINGLE_PASS  the cube map is attached layered and a
+//                             geometry shader routes each triangle to the
+//                             faces (gl_Layer) whose frustum it overlaps;
+//                             every caster is drawn once.
+//   POINT_SHADOW_SIX_PASS     each face is attached and rendered on its own,
+//                             with casters culled per face on the CPU.
+//
+// Only --bench-shadows uses it. The render loop's point shadows live in
+// the ShadowAtlas, a 2D depth texture with each light's faces in viewport
+// cells of a tile; a layered attachment needs one layer per face, and
+// routing triangles to viewports from the geometry shader
+// (gl_ViewportIndex) takes GL 4.1 / ARB_viewport_array, beyond the GL 3.3
+// core context. The atlas pass stays at six submissions per light.
+enum PointShadowMode {
+    POINT_SHADOW_SINGLE_PASS,
+    POINT_SHADOW_SIX_PASS
+};
+
+class PointShadowMap
+{
+public:
+    GLuint texture;
+    GLuint framebuffer;
+    GLuint size;
+    GLfloat nearDepth, farDepth;
+
+    PointShadowMap(GLuint size, GLfloat nearDepth, GLfloat farDepth);
+    ~PointShadowMap();
+
+    // Draw `mesh` once per model matrix; each caster is bounded by a sphere
+    // of `casterRadius` around its origin. Casters beyond farDepth are
+    // skipped in both modes. Returns the number of draw calls issued.
+    GLuint render(glm::vec3 lightPosition, Mesh& mesh,
+                  const std::vector<glm::mat4>& casters, GLfloat casterRadius,
+                  PointShadowMode mode);
+
+private:
+    Shader singlePassShader;
+    Shader sixPassShader;
+
+    PointShadowMap(const PointShadowMap&);
+    PointShadowMap& operator=(const PointShadowMap&);
+};
+
+// Fill a shadow map from `casterCount` random casters both ways and print
+// GPU (GL_TIME_ELAPSED) and CPU submission time per shadow map.
+void benchmarkPointShadows(Mesh& mesh, GLuint casterCount, GLuint iterations);
+
+#endif // POINTSHADOW_H
@@ -0,0 +1,194 @@
+#include "readback.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "gpumemory.h"
+#include "pngencode.h"
+
+struct FrameReadback::EncodeJob {
+    std::string path;
+    std::vector<GLubyte> pixels;    // RGBA, bottom row first
+    GLuint width, height;
+    GLsizeiptr bytes;               // 0 if the file couldn't be written
+    JobCounter counter;
+};
+
+FrameReadback::FrameReadback(JobSystem& jobs, GLuint width, GLuint height, const std::string& outputPrefix)
+    : jobs(jobs)
+    , width(width)
+    , height(height)
+    , outputPrefix(outputPrefix)
+    , nextSlot(0)
+    , frames(0)
+    , failures(0)
+    , readbackStalls(0)
+    , encodeStalls(0)
+    , bytesWritten(0)
+    , started(false)
+{
+    GLsizeiptr frameBytes = (GLsizeiptr) width * height * 4;
+    for (GLuint i = 0; i < READBACK_FRAMES; i++) {
+        glGenBuffers(1, &this->slots[i].buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->slots[i].buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+        trackBuffer(this->slots[i].buffer, GPU_MEMORY_UPLOAD, "frame readback", frameBytes);
+        this->slots[i].fence = 0;
+        this->slots[i].frame = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameReadback::~FrameReadback()
+{
+    this->finish();
+    for (GLuint i = 0; i < READBACK_FRAMES; i++) {
+        untrackBuffer(this->slots[i].buffer);
+        glDeleteBuffers(1, &this->slots[i].buffer);
+    }
+}
+
+void FrameReadback::capture(GLuint frame)
+{
+    if (!this->started) {
+        this->startTime = Clock::now();
+        this->started = true;
+    }
+    Slot& slot = this->slots[this->nextSlot];
+    if (slot.fence) {
+        if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            this->readbackStalls++;
+        }
+        this->collect(slot);
+    }
+
+    // RGBA rows are always 4-byte aligned, and it is the format drivers
+    // read back without converting.
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = frame;
+    this->nextSlot = (this->nextSlot + 1) % READBACK_FRAMES;
+}
+
+void FrameReadback::poll()
+{
+    // Oldest first, stopping at the first readback still in flight so
+    // frames reach the encoders in order.
+    for (GLuint i = 0; i < READBACK_FRAMES; i++) {
+        Slot& slot = this->slots[(this->nextSlot + i) % READBACK_FRAMES];
+        if (!slot.fence) {
+            continue;
+        }
+        GLenum result = glClientWaitSync(slot.fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        this->collect(slot);
+    }
+    this->retireEncodes(false);
+}
+
+void FrameReadback::finish()
+{
+    for (GLuint i = 0; i < READBACK_FRAMES; i++) {
+        Slot& slot = this->slots[(this->nextSlot + i) % READBACK_FRAMES];
+        if (slot.fence) {
+            this->collect(slot);
+        }
+    }
+    while (!this->encodes.empty()) {
+        this->retireEncodes(true);
+    }
+    this->endTime = Clock::now();
+}
+
+void FrameReadback::collect(Slot& slot)
+{
+    GLenum result = glClientWaitSync(slot.fence, 0, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    if (result == GL_WAIT_FAILED) {
+        std::cout << "ERROR::READBACK::FENCE_WAIT_FAILED" << std::endl;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    this->retireEncodes(false);
+    if (this->encodes.size() >= MAX_ENCODES_IN_FLIGHT) {
+        this->encodeStalls++;
+        this->retireEncodes(true);
+    }
+
+    EncodeJob* encode = new EncodeJob;
+    char name[16];
+    snprintf(name, sizeof(name), "%05u.png", slot.frame);
+    encode->path = this->outputPrefix + name;
+    encode->width = this->width;
+    encode->height = this->height;
+    encode->bytes = 0;
+    encode->pixels.resize((size_t) this->width * this->height * 4);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const GLubyte* mapped = (const GLubyte*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, encode->pixels.size(), GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(&encode->pixels[0], mapped, encode->pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped) {
+        std::cout << "ERROR::READBACK::MAP_FAILED frame " << slot.frame << std::endl;
+        this->failures++;
+        delete encode;
+        return;
+    }
+
+    this->encodes.push_back(encode);
+    this->jobs.run(&FrameReadback::encodeFrame, encode, 0, 1, &encode->counter);
+}
+
+void FrameReadback::encodeFrame(void* data, GLuint, GLuint)
+{
+    EncodeJob* encode = (EncodeJob*) data;
+    encode->bytes = writePng(encode->path, &encode->pixels[0], encode->width, encode->height, 4, true);
+}
+
+void FrameReadback::retireEncodes(bool wait)
+{
+    while (!this->encodes.empty()) {
+        EncodeJob* encode = this->encodes.front();
+        if (!wait && !encode->counter.done()) {
+            return;
+        }
+        this->jobs.wait(&encode->counter);
+        wait = false;
+        if (encode->bytes > 0) {
+            this->frames++;
+            this->bytesWritten += encode->bytes;
+        }
+        else {
+            this->failures++;
+        }
+        this->encodes.pop_front();
+        delete encode;
+    }
+}
+
+void FrameReadback::printStats() const
+{
+    GLdouble seconds = this->started
+        ? std::chrono::duration<GLdouble>(this->endTime - this->startTime).count() : 0.0;
+    std::cout << "BATCH:: " << this->frames << " frames in " << seconds << " s, "
+              << (seconds > 0.0 ? this->frames / seconds : 0.0) << " fps sustained, "
+              << this->readbackStalls << " readback stalls, " << this->encodeStalls << " encode stalls, "
+              << this->bytesWritten / 1048576.0 << " MB written";
+    if (this->failures > 0) {
+        std::cout << ", " << this->failures << " failed";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,84 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "jobs.h"
+
+// Frame Readback
+// ==============
+// Batch rendering writes every frame to `<prefix>NNNNN.png` without
+// stalling the GPU on each one. capture() queues a glReadPixels of the
+// back buffer into the next of READBACK_FRAMES pixel-pack buffers and
+// fences it; the copy runs while later frames render. poll() maps the
+// buffers whose fences have signalled, copies the pixels out and hands
+// them to a job that encodes and writes the PNG. Encodes go on a JobSystem
+// meant for I/O (see jobs.h): on the frame pool, the render thread's waits
+// could run a whole encode inline.
+//
+// The CPU only waits when it laps the ring (a readback stall) or when
+// MAX_ENCODES_IN_FLIGHT frames are still being encoded (an encode stall).
+//
+// Per frame:  render -> capture() -> swap -> poll(); finish() at the end.
+class FrameReadback
+{
+public:
+    FrameReadback(JobSystem& jobs, GLuint width, GLuint height, const std::string& outputPrefix);
+    // Calls finish().
+    ~FrameReadback();
+
+    // Read back the current back buffer as frame number `frame`.
+    void capture(GLuint frame);
+    void poll();
+    // Collect every outstanding readback and wait for every encode.
+    void finish();
+
+    // Frames written, sustained fps from the first capture to finish(),
+    // stalls and bytes written.
+    void printStats() const;
+
+private:
+    static const GLuint READBACK_FRAMES = 3;
+    static const GLuint MAX_ENCODES_IN_FLIGHT = 8;
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Slot {
+        GLuint buffer;
+        GLsync fence;       // 0 if the slot is free
+        GLuint frame;
+    };
+    struct EncodeJob;
+
+    JobSystem& jobs;
+    GLuint width, height;
+    std::string outputPrefix;
+    Slot slots[READBACK_FRAMES];
+    GLuint nextSlot;
+    std::deque<EncodeJob*> encodes;
+
+    GLuint frames;
+    GLuint failures;
+    GLuint readbackStalls;
+    GLuint encodeStalls;
+    GLsizeiptr bytesWritten;
+    bool started;
+    Clock::time_point startTime;
+    Clock::time_point endTime;
+
+    static void encodeFrame(void* data, GLuint begin, GLuint end);
+    void collect(Slot& slot);
+    // Delete finished encodes from the front of the queue; with `wait`,
+    // block on the oldest one first.
+    void retireEncodes(bool wait);
+
+    FrameReadback(const FrameReadback&);
+    FrameReadback& operator=(const FrameReadback&);
+};
+
+#endif // READBACK_H
@@ -0,0 +1,452 @@
+#include "rendergraph.h"
+
+#include <algorithm>
+#include <iostream>
+
+static bool sameDesc(const RenderTargetDesc& a, const RenderTargetDesc& b)
+{
+    return a.width == b.width && a.height == b.height
+        && a.internalFormat == b.internalFormat && a.filter == b.filter;
+}
+
+static bool hasStencil(GLenum internalFormat)
+{
+    return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+// The pixel format and type glTexImage2D accepts with `internalFormat`
+// (no data is passed, but the pair must still be valid for it).
+static void pixelTransfer(GLenum internalFormat, GLenum& format, GLenum& type)
+{
+    switch (internalFormat) {
+    case GL_DEPTH24_STENCIL8:
+        format = GL_DEPTH_STENCIL;
+        type = GL_UNSIGNED_INT_24_8;
+        break;
+    case GL_DEPTH32F_STENCIL8:
+        format = GL_DEPTH_STENCIL;
+        type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+        break;
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+        format = GL_DEPTH_COMPONENT;
+        type = GL_FLOAT;
+        break;
+    default:
+        format = GL_RGBA;
+        type = GL_FLOAT;
+        break;
+    }
+}
+
+RenderGraph::PassNode::PassNode(const char* name, LinearArena& arena)
+    : name(name)
+    , closure(NULL)
+    , invoke(NULL)
+    , destroy(NULL)
+    , reads(arena)
+    , writes(arena)
+    , attachments(arena)
+    , screen(false)
+    , culled(false)
+{
+}
+
+bool RenderGraph::FramebufferKey::operator<(const FramebufferKey& other) const
+{
+    if (this->count != other.count) {
+        return this->count < other.count;
+    }
+    return std::lexicographical_compare(this->values, this->values + 2 * this->count,
+                                        other.values, other.values + 2 * other.count);
+}
+
+RenderGraph::RenderGraph(GLuint screenWidth, GLuint screenHeight, LinearArena& frameArena)
+    : screenWidth(screenWidth)
+    , screenHeight(screenHeight)
+    , frameArena(frameArena)
+    , frame(0)
+    , culledPasses(0)
+    , transientBytes(0)
+    , aliasedBytes(0)
+    , aliasedTextures(0)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    this->end();
+    for (std::map<FramebufferKey, GLuint>::iterator it = this->framebuffers.begin();
+         it != this->framebuffers.end(); ++it) {
+        glDeleteFramebuffers(1, &it->second);
+    }
+    for (GLuint i = 0; i < this->pool.size(); i++) {
+        untrackTexture(this->pool[i].texture);
+        glDeleteTextures(1, &this->pool[i].texture);
+    }
+}
+
+// Declaration
+// -----------
+
+void RenderGraph::begin()
+{
+    this->end();
+    this->frame++;
+}
+
+void RenderGraph::end()
+{
+    for (GLuint i = 0; i < this->passes.size(); i++) {
+        this->passes[i].destroy(this->passes[i].closure);
+    }
+    this->resources.clear();
+    this->passes.clear();
+}
+
+RenderGraph::Resource RenderGraph::createTexture(const char* name, GLuint width, GLuint height,
+                                                 GLenum internalFormat, GLenum filter,
+                                                 GpuMemoryCategory category)
+{
+    ResourceNode node;
+    node.name = name;
+    node.desc.width = width;
+    node.desc.height = height;
+    node.desc.internalFormat = internalFormat;
+    node.desc.filter = filter;
+    node.desc.category = category;
+    node.imported = false;
+    node.texture = 0;
+    node.firstPass = -1;
+    node.lastPass = -1;
+    this->resources.push_back(node);
+    return this->resources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::importTexture(const char* name, GLuint texture, GLuint width, GLuint height,
+                                                 GLenum internalFormat)
+{
+    Resource resource = this->createTexture(name, width, height, internalFormat, GL_NONE);
+    this->resources[resource].imported = true;
+    this->resources[resource].texture = texture;
+    return resource;
+}
+
+RenderGraph::Pass RenderGraph::addPass(const char* name, void* closure, PassThunk invoke, PassThunk destroy)
+{
+    PassNode node(name, this->frameArena);
+    node.closure = closure;
+    node.invoke = invoke;
+    node.destroy = destroy;
+    this->passes.push_back(node);
+    return this->passes.size() - 1;
+}
+
+void RenderGraph::read(Pass pass, Resource resource)
+{
+    this->passes[pass].reads.push_back(resource);
+}
+
+void RenderGraph::writeColor(Pass pass, Resource resource, GLuint index)
+{
+    if (this->passes[pass].attachments.size() == MAX_ATTACHMENTS) {
+        std::cout << "ERROR::RENDER_GRAPH::TOO_MANY_ATTACHMENTS " << this->passes[pass].name << std::endl;
+        return;
+    }
+    Attachment attachment = { GL_COLOR_ATTACHMENT0 + index, resource };
+    this->passes[pass].attachments.push_back(attachment);
+    this->passes[pass].writes.push_back(resource);
+}
+
+void RenderGraph::writeDepthStencil(Pass pass, Resource resource)
+{
+    if (this->passes[pass].attachments.size() == MAX_ATTACHMENTS) {
+        std::cout << "ERROR::RENDER_GRAPH::TOO_MANY_ATTACHMENTS " << this->passes[pass].name << std::endl;
+        return;
+    }
+    GLenum point = hasStencil(this->resources[resource].desc.internalFormat)
+                 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+    Attachment attachment = { point, resource };
+    this->passes[pass].attachments.push_back(attachment);
+    this->passes[pass].writes.push_back(resource);
+}
+
+void RenderGraph::write(Pass pass, Resource resource)
+{
+    this->passes[pass].writes.push_back(resource);
+}
+
+void RenderGraph::writeScreen(Pass pass)
+{
+    this->passes[pass].screen = true;
+}
+
+// Compilation
+// -----------
+
+void RenderGraph::compile()
+{
+    this->cull();
+    if (!this->computeLifetimes()) {
+        return;
+    }
+    this->allocate();
+    this->releaseIdle();
+
+    GLuint culledPasses = 0;
+    for (GLuint i = 0; i < this->passes.size(); i++) {
+        culledPasses += this->passes[i].culled;
+    }
+    GLsizeiptr transientBytes = 0;
+    for (GLuint i = 0; i < this->resources.size(); i++) {
+        const ResourceNode& resource = this->resources[i];
+        if (!resource.imported && resource.firstPass >= 0) {
+            transientBytes += (GLsizeiptr) resource.desc.width * resource.desc.height
+                            * gpuTexelSize(resource.desc.internalFormat);
+        }
+    }
+    GLsizeiptr aliasedBytes = 0;
+    GLuint aliasedTextures = 0;
+    for (GLuint i = 0; i < this->pool.size(); i++) {
+        const PooledTexture& pooled = this->pool[i];
+        if (pooled.lastUsedFrame == this->frame) {
+            aliasedBytes += (GLsizeiptr) pooled.desc.width * pooled.desc.height
+                          * gpuTexelSize(pooled.desc.internalFormat);
+            aliasedTextures++;
+        }
+    }
+    if (culledPasses != this->culledPasses || transientBytes != this->transientBytes
+        || aliasedBytes != this->aliasedBytes || aliasedTextures != this->aliasedTextures) {
+        this->culledPasses = culledPasses;
+        this->transientBytes = transientBytes;
+        this->aliasedBytes = aliasedBytes;
+        this->aliasedTextures = aliasedTextures;
+        this->printReport();
+    }
+}
+
+void RenderGraph::cull()
+{
+    // Walk back from the screen: a pass survives if a surviving pass reads
+    // something it writes.
+    ArenaVector<bool> needed(this->resources.size(), false, this->frameArena);
+    for (int i = (int) this->passes.size() - 1; i >= 0; i--) {
+        PassNode& pass = this->passes[i];
+        bool keep = pass.screen;
+        for (GLuint j = 0; j < pass.writes.size() && !keep; j++) {
+            keep = needed[pass.writes[j]];
+        }
+        pass.culled = !keep;
+        if (keep) {
+            for (GLuint j = 0; j < pass.reads.size(); j++) {
+                needed[pass.reads[j]] = true;
+            }
+        }
+    }
+}
+
+bool RenderGraph::computeLifetimes()
+{
+    ArenaVector<bool> written(this->resources.size(), false, this->frameArena);
+    for (GLuint i = 0; i < this->passes.size(); i++) {
+        const PassNode& pass = this->passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        for (GLuint j = 0; j < pass.reads.size(); j++) {
+            ResourceNode& resource = this->resources[pass.reads[j]];
+            if (!resource.imported && !written[pass.reads[j]]) {
+                std::cout << "ERROR::RENDER_GRAPH::READ_BEFORE_WRITE " << resource.name
+                          << " in " << pass.name << std::endl;
+                return false;
+            }
+            resource.lastPass = i;
+        }
+        for (GLuint j = 0; j < pass.writes.size(); j++) {
+            ResourceNode& resource = this->resources[pass.writes[j]];
+            if (resource.firstPass < 0) {
+                resource.firstPass = i;
+            }
+            resource.lastPass = i;
+            written[pass.writes[j]] = true;
+        }
+    }
+    return true;
+}
+
+void RenderGraph::allocate()
+{
+    // Greedy interval allocation in order of first use: each target takes
+    // the first pooled texture of its kind that is free by then.
+    ArenaVector<Resource> order(this->frameArena);
+    for (GLuint i = 0; i < this->resources.size(); i++) {
+        if (!this->resources[i].imported && this->resources[i].firstPass >= 0) {
+            order.push_back(i);
+        }
+    }
+    // Insertion sort: stable, and unlike std::stable_sort it needs no
+    // temporary buffer.
+    for (GLuint i = 1; i < order.size(); i++) {
+        for (GLuint j = i; j > 0 && this->resources[order[j]].firstPass < this->resources[order[j - 1]].firstPass; j--) {
+            std::swap(order[j], order[j - 1]);
+        }
+    }
+    for (GLuint i = 0; i < this->pool.size(); i++) {
+        this->pool[i].busyUntil = -1;
+    }
+
+    for (GLuint i = 0; i < order.size(); i++) {
+        ResourceNode& resource = this->resources[order[i]];
+        GLuint slot = this->pool.size();
+        for (GLuint j = 0; j < this->pool.size(); j++) {
+            if (this->pool[j].busyUntil < resource.firstPass && sameDesc(this->pool[j].desc, resource.desc)) {
+                slot = j;
+                break;
+            }
+        }
+        if (slot == this->pool.size()) {
+            PooledTexture pooled;
+            pooled.desc = resource.desc;
+            GLenum format, type;
+            pixelTransfer(resource.desc.internalFormat, format, type);
+            glGenTextures(1, &pooled.texture);
+            glBindTexture(GL_TEXTURE_2D, pooled.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, resource.desc.internalFormat,
+                         resource.desc.width, resource.desc.height, 0, format, type, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, resource.desc.filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, resource.desc.filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            trackTexture(pooled.texture, resource.desc.category, resource.name,
+                         resource.desc.width, resource.desc.height, resource.desc.internalFormat);
+            this->pool.push_back(pooled);
+        }
+        this->pool[slot].busyUntil = resource.lastPass;
+        this->pool[slot].lastUsedFrame = this->frame;
+        resource.texture = this->pool[slot].texture;
+    }
+}
+
+void RenderGraph::releaseIdle()
+{
+    for (GLuint i = 0; i < this->pool.size(); ) {
+        if (this->frame - this->pool[i].lastUsedFrame <= POOL_IDLE_FRAMES) {
+            i++;
+            continue;
+        }
+        GLuint texture = this->pool[i].texture;
+        std::map<FramebufferKey, GLuint>::iterator it = this->framebuffers.begin();
+        while (it != this->framebuffers.end()) {
+            bool attached = false;
+            for (GLuint j = 1; j < 2 * it->first.count; j += 2) {
+                attached = attached || it->first.values[j] == texture;
+            }
+            if (attached) {
+                glDeleteFramebuffers(1, &it->second);
+                this->framebuffers.erase(it++);
+            }
+            else {
+                ++it;
+            }
+        }
+        untrackTexture(texture);
+        glDeleteTextures(1, &texture);
+        this->pool[i] = this->pool.back();
+        this->pool.pop_back();
+    }
+}
+
+// Execution
+// ---------
+
+void RenderGraph::execute()
+{
+    for (GLuint i = 0; i < this->passes.size(); i++) {
+        const PassNode& pass = this->passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        if (!pass.attachments.empty()) {
+            const RenderTargetDesc& desc = this->resources[pass.attachments[0].resource].desc;
+            glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer(pass));
+            glViewport(0, 0, desc.width, desc.height);
+        }
+        else if (pass.screen) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, this->screenWidth, this->screenHeight);
+        }
+        pass.invoke(pass.closure);
+    }
+}
+
+GLuint RenderGraph::framebuffer(const PassNode& pass)
+{
+    // Keyed by (attachment point, texture) pairs: aliasing keeps the set of
+    // textures, and so of framebuffers, small and stable across frames.
+    FramebufferKey key;
+    key.count = pass.attachments.size();
+    for (GLuint i = 0; i < key.count; i++) {
+        key.values[2 * i] = pass.attachments[i].point;
+        key.values[2 * i + 1] = this->resources[pass.attachments[i].resource].texture;
+    }
+    std::map<FramebufferKey, GLuint>::iterator it = this->framebuffers.find(key);
+    if (it != this->framebuffers.end()) {
+        return it->second;
+    }
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    std::vector<GLenum> drawBuffers;
+    for (GLuint i = 0; i < 2 * key.count; i += 2) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, key.values[i], GL_TEXTURE_2D, key.values[i + 1], 0);
+        if (key.values[i] != GL_DEPTH_STENCIL_ATTACHMENT && key.values[i] != GL_DEPTH_ATTACHMENT) {
+            GLuint index = key.values[i] - GL_COLOR_ATTACHMENT0;
+            if (drawBuffers.size() <= index) {
+                drawBuffers.resize(index + 1, GL_NONE);
+            }
+            drawBuffers[index] = key.values[i];
+        }
+    }
+    if (drawBuffers.empty()) {
+        glDrawBuffer(GL_NONE);
+    }
+    else {
+        glDrawBuffers(drawBuffers.size(), &drawBuffers[0]);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE " << pass.name << std::endl;
+    }
+    this->framebuffers[key] = framebuffer;
+    return framebuffer;
+}
+
+GLuint RenderGraph::texture(Resource resource) const
+{
+    return this->resources[resource].texture;
+}
+
+bool RenderGraph::culled(Pass pass) const
+{
+    return this->passes[pass].culled;
+}
+
+void RenderGraph::printReport() const
+{
+    std::cout << "RENDER_GRAPH:: " << this->passes.size() - this->culledPasses << " of "
+              << this->passes.size() << " passes";
+    if (this->culledPasses > 0) {
+        std::cout << " (culled:";
+        for (GLuint i = 0; i < this->passes.size(); i++) {
+            if (this->passes[i].culled) {
+                std::cout << " " << this->passes[i].name;
+            }
+        }
+        std::cout << ")";
+    }
+    std::cout << ", peak render target memory " << this->transientBytes / 1048576.0
+              << " MB unaliased, " << this->aliasedBytes / 1048576.0 << " MB aliased onto "
+              << this->aliasedTextures << " textures" << std::endl;
+}
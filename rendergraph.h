@@ -0,0 +1,193 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <map>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "arena.h"
+#include "gpumemory.h"
+
+// Render Graph
+// ============
+// The frame is declared, every frame, as a list of passes that read and
+// write named textures. compile() then:
+//
+//   - culls every pass whose outputs nobody reads (walking back from the
+//     passes that draw to the screen), e.g. the SSAO chain when lighting
+//     doesn't sample it;
+//   - validates the schedule: passes run in declaration order, so each
+//     transient texture must be written before it is read;
+//   - gives every transient texture a lifetime (first to last pass using
+//     it) and places it in a pool of GL textures, reusing a texture of the
+//     same format, size and filtering whose previous occupant is already
+//     dead. GL has no placement of textures in shared memory, so reusing
+//     the texture object is how two targets alias here.
+//
+// execute() then runs the surviving passes, binding a framebuffer built
+// (once, and cached) from each pass's color/depth attachments and setting
+// the viewport to their size. Imported textures (history buffers, the
+// shadow atlas) are owned elsewhere; the graph tracks their reads and
+// writes for culling but never aliases them.
+//
+// Transient textures' contents are undefined when their first pass starts:
+// that pass must clear or cover every pixel.
+//
+// A frame's passes, their read / write lists and their closures live in
+// the frame arena, so declaring the graph allocates nothing on the heap.
+// end() lets go of them and must come before the arena is reset.
+struct RenderTargetDesc {
+    GLuint width;
+    GLuint height;
+    GLenum internalFormat;
+    GLenum filter;
+    GpuMemoryCategory category;
+};
+
+class RenderGraph
+{
+public:
+    typedef GLuint Resource;
+    typedef GLuint Pass;
+
+    // `screenWidth` x `screenHeight` is the viewport set for passes that
+    // draw to framebuffer 0. Passes are declared in `frameArena`.
+    RenderGraph(GLuint screenWidth, GLuint screenHeight, LinearArena& frameArena);
+    ~RenderGraph();
+
+    // Declaration
+    // -----------
+    // Start a new frame's graph; handles from the previous frame are void.
+    void begin();
+
+    // `category` is what the pooled texture is accounted as (by the target
+    // that first needed it, when aliased).
+    Resource createTexture(const char* name, GLuint width, GLuint height,
+                           GLenum internalFormat, GLenum filter = GL_LINEAR,
+                           GpuMemoryCategory category = GPU_MEMORY_OTHER);
+    Resource importTexture(const char* name, GLuint texture, GLuint width, GLuint height,
+                           GLenum internalFormat);
+
+    // `execute` is any void() callable (usually a lambda); it is copied
+    // into the frame arena and destroyed by end().
+    template <class Function>
+    Pass addPass(const char* name, Function execute)
+    {
+        void* closure = new (this->frameArena.allocate<Function>()) Function(std::move(execute));
+        return this->addPass(name, closure, &invokePass<Function>, &destroyPass<Function>);
+    }
+    void read(Pass pass, Resource resource);
+    // Render to `resource` as color attachment `index` / as the
+    // depth-stencil attachment (the depth attachment for a depth-only
+    // format). A pass that keeps a target's contents
+    // (blending, depth testing) must also read() it.
+    void writeColor(Pass pass, Resource resource, GLuint index);
+    void writeDepthStencil(Pass pass, Resource resource);
+    // Written by the pass through its own framebuffer.
+    void write(Pass pass, Resource resource);
+    // Draws to framebuffer 0: the pass and everything it reads is kept.
+    void writeScreen(Pass pass);
+
+    // Cull, validate and allocate. Prints the memory report whenever the
+    // compiled frame changes shape.
+    void compile();
+    void execute();
+    // Done with this frame's graph: destroys the pass closures and drops
+    // every handle, so the frame arena can be reset.
+    void end();
+
+    // The GL texture behind `resource` (after compile()).
+    GLuint texture(Resource resource) const;
+    bool culled(Pass pass) const;
+
+    // Peak render target memory: every transient target in its own texture
+    // (as if allocated by hand) against the aliased pool.
+    void printReport() const;
+
+private:
+    // Pool textures unused for this many frames are deleted.
+    static const GLuint POOL_IDLE_FRAMES = 120;
+    // Color and depth attachments of one pass, at most.
+    static const GLuint MAX_ATTACHMENTS = 8;
+
+    typedef void (*PassThunk)(void* closure);
+
+    struct ResourceNode {
+        const char* name;
+        RenderTargetDesc desc;
+        bool imported;
+        GLuint texture;
+        int firstPass;
+        int lastPass;
+    };
+    struct Attachment {
+        GLenum point;
+        Resource resource;
+    };
+    struct PassNode {
+        const char* name;
+        void* closure;
+        PassThunk invoke;
+        PassThunk destroy;
+        ArenaVector<Resource> reads;
+        ArenaVector<Resource> writes;
+        ArenaVector<Attachment> attachments;
+        bool screen;
+        bool culled;
+
+        PassNode(const char* name, LinearArena& arena);
+    };
+    // (attachment point, texture) pairs.
+    struct FramebufferKey {
+        GLuint count;
+        GLuint values[2 * MAX_ATTACHMENTS];
+
+        bool operator<(const FramebufferKey& other) const;
+    };
+    struct PooledTexture {
+        RenderTargetDesc desc;
+        GLuint texture;
+        int busyUntil;
+        GLuint lastUsedFrame;
+    };
+
+    GLuint screenWidth, screenHeight;
+    LinearArena& frameArena;
+    std::vector<ResourceNode> resources;
+    std::vector<PassNode> passes;
+    std::vector<PooledTexture> pool;
+    std::map<FramebufferKey, GLuint> framebuffers;
+    GLuint frame;
+
+    // Last reported shape: culled pass count, bytes before / after.
+    GLuint culledPasses;
+    GLsizeiptr transientBytes;
+    GLsizeiptr aliasedBytes;
+    GLuint aliasedTextures;
+
+    template <class Function>
+    static void invokePass(void* closure)
+    {
+        (*static_cast<Function*>(closure))();
+    }
+    template <class Function>
+    static void destroyPass(void* closure)
+    {
+        static_cast<Function*>(closure)->~Function();
+    }
+    Pass addPass(const char* name, void* closure, PassThunk invoke, PassThunk destroy);
+
+    void cull();
+    bool computeLifetimes();
+    void allocate();
+    void releaseIdle();
+    GLuint framebuffer(const PassNode& pass);
+
+    RenderGraph(const RenderGraph&);
+    RenderGraph& operator=(const RenderGraph&);
+};
+
+#endif // RENDERGRAPH_H
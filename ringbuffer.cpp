@@ -0,0 +1,126 @@
+#include "ringbuffer.h"
+
+#include <chrono>
+#include <iostream>
+
+#include "gpumemory.h"
+
+FrameRingBuffer::FrameRingBuffer(GLsizeiptr frameSize)
+    : frameSize(frameSize)
+    , fenceWaitTime(0.0)
+    , frame(0)
+    , regionBase(0)
+    , head(0)
+    , flushedHead(0)
+    , mapped(NULL)
+{
+    for (GLuint i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        this->fences[i] = 0;
+    }
+
+    this->persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+    glGenBuffers(1, &this->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+    if (this->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, FRAMES_IN_FLIGHT * frameSize, NULL, flags);
+        trackBuffer(this->buffer, GPU_MEMORY_UPLOAD, "frame upload ring", FRAMES_IN_FLIGHT * frameSize);
+        this->mapped = (char*) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, FRAMES_IN_FLIGHT * frameSize, flags);
+        if (!this->mapped) {
+            std::cout << "ERROR::RING_BUFFER::PERSISTENT_MAP_FAILED" << std::endl;
+        }
+    }
+    else {
+        // Orphaning gives every frame fresh storage, so one region is enough.
+        glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+        trackBuffer(this->buffer, GPU_MEMORY_UPLOAD, "frame upload ring", frameSize);
+        this->staging.resize(frameSize);
+        this->mapped = &this->staging[0];
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+FrameRingBuffer::~FrameRingBuffer()
+{
+    for (GLuint i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        if (this->fences[i]) {
+            glDeleteSync(this->fences[i]);
+        }
+    }
+    if (this->persistent) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    untrackBuffer(this->buffer);
+    glDeleteBuffers(1, &this->buffer);
+}
+
+void FrameRingBuffer::beginFrame()
+{
+    this->head = 0;
+    this->flushedHead = 0;
+    if (!this->persistent) {
+        return;
+    }
+
+    this->regionBase = this->frame * this->frameSize;
+    GLsync fence = this->fences[this->frame];
+    if (fence) {
+        typedef std::chrono::high_resolution_clock Clock;
+        Clock::time_point start = Clock::now();
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        if (result == GL_WAIT_FAILED) {
+            std::cout << "ERROR::RING_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+        }
+        glDeleteSync(fence);
+        this->fences[this->frame] = 0;
+        this->fenceWaitTime += std::chrono::duration<GLdouble, std::milli>(Clock::now() - start).count();
+    }
+}
+
+RingAllocation FrameRingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+    RingAllocation allocation = { NULL, 0, size };
+    // Region bases are multiples of frameSize, so align the absolute offset.
+    GLintptr offset = this->regionBase + this->head;
+    offset = (offset + alignment - 1) / alignment * alignment;
+    GLsizeiptr end = offset - this->regionBase + size;
+    if (end > this->frameSize) {
+        std::cout << "ERROR::RING_BUFFER::OUT_OF_SPACE " << size << " bytes" << std::endl;
+        return allocation;
+    }
+    this->head = end;
+    allocation.offset = offset;
+    allocation.data   = this->mapped + (this->persistent ? offset : offset - this->regionBase);
+    return allocation;
+}
+
+void FrameRingBuffer::flush()
+{
+    if (this->persistent || this->head == this->flushedHead) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+    if (this->flushedHead == 0) {
+        // First upload of the frame: orphan, so the driver hands us new
+        // storage instead of waiting for draws still reading the old one.
+        glBufferData(GL_COPY_WRITE_BUFFER, this->frameSize, NULL, GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_COPY_WRITE_BUFFER, this->flushedHead,
+                    this->head - this->flushedHead, &this->staging[this->flushedHead]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    this->flushedHead = this->head;
+}
+
+void FrameRingBuffer::endFrame()
+{
+    this->flush();
+    if (this->persistent) {
+        this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->frame = (this->frame + 1) % FRAMES_IN_FLIGHT;
+    }
+}
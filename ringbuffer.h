@@ -0,0 +1,65 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+// Per-Frame Upload Ring
+// =====================
+// One buffer object split into FRAMES_IN_FLIGHT regions. Each frame bump-
+// allocates its dynamic data (UBO ranges, instance attributes, ...) from the
+// next region, and a fence sync object marks when the GPU is done with it.
+// The CPU only ever waits if it laps the GPU by a whole ring, so frame N+1
+// can be prepared while frame N is still drawing.
+//
+// With ARB_buffer_storage the buffer is persistently and coherently mapped
+// and allocations point straight into GPU-visible memory. Without it,
+// allocations are staged in system memory and flush() orphans the buffer
+// and uploads the frame's data in one glBufferSubData.
+//
+// Per frame:  beginFrame() -> allocate()... -> flush() -> draw -> endFrame()
+
+struct RingAllocation {
+    void*      data;
+    GLintptr   offset;  // into `buffer`, for glBindBufferRange / attrib pointers
+    GLsizeiptr size;
+};
+
+class FrameRingBuffer
+{
+public:
+    static const GLuint FRAMES_IN_FLIGHT = 3;
+
+    GLuint buffer;
+    GLsizeiptr frameSize;
+    bool persistent;
+
+    FrameRingBuffer(GLsizeiptr frameSize);
+    ~FrameRingBuffer();
+
+    void beginFrame();
+    // Returns data == NULL if the frame's region is exhausted.
+    RingAllocation allocate(GLsizeiptr size, GLsizeiptr alignment);
+    // Make everything allocated so far visible to the GPU. A no-op for the
+    // persistent mapping, which is coherent.
+    void flush();
+    void endFrame();
+
+    // Wait time spent in beginFrame (ms) over the buffer's lifetime.
+    GLdouble fenceWaitTime;
+
+private:
+    GLuint frame;
+    GLintptr regionBase;
+    GLsizeiptr head;
+    GLsizeiptr flushedHead;
+    char* mapped;
+    std::vector<char> staging;
+    GLsync fences[FRAMES_IN_FLIGHT];
+
+    FrameRingBuffer(const FrameRingBuffer&);
+    FrameRingBuffer& operator=(const FrameRingBuffer&);
+};
+
+#endif // RINGBUFFER_H
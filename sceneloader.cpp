@@ -0,0 +1,487 @@
+#include "sceneloader.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <SOIL.h>
+
+#include "gpumemory.h"
+
+const GLdouble SceneLoader::BUDGET_HEADROOM = 0.75;
+
+struct SceneLoader::TextureLoad {
+    JobCounter counter;
+    ImageUpload image;
+    GLuint placeholder;
+    TextureLoadedCallback loaded;
+};
+
+struct SceneLoader::ModelLoad {
+    JobCounter counter;
+    std::string path;
+    bool imported;
+    ModelImport import;
+    // Material textures, and their images (same order).
+    std::vector<Texture> textures;
+    std::vector<ImageUpload> images;
+    std::vector<MeshUpload> meshes;
+    GLuint nextTexture;
+    GLuint nextMesh;
+    Model* model;
+    ModelLoadedCallback loaded;
+};
+
+SceneLoader::ImageUpload::ImageUpload()
+    : label(NULL), pixels(NULL), width(0), height(0), texture(0), rowsUploaded(0)
+{
+}
+
+SceneLoader::MeshUpload::MeshUpload()
+    : VAO(0), VBO(0), EBO(0), vertexBytesUploaded(0), indexBytesUploaded(0)
+{
+}
+
+SceneLoader::SceneLoader(JobSystem& jobs, GLdouble uploadBudget)
+    : jobs(jobs), uploadBudget(uploadBudget),
+      frameTime(0.0), frameSteps(0), frameBytes(0)
+{
+    // Conservative until measured: 64 MB/s uploads, and mipmap
+    // generation at the same rate.
+    this->stepCosts[STEP_UPLOAD] = 1.0 / (64 * 1024);
+    this->stepCosts[STEP_MIPMAP] = 1.0 / (64 * 1024);
+    this->stepCosts[STEP_MODEL] = 0.05;
+    this->stepCosts[STEP_CREATE] = 0.05;
+    SceneLoaderStats totals = { 0, 0, 0, 0, 0, 0, 0.0, 0 };
+    this->totals = totals;
+}
+
+SceneLoader::~SceneLoader()
+{
+    for (size_t i = 0; i < this->textureLoads.size(); i++) {
+        TextureLoad* load = this->textureLoads[i];
+        this->jobs.wait(&load->counter);
+        releaseImage(load->image);
+        this->placeholders.push_back(load->placeholder);
+        delete load;
+    }
+    for (size_t i = 0; i < this->modelLoads.size(); i++) {
+        ModelLoad* load = this->modelLoads[i];
+        this->jobs.wait(&load->counter);
+        for (size_t t = 0; t < load->images.size(); t++) {
+            releaseImage(load->images[t]);
+        }
+        for (size_t m = 0; m < load->meshes.size(); m++) {
+            releaseMesh(load->import.meshes[m], load->meshes[m]);
+        }
+        delete load;
+    }
+    for (size_t i = 0; i < this->placeholders.size(); i++) {
+        untrackTexture(this->placeholders[i]);
+        glDeleteTextures(1, &this->placeholders[i]);
+    }
+}
+
+GLuint SceneLoader::loadTexture(const std::string& path, const char* label, glm::vec3 placeholder,
+                                TextureLoadedCallback loaded)
+{
+    TextureLoad* load = new TextureLoad();
+    load->image.path = path;
+    load->image.label = label;
+    load->loaded = loaded;
+
+    GLubyte texel[3] = { (GLubyte) (glm::clamp(placeholder.r, 0.0f, 1.0f) * 255.0f + 0.5f),
+                         (GLubyte) (glm::clamp(placeholder.g, 0.0f, 1.0f) * 255.0f + 0.5f),
+                         (GLubyte) (glm::clamp(placeholder.b, 0.0f, 1.0f) * 255.0f + 0.5f) };
+    glGenTextures(1, &load->placeholder);
+    glBindTexture(GL_TEXTURE_2D, load->placeholder);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    trackTexture(load->placeholder, GPU_MEMORY_MATERIAL, "placeholder texture", 1, 1, GL_RGB);
+
+    this->textureLoads.push_back(load);
+    this->jobs.run(&SceneLoader::decodeTexture, load, 0, 1, &load->counter);
+    return load->placeholder;
+}
+
+void SceneLoader::loadModel(const std::string& path, ModelLoadedCallback loaded)
+{
+    ModelLoad* load = new ModelLoad();
+    load->path = path;
+    load->imported = false;
+    load->nextTexture = 0;
+    load->nextMesh = 0;
+    load->model = NULL;
+    load->loaded = loaded;
+    this->modelLoads.push_back(load);
+    this->jobs.run(&SceneLoader::importModel, load, 0, 1, &load->counter);
+}
+
+// Job Functions
+// =============
+// Workers touch nothing but their own load.
+
+void SceneLoader::decodeTexture(void* data, GLuint, GLuint)
+{
+    decodeImage(((TextureLoad*) data)->image);
+}
+
+void SceneLoader::importModel(void* data, GLuint, GLuint)
+{
+    ModelLoad* load = (ModelLoad*) data;
+    load->imported = Model::importFile(load->path, load->import);
+    if (!load->imported) {
+        return;
+    }
+    load->textures = Model::materialTextures(load->import);
+    load->images.resize(load->textures.size());
+    for (size_t i = 0; i < load->textures.size(); i++) {
+        load->images[i].path = load->import.directory + '/' + load->textures[i].path.C_Str();
+        load->images[i].label = "model texture";
+        decodeImage(load->images[i]);
+    }
+    load->meshes.resize(load->import.meshes.size());
+}
+
+void SceneLoader::decodeImage(ImageUpload& image)
+{
+    image.pixels = SOIL_load_image(image.path.c_str(), &image.width, &image.height, 0, SOIL_LOAD_RGB);
+}
+
+void SceneLoader::releaseImage(ImageUpload& image)
+{
+    if (image.pixels) {
+        SOIL_free_image_data(image.pixels);
+        image.pixels = NULL;
+    }
+    if (image.texture) {
+        untrackTexture(image.texture);
+        glDeleteTextures(1, &image.texture);
+        image.texture = 0;
+    }
+}
+
+// Once registered, the buffers belong to the geometry registry.
+void SceneLoader::releaseMesh(const MeshImport& mesh, MeshUpload& upload)
+{
+    if (!mesh.geometry && upload.VAO) {
+        glDeleteVertexArrays(1, &upload.VAO);
+        glDeleteBuffers(1, &upload.VBO);
+        glDeleteBuffers(1, &upload.EBO);
+    }
+}
+
+// Update
+// ======
+void SceneLoader::update()
+{
+    this->frameTime = 0.0;
+    this->frameSteps = 0;
+    this->frameBytes = 0;
+
+    if (this->jobs.threadCount() == 1) {
+        if (!this->textureLoads.empty()) {
+            this->jobs.wait(&this->textureLoads[0]->counter);
+        }
+        else if (!this->modelLoads.empty()) {
+            this->jobs.wait(&this->modelLoads[0]->counter);
+        }
+    }
+
+    // Textures
+    // --------
+    // Oldest first. Callbacks run once the uploading is done, so they may
+    // request more.
+    std::vector<TextureLoad*> texturesDone, texturesPending;
+    for (size_t i = 0; i < this->textureLoads.size(); i++) {
+        TextureLoad* load = this->textureLoads[i];
+        if (!load->counter.done()) {
+            texturesPending.push_back(load);
+            continue;
+        }
+        this->jobs.wait(&load->counter);
+        if (!load->image.pixels && !load->image.texture) {
+            std::cout << "ERROR::SCENE_LOADER::IMAGE_NOT_LOADED " << load->image.path << std::endl;
+            this->totals.failed++;
+            this->placeholders.push_back(load->placeholder);
+            delete load;
+        }
+        else if (this->uploadImage(load->image)) {
+            texturesDone.push_back(load);
+        }
+        else {
+            texturesPending.push_back(load);
+        }
+    }
+    this->textureLoads = texturesPending;
+
+    // Models
+    // ------
+    std::vector<ModelLoad*> modelsDone, modelsPending;
+    for (size_t i = 0; i < this->modelLoads.size(); i++) {
+        ModelLoad* load = this->modelLoads[i];
+        if (!load->counter.done()) {
+            modelsPending.push_back(load);
+            continue;
+        }
+        this->jobs.wait(&load->counter);
+        if (!load->imported) {
+            this->totals.failed++;
+            delete load;
+        }
+        else if (this->uploadModel(*load)) {
+            modelsDone.push_back(load);
+        }
+        else {
+            modelsPending.push_back(load);
+        }
+    }
+    this->modelLoads = modelsPending;
+
+    if (this->frameSteps > 0) {
+        this->totals.uploadFrames++;
+        this->totals.uploadedBytes += this->frameBytes;
+        this->totals.maxFrameTime = std::max(this->totals.maxFrameTime, this->frameTime);
+        if (this->frameTime > this->uploadBudget) {
+            this->totals.overruns++;
+        }
+    }
+
+    // Callbacks
+    // ---------
+    for (size_t i = 0; i < texturesDone.size(); i++) {
+        TextureLoad* load = texturesDone[i];
+        this->totals.texturesLoaded++;
+        load->loaded(load->image.texture);
+        untrackTexture(load->placeholder);
+        glDeleteTextures(1, &load->placeholder);
+        delete load;
+    }
+    for (size_t i = 0; i < modelsDone.size(); i++) {
+        this->totals.modelsLoaded++;
+        modelsDone[i]->loaded(modelsDone[i]->model);
+        delete modelsDone[i];
+    }
+}
+
+bool SceneLoader::idle() const
+{
+    return this->textureLoads.empty() && this->modelLoads.empty();
+}
+
+// Uploads
+// =======
+// Each returns true once its item is complete, false when the frame's
+// budget ran out first; called again next frame, it picks up where it
+// stopped.
+
+bool SceneLoader::uploadImage(ImageUpload& image)
+{
+    GLsizeiptr rowBytes = (GLsizeiptr) image.width * 3;
+    if (!image.texture) {
+        if (!this->stepFits(STEP_CREATE, 1)) {
+            return false;
+        }
+        Clock::time_point start = Clock::now();
+        glGenTextures(1, &image.texture);
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        this->endStep(STEP_CREATE, start, 1);
+    }
+
+    while (image.rowsUploaded < (GLuint) image.height) {
+        GLsizeiptr bytes = this->bytesThatFit(rowBytes, (image.height - image.rowsUploaded) * rowBytes);
+        if (bytes == 0) {
+            return false;
+        }
+        GLuint rows = bytes / rowBytes;
+        Clock::time_point start = Clock::now();
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, image.rowsUploaded, image.width, rows,
+                        GL_RGB, GL_UNSIGNED_BYTE, image.pixels + image.rowsUploaded * rowBytes);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        image.rowsUploaded += rows;
+        this->endStep(STEP_UPLOAD, start, rows * rowBytes);
+    }
+
+    if (!this->stepFits(STEP_MIPMAP, image.height * rowBytes)) {
+        return false;
+    }
+    Clock::time_point start = Clock::now();
+    glBindTexture(GL_TEXTURE_2D, image.texture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    this->endStep(STEP_MIPMAP, start, image.height * rowBytes);
+    trackTexture(image.texture, GPU_MEMORY_MATERIAL, image.label, image.width, image.height, GL_RGB, 0);
+    SOIL_free_image_data(image.pixels);
+    image.pixels = NULL;
+    return true;
+}
+
+// Buffers are allocated and the VAO set up first; an identical mesh
+// already in the geometry registry is shared instead (see geometry.h).
+bool SceneLoader::uploadMesh(MeshImport& mesh, MeshUpload& upload)
+{
+    GLsizeiptr vertexBytes = mesh.vertices.size() * sizeof(Vertex);
+    GLsizeiptr indexBytes = mesh.indices.size() * sizeof(GLuint);
+    if (!upload.VAO && !mesh.geometry) {
+        if (!this->stepFits(STEP_CREATE, 1)) {
+            return false;
+        }
+        Clock::time_point start = Clock::now();
+        mesh.geometry = findGeometry(mesh.key);
+        if (!mesh.geometry) {
+            glGenBuffers(1, &upload.VBO);
+            glGenBuffers(1, &upload.EBO);
+            glGenVertexArrays(1, &upload.VAO);
+            glBindVertexArray(upload.VAO);
+                glBindBuffer(GL_ARRAY_BUFFER, upload.VBO);
+                glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload.EBO);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+                Mesh::vertexAttributes();
+            glBindVertexArray(0);
+        }
+        this->endStep(STEP_CREATE, start, 1);
+    }
+    if (mesh.geometry) {
+        return true;
+    }
+
+    if (!this->uploadRange(upload.VBO, mesh.vertices.data(), vertexBytes, upload.vertexBytesUploaded)
+        || !this->uploadRange(upload.EBO, mesh.indices.data(), indexBytes, upload.indexBytesUploaded)) {
+        return false;
+    }
+    trackBuffer(upload.VBO, GPU_MEMORY_MESH, "mesh vertices", vertexBytes);
+    trackBuffer(upload.EBO, GPU_MEMORY_MESH, "mesh indices", indexBytes);
+    mesh.geometry = registerGeometry(mesh.key, upload.VAO, upload.VBO, upload.EBO, vertexBytes + indexBytes);
+    return true;
+}
+
+bool SceneLoader::uploadRange(GLuint buffer, const void* data, GLsizeiptr size, GLsizeiptr& uploaded)
+{
+    while (uploaded < size) {
+        GLsizeiptr bytes = this->bytesThatFit(BUFFER_STEP_BYTES, size - uploaded);
+        if (bytes == 0) {
+            return false;
+        }
+        Clock::time_point start = Clock::now();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, uploaded, bytes, (const GLubyte*) data + uploaded);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        uploaded += bytes;
+        this->endStep(STEP_UPLOAD, start, bytes);
+    }
+    return true;
+}
+
+// Material textures, then meshes, then (if there is budget left for it)
+// the Model itself, which then only has to look things up.
+bool SceneLoader::uploadModel(ModelLoad& load)
+{
+    for (; load.nextTexture < load.textures.size(); load.nextTexture++) {
+        Texture& texture = load.textures[load.nextTexture];
+        ImageUpload& image = load.images[load.nextTexture];
+        if (!image.texture && (!image.pixels || isTextureLoaded(texture.path))) {
+            // Already there (another model), or unreadable: registered
+            // as texture 0 so the Model doesn't try again synchronously.
+            if (!image.pixels && !isTextureLoaded(texture.path)) {
+                std::cout << "ERROR::SCENE_LOADER::IMAGE_NOT_LOADED " << image.path << std::endl;
+                addLoadedTexture(texture);
+            }
+            releaseImage(image);
+            continue;
+        }
+        if (!this->uploadImage(image)) {
+            return false;
+        }
+        texture.id = image.texture;
+        addLoadedTexture(texture);
+        // The texture now belongs to the loaded textures.
+        image.texture = 0;
+    }
+
+    for (; load.nextMesh < load.meshes.size(); load.nextMesh++) {
+        if (!this->uploadMesh(load.import.meshes[load.nextMesh], load.meshes[load.nextMesh])) {
+            return false;
+        }
+    }
+
+    if (!this->stepFits(STEP_MODEL, load.meshes.size())) {
+        return false;
+    }
+    Clock::time_point start = Clock::now();
+    load.model = new Model(load.import);
+    this->endStep(STEP_MODEL, start, load.meshes.size());
+    return true;
+}
+
+// Budget
+// ======
+
+// A step predicted over budget still runs if it's the frame's first:
+// nothing else would make it fit later.
+bool SceneLoader::stepFits(StepKind kind, GLsizeiptr units) const
+{
+    return this->frameSteps == 0
+        || this->frameTime + units * this->stepCosts[kind] <= this->uploadBudget;
+}
+
+// What is left of the frame's budget as upload bytes, in whole `unit`s
+// (or all of `remaining`, if less); at least one unit for a frame's first
+// step. Only part of the time left is planned for, as headroom for calls
+// that run slower than the estimate.
+GLsizeiptr SceneLoader::bytesThatFit(GLsizeiptr unit, GLsizeiptr remaining) const
+{
+    GLdouble bytesLeft = (this->uploadBudget - this->frameTime) * BUDGET_HEADROOM / this->stepCosts[STEP_UPLOAD];
+    GLsizeiptr units = bytesLeft > 0.0 ? (GLsizeiptr) bytesLeft / unit : 0;
+    if (units == 0 && this->frameSteps == 0) {
+        units = 1;
+    }
+    if (units == 0) {
+        return remaining < unit && bytesLeft >= remaining ? remaining : 0;
+    }
+    return std::min(units * unit, remaining);
+}
+
+// Estimates are moving averages, so one slow call doesn't stall loading
+// for the next frames.
+void SceneLoader::endStep(StepKind kind, Clock::time_point start, GLsizeiptr units)
+{
+    GLdouble time = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    this->frameTime += time;
+    this->frameSteps++;
+    if (kind == STEP_UPLOAD) {
+        this->frameBytes += units;
+    }
+    if (units > 0) {
+        this->stepCosts[kind] = 0.75 * this->stepCosts[kind] + 0.25 * time / units;
+    }
+}
+
+SceneLoaderStats SceneLoader::stats() const
+{
+    SceneLoaderStats stats = this->totals;
+    stats.pending = this->textureLoads.size() + this->modelLoads.size();
+    return stats;
+}
+
+void SceneLoader::printStats() const
+{
+    SceneLoaderStats stats = this->stats();
+    std::cout << "SCENE_LOADER:: " << stats.texturesLoaded << " textures, " << stats.modelsLoaded
+              << " models loaded (" << stats.failed << " failed, " << stats.pending << " pending), "
+              << stats.uploadedBytes / 1048576.0 << " MB uploaded over " << stats.uploadFrames
+              << " frames, at most " << stats.maxFrameTime << " ms per frame (budget "
+              << this->uploadBudget << " ms, " << stats.overruns << " frames over)" << std::endl;
+}
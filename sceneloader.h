@@ -0,0 +1,153 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "jobs.h"
+#include "model.h"
+
+// Scene Loading
+// =============
+// Assets are requested without blocking the frame: file reads, image
+// decoding, model import and mesh conversion run on job workers, and the
+// GL side is spread over frames by update(), which stops uploading once
+// the frame's budget (in milliseconds) is spent. Until an asset is
+// resident the caller draws a placeholder: loadTexture hands out a 1x1
+// texture of the given color, models stand in with whatever the caller
+// draws instead. A completion callback then hands over the real asset.
+//
+// Uploads are cut into steps that fit the budget: row bands of a texture
+// (glTexSubImage2D) and ranges of a buffer (glBufferSubData, through
+// GL_COPY_WRITE_BUFFER so no VAO binding is disturbed). Each step's cost
+// is predicted from the throughput measured on earlier ones, and a step
+// that won't fit waits for the next frame. Steps that can't be split
+// (creating objects, generating mipmaps, building the Model) run over
+// budget only as the first step of a frame; such frames are counted as
+// overruns. The time measured is what the upload calls cost this thread,
+// not what the GPU does with them later.
+//
+// Give it a JobSystem of its own (see jobs.h), or waiting on frame work
+// may run a whole import on the render thread. With a single-threaded
+// JobSystem jobs only run inside wait(), so update() then waits for the
+// oldest load still decoding.
+typedef std::function<void(GLuint texture)> TextureLoadedCallback;
+typedef std::function<void(Model* model)> ModelLoadedCallback;
+
+struct SceneLoaderStats {
+    GLuint texturesLoaded;
+    GLuint modelsLoaded;
+    GLuint failed;
+    GLuint pending;             // requested, not loaded yet
+    GLsizeiptr uploadedBytes;   // since start
+    GLuint uploadFrames;        // frames that uploaded anything
+    GLdouble maxFrameTime;      // ms, the most any frame spent uploading
+    GLuint overruns;            // frames over budget
+};
+
+class SceneLoader
+{
+public:
+    SceneLoader(JobSystem& jobs, GLdouble uploadBudget = 2.0);
+    // Joins outstanding jobs; unfinished loads are dropped along with
+    // their GL objects, and every placeholder is deleted.
+    ~SceneLoader();
+
+    // A 1x1 `placeholder` colored texture, at once. `path` is decoded on
+    // a worker and uploaded as a mipmapped, repeat-wrapped RGB texture;
+    // `loaded` then gets it (it's the caller's to delete) and the
+    // placeholder is deleted. If the image can't be loaded, `loaded` is
+    // never called and the placeholder stays. `label` must be a string
+    // literal (see trackTexture).
+    GLuint loadTexture(const std::string& path, const char* label, glm::vec3 placeholder,
+                       TextureLoadedCallback loaded);
+    // Import and convert `path` on a worker, then upload its material
+    // textures and meshes; `loaded` gets the Model (the caller's to
+    // delete). Not called if the file can't be imported.
+    void loadModel(const std::string& path, ModelLoadedCallback loaded);
+
+    // Once per frame, on the GL thread. Callbacks run from here.
+    void update();
+    bool idle() const;
+
+    SceneLoaderStats stats() const;
+    void printStats() const;
+
+private:
+    // Costs are tracked per kind of step, as time per unit: bytes for
+    // uploads and mipmap generation, meshes for building a Model, one for
+    // creating objects.
+    enum StepKind {
+        STEP_UPLOAD,
+        STEP_MIPMAP,
+        STEP_MODEL,
+        STEP_CREATE,
+        STEP_KINDS
+    };
+    // Fraction of the frame's remaining budget uploads are sized for.
+    static const GLdouble BUDGET_HEADROOM;
+    // Buffer ranges are uploaded in multiples of this.
+    static const GLsizeiptr BUFFER_STEP_BYTES = 16 * 1024;
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct ImageUpload {
+        std::string path;
+        const char* label;
+        unsigned char* pixels;  // SOIL
+        int width, height;
+        GLuint texture;
+        GLuint rowsUploaded;
+
+        ImageUpload();
+    };
+    struct MeshUpload {
+        GLuint VAO, VBO, EBO;
+        GLsizeiptr vertexBytesUploaded;
+        GLsizeiptr indexBytesUploaded;
+
+        MeshUpload();
+    };
+    struct TextureLoad;
+    struct ModelLoad;
+
+    JobSystem& jobs;
+    GLdouble uploadBudget;
+    std::vector<TextureLoad*> textureLoads;
+    std::vector<ModelLoad*> modelLoads;
+    std::vector<GLuint> placeholders;   // of failed loads
+
+    // This frame
+    GLdouble frameTime;
+    GLuint frameSteps;
+    GLsizeiptr frameBytes;
+    // ms per unit, by StepKind
+    GLdouble stepCosts[STEP_KINDS];
+
+    SceneLoaderStats totals;
+
+    static void decodeTexture(void* data, GLuint begin, GLuint end);
+    static void importModel(void* data, GLuint begin, GLuint end);
+    static void decodeImage(ImageUpload& image);
+    static void releaseImage(ImageUpload& image);
+    static void releaseMesh(const MeshImport& mesh, MeshUpload& upload);
+
+    bool uploadImage(ImageUpload& image);
+    bool uploadMesh(MeshImport& mesh, MeshUpload& upload);
+    bool uploadRange(GLuint buffer, const void* data, GLsizeiptr size, GLsizeiptr& uploaded);
+    bool uploadModel(ModelLoad& load);
+
+    bool stepFits(StepKind kind, GLsizeiptr units) const;
+    GLsizeiptr bytesThatFit(GLsizeiptr unit, GLsizeiptr remaining) const;
+    void endStep(StepKind kind, Clock::time_point start, GLsizeiptr units);
+
+    SceneLoader(const SceneLoader&);
+    SceneLoader& operator=(const SceneLoader&);
+};
+
+#endif // SCENELOADER_H
@@ -1,195 +1,292 @@
 #include "shader.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
-{
-    // Read Shader Source from File
-    // ----------------------------
-    std::string vertexShaderSource;
-    std::string fragmentShaderSource;
-    std::ifstream vertexShaderFile;
-    std::ifstream fragmentShaderFile;
+#include <chrono>
+#include <set>
+
+#include "shadercache.h"
+
+// Preprocessing
+// =============
+
+static bool readShaderFile(const std::string& path, std::string& source)
+{
+    std::ifstream shaderFile;
     // Set exceptions for input streams
-    vertexShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fragmentShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    shaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
     try
     {
-        // Process vertex shader
-        vertexShaderFile.open(vertexPath);
-        std::stringstream vertexShaderStream;
-        vertexShaderStream << vertexShaderFile.rdbuf();
-        vertexShaderFile.close();
-        vertexShaderSource = vertexShaderStream.str();
-        // Process fragment shader
-        fragmentShaderFile.open(fragmentPath);
-        std::stringstream fragmentShaderStream;
-        fragmentShaderStream << fragmentShaderFile.rdbuf();
-        fragmentShaderFile.close();
-        fragmentShaderSource = fragmentShaderStream.str();
+        shaderFile.open(path.c_str());
+        std::stringstream shaderStream;
+        shaderStream << shaderFile.rdbuf();
+        shaderFile.close();
+        source = shaderStream.str();
+        return true;
     }
     catch (std::ifstream::failure e)
     {
-        std::cout << "ERROR:SHADER:FILE_NOT_SUCCESSFULY_READ" << std::endl;
+        std::cout << "ERROR:SHADER:FILE_NOT_SUCCESSFULY_READ " << path << std::endl;
     }
-    const GLchar* vertexShaderCode = vertexShaderSource.c_str();
-    const GLchar* fragmentShaderCode = fragmentShaderSource.c_str();
+    return false;
+}
 
-    // Shader Compilation
-    // ==================
-    GLint success;
-    GLchar infoLog[512];
+static std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
 
-    // Vertex Shader
-    // -------------
-    GLuint vertexShader;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderCode, NULL);
-    glCompileShader(vertexShader);
-    // Check compilation
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+// Append `path` to `out`, expanding includes. Lines of the including file
+// are renumbered with #line so compiler errors still point at it.
+static void expandIncludes(const std::string& path, std::set<std::string>& included,
+                           std::string& out, bool isRoot)
+{
+    if (included.count(path)) {
+        return;
     }
+    included.insert(path);
 
-    // Fragment Shader
-    // ---------------
-    GLuint fragmentShader;
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderCode, NULL);
-    glCompileShader(fragmentShader);
-    // Check compilation
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    std::string source;
+    if (!readShaderFile(path, source)) {
+        return;
     }
+    std::istringstream lines(source);
+    std::string line;
+    GLuint lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line.compare(first, 8, "#include") == 0) {
+            size_t open  = line.find('"', first);
+            size_t close = line.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos) {
+                std::cout << "ERROR::SHADER::MALFORMED_INCLUDE " << path << ":" << lineNumber << std::endl;
+                continue;
+            }
+            std::string includePath = directoryOf(path) + "/" + line.substr(open + 1, close - open - 1);
+            expandIncludes(includePath, included, out, false);
+            if (isRoot) {
+                std::stringstream ss;
+                ss << "#line " << lineNumber + 1 << "\n";
+                out += ss.str();
+            }
+            continue;
+        }
+        out += line;
+        out += '\n';
+    }
+}
 
-    // Link Shader Program
-    // -------------------
-    this->Program = glCreateProgram();
-    glAttachShader(this->Program, vertexShader);
-    glAttachShader(this->Program, fragmentShader);
-    glLinkProgram(this->Program);
-    // Check linkage
-    glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+std::string preprocessShader(const char* path, const ShaderDefines& defines)
+{
+    std::set<std::string> included;
+    std::string expanded;
+    expandIncludes(path, included, expanded, true);
+
+    // #version must stay the first statement, so defines go right after it.
+    std::string header;
+    for (GLuint i = 0; i < defines.size(); i++) {
+        header += "#define " + defines[i].name + " " + defines[i].value + "\n";
     }
+    size_t versionLine = expanded.find("#version");
+    if (versionLine == std::string::npos) {
+        return header + expanded;
+    }
+    size_t insertAt = expanded.find('\n', versionLine);
+    insertAt = (insertAt == std::string::npos) ? expanded.size() : insertAt + 1;
+    if (!header.empty()) {
+        header += "#line 2\n";
+    }
+    return expanded.insert(insertAt, header);
+}
 
-    // Cleanup
-    // -------
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+ShaderDefine shaderDefine(const std::string& name, const std::string& value)
+{
+    ShaderDefine define;
+    define.name  = name;
+    define.value = value;
+    return define;
 }
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+ShaderDefine shaderDefine(const std::string& name, GLint value)
 {
-    // Read Shader Source from File
-    // ----------------------------
-    std::string vertexShaderSource;
-    std::string fragmentShaderSource;
-    std::string geometryShaderSource;
-    std::ifstream vertexShaderFile;
-    std::ifstream fragmentShaderFile;
-    std::ifstream geometryShaderFile;
+    std::stringstream ss;
+    ss << value;
+    return shaderDefine(name, ss.str());
+}
 
-    // Set exceptions for input streams
-    vertexShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fragmentShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    geometryShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        // Process vertex shader
-        vertexShaderFile.open(vertexPath);
-        std::stringstream vertexShaderStream;
-        vertexShaderStream << vertexShaderFile.rdbuf();
-        vertexShaderFile.close();
-        vertexShaderSource = vertexShaderStream.str();
-        // Process fragment shader
-        fragmentShaderFile.open(fragmentPath);
-        std::stringstream fragmentShaderStream;
-        fragmentShaderStream << fragmentShaderFile.rdbuf();
-        fragmentShaderFile.close();
-        fragmentShaderSource = fragmentShaderStream.str();
-        // Process geometry shader
-        geometryShaderFile.open(geometryPath);
-        std::stringstream geometryShaderStream;
-        geometryShaderStream << geometryShaderFile.rdbuf();
-        geometryShaderFile.close();
-        geometryShaderSource = geometryShaderStream.str();
-    }
-    catch (std::ifstream::failure e)
-    {
-        std::cout << "ERROR:SHADER:FILE_NOT_SUCCESSFULY_READ" << std::endl;
+ShaderDefine shaderDefine(const std::string& name, GLfloat value)
+{
+    // Always emit a float literal, e.g. "200.0" rather than "200".
+    std::stringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(6);
+    ss << value;
+    return shaderDefine(name, ss.str());
+}
+
+// Shader
+// ======
+
+static GLdouble currentMilliseconds()
+{
+    typedef std::chrono::steady_clock Clock;
+    return std::chrono::duration<GLdouble, std::milli>(Clock::now().time_since_epoch()).count();
+}
+
+static bool parallelCompileSupported()
+{
+    static bool initialized = false;
+    static bool supported = false;
+    if (!initialized) {
+        initialized = true;
+        supported = GLEW_KHR_parallel_shader_compile;
+        if (supported) {
+            // Let the driver pick how many threads to use.
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        }
     }
-    const GLchar* vertexShaderCode = vertexShaderSource.c_str();
-    const GLchar* fragmentShaderCode = fragmentShaderSource.c_str();
-    const GLchar* geometryShaderCode = geometryShaderSource.c_str();
+    return supported;
+}
 
-    // Shader Compilation
-    // ==================
-    GLint success;
-    GLchar infoLog[512];
+Shader::Shader(const char* vertexPath, const char* fragmentPath,
+               const ShaderDefines& defines, bool async)
+{
+    this->build(vertexPath, fragmentPath, NULL, defines, async);
+}
 
-    // Vertex Shader
-    // -------------
-    GLuint vertexShader;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderCode, NULL);
-    glCompileShader(vertexShader);
-    // Check compilation
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+               const ShaderDefines& defines, bool async)
+{
+    this->build(vertexPath, fragmentPath, geometryPath, defines, async);
+}
+
+void Shader::build(const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+                   const ShaderDefines& defines, bool async)
+{
+    this->startTime = currentMilliseconds();
+    this->pending   = false;
+    this->name      = std::string(vertexPath) + " + " + fragmentPath;
+    for (GLuint i = 0; i < defines.size(); i++) {
+        this->name += " " + defines[i].name + "=" + defines[i].value;
     }
 
-    // Fragment Shader
-    // ---------------
-    GLuint fragmentShader;
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderCode, NULL);
-    glCompileShader(fragmentShader);
-    // Check compilation
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    // Preprocess Sources
+    // ------------------
+    std::vector<std::string> sources;
+    sources.push_back(preprocessShader(vertexPath, defines));
+    sources.push_back(preprocessShader(fragmentPath, defines));
+    if (geometryPath) {
+        sources.push_back(preprocessShader(geometryPath, defines));
     }
 
-    // Geometry Shader
-    // ---------------
-    GLuint geometryShader;
-    geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometryShader, 1, &geometryShaderCode, NULL);
-    glCompileShader(geometryShader);
-    // Check compilation
-    glGetShaderiv(geometryShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(geometryShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n" << infoLog << std::endl;
+    // Program Cache Lookup
+    // --------------------
+    this->useCache = programCacheSupported();
+    this->cacheKey = 0;
+    if (this->useCache) {
+        this->cacheKey = programCacheKey(sources);
+        this->Program = loadCachedProgram(this->cacheKey);
+        if (this->Program) {
+            GLdouble milliseconds = currentMilliseconds() - this->startTime;
+            recordProgramBuild(true, milliseconds);
+            std::cout << "SHADER::CACHE_HIT " << this->name << " (" << milliseconds << " ms)" << std::endl;
+            return;
+        }
+    }
+
+    // Shader Compilation
+    // ==================
+    // Status checks are deferred to finish(), so that with parallel
+    // compilation nothing here waits on the driver.
+    parallelCompileSupported();
+    const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+    for (GLuint i = 0; i < sources.size(); i++) {
+        this->stages.push_back(this->compileStage(types[i], sources[i]));
     }
 
     // Link Shader Program
     // -------------------
     this->Program = glCreateProgram();
-    glAttachShader(this->Program, vertexShader);
-    glAttachShader(this->Program, fragmentShader);
-    glAttachShader(this->Program, geometryShader);
+    for (GLuint i = 0; i < this->stages.size(); i++) {
+        glAttachShader(this->Program, this->stages[i]);
+    }
+    if (this->useCache) {
+        glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(this->Program);
+    this->pending = true;
+
+    if (!async) {
+        this->finish();
+    }
+}
+
+GLuint Shader::compileStage(GLenum type, const std::string& source)
+{
+    const GLchar* shaderCode = source.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &shaderCode, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+bool Shader::isReady()
+{
+    if (!this->pending) {
+        return true;
+    }
+    if (!parallelCompileSupported()) {
+        // Without the extension any query blocks anyway.
+        return true;
+    }
+    GLint complete = GL_FALSE;
+    glGetProgramiv(this->Program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+void Shader::finish()
+{
+    if (!this->pending) {
+        return;
+    }
+    this->pending = false;
+
+    GLint success;
+    GLchar infoLog[512];
+    const char* stageNames[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+
+    // Check compilation
+    for (GLuint i = 0; i < this->stages.size(); i++) {
+        glGetShaderiv(this->stages[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(this->stages[i], 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::" << stageNames[i] << "::COMPILATION_FAILED " << this->name << "\n" << infoLog << std::endl;
+        }
+    }
     // Check linkage
     glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
     if (!success) {
         glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << this->name << "\n" << infoLog << std::endl;
+    }
+    else if (this->useCache) {
+        storeCachedProgram(this->cacheKey, this->Program);
     }
 
     // Cleanup
     // -------
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    glDeleteShader(geometryShader);
+    for (GLuint i = 0; i < this->stages.size(); i++) {
+        glDeleteShader(this->stages[i]);
+    }
+    this->stages.clear();
+
+    GLdouble milliseconds = currentMilliseconds() - this->startTime;
+    recordProgramBuild(false, milliseconds);
+    std::cout << "SHADER::COMPILED " << this->name << " (" << milliseconds << " ms)" << std::endl;
 }
 
-void Shader::Use() { glUseProgram(this->Program); }
+void Shader::Use()
+{
+    this->finish();
+    glUseProgram(this->Program);
+}
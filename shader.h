@@ -2,22 +2,58 @@
 #define SHADER_H
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
 #include <GL/glew.h>
 
+// Shader Variants
+// ===============
+// Sources are preprocessed before compilation: `#include "file"` is resolved
+// relative to the including file (each file at most once), and the given
+// defines are injected right after the `#version` line. Each combination of
+// defines is a separate program, so tuning constants become compile-time
+// constants instead of runtime branches.
+struct ShaderDefine {
+    std::string name;
+    std::string value;
+};
+typedef std::vector<ShaderDefine> ShaderDefines;
+
+ShaderDefine shaderDefine(const std::string& name, const std::string& value);
+ShaderDefine shaderDefine(const std::string& name, GLint value);
+ShaderDefine shaderDefine(const std::string& name, GLfloat value);
+std::string preprocessShader(const char* path, const ShaderDefines& defines);
+
 class Shader
 {
 public:
     // Program ID
     GLuint Program;
     // Constructor for reading and building the shader
-    Shader(const char* vertexPath, const char* fragmentPath);
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath);
+    // With `async`, compilation is only kicked off; with
+    // KHR_parallel_shader_compile the driver builds it on its own threads.
+    // Poll isReady() to avoid stalling, or call finish() (Use() does).
+    Shader(const char* vertexPath, const char* fragmentPath,
+           const ShaderDefines& defines = ShaderDefines(), bool async = false);
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+           const ShaderDefines& defines = ShaderDefines(), bool async = false);
     // Use the Program
     void Use();
+    bool isReady();
+    void finish();
+private:
+    std::string name;
+    std::vector<GLuint> stages;
+    bool pending;
+    bool useCache;
+    GLuint64 cacheKey;
+    GLdouble startTime;
+    void build(const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+               const ShaderDefines& defines, bool async);
+    GLuint compileStage(GLenum type, const std::string& source);
 };
 
 #endif // SHADER_H
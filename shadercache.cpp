@@ -0,0 +1,186 @@
+#include "shadercache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// On-disk entry header, followed by `length` bytes of program binary.
+struct ProgramCacheHeader {
+    char     magic[8];
+    GLuint64 key;
+    GLuint64 checksum;
+    GLuint   format;
+    GLuint   length;
+};
+
+static const char PROGRAM_CACHE_MAGIC[8] = { 'L', 'O', 'G', 'L', 'P', 'R', 'G', '1' };
+
+static std::string cacheDirectory = "shader-cache";
+static ProgramCacheStats stats = { 0, 0, 0, 0.0, 0.0 };
+
+// FNV-1a, 64 bit
+static GLuint64 hashBytes(GLuint64 hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static GLuint64 hashString(GLuint64 hash, const char* s)
+{
+    // Hash the terminator too, so ("ab", "c") and ("a", "bc") differ.
+    return s ? hashBytes(hash, s, std::strlen(s) + 1) : hashBytes(hash, "", 1);
+}
+
+static std::string cachePath(GLuint64 key)
+{
+    std::stringstream ss;
+    ss << cacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return ss.str();
+}
+
+void setProgramCacheDirectory(const std::string& directory)
+{
+    cacheDirectory = directory;
+}
+
+bool programCacheSupported()
+{
+    if (!GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+GLuint64 programCacheKey(const std::vector<std::string>& sources)
+{
+    GLuint64 hash = 14695981039346656037ULL;
+    hash = hashString(hash, (const char*) glGetString(GL_VENDOR));
+    hash = hashString(hash, (const char*) glGetString(GL_RENDERER));
+    hash = hashString(hash, (const char*) glGetString(GL_VERSION));
+    hash = hashString(hash, (const char*) glGetString(GL_SHADING_LANGUAGE_VERSION));
+    for (GLuint i = 0; i < sources.size(); i++) {
+        hash = hashString(hash, sources[i].c_str());
+    }
+    return hash;
+}
+
+GLuint loadCachedProgram(GLuint64 key)
+{
+    std::string path = cachePath(key);
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    file.read((char*) &header, sizeof(header));
+    bool valid = file
+              && std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0
+              && header.key == key
+              && header.length > 0;
+    if (valid) {
+        binary.resize(header.length);
+        file.read(&binary[0], header.length);
+        valid = file && hashBytes(14695981039346656037ULL, &binary[0], binary.size()) == header.checksum;
+    }
+    file.close();
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, &binary[0], header.length);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (!program) {
+        std::cout << "WARNING::SHADER_CACHE::REJECTED_ENTRY " << path << std::endl;
+        std::remove(path.c_str());
+        stats.rejected++;
+    }
+    return program;
+}
+
+void storeCachedProgram(GLuint64 key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+    ProgramCacheHeader header;
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.key      = key;
+    header.checksum = hashBytes(14695981039346656037ULL, &binary[0], binary.size());
+    header.format   = format;
+    header.length   = length;
+
+#ifdef _WIN32
+    _mkdir(cacheDirectory.c_str());
+#else
+    mkdir(cacheDirectory.c_str(), 0755);
+#endif
+    // Write to a temporary file and rename, so a crash mid-write never
+    // leaves a truncated entry under the real name.
+    std::string path = cachePath(key);
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+    file.write((const char*) &header, sizeof(header));
+    file.write(&binary[0], binary.size());
+    file.close();
+    if (!file || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cout << "WARNING::SHADER_CACHE::WRITE_FAILED " << path << std::endl;
+        std::remove(temporaryPath.c_str());
+    }
+}
+
+void recordProgramBuild(bool cacheHit, GLdouble milliseconds)
+{
+    if (cacheHit) {
+        stats.hits++;
+        stats.hitTime += milliseconds;
+    }
+    else {
+        stats.misses++;
+        stats.missTime += milliseconds;
+    }
+}
+
+ProgramCacheStats programCacheStats()
+{
+    return stats;
+}
+
+void printProgramCacheStats()
+{
+    std::cout << "SHADER_CACHE:: " << stats.hits + stats.misses << " programs in "
+              << stats.hitTime + stats.missTime << " ms ("
+              << stats.hits << " cached in " << stats.hitTime << " ms, "
+              << stats.misses << " compiled in " << stats.missTime << " ms";
+    if (stats.rejected) {
+        std::cout << ", " << stats.rejected << " rejected";
+    }
+    std::cout << ")" << std::endl;
+}
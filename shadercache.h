@@ -0,0 +1,41 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Program Binary Cache
+// ====================
+// Linked programs are stored on disk with glGetProgramBinary and reloaded
+// with glProgramBinary on the next launch. Entries are keyed by a hash of
+// the shader sources and the driver's vendor/renderer/version strings, so a
+// driver update or an edited shader simply misses. Anything that fails to
+// validate or load is discarded and the caller compiles from source.
+
+struct ProgramCacheStats {
+    GLuint hits;
+    GLuint misses;
+    GLuint rejected;    // present on disk but corrupt or refused by the driver
+    GLdouble hitTime;   // ms spent building programs served from the cache
+    GLdouble missTime;  // ms spent compiling and linking from source
+};
+
+// Where cache files live (default "shader-cache", relative to the working
+// directory). Created on first store.
+void setProgramCacheDirectory(const std::string& directory);
+// Requires a current context; false if the driver exposes no binary formats.
+bool programCacheSupported();
+
+GLuint64 programCacheKey(const std::vector<std::string>& sources);
+// Returns a linked program, or 0 on a miss or an invalid entry.
+GLuint loadCachedProgram(GLuint64 key);
+// `program` must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+void storeCachedProgram(GLuint64 key, GLuint program);
+
+void recordProgramBuild(bool cacheHit, GLdouble milliseconds);
+ProgramCacheStats programCacheStats();
+void printProgramCacheStats();
+
+#endif // SHADERCACHE_H
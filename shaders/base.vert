@@ -6,11 +6,7 @@ uniform mat4 modelMatrix;
 uniform mat4 modelViewMatrix;
 uniform mat4 modelViewProjectionMatrix;
 
-layout (std140) uniform Matrices
-{
-    uniform mat4 projectionMatrix;
-    uniform mat4 viewMatrix;
-};
+#include "common/matrices.glsl"
 
 out VS_OUT 
 {
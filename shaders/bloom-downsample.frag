@@ -0,0 +1,24 @@
+#version 330 core
+
+in VS_OUT
+{
+    vec3 position;
+    vec2 uv;
+} fs_in;
+
+// The next larger level (or the bright-pass output).
+uniform sampler2D image;
+
+out vec4 fragColor;
+
+// Dual-Kawase downsample: the centre and four diagonal taps half a source
+// texel away, each bilinear tap averaging a 2 x 2 block.
+void main() {
+    vec2 halfTexel = 0.5 / vec2(textureSize(image, 0));
+    vec3 sum = texture(image, fs_in.uv).rgb * 4.0;
+    sum += texture(image, fs_in.uv + vec2(-halfTexel.x, -halfTexel.y)).rgb;
+    sum += texture(image, fs_in.uv + vec2( halfTexel.x, -halfTexel.y)).rgb;
+    sum += texture(image, fs_in.uv + vec2(-halfTexel.x,  halfTexel.y)).rgb;
+    sum += texture(image, fs_in.uv + vec2( halfTexel.x,  halfTexel.y)).rgb;
+    fragColor = vec4(sum / 8.0, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+in VS_OUT
+{
+    vec3 position;
+    vec2 uv;
+} fs_in;
+
+// The next smaller level; the result is blended onto this level.
+uniform sampler2D image;
+
+out vec4 fragColor;
+
+// Dual-Kawase upsample: four taps one source texel out along the axes and
+// four (weighted double) half a texel out along the diagonals.
+void main() {
+    vec2 halfTexel = 0.5 / vec2(textureSize(image, 0));
+    vec3 sum = texture(image, fs_in.uv + vec2(-2.0 * halfTexel.x, 0.0)).rgb;
+    sum += texture(image, fs_in.uv + vec2( 2.0 * halfTexel.x, 0.0)).rgb;
+    sum += texture(image, fs_in.uv + vec2(0.0, -2.0 * halfTexel.y)).rgb;
+    sum += texture(image, fs_in.uv + vec2(0.0,  2.0 * halfTexel.y)).rgb;
+    sum += texture(image, fs_in.uv + vec2(-halfTexel.x, -halfTexel.y)).rgb * 2.0;
+    sum += texture(image, fs_in.uv + vec2( halfTexel.x, -halfTexel.y)).rgb * 2.0;
+    sum += texture(image, fs_in.uv + vec2(-halfTexel.x,  halfTexel.y)).rgb * 2.0;
+    sum += texture(image, fs_in.uv + vec2( halfTexel.x,  halfTexel.y)).rgb * 2.0;
+    fragColor = vec4(sum / 12.0, 1.0);
+}
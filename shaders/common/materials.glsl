@@ -0,0 +1,25 @@
+// Material records and per-instance material indices (material.h).
+struct MaterialRecord
+{
+    // Array layer of each slot: diffuse, specular, normal, depth.
+    ivec4 layers;
+    vec3 tint;
+    float specular;
+};
+
+#ifndef MAX_MATERIALS
+#define MAX_MATERIALS 64
+#endif
+layout (std140) uniform Materials
+{
+    MaterialRecord materials[MAX_MATERIALS];
+};
+
+// Instance i's material is component i % 4 of instanceMaterials[i / 4].
+#ifndef MAX_MATERIAL_INSTANCES
+#define MAX_MATERIAL_INSTANCES 1024
+#endif
+layout (std140) uniform InstanceMaterials
+{
+    ivec4 instanceMaterials[MAX_MATERIAL_INSTANCES / 4];
+};
@@ -0,0 +1,5 @@
+layout (std140) uniform Matrices
+{
+    uniform mat4 projectionMatrix;
+    uniform mat4 viewMatrix;
+};
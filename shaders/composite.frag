@@ -0,0 +1,38 @@
+#version 330 core
+
+in VS_OUT
+{
+    vec3 position;
+    vec2 uv;
+} fs_in;
+
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloomIntensity;
+
+// Auto exposure (exposure.h): 1 x 1 adapted luminance, exposed to
+// keyValue and clamped to [minExposure, maxExposure]. Off: exposure 1.
+uniform sampler2D adaptedLuminance;
+uniform bool autoExposureOn;
+uniform float keyValue;
+uniform float minExposure;
+uniform float maxExposure;
+
+out vec4 fragColor;
+
+// Narkowicz's fit of the ACES filmic curve.
+vec3 toneMap(vec3 color) {
+    return clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main() {
+    vec3 color = texture(scene, fs_in.uv).rgb;
+    color += texture(bloom, fs_in.uv).rgb * bloomIntensity;
+
+    float exposure = 1.0;
+    if (autoExposureOn) {
+        float adapted = texelFetch(adaptedLuminance, ivec2(0), 0).r;
+        exposure = clamp(keyValue / adapted, minExposure, maxExposure);
+    }
+    fragColor = vec4(toneMap(color * exposure), 1.0);
+}
@@ -7,9 +7,17 @@ in VS_OUT
 
 uniform vec3 color;
 
-out vec4 fragColor;
+// As in deferred-light.frag: bright pixels also feed the bloom stage.
+#ifndef BLOOM_THRESHOLD
+#define BLOOM_THRESHOLD 1.0
+#endif
+
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out vec4 brightColor;
 
 void main()
 {
     fragColor = vec4(color, 1.0);
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    brightColor = brightness >= BLOOM_THRESHOLD ? fragColor : vec4(0.0, 0.0, 0.0, 1.0);
 }
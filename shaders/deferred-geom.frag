@@ -12,40 +12,79 @@ in VS_OUT
     mat3 TBNMatrix;
     mat3 TBNMatrixInverse;
 } fs_in;
+// This instance's record in `materials`.
+flat in int instanceMaterial;
 
-struct Material
+#include "common/materials.glsl"
+
+// Sampler units are fixed per slot (MaterialLibrary::assignSamplers), and
+// so are their targets (MATERIAL_SLOT_TARGETS in material.cpp): the
+// specular maps vary between materials and are layers of one array; the
+// streamed maps are shared 2D textures.
+struct MaterialTextures
 {
     sampler2D diffuse;
-    sampler2D specular;
+    sampler2DArray specular;
     sampler2D normal;
     sampler2D depth;
-    float shininess;
 };
-uniform Material material;
+uniform MaterialTextures material;
+
+// PARALLAX_MAPPING enables the height-map ray march, PARALLAX_LAYERS sets
+// its step count. HEIGHT_SCALE (PARALLAX_HEIGHT_SCALE in conestep.h) is how
+// far the ray moves in UV per unit of depth, for both marches.
+#if (defined(PARALLAX_MAPPING) || defined(CONE_STEP_MAPPING)) && !defined(HEIGHT_SCALE)
+#error HEIGHT_SCALE must be defined (PARALLAX_HEIGHT_SCALE)
+#endif
+#ifndef PARALLAX_LAYERS
+#define PARALLAX_LAYERS 30.0
+#endif
+
+// CONE_STEP_MAPPING replaces the linear march with cone stepping;
+// material.depth is then a cone step map (conestep.h: R = depth,
+// G = sqrt(cone ratio)). Steps are at least CONE_MIN_STEP deep so thin
+// cones along walls still progress; once the ray is below the surface,
+// CONE_REFINEMENTS binary search steps find it.
+#ifndef CONE_STEPS
+#define CONE_STEPS 16
+#endif
+#ifndef CONE_MIN_STEP
+#define CONE_MIN_STEP (1.0 / 64.0)
+#endif
+#ifndef CONE_REFINEMENTS
+#define CONE_REFINEMENTS 4
+#endif
 
 vec2 parallaxMapping();
+vec2 coneStepMapping();
 
 void main() {
     position = fs_in.position;
+#if defined(CONE_STEP_MAPPING)
+    vec2 uv = coneStepMapping();
+#elif defined(PARALLAX_MAPPING)
     vec2 uv = parallaxMapping();
+#else
+    vec2 uv = fs_in.uv;
+#endif
 //    if (uv.x > 1.0 || uv.x < 0.0 || uv.y > 1.0 || uv.y < 0.0) discard;
     normal = texture(material.normal, uv).xyz;
     normal = fs_in.TBNMatrixInverse * normal;
     normal = normalize(normal);
     // To Do: Parallax Mapping
-    albedoSpecular.rgb = texture(material.diffuse, uv).rgb;
-    albedoSpecular.a   = texture(material.specular, uv).r;
+    MaterialRecord record = materials[instanceMaterial];
+    albedoSpecular.rgb = texture(material.diffuse, uv).rgb * record.tint;
+    albedoSpecular.a   = texture(material.specular, vec3(uv, record.layers.y)).r * record.specular;
 }
 
 vec2 parallaxMapping() {
-    float numLayers = 30.0;
+    float numLayers = PARALLAX_LAYERS;
     float layerDepth = 1.0 / numLayers;
     float currentLayerDepth = 0.0;
     float currentMapDepth = texture(material.depth, fs_in.uv).r;
 
     vec3 viewDir = fs_in.TBNMatrix * fs_in.position;
-    float heightScale = .1;
-    vec2 p = viewDir.xy * heightScale;
+    vec2 p = viewDir.xy * HEIGHT_SCALE;
     vec2 deltaUV = p / numLayers;
     vec2 currentUV = fs_in.uv;
 
@@ -66,3 +105,39 @@ vec2 parallaxMapping() {
 
     return previousUV*weight + currentUV*(1-weight);
 }
+
+vec2 coneStepMapping() {
+    // The same ray as parallaxMapping(): uv moves by -p per unit of depth.
+    vec3 viewDir = fs_in.TBNMatrix * fs_in.position;
+    vec2 p = viewDir.xy * HEIGHT_SCALE;
+    float rayRatio = length(p);
+
+    // The map has no mipmaps, and the loop is not uniform control flow.
+    float depth = 0.0;
+    float previousDepth = 0.0;
+    bool below = false;
+    for (int i = 0; i < CONE_STEPS; i++) {
+        vec2 depthCone = textureLod(material.depth, fs_in.uv - p * depth, 0.0).rg;
+        if (depthCone.r <= depth) {
+            below = true;
+            break;
+        }
+        float coneRatio = depthCone.g * depthCone.g;
+        previousDepth = depth;
+        depth += max(coneRatio * (depthCone.r - depth) / (rayRatio + coneRatio), CONE_MIN_STEP);
+    }
+
+    if (below) {
+        for (int i = 0; i < CONE_REFINEMENTS; i++) {
+            float middleDepth = 0.5 * (previousDepth + depth);
+            if (textureLod(material.depth, fs_in.uv - p * middleDepth, 0.0).r <= middleDepth) {
+                depth = middleDepth;
+            }
+            else {
+                previousDepth = middleDepth;
+            }
+        }
+    }
+
+    return fs_in.uv - p * depth;
+}
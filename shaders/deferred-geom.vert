@@ -5,17 +5,13 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 uv;
 layout (location = 3) in vec3 tangent;
 layout (location = 4) in vec3 bitangent;
+// Per-instance matrices, see InstanceMatrixBuffer.
+layout (location = 5)  in mat4 instanceModelView;
+layout (location = 9)  in mat4 instanceModelViewProjection;
+layout (location = 13) in mat3 instanceNormalMatrix;
 
-uniform mat4 modelMatrix;
-uniform mat4 modelViewMatrix;
-uniform mat4 modelViewMatrixInverseTranspose;
-uniform mat4 modelViewProjectionMatrix;
-
-layout (std140) uniform Matrices 
-{
-    uniform mat4 projectionMatrix;
-    uniform mat4 viewMatrix;
-};
+#include "common/matrices.glsl"
+#include "common/materials.glsl"
 
 out VS_OUT 
 {
@@ -25,15 +21,17 @@ out VS_OUT
     mat3 TBNMatrix;
     mat3 TBNMatrixInverse;
 } vs_out;
+flat out int instanceMaterial;
 
 void main() {
-    gl_Position = modelViewProjectionMatrix * vec4(position, 1.0);
-    vs_out.position = vec3(modelViewMatrix * vec4(position, 1.0));
-    vs_out.normal = mat3(modelViewMatrixInverseTranspose) * normal;
+    gl_Position = instanceModelViewProjection * vec4(position, 1.0);
+    vs_out.position = vec3(instanceModelView * vec4(position, 1.0));
+    vs_out.normal = instanceNormalMatrix * normal;
     vs_out.uv = uv;
-    vec3 T = normalize(vec3(modelViewMatrix * vec4(tangent,   0.0)));
-    vec3 B = normalize(vec3(modelViewMatrix * vec4(bitangent, 0.0)));
-    vec3 N = normalize(vec3(modelViewMatrix * vec4(normal,    0.0)));
+    vec3 T = normalize(vec3(instanceModelView * vec4(tangent,   0.0)));
+    vec3 B = normalize(vec3(instanceModelView * vec4(bitangent, 0.0)));
+    vec3 N = normalize(vec3(instanceModelView * vec4(normal,    0.0)));
     vs_out.TBNMatrixInverse = mat3(T, B, N);
     vs_out.TBNMatrix = transpose(vs_out.TBNMatrixInverse);
+    instanceMaterial = instanceMaterials[gl_InstanceID / 4][gl_InstanceID % 4];
 }
@@ -13,26 +13,39 @@ struct Light
     float constFalloff;
     float linFalloff;
     float quadFalloff;
+    // Shadow atlas tile: xy = origin, z = face size (atlas UV), w = radius.
+    // w == 0 for lights without a tile.
+    vec4 shadowTile;
 };
 
-layout (std140) uniform Matrices
+#include "common/matrices.glsl"
+
+#ifndef NR_LIGHTS
+#define NR_LIGHTS 20
+#endif
+layout (std140) uniform Lights
 {
-    uniform mat4 projectionMatrix;
-    uniform mat4 viewMatrix;
+    Light lights[NR_LIGHTS];
 };
 
-const int NR_LIGHTS = 20;
-uniform Light lights[NR_LIGHTS];
-
 uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedoSpecular;
 uniform sampler2D ssao;
 uniform bool ambientOcclusionOn;
+uniform sampler2D shadowAtlas;
 
 vec3 calcLight(Light light, vec3 fragPosition, vec3 fragNormal, vec3 fragAlbedo);
+float calcShadow(Light light, vec3 lightToFrag);
 
-out vec4 fragColor;
+// Pixels brighter than BLOOM_THRESHOLD (luminance) also go to brightColor,
+// the bloom stage's input.
+#ifndef BLOOM_THRESHOLD
+#define BLOOM_THRESHOLD 1.0
+#endif
+
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out vec4 brightColor;
 
 void main() {
     vec3 fragPosition  = texture(gPosition, fs_in.uv).rgb;
@@ -45,6 +58,8 @@ void main() {
         color += calcLight(lights[i], fragPosition, fragNormal, fragAlbedo);
     }
     fragColor = vec4(color, 1.0);
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    brightColor = brightness >= BLOOM_THRESHOLD ? fragColor : vec4(0.0, 0.0, 0.0, 1.0);
 }
 
 vec3 calcLight(Light light, vec3 fragPosition, vec3 fragNormal, vec3 fragAlbedo) {
@@ -84,6 +99,58 @@ vec3 calcLight(Light light, vec3 fragPosition, vec3 fragNormal, vec3 fragAlbedo)
     diffuse  *= attenuation;
     specular *= attenuation;
 
+    // Shadow
+    // The view matrix is rigid, so its transpose takes directions back to
+    // world space, where the shadow faces are oriented.
+    vec3 lightToFrag = transpose(mat3(viewMatrix)) * (fragPosition - lightPosition);
+    float shadow = calcShadow(light, lightToFrag);
+    diffuse  *= shadow;
+    specular *= shadow;
+
     vec3 result = ambient + diffuse + specular;
     return result;
 }
+
+// Cube face frames as ShadowAtlas renders them (face order +X -X +Y -Y +Z
+// -Z, laid out 3 x 2 in the light's tile): forward, right and up.
+const vec3 FACE_FORWARD[6] = vec3[](vec3( 1, 0, 0), vec3(-1, 0, 0), vec3(0,  1, 0),
+                                    vec3( 0,-1, 0), vec3( 0, 0, 1), vec3(0,  0,-1));
+const vec3 FACE_RIGHT[6]   = vec3[](vec3( 0, 0,-1), vec3( 0, 0, 1), vec3(1,  0, 0),
+                                    vec3( 1, 0, 0), vec3( 1, 0, 0), vec3(-1, 0, 0));
+const vec3 FACE_UP[6]      = vec3[](vec3( 0,-1, 0), vec3( 0,-1, 0), vec3(0,  0, 1),
+                                    vec3( 0, 0,-1), vec3( 0,-1, 0), vec3(0, -1, 0));
+
+float calcShadow(Light light, vec3 lightToFrag) {
+    float radius = light.shadowTile.w;
+    float distance = length(lightToFrag);
+    if (radius <= 0.0 || distance >= radius) {
+        return 1.0;
+    }
+
+    // Face Selection
+    // The major axis picks the face; the other two axes, divided by it,
+    // are the face's normalized device coordinates.
+    vec3 a = abs(lightToFrag);
+    int face;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = lightToFrag.x > 0.0 ? 0 : 1;
+    }
+    else if (a.y >= a.z) {
+        face = lightToFrag.y > 0.0 ? 2 : 3;
+    }
+    else {
+        face = lightToFrag.z > 0.0 ? 4 : 5;
+    }
+    float forward = dot(lightToFrag, FACE_FORWARD[face]);
+    vec2 faceUV = vec2(dot(lightToFrag, FACE_RIGHT[face]),
+                       dot(lightToFrag, FACE_UP[face])) / forward * 0.5 + 0.5;
+    // Keep half a texel inside the face so we never read its neighbour.
+    float halfTexel = 0.5 / (light.shadowTile.z * float(textureSize(shadowAtlas, 0).x));
+    faceUV = clamp(faceUV, halfTexel, 1.0 - halfTexel);
+
+    vec2 cell = vec2(float(face % 3), float(face / 3));
+    vec2 uv = light.shadowTile.xy + (cell + faceUV) * light.shadowTile.z;
+    float closest = texture(shadowAtlas, uv).r;
+    float bias = 0.02;
+    return distance / radius - bias > closest ? 0.0 : 1.0;
+}
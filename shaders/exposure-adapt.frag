@@ -0,0 +1,18 @@
+#version 330 core
+
+// The mip-reduced log luminance; level lastLevel (1 x 1) is the mean.
+uniform sampler2D logLuminance;
+uniform float lastLevel;
+// Last frame's adapted luminance (1 x 1).
+uniform sampler2D previousLuminance;
+// Fraction of the way to move towards the target this frame:
+// 1 - exp(-dt * rate), or 1 to reset.
+uniform float adaptation;
+
+out float adaptedLuminance;
+
+void main() {
+    float target = exp(textureLod(logLuminance, vec2(0.5), lastLevel).r);
+    float previous = texelFetch(previousLuminance, ivec2(0), 0).r;
+    adaptedLuminance = previous + (target - previous) * adaptation;
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+in VS_OUT
+{
+    vec3 position;
+    vec2 uv;
+} fs_in;
+
+// The HDR scene (lighting pass output).
+uniform sampler2D scene;
+
+out float logLuminance;
+
+// Keeps log() finite on black pixels; matches exposure.cpp.
+const float LUMINANCE_EPSILON = 1.0e-4;
+
+void main() {
+    vec3 color = texture(scene, fs_in.uv).rgb;
+    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    logLuminance = log(LUMINANCE_EPSILON + luminance);
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+#ifdef SINGLE_PASS
+in GS_OUT
+#else
+in VS_OUT
+#endif
+{
+    vec3 positionWorld;
+} fs_in;
+
+uniform vec3 lightPosition;
+uniform float nearDepth;
+uniform float farDepth;
+
+void main()
+{
+    // Linear distance mapped from [nearDepth, farDepth] to [0, 1], as
+    // blinn.frag's depthMap lookup expects.
+    float distance = length(fs_in.positionWorld - lightPosition);
+    gl_FragDepth = (distance - nearDepth) / (farDepth - nearDepth);
+}
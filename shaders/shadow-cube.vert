@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+
+uniform mat4 modelMatrix;
+
+void main()
+{
+    // World space; the geometry shader projects onto each face.
+    gl_Position = modelMatrix * vec4(position, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+in VS_OUT
+{
+    vec3 positionWorld;
+} fs_in;
+
+uniform vec3 lightPosition;
+uniform float lightRadius;
+
+void main()
+{
+    // Linear distance to the light, so every cube face (and every tile in
+    // the atlas) compares in the same units.
+    gl_FragDepth = length(fs_in.positionWorld - lightPosition) / lightRadius;
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+
+uniform mat4 modelMatrix;
+uniform mat4 lightViewProjectionMatrix;
+
+out VS_OUT
+{
+    vec3 positionWorld;
+} vs_out;
+
+void main()
+{
+    vec4 positionWorld = modelMatrix * vec4(position, 1.0);
+    gl_Position = lightViewProjectionMatrix * positionWorld;
+    vs_out.positionWorld = positionWorld.xyz;
+}
@@ -0,0 +1,67 @@
+#version 330 core
+
+in VS_OUT
+{
+    vec3 position;
+    vec2 uv;
+} fs_in;
+
+// This frame's AO, from a quarter of the kernel.
+uniform sampler2D currentAO;
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+// Last frame's output of this pass.
+uniform sampler2D historyAO;
+uniform sampler2D historyGeometry;
+uniform bool historyValid;
+
+uniform mat4 inverseViewMatrix;
+uniform mat4 previousViewMatrix;
+uniform mat4 previousViewProjectionMatrix;
+
+// r = accumulated AO, g = frames accumulated.
+layout (location = 0) out vec2 ao;
+// World-space normal and view depth, for the next frame's rejection test.
+layout (location = 1) out vec4 geometry;
+
+// Frames averaged before the history turns into an exponential average.
+const float MAX_HISTORY = 8.0;
+// History is rejected when the surface it came from is this much
+// (relative) further or nearer, or its normal turned by ~25 degrees.
+const float DEPTH_TOLERANCE = 0.05;
+const float NORMAL_TOLERANCE = 0.9;
+
+void main() {
+    vec3 fragPosition = texture(gPosition, fs_in.uv).xyz;
+    vec3 fragNormal = texture(gNormal, fs_in.uv).xyz;
+    vec4 worldPosition = inverseViewMatrix * vec4(fragPosition, 1.0);
+    vec3 worldNormal = normalize(mat3(inverseViewMatrix) * fragNormal);
+    geometry = vec4(worldNormal, fragPosition.z);
+
+    float history = 0.0;
+    float frames = 0.0;
+    if (historyValid) {
+        // Reprojection
+        vec4 previousClip = previousViewProjectionMatrix * worldPosition;
+        vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+        if (previousClip.w > 0.0 && all(greaterThanEqual(previousUV, vec2(0.0)))
+                                 && all(lessThan(previousUV, vec2(1.0)))) {
+            // Disocclusion
+            // Clamped too: previousUV * size can still round up to size.
+            ivec2 historySize = textureSize(historyGeometry, 0);
+            ivec2 previousTexel = min(ivec2(previousUV * vec2(historySize)), historySize - 1);
+            vec4 previousGeometry = texelFetch(historyGeometry, previousTexel, 0);
+            float expectedDepth = (previousViewMatrix * worldPosition).z;
+            bool sameDepth = abs(previousGeometry.w - expectedDepth) <= DEPTH_TOLERANCE * abs(expectedDepth);
+            bool sameNormal = dot(previousGeometry.xyz, worldNormal) >= NORMAL_TOLERANCE;
+            if (sameDepth && sameNormal) {
+                vec2 previous = texture(historyAO, previousUV).rg;
+                history = previous.r;
+                frames = previous.g;
+            }
+        }
+    }
+
+    frames = min(frames + 1.0, MAX_HISTORY);
+    ao = vec2(mix(history, texture(currentAO, fs_in.uv).r, 1.0 / frames), frames);
+}
@@ -6,27 +6,44 @@ in VS_OUT
     vec2 uv;
 } fs_in;
 
-layout (std140) uniform Matrices
-{
-    uniform mat4 projectionMatrix;
-    uniform mat4 viewMatrix;
-};
+#include "common/matrices.glsl"
 
 uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 
-const int KERNEL_SIZE = 32;
+// Quality and screen size are specialized per variant, see main.cpp.
+#ifndef KERNEL_SIZE
+#define KERNEL_SIZE 32
+#endif
+#ifndef SCREEN_WIDTH
+#define SCREEN_WIDTH 800.0
+#endif
+#ifndef SCREEN_HEIGHT
+#define SCREEN_HEIGHT 600.0
+#endif
+#ifndef NOISE_SIZE
+#define NOISE_SIZE 4.0
+#endif
 uniform vec3 kernelSamples[KERNEL_SIZE];
 uniform sampler2D kernelRotationTexture;
+#ifdef TEMPORAL
+// Rotates the noise vectors per frame; main.cpp also cycles the kernel
+// subset, so successive frames sample different directions.
+uniform float kernelRotation;
+#endif
 
 out float fragColor;
 
-const vec2 noiseScale = vec2(800.0 / 4.0, 600.0 / 4.0);
+const vec2 noiseScale = vec2(SCREEN_WIDTH / NOISE_SIZE, SCREEN_HEIGHT / NOISE_SIZE);
 
 void main() {
     vec3 fragPos = texture(gPosition, fs_in.uv).xyz;
     vec3 fragNormal = texture(gNormal, fs_in.uv).xyz;
     vec3 rVec = texture(kernelRotationTexture, fs_in.uv * noiseScale).xyz;
+#ifdef TEMPORAL
+    rVec.xy = mat2(cos(kernelRotation), sin(kernelRotation),
+                   -sin(kernelRotation), cos(kernelRotation)) * rVec.xy;
+#endif
     vec3 tangent = normalize((rVec - fragNormal * dot(rVec, fragNormal)));
     vec3 bitangent = cross(fragNormal, tangent);
     mat3 TBN = mat3(tangent, bitangent, fragNormal);
@@ -45,6 +62,6 @@ void main() {
         float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
         occlusion += (sampleDepth >= kernelSample.z + 0.025 ? 1.0 : 0.0) * rangeCheck;
     }
-    occlusion = 1.0 - (occlusion / KERNEL_SIZE);
+    occlusion = 1.0 - (occlusion / float(KERNEL_SIZE));
     fragColor = occlusion;
 }
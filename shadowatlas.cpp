@@ -0,0 +1,397 @@
+#include "shadowatlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gpumemory.h"
+
+// Quadtree Allocator
+// ==================
+
+QuadtreeAllocator::QuadtreeAllocator(GLuint size, GLuint minTileSize)
+    : rootSize(size), levels(1), usedArea(0)
+{
+    GLuint nodeCount = 1;
+    for (GLuint s = size, count = 1; s > minTileSize; s /= 2) {
+        count *= 4;
+        nodeCount += count;
+        this->levels++;
+    }
+    this->nodes.assign(nodeCount, (GLubyte) NODE_FREE);
+}
+
+bool QuadtreeAllocator::allocate(GLuint size, AtlasTile& tile)
+{
+    // Fill partially used nodes first; only then break up a free one.
+    return this->find(0, this->rootSize, 0, 0, size, false, tile)
+        || this->find(0, this->rootSize, 0, 0, size, true, tile);
+}
+
+bool QuadtreeAllocator::find(GLuint node, GLuint nodeSize, GLuint x, GLuint y,
+                             GLuint tileSize, bool allowSplit, AtlasTile& tile)
+{
+    GLubyte state = this->nodes[node];
+    if (state == NODE_USED || nodeSize < tileSize) {
+        return false;
+    }
+    if (nodeSize == tileSize) {
+        if (state != NODE_FREE) {
+            return false;
+        }
+        this->nodes[node] = NODE_USED;
+        this->usedArea += (GLuint64) tileSize * tileSize;
+        tile.x = x;
+        tile.y = y;
+        tile.size = tileSize;
+        return true;
+    }
+    if (state == NODE_FREE) {
+        if (!allowSplit || 4 * node + 4 >= this->nodes.size()) {
+            return false;
+        }
+        this->nodes[node] = NODE_SPLIT;
+        // Children of a free node are free; take the first one.
+        if (this->find(4 * node + 1, nodeSize / 2, x, y, tileSize, true, tile)) {
+            return true;
+        }
+        this->nodes[node] = NODE_FREE;
+        return false;
+    }
+    GLuint half = nodeSize / 2;
+    GLuint childX[4] = { x, x + half, x, x + half };
+    GLuint childY[4] = { y, y, y + half, y + half };
+    for (GLuint i = 0; i < 4; i++) {
+        if (this->find(4 * node + 1 + i, half, childX[i], childY[i], tileSize, allowSplit, tile)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void QuadtreeAllocator::release(const AtlasTile& tile)
+{
+    if (tile.size == 0) {
+        return;
+    }
+    // Walk down to the tile's node, remembering the path.
+    GLuint path[32];
+    GLuint depth = 0;
+    GLuint node = 0;
+    GLuint nodeSize = this->rootSize;
+    GLuint x = 0, y = 0;
+    while (nodeSize > tile.size) {
+        path[depth++] = node;
+        nodeSize /= 2;
+        GLuint child = (tile.x >= x + nodeSize ? 1 : 0) + (tile.y >= y + nodeSize ? 2 : 0);
+        x += (child & 1) ? nodeSize : 0;
+        y += (child & 2) ? nodeSize : 0;
+        node = 4 * node + 1 + child;
+    }
+    if (this->nodes[node] != NODE_USED) {
+        std::cout << "ERROR::SHADOW_ATLAS::RELEASING_FREE_TILE" << std::endl;
+        return;
+    }
+    this->nodes[node] = NODE_FREE;
+    this->usedArea -= (GLuint64) tile.size * tile.size;
+
+    // Merge parents whose four children are all free again.
+    while (depth > 0) {
+        GLuint parent = path[--depth];
+        GLuint first = 4 * parent + 1;
+        if (this->nodes[first] != NODE_FREE || this->nodes[first + 1] != NODE_FREE
+         || this->nodes[first + 2] != NODE_FREE || this->nodes[first + 3] != NODE_FREE) {
+            break;
+        }
+        this->nodes[parent] = NODE_FREE;
+    }
+}
+
+GLuint QuadtreeAllocator::size() const
+{
+    return this->rootSize;
+}
+
+GLfloat QuadtreeAllocator::occupancy() const
+{
+    return (GLfloat) ((GLdouble) this->usedArea / ((GLdouble) this->rootSize * this->rootSize));
+}
+
+// Cube Faces
+// ==========
+
+// Cube face orientations (forward, up) for glm::lookAt, in face order. The
+// lighting shader's face selection mirrors this table.
+static const glm::vec3 FACE_FORWARD[6] = {
+    glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(-1.0f,  0.0f,  0.0f),
+    glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f),
+    glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f)
+};
+static const glm::vec3 FACE_UP[6] = {
+    glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f),
+    glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f),
+    glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f)
+};
+
+glm::mat4 cubeFaceViewMatrix(glm::vec3 position, GLuint face)
+{
+    return glm::lookAt(position, position + FACE_FORWARD[face], FACE_UP[face]);
+}
+
+// Shadow Atlas
+// ============
+
+static const GLfloat SHADOW_NEAR_DEPTH = 0.05f;
+
+ShadowAtlas::ShadowAtlas(GLuint size, GLuint reportInterval)
+    : allocator(size, MIN_TILE_SIZE)
+    , previousBoundsFirst(0)
+    , reportInterval(reportInterval)
+    , frames(0)
+    , lightRenders(0)
+    , faceRenders(0)
+    , maxLightRenders(0)
+{
+    // 16 bits is plenty for depth that is already linear in [0, 1].
+    glGenTextures(1, &this->texture);
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    trackTexture(this->texture, GPU_MEMORY_SHADOW, "shadow atlas", size, size, GL_DEPTH_COMPONENT16);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::SHADOW_ATLAS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+    // Everything starts out unoccluded.
+    glClearDepth(1.0);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+    glDeleteFramebuffers(1, &this->framebuffer);
+    untrackTexture(this->texture);
+    glDeleteTextures(1, &this->texture);
+}
+
+GLuint ShadowAtlas::addLight(glm::vec3 position, GLfloat radius)
+{
+    ShadowLight light;
+    light.position = position;
+    light.radius = radius;
+    light.tile.x = light.tile.y = light.tile.size = 0;
+    light.importance = 0.0f;
+    light.dirty = true;
+    this->lights.push_back(light);
+    return this->lights.size() - 1;
+}
+
+void ShadowAtlas::setLight(GLuint light, glm::vec3 position, GLfloat radius)
+{
+    ShadowLight& l = this->lights[light];
+    if (l.position != position || l.radius != radius) {
+        l.position = position;
+        l.radius = radius;
+        l.dirty = true;
+    }
+}
+
+bool ShadowAtlas::intersectsLights(glm::vec4 bounds)
+{
+    if (bounds.w < 0.0f) {
+        return false;
+    }
+    bool any = false;
+    for (GLuint i = 0; i < this->lights.size(); i++) {
+        ShadowLight& light = this->lights[i];
+        GLfloat reach = light.radius + bounds.w;
+        glm::vec3 offset = glm::vec3(bounds) - light.position;
+        if (glm::dot(offset, offset) <= reach * reach) {
+            light.dirty = true;
+            any = true;
+        }
+    }
+    return any;
+}
+
+void ShadowAtlas::objectsMoved(const TransformHierarchy& transforms, GLuint first, GLuint last)
+{
+    if (this->previousBounds.size() != last - first || this->previousBoundsFirst != first) {
+        this->previousBounds.assign(last - first, glm::vec4(0.0f, 0.0f, 0.0f, -1.0f));
+        this->previousBoundsFirst = first;
+    }
+    const std::vector<NodeRange>& ranges = transforms.updatedRanges();
+    for (GLuint r = 0; r < ranges.size(); r++) {
+        GLuint begin = std::max(ranges[r].begin, first);
+        GLuint end = std::min(ranges[r].end, last);
+        for (GLuint node = begin; node < end; node++) {
+            glm::vec4 bounds = transforms.worldBounds(node);
+            if (bounds.w <= 0.0f) {
+                continue;
+            }
+            glm::vec4& previous = this->previousBounds[node - first];
+            this->intersectsLights(previous);
+            this->intersectsLights(bounds);
+            previous = bounds;
+        }
+    }
+}
+
+GLuint ShadowAtlas::tileSizeFor(GLfloat importance, GLuint currentSize) const
+{
+    GLfloat ideal = importance * MAX_TILE_SIZE;
+    // Hysteresis: grow as soon as the light needs more, but only shrink once
+    // it is well below the next size down, so tiles don't flip-flop.
+    if (currentSize && ideal <= currentSize && ideal >= 0.375f * currentSize) {
+        return currentSize;
+    }
+    GLuint size = MIN_TILE_SIZE;
+    while (size < ideal && size < MAX_TILE_SIZE) {
+        size *= 2;
+    }
+    return size;
+}
+
+void ShadowAtlas::update(glm::vec3 cameraPosition, GLfloat fovY)
+{
+    // Importance: the light's sphere of influence as a fraction of the
+    // screen height (1 when the camera is inside it).
+    GLfloat tanHalfFov = std::tan(glm::radians(fovY) * 0.5f);
+    std::vector<GLuint>& order = this->order;
+    order.resize(this->lights.size());
+    for (GLuint i = 0; i < this->lights.size(); i++) {
+        ShadowLight& light = this->lights[i];
+        GLfloat distance = glm::length(light.position - cameraPosition);
+        light.importance = (distance <= light.radius)
+                         ? 1.0f
+                         : std::min(1.0f, light.radius / (distance * tanHalfFov));
+        order[i] = i;
+    }
+
+    // Release tiles that change size, then allocate most important first,
+    // so when the atlas is full it is the least important lights that get
+    // smaller tiles (or none).
+    std::vector<GLuint>& wanted = this->wanted;
+    wanted.resize(this->lights.size());
+    for (GLuint i = 0; i < this->lights.size(); i++) {
+        ShadowLight& light = this->lights[i];
+        wanted[i] = this->tileSizeFor(light.importance, light.tile.size);
+        if (light.tile.size != 0 && light.tile.size != wanted[i]) {
+            this->allocator.release(light.tile);
+            light.tile.size = 0;
+        }
+    }
+    for (GLuint i = 1; i < order.size(); i++) {
+        for (GLuint j = i; j > 0 && this->lights[order[j]].importance > this->lights[order[j - 1]].importance; j--) {
+            std::swap(order[j], order[j - 1]);
+        }
+    }
+    for (GLuint i = 0; i < order.size(); i++) {
+        ShadowLight& light = this->lights[order[i]];
+        if (light.tile.size != 0) {
+            continue;
+        }
+        for (GLuint size = wanted[order[i]]; size >= MIN_TILE_SIZE; size /= 2) {
+            if (this->allocator.allocate(size, light.tile)) {
+                break;
+            }
+        }
+        light.dirty = true;
+    }
+}
+
+const std::vector<GLuint>& ShadowAtlas::collectRenders()
+{
+    this->renderList.clear();
+    for (GLuint i = 0; i < this->lights.size(); i++) {
+        ShadowLight& light = this->lights[i];
+        if (light.dirty && light.tile.size != 0) {
+            this->renderList.push_back(i);
+        }
+        light.dirty = false;
+    }
+
+    // Stats
+    this->frames++;
+    this->lightRenders += this->renderList.size();
+    this->faceRenders += 6 * this->renderList.size();
+    this->maxLightRenders = std::max(this->maxLightRenders, (GLuint) this->renderList.size());
+    if (this->reportInterval && this->frames == this->reportInterval) {
+        GLuint shadowed = 0;
+        for (GLuint i = 0; i < this->lights.size(); i++) {
+            shadowed += this->lights[i].tile.size != 0;
+        }
+        std::cout << "SHADOW_ATLAS:: " << this->frames << " frames: "
+                  << this->lightRenders << " light renders (" << this->faceRenders << " faces), "
+                  << "max " << this->maxLightRenders << " per frame; "
+                  << shadowed << "/" << this->lights.size() << " lights shadowed, "
+                  << "occupancy " << this->allocator.occupancy() * 100.0f << "%" << std::endl;
+        this->frames = 0;
+        this->lightRenders = 0;
+        this->faceRenders = 0;
+        this->maxLightRenders = 0;
+    }
+    return this->renderList;
+}
+
+void ShadowAtlas::beginRender()
+{
+    glGetIntegerv(GL_VIEWPORT, this->previousViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+}
+
+void ShadowAtlas::bindFace(GLuint light, GLuint face)
+{
+    const AtlasTile& tile = this->lights[light].tile;
+    GLuint faceSize = tile.size / 3;
+    GLuint x = tile.x + (face % 3) * faceSize;
+    GLuint y = tile.y + (face / 3) * faceSize;
+    glViewport(x, y, faceSize, faceSize);
+    glScissor(x, y, faceSize, faceSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+glm::mat4 ShadowAtlas::faceViewProjection(GLuint light, GLuint face) const
+{
+    const ShadowLight& l = this->lights[light];
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_DEPTH, l.radius);
+    return projection * cubeFaceViewMatrix(l.position, face);
+}
+
+void ShadowAtlas::endRender()
+{
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(this->previousViewport[0], this->previousViewport[1],
+               this->previousViewport[2], this->previousViewport[3]);
+}
+
+glm::vec4 ShadowAtlas::shadowTile(GLuint light) const
+{
+    const ShadowLight& l = this->lights[light];
+    if (l.tile.size == 0) {
+        return glm::vec4(0.0f);
+    }
+    GLfloat size = (GLfloat) this->allocator.size();
+    return glm::vec4(l.tile.x / size, l.tile.y / size, (l.tile.size / 3) / size, l.radius);
+}
+
+GLuint ShadowAtlas::size() const
+{
+    return this->allocator.size();
+}
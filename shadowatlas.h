@@ -0,0 +1,149 @@
+#ifndef SHADOWATLAS_H
+#define SHADOWATLAS_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "transform.h"
+
+// Quadtree Allocator
+// ==================
+// Hands out power-of-two square tiles of a square area. The tree is stored
+// implicitly (children of node i are 4i+1 .. 4i+4), freeing a tile merges
+// it back with its siblings, and allocation prefers space in nodes that are
+// already split so large free blocks stay whole.
+
+struct AtlasTile {
+    GLuint x, y;
+    GLuint size;    // 0 = no tile
+};
+
+class QuadtreeAllocator
+{
+public:
+    QuadtreeAllocator(GLuint size, GLuint minTileSize);
+    // `size` must be a power of two in [minTileSize, size of the area].
+    bool allocate(GLuint size, AtlasTile& tile);
+    void release(const AtlasTile& tile);
+    GLuint size() const;
+    // Allocated texels / total texels.
+    GLfloat occupancy() const;
+private:
+    enum NodeState { NODE_FREE, NODE_SPLIT, NODE_USED };
+
+    GLuint rootSize;
+    GLuint levels;
+    std::vector<GLubyte> nodes;
+    GLuint64 usedArea;
+
+    bool find(GLuint node, GLuint nodeSize, GLuint x, GLuint y,
+              GLuint tileSize, bool allowSplit, AtlasTile& tile);
+};
+
+// Cube Faces
+// ==========
+// View matrix of cube face `face` (0..5: +X -X +Y -Y +Z -Z) seen from
+// `position`, oriented as OpenGL's cube map faces.
+glm::mat4 cubeFaceViewMatrix(glm::vec3 position, GLuint face);
+
+// Shadow Atlas
+// ============
+// Omnidirectional shadows for many point lights in one depth texture. Each
+// shadowed light owns a square tile holding its six cube faces in a 3 x 2
+// grid from the tile's bottom edge up. The quadtree only hands out square
+// tiles, so the top third of each tile (33% of its texels) is deliberately
+// left unused:
+//
+//   +--------------+
+//   |    unused    |   row 2
+//   +----+----+----+
+//   | -Y | +Z | -Z |   row 1
+//   +----+----+----+
+//   | +X | -X | +Y |   row 0
+//   +----+----+----+
+//
+// Faces store linear distance to the light / light radius. Tiles are cached:
+// a light is only re-rendered when it moved, its radius changed, its tile
+// was resized, or a shadow caster moved inside its radius. Tile size follows
+// the light's importance, i.e. how large its sphere of influence is on
+// screen.
+//
+// Per frame:
+//   setLight()... update() ... objectsMoved() -> collectRenders(), then
+//   beginRender(), per light and face bindFace() + faceViewProjection() +
+//   draw casters, endRender()
+class ShadowAtlas
+{
+public:
+    static const GLuint MIN_TILE_SIZE = 128;
+    static const GLuint MAX_TILE_SIZE = 1024;
+
+    GLuint texture;
+    GLuint framebuffer;
+
+    ShadowAtlas(GLuint size = 4096, GLuint reportInterval = 300);
+    ~ShadowAtlas();
+
+    // Lights
+    GLuint addLight(glm::vec3 position, GLfloat radius);
+    void setLight(GLuint light, glm::vec3 position, GLfloat radius);
+
+    // Invalidate lights whose radius contains a moved node of
+    // [first, last) --- either where it was or where it is now. Uses the
+    // ranges of the last TransformHierarchy update.
+    void objectsMoved(const TransformHierarchy& transforms, GLuint first, GLuint last);
+
+    // Re-size tiles by importance. Tiles (shadowTile) are final after this.
+    void update(glm::vec3 cameraPosition, GLfloat fovY);
+    // The lights to re-render this frame; clears their invalidation.
+    const std::vector<GLuint>& collectRenders();
+
+    // Rendering
+    void beginRender();
+    // Viewport and scissor for one face (0..5: +X -X +Y -Y +Z -Z).
+    void bindFace(GLuint light, GLuint face);
+    glm::mat4 faceViewProjection(GLuint light, GLuint face) const;
+    void endRender();
+
+    // For the shader: xy = tile origin, z = face size (both in atlas UV),
+    // w = light radius, or all zero if the light has no tile.
+    glm::vec4 shadowTile(GLuint light) const;
+    // Width and height of the atlas texture.
+    GLuint size() const;
+
+private:
+    struct ShadowLight {
+        glm::vec3 position;
+        GLfloat radius;
+        AtlasTile tile;
+        GLfloat importance;
+        bool dirty;
+    };
+
+    QuadtreeAllocator allocator;
+    std::vector<ShadowLight> lights;
+    std::vector<GLuint> renderList;
+    // update()'s scratch, kept so a frame doesn't allocate: lights by
+    // importance, and the tile size each wants.
+    std::vector<GLuint> order;
+    std::vector<GLuint> wanted;
+    // World bounds of moved nodes when last seen, (xyz, radius); radius < 0
+    // where unknown.
+    std::vector<glm::vec4> previousBounds;
+    GLuint previousBoundsFirst;
+
+    // Stats
+    GLuint reportInterval;
+    GLuint frames;
+    GLuint lightRenders;
+    GLuint faceRenders;
+    GLuint maxLightRenders;
+    GLint previousViewport[4];
+
+    GLuint tileSizeFor(GLfloat importance, GLuint currentSize) const;
+    bool intersectsLights(glm::vec4 bounds);
+};
+
+#endif // SHADOWATLAS_H
@@ -0,0 +1,624 @@
+#include "softrender.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include <SOIL.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#define SOFTRENDER_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Software Texture
+// ================
+
+bool SoftwareTexture::load(const std::string& path)
+{
+    int width, height;
+    unsigned char* image = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+    if (!image) {
+        std::cout << "ERROR::SOFTWARE_RENDER::TEXTURE_NOT_LOADED " << path << std::endl;
+        return false;
+    }
+    this->levels.assign(1, std::vector<GLfloat>(width * height * 3));
+    this->widths.assign(1, width);
+    this->heights.assign(1, height);
+    for (int i = 0; i < width * height * 3; i++) {
+        this->levels[0][i] = image[i] / 255.0f;
+    }
+    SOIL_free_image_data(image);
+
+    // Each level a 2x2 box filter of the one above it.
+    while (this->widths.back() > 1 || this->heights.back() > 1) {
+        const std::vector<GLfloat>& source = this->levels.back();
+        GLuint sourceWidth = this->widths.back(), sourceHeight = this->heights.back();
+        GLuint levelWidth = std::max(sourceWidth / 2, 1u), levelHeight = std::max(sourceHeight / 2, 1u);
+        std::vector<GLfloat> level(levelWidth * levelHeight * 3);
+        for (GLuint y = 0; y < levelHeight; y++) {
+            GLuint y0 = std::min(2 * y, sourceHeight - 1), y1 = std::min(2 * y + 1, sourceHeight - 1);
+            for (GLuint x = 0; x < levelWidth; x++) {
+                GLuint x0 = std::min(2 * x, sourceWidth - 1), x1 = std::min(2 * x + 1, sourceWidth - 1);
+                for (GLuint c = 0; c < 3; c++) {
+                    level[(y * levelWidth + x) * 3 + c] = 0.25f * (source[(y0 * sourceWidth + x0) * 3 + c]
+                                                                 + source[(y0 * sourceWidth + x1) * 3 + c]
+                                                                 + source[(y1 * sourceWidth + x0) * 3 + c]
+                                                                 + source[(y1 * sourceWidth + x1) * 3 + c]);
+                }
+            }
+        }
+        this->levels.push_back(level);
+        this->widths.push_back(levelWidth);
+        this->heights.push_back(levelHeight);
+    }
+    return true;
+}
+
+glm::vec3 SoftwareTexture::sample(glm::vec2 uv, GLfloat lod) const
+{
+    GLint level = (GLint) std::floor(lod + 0.5f);
+    level = std::max(0, std::min(level, (GLint) this->levels.size() - 1));
+    GLint width = this->widths[level], height = this->heights[level];
+    const GLfloat* texels = &this->levels[level][0];
+
+    GLfloat u = uv.x * width - 0.5f, v = uv.y * height - 0.5f;
+    GLfloat u0 = std::floor(u), v0 = std::floor(v);
+    GLfloat fu = u - u0, fv = v - v0;
+    GLint x0 = ((GLint) u0 % width + width) % width, y0 = ((GLint) v0 % height + height) % height;
+    GLint x1 = (x0 + 1) % width, y1 = (y0 + 1) % height;
+    const GLfloat* t00 = texels + (y0 * width + x0) * 3;
+    const GLfloat* t10 = texels + (y0 * width + x1) * 3;
+    const GLfloat* t01 = texels + (y1 * width + x0) * 3;
+    const GLfloat* t11 = texels + (y1 * width + x1) * 3;
+    glm::vec3 result;
+    for (GLuint c = 0; c < 3; c++) {
+        GLfloat top = t00[c] + (t10[c] - t00[c]) * fu;
+        GLfloat bottom = t01[c] + (t11[c] - t01[c]) * fu;
+        result[c] = top + (bottom - top) * fv;
+    }
+    return result;
+}
+
+// Software Renderer
+// =================
+
+struct SoftwareRenderer::PassJob {
+    SoftwareRenderer* renderer;
+    void (SoftwareRenderer::*pass)(GLuint index);
+
+    void operator()(GLuint begin, GLuint end)
+    {
+        for (GLuint i = begin; i < end; i++) {
+            (this->renderer->*this->pass)(i);
+        }
+    }
+};
+
+static GLfloat smoothstep(GLfloat edge0, GLfloat edge1, GLfloat x)
+{
+    GLfloat t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// Narkowicz's ACES fit, as in composite.frag.
+static GLfloat toneMap(GLfloat color)
+{
+    GLfloat mapped = (color * (2.51f * color + 0.03f)) / (color * (2.43f * color + 0.59f) + 0.14f);
+    return std::min(std::max(mapped, 0.0f), 1.0f);
+}
+
+SoftwareRenderer::SoftwareRenderer(GLuint width, GLuint height, JobSystem& jobs)
+    : width(width), height(height),
+      tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+      jobs(jobs), scene(NULL), renders(0)
+{
+    GLuint pixelCount = width * height;
+    this->tileTriangles.resize(this->tilesX * this->tilesY);
+    this->covered.resize(pixelCount);
+    this->positionX.resize(pixelCount);
+    this->positionY.resize(pixelCount);
+    this->positionZ.resize(pixelCount);
+    this->normalX.resize(pixelCount);
+    this->normalY.resize(pixelCount);
+    this->normalZ.resize(pixelCount);
+    this->albedoR.resize(pixelCount);
+    this->albedoG.resize(pixelCount);
+    this->albedoB.resize(pixelCount);
+    this->occlusion.resize(pixelCount);
+    this->occlusionBlurred.resize(pixelCount);
+    this->pixels.resize(pixelCount * 3);
+    for (GLuint i = 0; i < STAGES; i++) {
+        this->stageTime[i] = 0.0;
+    }
+}
+
+void SoftwareRenderer::render(const SoftwareScene& scene, const glm::mat4& viewMatrix,
+                              const glm::mat4& projectionMatrix)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    this->scene = &scene;
+    this->viewMatrix = viewMatrix;
+    this->projectionMatrix = projectionMatrix;
+    this->lightViewPositions.resize(scene.lightPositions.size());
+    for (size_t i = 0; i < scene.lightPositions.size(); i++) {
+        this->lightViewPositions[i] = glm::vec3(viewMatrix * glm::vec4(scene.lightPositions[i], 1.0f));
+    }
+
+    // Vertex Stage and Binning
+    // ------------------------
+    Clock::time_point start = Clock::now();
+    this->objectTriangles.resize(scene.objectMatrices.size());
+    PassJob transform = { this, &SoftwareRenderer::transformObject };
+    this->jobs.parallelFor(scene.objectMatrices.size(), 1, transform);
+    this->triangles.clear();
+    for (GLuint tile = 0; tile < this->tileTriangles.size(); tile++) {
+        this->tileTriangles[tile].clear();
+    }
+    for (size_t object = 0; object < this->objectTriangles.size(); object++) {
+        for (size_t i = 0; i < this->objectTriangles[object].size(); i++) {
+            const Triangle& triangle = this->objectTriangles[object][i];
+            GLuint index = this->triangles.size();
+            this->triangles.push_back(&triangle);
+            for (GLint ty = triangle.minY / (GLint) TILE_SIZE; ty <= triangle.maxY / (GLint) TILE_SIZE; ty++) {
+                for (GLint tx = triangle.minX / (GLint) TILE_SIZE; tx <= triangle.maxX / (GLint) TILE_SIZE; tx++) {
+                    this->tileTriangles[ty * this->tilesX + tx].push_back(index);
+                }
+            }
+        }
+    }
+    Clock::time_point vertexEnd = Clock::now();
+
+    // Screen-Space Passes
+    // -------------------
+    this->runTiles(&SoftwareRenderer::rasterizeTile);
+    Clock::time_point rasterEnd = Clock::now();
+    if (scene.ambientOcclusion) {
+        this->runTiles(&SoftwareRenderer::ssaoTile);
+    }
+    Clock::time_point ssaoEnd = Clock::now();
+    if (scene.ambientOcclusion) {
+        this->runTiles(&SoftwareRenderer::blurTile);
+    }
+    Clock::time_point blurEnd = Clock::now();
+    this->runTiles(&SoftwareRenderer::lightTile);
+    Clock::time_point lightingEnd = Clock::now();
+
+    this->stageTime[STAGE_VERTEX]   += std::chrono::duration<double, std::milli>(vertexEnd - start).count();
+    this->stageTime[STAGE_RASTER]   += std::chrono::duration<double, std::milli>(rasterEnd - vertexEnd).count();
+    this->stageTime[STAGE_SSAO]     += std::chrono::duration<double, std::milli>(ssaoEnd - rasterEnd).count();
+    this->stageTime[STAGE_BLUR]     += std::chrono::duration<double, std::milli>(blurEnd - ssaoEnd).count();
+    this->stageTime[STAGE_LIGHTING] += std::chrono::duration<double, std::milli>(lightingEnd - blurEnd).count();
+    this->renders++;
+}
+
+const std::vector<GLubyte>& SoftwareRenderer::image() const
+{
+    return this->pixels;
+}
+
+bool SoftwareRenderer::save(const std::string& path) const
+{
+    if (!SOIL_save_image(path.c_str(), SOIL_SAVE_TYPE_BMP, this->width, this->height, 3, &this->pixels[0])) {
+        std::cout << "ERROR::SOFTWARE_RENDER::IMAGE_NOT_SAVED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void SoftwareRenderer::printStats() const
+{
+    if (this->renders == 0) {
+        return;
+    }
+    GLdouble total = 0.0;
+    for (GLuint i = 0; i < STAGES; i++) {
+        total += this->stageTime[i];
+    }
+    total /= this->renders;
+    GLdouble megapixels = this->width * this->height / 1000000.0;
+    std::cout << "SOFTWARE_RENDER:: " << this->width << "x" << this->height << ", "
+              << this->triangles.size() << " triangles, " << total << " ms per frame (vertex "
+              << this->stageTime[STAGE_VERTEX] / this->renders << ", raster "
+              << this->stageTime[STAGE_RASTER] / this->renders << ", ssao "
+              << this->stageTime[STAGE_SSAO] / this->renders << ", blur "
+              << this->stageTime[STAGE_BLUR] / this->renders << ", lighting "
+              << this->stageTime[STAGE_LIGHTING] / this->renders << ") on "
+              << this->jobs.threadCount() << " threads, "
+              << megapixels / (total / 1000.0) / this->jobs.threadCount() << " MP/s per core" << std::endl;
+}
+
+void SoftwareRenderer::runTiles(void (SoftwareRenderer::*pass)(GLuint tile))
+{
+    PassJob job = { this, pass };
+    this->jobs.parallelFor(this->tilesX * this->tilesY, 1, job);
+}
+
+// Vertex Stage
+// ============
+// What deferred-geom.vert passes on: view-space position, uv and the
+// view-space tangent frame.
+
+void SoftwareRenderer::transformObject(GLuint object)
+{
+    const SoftwareScene& scene = *this->scene;
+    glm::mat4 modelViewMatrix = this->viewMatrix * scene.objectMatrices[object];
+    glm::mat4 modelViewProjectionMatrix = this->projectionMatrix * modelViewMatrix;
+
+    std::vector<ClipVertex> vertices(scene.vertices.size());
+    for (size_t i = 0; i < scene.vertices.size(); i++) {
+        const Vertex& vertex = scene.vertices[i];
+        ClipVertex& out = vertices[i];
+        out.position = modelViewProjectionMatrix * glm::vec4(vertex.position, 1.0f);
+        glm::vec3 position = glm::vec3(modelViewMatrix * glm::vec4(vertex.position, 1.0f));
+        glm::vec3 tangent = glm::normalize(glm::vec3(modelViewMatrix * glm::vec4(vertex.tangent, 0.0f)));
+        glm::vec3 bitangent = glm::normalize(glm::vec3(modelViewMatrix * glm::vec4(vertex.bitangent, 0.0f)));
+        glm::vec3 normal = glm::normalize(glm::vec3(modelViewMatrix * glm::vec4(vertex.normal, 0.0f)));
+        for (GLuint c = 0; c < 3; c++) {
+            out.attributes[c] = position[c];
+            out.attributes[5 + c] = tangent[c];
+            out.attributes[8 + c] = bitangent[c];
+            out.attributes[11 + c] = normal[c];
+        }
+        out.attributes[3] = vertex.texCoord.x;
+        out.attributes[4] = vertex.texCoord.y;
+    }
+
+    std::vector<Triangle>& out = this->objectTriangles[object];
+    out.clear();
+    ClipVertex triangle[3];
+    for (size_t i = 0; i + 2 < scene.indices.size(); i += 3) {
+        triangle[0] = vertices[scene.indices[i]];
+        triangle[1] = vertices[scene.indices[i + 1]];
+        triangle[2] = vertices[scene.indices[i + 2]];
+        this->clipTriangle(triangle, out);
+    }
+}
+
+// Only the near plane (z >= -w) is clipped; the rest of the frustum is left
+// to the screen bounds and the depth test.
+void SoftwareRenderer::clipTriangle(const ClipVertex* vertices, std::vector<Triangle>& out) const
+{
+    GLfloat distance[3];
+    GLuint inside = 0;
+    for (GLuint i = 0; i < 3; i++) {
+        distance[i] = vertices[i].position.z + vertices[i].position.w;
+        inside += distance[i] >= 0.0f ? 1 : 0;
+    }
+    if (inside == 3) {
+        this->setupTriangle(vertices[0], vertices[1], vertices[2], out);
+        return;
+    }
+    if (inside == 0) {
+        return;
+    }
+
+    ClipVertex polygon[4];
+    GLuint count = 0;
+    for (GLuint i = 0; i < 3; i++) {
+        GLuint j = (i + 1) % 3;
+        if (distance[i] >= 0.0f) {
+            polygon[count++] = vertices[i];
+        }
+        if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+            GLfloat t = distance[i] / (distance[i] - distance[j]);
+            ClipVertex& crossing = polygon[count++];
+            crossing.position = vertices[i].position + (vertices[j].position - vertices[i].position) * t;
+            for (GLuint k = 0; k < ATTRIBUTES; k++) {
+                crossing.attributes[k] = vertices[i].attributes[k]
+                                       + (vertices[j].attributes[k] - vertices[i].attributes[k]) * t;
+            }
+        }
+    }
+    for (GLuint i = 1; i + 1 < count; i++) {
+        this->setupTriangle(polygon[0], polygon[i], polygon[i + 1], out);
+    }
+}
+
+void SoftwareRenderer::setupTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c,
+                                     std::vector<Triangle>& out) const
+{
+    const ClipVertex* vertices[3] = { &a, &b, &c };
+    Triangle triangle;
+    for (GLuint i = 0; i < 3; i++) {
+        GLfloat oneOverW = 1.0f / vertices[i]->position.w;
+        triangle.x[i] = (vertices[i]->position.x * oneOverW * 0.5f + 0.5f) * this->width;
+        triangle.y[i] = (vertices[i]->position.y * oneOverW * 0.5f + 0.5f) * this->height;
+        triangle.z[i] = vertices[i]->position.z * oneOverW;
+        triangle.oneOverW[i] = oneOverW;
+        for (GLuint k = 0; k < ATTRIBUTES; k++) {
+            triangle.attributes[i][k] = vertices[i]->attributes[k] * oneOverW;
+        }
+    }
+    // Counter-clockwise (GL's front face) is positive; back faces are
+    // culled, as in the geometry pass.
+    triangle.area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+                  - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+    if (!(triangle.area > 0.0f)) {
+        return;
+    }
+
+    // Pixels whose centres may be covered.
+    GLfloat minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+    GLfloat maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+    GLfloat minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+    GLfloat maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+    triangle.minX = std::max((GLint) std::ceil(minX - 0.5f), 0);
+    triangle.minY = std::max((GLint) std::ceil(minY - 0.5f), 0);
+    triangle.maxX = std::min((GLint) std::floor(maxX - 0.5f), (GLint) this->width - 1);
+    triangle.maxY = std::min((GLint) std::floor(maxY - 0.5f), (GLint) this->height - 1);
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // UV area over pixel area; each texture adds log2 of its texel count.
+    GLfloat du1 = a.attributes[3] - c.attributes[3], dv1 = a.attributes[4] - c.attributes[4];
+    GLfloat du2 = b.attributes[3] - c.attributes[3], dv2 = b.attributes[4] - c.attributes[4];
+    GLfloat uvArea = std::fabs(du1 * dv2 - du2 * dv1);
+    triangle.lod = uvArea > 0.0f ? 0.5f * std::log2(uvArea / triangle.area) : 0.0f;
+    out.push_back(triangle);
+}
+
+// Rasterization
+// =============
+
+void SoftwareRenderer::rasterizeTile(GLuint tile)
+{
+    GLint tileX = (tile % this->tilesX) * TILE_SIZE;
+    GLint tileY = (tile / this->tilesX) * TILE_SIZE;
+    GLint tileMaxX = std::min(tileX + (GLint) TILE_SIZE, (GLint) this->width) - 1;
+    GLint tileMaxY = std::min(tileY + (GLint) TILE_SIZE, (GLint) this->height) - 1;
+
+    // Cleared to 0 like the GL G-buffer: SSAO samples positionZ at
+    // uncovered pixels too, which must not see an earlier render's scene.
+    std::vector<GLfloat>* gBuffer[] = { &this->positionX, &this->positionY, &this->positionZ,
+                                        &this->normalX, &this->normalY, &this->normalZ,
+                                        &this->albedoR, &this->albedoG, &this->albedoB };
+    for (GLint y = tileY; y <= tileMaxY; y++) {
+        GLuint row = y * this->width;
+        std::fill(&this->covered[row + tileX], &this->covered[row + tileMaxX] + 1, 0);
+        for (GLuint i = 0; i < sizeof(gBuffer) / sizeof(gBuffer[0]); i++) {
+            std::fill(&(*gBuffer[i])[row + tileX], &(*gBuffer[i])[row + tileMaxX] + 1, 0.0f);
+        }
+    }
+
+    // Tile-local NDC depth, cleared to the far plane; padded so a 4-wide
+    // load at the end of the last row stays inside.
+    GLfloat depth[TILE_SIZE * TILE_SIZE + 4];
+    std::fill(depth, depth + TILE_SIZE * TILE_SIZE + 4, 1.0f);
+
+    const std::vector<GLuint>& bin = this->tileTriangles[tile];
+    for (size_t t = 0; t < bin.size(); t++) {
+        const Triangle& triangle = *this->triangles[bin[t]];
+        GLint minX = std::max(triangle.minX, tileX), maxX = std::min(triangle.maxX, tileMaxX);
+        GLint minY = std::max(triangle.minY, tileY), maxY = std::min(triangle.maxY, tileMaxY);
+        if (minX > maxX || minY > maxY) {
+            continue;
+        }
+
+        // Edge functions, each the weight of the opposite vertex times the
+        // area, at the first pixel centre, and their per-pixel steps.
+        GLfloat stepX[3], stepY[3], edgeRow[3];
+        GLfloat px = minX + 0.5f, py = minY + 0.5f;
+        for (GLuint i = 0; i < 3; i++) {
+            GLuint j = (i + 1) % 3, k = (i + 2) % 3;
+            stepX[i] = -(triangle.y[k] - triangle.y[j]);
+            stepY[i] = triangle.x[k] - triangle.x[j];
+            edgeRow[i] = (triangle.x[k] - triangle.x[j]) * (py - triangle.y[j])
+                       - (triangle.y[k] - triangle.y[j]) * (px - triangle.x[j]);
+        }
+        GLfloat oneOverArea = 1.0f / triangle.area;
+
+        for (GLint y = minY; y <= maxY; y++) {
+            GLfloat* depthRow = depth + (y - tileY) * TILE_SIZE - tileX;
+#if SOFTRENDER_SSE
+            const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 e0 = _mm_add_ps(_mm_set1_ps(edgeRow[0]), _mm_mul_ps(lanes, _mm_set1_ps(stepX[0])));
+            __m128 e1 = _mm_add_ps(_mm_set1_ps(edgeRow[1]), _mm_mul_ps(lanes, _mm_set1_ps(stepX[1])));
+            __m128 e2 = _mm_add_ps(_mm_set1_ps(edgeRow[2]), _mm_mul_ps(lanes, _mm_set1_ps(stepX[2])));
+            const __m128 step0 = _mm_set1_ps(4.0f * stepX[0]);
+            const __m128 step1 = _mm_set1_ps(4.0f * stepX[1]);
+            const __m128 step2 = _mm_set1_ps(4.0f * stepX[2]);
+            const __m128 z0 = _mm_set1_ps(triangle.z[0] * oneOverArea);
+            const __m128 z1 = _mm_set1_ps(triangle.z[1] * oneOverArea);
+            const __m128 z2 = _mm_set1_ps(triangle.z[2] * oneOverArea);
+            for (GLint x = minX; x <= maxX; x += 4) {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                           _mm_cmpge_ps(e2, zero));
+                __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, z0), _mm_mul_ps(e1, z1)), _mm_mul_ps(e2, z2));
+                __m128 stored = _mm_loadu_ps(depthRow + x);
+                __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, stored));
+                GLint mask = _mm_movemask_ps(pass);
+                // Lanes past the triangle's last column.
+                if (maxX - x < 3) {
+                    mask &= (1 << (maxX - x + 1)) - 1;
+                }
+                if (mask) {
+                    GLfloat edges[3][4], depths[4];
+                    _mm_storeu_ps(edges[0], e0);
+                    _mm_storeu_ps(edges[1], e1);
+                    _mm_storeu_ps(edges[2], e2);
+                    _mm_storeu_ps(depths, z);
+                    for (GLint lane = 0; lane < 4; lane++) {
+                        if (mask & (1 << lane)) {
+                            depthRow[x + lane] = depths[lane];
+                            this->shadePixel(triangle, x + lane, y, edges[0][lane], edges[1][lane], edges[2][lane]);
+                        }
+                    }
+                }
+                e0 = _mm_add_ps(e0, step0);
+                e1 = _mm_add_ps(e1, step1);
+                e2 = _mm_add_ps(e2, step2);
+            }
+#else
+            GLfloat e[3] = { edgeRow[0], edgeRow[1], edgeRow[2] };
+            for (GLint x = minX; x <= maxX; x++) {
+                if (e[0] >= 0.0f && e[1] >= 0.0f && e[2] >= 0.0f) {
+                    GLfloat z = (e[0] * triangle.z[0] + e[1] * triangle.z[1] + e[2] * triangle.z[2]) * oneOverArea;
+                    if (z < depthRow[x]) {
+                        depthRow[x] = z;
+                        this->shadePixel(triangle, x, y, e[0], e[1], e[2]);
+                    }
+                }
+                e[0] += stepX[0];
+                e[1] += stepX[1];
+                e[2] += stepX[2];
+            }
+#endif
+            edgeRow[0] += stepY[0];
+            edgeRow[1] += stepY[1];
+            edgeRow[2] += stepY[2];
+        }
+    }
+}
+
+// deferred-geom.frag, without parallax.
+void SoftwareRenderer::shadePixel(const Triangle& triangle, GLuint x, GLuint y,
+                                  GLfloat e0, GLfloat e1, GLfloat e2)
+{
+    GLfloat oneOverW = e0 * triangle.oneOverW[0] + e1 * triangle.oneOverW[1] + e2 * triangle.oneOverW[2];
+    GLfloat w = 1.0f / oneOverW;
+    GLfloat attributes[ATTRIBUTES];
+    for (GLuint k = 0; k < ATTRIBUTES; k++) {
+        attributes[k] = (e0 * triangle.attributes[0][k] + e1 * triangle.attributes[1][k]
+                       + e2 * triangle.attributes[2][k]) * w;
+    }
+
+    const SoftwareScene& scene = *this->scene;
+    glm::vec2 uv(attributes[3], attributes[4]);
+    GLfloat diffuseLod = triangle.lod + 0.5f * std::log2((GLfloat) scene.diffuse.widths[0] * scene.diffuse.heights[0]);
+    GLfloat normalLod = triangle.lod + 0.5f * std::log2((GLfloat) scene.normal.widths[0] * scene.normal.heights[0]);
+    glm::vec3 albedo = scene.diffuse.sample(uv, diffuseLod);
+    glm::vec3 normalSample = scene.normal.sample(uv, normalLod);
+    glm::vec3 normal = glm::vec3(attributes[5], attributes[6], attributes[7]) * normalSample.x
+                     + glm::vec3(attributes[8], attributes[9], attributes[10]) * normalSample.y
+                     + glm::vec3(attributes[11], attributes[12], attributes[13]) * normalSample.z;
+    normal = glm::normalize(normal);
+
+    GLuint pixel = y * this->width + x;
+    this->covered[pixel] = 1;
+    this->positionX[pixel] = attributes[0];
+    this->positionY[pixel] = attributes[1];
+    this->positionZ[pixel] = attributes[2];
+    this->normalX[pixel] = normal.x;
+    this->normalY[pixel] = normal.y;
+    this->normalZ[pixel] = normal.z;
+    this->albedoR[pixel] = albedo.r;
+    this->albedoG[pixel] = albedo.g;
+    this->albedoB[pixel] = albedo.b;
+}
+
+// Screen-Space Passes
+// ===================
+
+// ssao.frag: G-buffer reads are nearest, clamped to the edge.
+void SoftwareRenderer::ssaoTile(GLuint tile)
+{
+    const SoftwareScene& scene = *this->scene;
+    const GLfloat RADIUS = 0.5f;
+    glm::mat4 projectionTranspose = glm::transpose(this->projectionMatrix);
+    glm::vec4 projectionRowX = projectionTranspose[0];
+    glm::vec4 projectionRowY = projectionTranspose[1];
+    glm::vec4 projectionRowW = projectionTranspose[3];
+    GLuint tileX = (tile % this->tilesX) * TILE_SIZE, tileY = (tile / this->tilesX) * TILE_SIZE;
+    GLuint tileEndX = std::min(tileX + TILE_SIZE, this->width), tileEndY = std::min(tileY + TILE_SIZE, this->height);
+    for (GLuint y = tileY; y < tileEndY; y++) {
+        for (GLuint x = tileX; x < tileEndX; x++) {
+            GLuint pixel = y * this->width + x;
+            if (!this->covered[pixel]) {
+                this->occlusion[pixel] = 1.0f;
+                continue;
+            }
+            glm::vec3 fragPos(this->positionX[pixel], this->positionY[pixel], this->positionZ[pixel]);
+            glm::vec3 fragNormal(this->normalX[pixel], this->normalY[pixel], this->normalZ[pixel]);
+            glm::vec3 rVec = scene.ssaoNoise[(y % 4) * 4 + x % 4];
+            glm::vec3 tangent = glm::normalize(rVec - fragNormal * glm::dot(rVec, fragNormal));
+            glm::vec3 bitangent = glm::cross(fragNormal, tangent);
+            glm::mat3 TBN(tangent, bitangent, fragNormal);
+
+            GLfloat occluded = 0.0f;
+            for (size_t i = 0; i < scene.ssaoKernel.size(); i++) {
+                glm::vec3 kernelSample = TBN * scene.ssaoKernel[i] * RADIUS + fragPos;
+                // Only x, y and w of the projection are needed.
+                GLfloat offsetX = glm::dot(projectionRowX, glm::vec4(kernelSample, 1.0f));
+                GLfloat offsetY = glm::dot(projectionRowY, glm::vec4(kernelSample, 1.0f));
+                GLfloat offsetW = glm::dot(projectionRowW, glm::vec4(kernelSample, 1.0f));
+                GLfloat u = offsetX / offsetW * 0.5f + 0.5f;
+                GLfloat v = offsetY / offsetW * 0.5f + 0.5f;
+                GLint sx = std::min(std::max((GLint) std::floor(u * this->width), 0), (GLint) this->width - 1);
+                GLint sy = std::min(std::max((GLint) std::floor(v * this->height), 0), (GLint) this->height - 1);
+                GLfloat sampleDepth = this->positionZ[sy * this->width + sx];
+                GLfloat rangeCheck = smoothstep(0.0f, 1.0f, RADIUS / std::fabs(fragPos.z - sampleDepth));
+                occluded += (sampleDepth >= kernelSample.z + 0.025f ? 1.0f : 0.0f) * rangeCheck;
+            }
+            this->occlusion[pixel] = 1.0f - occluded / scene.ssaoKernel.size();
+        }
+    }
+}
+
+// ssao-blur.frag: 4 x 4 box, offsets -2 to 1.
+void SoftwareRenderer::blurTile(GLuint tile)
+{
+    GLuint tileX = (tile % this->tilesX) * TILE_SIZE, tileY = (tile / this->tilesX) * TILE_SIZE;
+    GLuint tileEndX = std::min(tileX + TILE_SIZE, this->width), tileEndY = std::min(tileY + TILE_SIZE, this->height);
+    for (GLuint y = tileY; y < tileEndY; y++) {
+        for (GLuint x = tileX; x < tileEndX; x++) {
+            GLfloat sum = 0.0f;
+            for (GLint dy = -2; dy < 2; dy++) {
+                GLint sy = std::min(std::max((GLint) y + dy, 0), (GLint) this->height - 1);
+                for (GLint dx = -2; dx < 2; dx++) {
+                    GLint sx = std::min(std::max((GLint) x + dx, 0), (GLint) this->width - 1);
+                    sum += this->occlusion[sy * this->width + sx];
+                }
+            }
+            this->occlusionBlurred[y * this->width + x] = sum / 16.0f;
+        }
+    }
+}
+
+// deferred-light.frag without shadows, then the composite's tone map.
+void SoftwareRenderer::lightTile(GLuint tile)
+{
+    const SoftwareScene& scene = *this->scene;
+    GLuint tileX = (tile % this->tilesX) * TILE_SIZE, tileY = (tile / this->tilesX) * TILE_SIZE;
+    GLuint tileEndX = std::min(tileX + TILE_SIZE, this->width), tileEndY = std::min(tileY + TILE_SIZE, this->height);
+    for (GLuint y = tileY; y < tileEndY; y++) {
+        GLubyte* out = &this->pixels[((this->height - 1 - y) * this->width + tileX) * 3];
+        for (GLuint x = tileX; x < tileEndX; x++, out += 3) {
+            GLuint pixel = y * this->width + x;
+            if (!this->covered[pixel]) {
+                out[0] = out[1] = out[2] = 0;
+                continue;
+            }
+            glm::vec3 fragPosition(this->positionX[pixel], this->positionY[pixel], this->positionZ[pixel]);
+            glm::vec3 fragNormal(this->normalX[pixel], this->normalY[pixel], this->normalZ[pixel]);
+            glm::vec3 fragAlbedo(this->albedoR[pixel], this->albedoG[pixel], this->albedoB[pixel]);
+            GLfloat ambientOcclusion = scene.ambientOcclusion ? this->occlusionBlurred[pixel] : 1.0f;
+            glm::vec3 viewDir = glm::normalize(-fragPosition);
+            glm::vec3 ambient = 0.1f * fragAlbedo * ambientOcclusion;
+
+            glm::vec3 color(0.0f);
+            for (size_t i = 0; i < this->lightViewPositions.size(); i++) {
+                glm::vec3 toLight = this->lightViewPositions[i] - fragPosition;
+                GLfloat distance = glm::length(toLight);
+                glm::vec3 lightDir = toLight / distance;
+                GLfloat diffuseStrength = std::max(glm::dot(lightDir, fragNormal), 0.0f);
+                glm::vec3 halfwayDir = glm::normalize(lightDir + viewDir);
+                // pow(x, 64) by squaring.
+                GLfloat specularStrength = std::max(glm::dot(fragNormal, halfwayDir), 0.0f);
+                for (GLuint k = 0; k < 6; k++) {
+                    specularStrength *= specularStrength;
+                }
+                GLfloat attenuation = 1.0f / (scene.constFalloff + scene.linFalloff * distance
+                                              + scene.quadFalloff * distance * distance);
+                color += (ambient + scene.lightColors[i] * (diffuseStrength * fragAlbedo + specularStrength * 0.4f))
+                       * attenuation;
+            }
+            for (GLuint c = 0; c < 3; c++) {
+                out[c] = (GLubyte) (toneMap(color[c]) * 255.0f + 0.5f);
+            }
+        }
+    }
+}
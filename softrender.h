@@ -0,0 +1,135 @@
+#ifndef SOFTRENDER_H
+#define SOFTRENDER_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "jobs.h"
+
+// Software Renderer
+// =================
+// The deferred pipeline on the CPU, for machines without a GPU: the same
+// stages as deferred-geom, ssao, ssao-blur and deferred-light (and the
+// composite's tone map), producing a comparable image.
+//
+//   - Vertices are transformed per object (in parallel) and clipped to the
+//     near plane; back faces are culled; triangles are binned into
+//     TILE_SIZE x TILE_SIZE screen tiles.
+//   - Each tile is rasterized by one job into a tile-local depth buffer,
+//     testing four pixels at a time with SSE edge functions; covered
+//     pixels are shaded into a structure-of-arrays G-buffer.
+//   - SSAO, its blur and lighting run as tiled screen-space passes on the
+//     job system.
+//
+// Not reproduced: parallax / cone step mapping, shadows, bloom and auto
+// exposure (the composite runs at exposure 1). Textures are sampled
+// bilinearly from one mip level per triangle, picked from its texel to
+// pixel area ratio.
+struct SoftwareTexture {
+    std::vector<std::vector<GLfloat> > levels;   // RGB, 0 to 1
+    std::vector<GLuint> widths, heights;
+
+    // An RGB image and its box-filtered mip chain.
+    bool load(const std::string& path);
+    // Repeat-wrapped bilinear sample of the level nearest `lod`.
+    glm::vec3 sample(glm::vec2 uv, GLfloat lod) const;
+};
+
+struct SoftwareScene {
+    // One mesh, drawn once per object matrix.
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<glm::mat4> objectMatrices;
+    SoftwareTexture diffuse;
+    SoftwareTexture normal;
+
+    std::vector<glm::vec3> lightPositions;
+    std::vector<glm::vec3> lightColors;
+    GLfloat constFalloff, linFalloff, quadFalloff;
+
+    // Hemisphere kernel and 4 x 4 rotation noise, as uploaded to ssao.
+    std::vector<glm::vec3> ssaoKernel;
+    std::vector<glm::vec3> ssaoNoise;
+    bool ambientOcclusion;
+};
+
+class SoftwareRenderer
+{
+public:
+    SoftwareRenderer(GLuint width, GLuint height, JobSystem& jobs);
+
+    void render(const SoftwareScene& scene, const glm::mat4& viewMatrix,
+                const glm::mat4& projectionMatrix);
+
+    // RGB8, top row first.
+    const std::vector<GLubyte>& image() const;
+    bool save(const std::string& path) const;
+
+    // Average stage times of every render() so far, and throughput in
+    // megapixels per second per core.
+    void printStats() const;
+
+private:
+    static const GLuint TILE_SIZE = 32;
+    // View position, uv, tangent, bitangent, normal.
+    static const GLuint ATTRIBUTES = 14;
+
+    struct ClipVertex {
+        glm::vec4 position;
+        GLfloat attributes[ATTRIBUTES];
+    };
+    // Screen-space vertices, attributes pre-divided by w.
+    struct Triangle {
+        GLfloat x[3], y[3], z[3], oneOverW[3];
+        GLfloat attributes[3][ATTRIBUTES];
+        GLfloat area;
+        GLfloat lod;            // log2 of texels per pixel, over UV area
+        GLint minX, minY, maxX, maxY;
+    };
+    struct PassJob;
+
+    enum Stage { STAGE_VERTEX, STAGE_RASTER, STAGE_SSAO, STAGE_BLUR, STAGE_LIGHTING, STAGES };
+
+    GLuint width, height;
+    GLuint tilesX, tilesY;
+    JobSystem& jobs;
+
+    const SoftwareScene* scene;
+    glm::mat4 viewMatrix, projectionMatrix;
+    std::vector<glm::vec3> lightViewPositions;
+
+    std::vector<std::vector<Triangle> > objectTriangles;
+    std::vector<const Triangle*> triangles;
+    std::vector<std::vector<GLuint> > tileTriangles;
+
+    // G-buffer, one array per channel.
+    std::vector<GLubyte> covered;
+    std::vector<GLfloat> positionX, positionY, positionZ;
+    std::vector<GLfloat> normalX, normalY, normalZ;
+    std::vector<GLfloat> albedoR, albedoG, albedoB;
+    std::vector<GLfloat> occlusion, occlusionBlurred;
+    std::vector<GLubyte> pixels;
+
+    GLdouble stageTime[STAGES];
+    GLuint renders;
+
+    void transformObject(GLuint object);
+    void clipTriangle(const ClipVertex* vertices, std::vector<Triangle>& out) const;
+    void setupTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c,
+                       std::vector<Triangle>& out) const;
+    void rasterizeTile(GLuint tile);
+    void shadePixel(const Triangle& triangle, GLuint x, GLuint y, GLfloat e0, GLfloat e1, GLfloat e2);
+    void ssaoTile(GLuint tile);
+    void blurTile(GLuint tile);
+    void lightTile(GLuint tile);
+    void runTiles(void (SoftwareRenderer::*pass)(GLuint tile));
+
+    SoftwareRenderer(const SoftwareRenderer&);
+    SoftwareRenderer& operator=(const SoftwareRenderer&);
+};
+
+#endif // SOFTRENDER_H
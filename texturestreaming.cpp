@@ -0,0 +1,385 @@
+#include "texturestreaming.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include <SOIL.h>
+
+#include "gpumemory.h"
+
+static const char CACHE_MAGIC[4] = { 'M', 'I', 'P', 'S' };
+static const long CACHE_HEADER_SIZE = 4 + 3 * sizeof(GLuint);
+static const GLuint NO_REQUEST = 0xFFFFFFFF;
+
+struct TextureStreamer::MipRead {
+    std::string path;
+    long offset;
+    GLsizeiptr size;
+    GLuint textureIndex;
+    GLuint level;
+    std::vector<GLubyte> texels;
+    bool ok;
+    JobCounter counter;
+};
+
+static GLuint levelDimension(GLuint size, GLuint level)
+{
+    return std::max(size >> level, 1u);
+}
+
+// Each level a 2x2 box filter of the one above it, clamping at odd edges.
+static void buildMipChain(const GLubyte* image, GLuint width, GLuint height,
+                          std::vector<GLubyte>& chain, GLuint& levels)
+{
+    chain.assign(image, image + width * height * 3);
+    levels = 1;
+    size_t source = 0;
+    GLuint sourceWidth = width, sourceHeight = height;
+    while (sourceWidth > 1 || sourceHeight > 1) {
+        GLuint levelWidth = std::max(sourceWidth / 2, 1u);
+        GLuint levelHeight = std::max(sourceHeight / 2, 1u);
+        size_t level = chain.size();
+        chain.resize(level + levelWidth * levelHeight * 3);
+        for (GLuint y = 0; y < levelHeight; y++) {
+            GLuint y0 = std::min(2 * y, sourceHeight - 1), y1 = std::min(2 * y + 1, sourceHeight - 1);
+            for (GLuint x = 0; x < levelWidth; x++) {
+                GLuint x0 = std::min(2 * x, sourceWidth - 1), x1 = std::min(2 * x + 1, sourceWidth - 1);
+                for (GLuint c = 0; c < 3; c++) {
+                    GLuint sum = chain[source + (y0 * sourceWidth + x0) * 3 + c]
+                               + chain[source + (y0 * sourceWidth + x1) * 3 + c]
+                               + chain[source + (y1 * sourceWidth + x0) * 3 + c]
+                               + chain[source + (y1 * sourceWidth + x1) * 3 + c];
+                    chain[level + (y * levelWidth + x) * 3 + c] = (GLubyte) ((sum + 2) / 4);
+                }
+            }
+        }
+        source = level;
+        sourceWidth = levelWidth;
+        sourceHeight = levelHeight;
+        levels++;
+    }
+}
+
+static bool readMipCacheHeader(FILE* file, GLuint& width, GLuint& height, GLuint& levels)
+{
+    char magic[4];
+    return fread(magic, 1, 4, file) == 4 && memcmp(magic, CACHE_MAGIC, 4) == 0
+        && fread(&width, sizeof(GLuint), 1, file) == 1
+        && fread(&height, sizeof(GLuint), 1, file) == 1
+        && fread(&levels, sizeof(GLuint), 1, file) == 1
+        && width > 0 && height > 0 && levels > 0 && levels <= 32;
+}
+
+static void writeMipCache(const std::string& path, GLuint width, GLuint height, GLuint levels,
+                          const std::vector<GLubyte>& chain)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "ERROR::TEXTURE_STREAMING::CACHE_NOT_WRITTEN " << path << std::endl;
+        return;
+    }
+    fwrite(CACHE_MAGIC, 1, 4, file);
+    fwrite(&width, sizeof(GLuint), 1, file);
+    fwrite(&height, sizeof(GLuint), 1, file);
+    fwrite(&levels, sizeof(GLuint), 1, file);
+    fwrite(&chain[0], 1, chain.size(), file);
+    fclose(file);
+}
+
+TextureStreamer::TextureStreamer(JobSystem& jobs, GLsizeiptr uploadBudget, GLuint reportInterval)
+    : jobs(jobs), uploadBudget(uploadBudget), reportInterval(reportInterval),
+      frame(0), uploadedBytes(0), evictedBytes(0)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (size_t i = 0; i < this->reads.size(); i++) {
+        this->jobs.wait(&this->reads[i]->counter);
+        delete this->reads[i];
+    }
+    for (size_t i = 0; i < this->textures.size(); i++) {
+        untrackTexture(this->textures[i].texture);
+        glDeleteTextures(1, &this->textures[i].texture);
+    }
+}
+
+GLuint TextureStreamer::load(const std::string& path, const char* label)
+{
+    StreamedTexture streamed;
+    streamed.label = label;
+    streamed.cachePath = path + ".mips";
+
+    // The chain, if it had to be built; otherwise the coarse levels are
+    // read from the cache.
+    std::vector<GLubyte> chain;
+    struct stat imageStat, cacheStat;
+    bool cacheFresh = stat(streamed.cachePath.c_str(), &cacheStat) == 0
+                   && (stat(path.c_str(), &imageStat) != 0 || cacheStat.st_mtime >= imageStat.st_mtime);
+    FILE* cache = cacheFresh ? fopen(streamed.cachePath.c_str(), "rb") : NULL;
+    if (!cache || !readMipCacheHeader(cache, streamed.width, streamed.height, streamed.levels)) {
+        if (cache) {
+            fclose(cache);
+            cache = NULL;
+        }
+        int width, height;
+        unsigned char* image = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+        if (!image) {
+            std::cout << "ERROR::TEXTURE_STREAMING::IMAGE_NOT_LOADED " << path << std::endl;
+            return 0;
+        }
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        streamed.width = width;
+        streamed.height = height;
+        buildMipChain(image, streamed.width, streamed.height, chain, streamed.levels);
+        GLdouble time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        SOIL_free_image_data(image);
+        std::cout << "TEXTURE_STREAMING:: built " << streamed.cachePath << " (" << streamed.levels
+                  << " levels) in " << time << " ms" << std::endl;
+        writeMipCache(streamed.cachePath, streamed.width, streamed.height, streamed.levels, chain);
+    }
+
+    long offset = CACHE_HEADER_SIZE;
+    streamed.tailLevel = streamed.levels - 1;
+    for (GLuint level = 0; level < streamed.levels; level++) {
+        streamed.levelOffsets.push_back(offset);
+        offset += this->levelBytes(streamed, level);
+        if (level < streamed.tailLevel
+            && levelDimension(streamed.width, level) <= RESIDENT_SIZE
+            && levelDimension(streamed.height, level) <= RESIDENT_SIZE) {
+            streamed.tailLevel = level;
+        }
+    }
+    std::vector<GLubyte> tail;
+    if (cache) {
+        long tailOffset = streamed.levelOffsets[streamed.tailLevel];
+        tail.resize(offset - tailOffset);
+        bool ok = fseek(cache, tailOffset, SEEK_SET) == 0
+               && fread(&tail[0], 1, tail.size(), cache) == tail.size();
+        fclose(cache);
+        if (!ok) {
+            std::cout << "ERROR::TEXTURE_STREAMING::CACHE_NOT_READ " << streamed.cachePath << std::endl;
+            return 0;
+        }
+    }
+    else {
+        tail.assign(chain.begin() + (streamed.levelOffsets[streamed.tailLevel] - CACHE_HEADER_SIZE), chain.end());
+    }
+
+    glGenTextures(1, &streamed.texture);
+    glBindTexture(GL_TEXTURE_2D, streamed.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, streamed.levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    for (GLuint level = streamed.tailLevel; level < streamed.levels; level++) {
+        long levelOffset = streamed.levelOffsets[level] - streamed.levelOffsets[streamed.tailLevel];
+        this->uploadLevel(streamed, level, &tail[levelOffset]);
+    }
+    streamed.baseLevel = streamed.levels;
+    this->setBaseLevel(streamed, streamed.tailLevel);
+    streamed.requestedMip = NO_REQUEST;
+    streamed.targetMip = streamed.tailLevel;
+    streamed.targetFrame = this->frame;
+    streamed.reading = false;
+    streamed.failed = false;
+
+    this->textureIndices[streamed.texture] = this->textures.size();
+    this->textures.push_back(streamed);
+    return streamed.texture;
+}
+
+GLuint TextureStreamer::requiredMip(GLuint width, GLfloat distance, GLfloat uvDensity,
+                                    GLfloat projectionScale)
+{
+    GLfloat texelsPerPixel = width * uvDensity * std::max(distance, 0.0f) / projectionScale;
+    if (texelsPerPixel <= 1.0f) {
+        return 0;
+    }
+    return (GLuint) std::floor(std::log2(texelsPerPixel));
+}
+
+void TextureStreamer::request(GLuint texture, GLuint mip)
+{
+    std::map<GLuint, GLuint>::iterator it = this->textureIndices.find(texture);
+    if (it == this->textureIndices.end()) {
+        return;
+    }
+    StreamedTexture& streamed = this->textures[it->second];
+    streamed.requestedMip = std::min(streamed.requestedMip, mip);
+}
+
+void TextureStreamer::request(GLuint texture, GLfloat distance, GLfloat uvDensity, GLfloat projectionScale)
+{
+    std::map<GLuint, GLuint>::iterator it = this->textureIndices.find(texture);
+    if (it == this->textureIndices.end()) {
+        return;
+    }
+    StreamedTexture& streamed = this->textures[it->second];
+    GLuint mip = requiredMip(streamed.width, distance, uvDensity, projectionScale);
+    streamed.requestedMip = std::min(streamed.requestedMip, mip);
+}
+
+void TextureStreamer::update()
+{
+    this->frame++;
+
+    // Upload Finished Reads
+    // ---------------------
+    // Coarsest first: those fix the most visible blur per byte.
+    std::vector<MipRead*> finished, pending;
+    for (size_t i = 0; i < this->reads.size(); i++) {
+        (this->reads[i]->counter.done() ? finished : pending).push_back(this->reads[i]);
+    }
+    std::sort(finished.begin(), finished.end(),
+              [](const MipRead* a, const MipRead* b) { return a->level > b->level; });
+    GLsizeiptr frameBytes = 0;
+    for (size_t i = 0; i < finished.size(); i++) {
+        MipRead* read = finished[i];
+        if (frameBytes > 0 && frameBytes + read->size > this->uploadBudget) {
+            pending.push_back(read);
+            continue;
+        }
+        this->jobs.wait(&read->counter);
+        StreamedTexture& streamed = this->textures[read->textureIndex];
+        streamed.reading = false;
+        if (!read->ok) {
+            std::cout << "ERROR::TEXTURE_STREAMING::LEVEL_NOT_READ " << read->path
+                      << " level " << read->level << std::endl;
+            streamed.failed = true;
+        }
+        else if (read->level + 1 == streamed.baseLevel && read->level >= streamed.targetMip) {
+            this->uploadLevel(streamed, read->level, &read->texels[0]);
+            this->setBaseLevel(streamed, read->level);
+            frameBytes += read->size;
+        }
+        delete read;
+    }
+    this->reads = pending;
+    this->uploadedBytes += frameBytes;
+
+    // Targets, Eviction and New Reads
+    // -------------------------------
+    // A finer request takes effect at once; a coarser one only after it
+    // has held for EVICT_FRAMES, so levels don't thrash as the camera
+    // moves back and forth.
+    for (size_t i = 0; i < this->textures.size(); i++) {
+        StreamedTexture& streamed = this->textures[i];
+        GLuint requested = std::min(streamed.requestedMip, streamed.tailLevel);
+        streamed.requestedMip = NO_REQUEST;
+        if (requested <= streamed.targetMip || this->frame - streamed.targetFrame >= EVICT_FRAMES) {
+            streamed.targetMip = requested;
+            streamed.targetFrame = this->frame;
+        }
+        if (streamed.reading) {
+            continue;
+        }
+
+        if (streamed.baseLevel < streamed.targetMip) {
+            GLuint evictFrom = streamed.baseLevel;
+            this->setBaseLevel(streamed, streamed.targetMip);
+            glBindTexture(GL_TEXTURE_2D, streamed.texture);
+            for (GLuint level = evictFrom; level < streamed.targetMip; level++) {
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+                this->evictedBytes += this->levelBytes(streamed, level);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        else if (streamed.baseLevel > streamed.targetMip && !streamed.failed
+                 && this->reads.size() < MAX_READS_IN_FLIGHT) {
+            MipRead* read = new MipRead();
+            read->path = streamed.cachePath;
+            read->level = streamed.baseLevel - 1;
+            read->offset = streamed.levelOffsets[read->level];
+            read->size = this->levelBytes(streamed, read->level);
+            read->textureIndex = i;
+            read->ok = false;
+            streamed.reading = true;
+            this->reads.push_back(read);
+            this->jobs.run(&TextureStreamer::readLevel, read, 0, 1, &read->counter);
+        }
+    }
+
+    if (this->reportInterval > 0 && this->frame % this->reportInterval == 0) {
+        this->printStats();
+    }
+}
+
+void TextureStreamer::readLevel(void* data, GLuint, GLuint)
+{
+    MipRead* read = (MipRead*) data;
+    FILE* file = fopen(read->path.c_str(), "rb");
+    if (!file) {
+        return;
+    }
+    read->texels.resize(read->size);
+    read->ok = fseek(file, read->offset, SEEK_SET) == 0
+            && fread(&read->texels[0], 1, read->size, file) == (size_t) read->size;
+    fclose(file);
+}
+
+GLsizeiptr TextureStreamer::levelBytes(const StreamedTexture& texture, GLuint level) const
+{
+    return (GLsizeiptr) levelDimension(texture.width, level) * levelDimension(texture.height, level) * 3;
+}
+
+void TextureStreamer::uploadLevel(StreamedTexture& texture, GLuint level, const GLubyte* texels)
+{
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGB,
+                 levelDimension(texture.width, level), levelDimension(texture.height, level),
+                 0, GL_RGB, GL_UNSIGNED_BYTE, texels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureStreamer::setBaseLevel(StreamedTexture& texture, GLuint level)
+{
+    if (level == texture.baseLevel) {
+        return;
+    }
+    texture.baseLevel = level;
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    trackTexture(texture.texture, GPU_MEMORY_MATERIAL, texture.label,
+                 levelDimension(texture.width, level), levelDimension(texture.height, level), GL_RGB, 0);
+}
+
+TextureStreamingStats TextureStreamer::stats() const
+{
+    TextureStreamingStats stats = { (GLuint) this->textures.size(), 0, 0, 0, 0,
+                                    (GLuint) this->reads.size(), this->uploadedBytes, this->evictedBytes };
+    for (size_t i = 0; i < this->textures.size(); i++) {
+        const StreamedTexture& streamed = this->textures[i];
+        stats.fullChainBytes += gpuTextureBytes(streamed.width, streamed.height, GL_RGB, 0);
+        for (GLuint level = streamed.baseLevel; level < streamed.levels; level++) {
+            stats.residentBytes += this->levelBytes(streamed, level);
+        }
+        for (GLuint level = streamed.targetMip; level < streamed.baseLevel && !streamed.failed; level++) {
+            stats.backlogLevels++;
+            stats.backlogBytes += this->levelBytes(streamed, level);
+        }
+    }
+    return stats;
+}
+
+void TextureStreamer::printStats() const
+{
+    TextureStreamingStats stats = this->stats();
+    std::cout << "TEXTURE_STREAMING:: " << stats.textures << " textures, "
+              << stats.residentBytes / 1048576.0 << " of " << stats.fullChainBytes / 1048576.0
+              << " MB resident, backlog " << stats.backlogLevels << " levels ("
+              << stats.backlogBytes / 1048576.0 << " MB, " << stats.readsInFlight << " reading), "
+              << stats.uploadedBytes / 1048576.0 << " MB streamed in, "
+              << stats.evictedBytes / 1048576.0 << " MB evicted" << std::endl;
+}
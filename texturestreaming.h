@@ -0,0 +1,115 @@
+#ifndef TEXTURESTREAMING_H
+#define TEXTURESTREAMING_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "jobs.h"
+
+// Texture Streaming
+// =================
+// Textures are loaded with only the coarse end of their mip chain resident
+// (every level of at most RESIDENT_SIZE texels); finer levels are streamed
+// in from disk as the screen needs them and dropped again when it no
+// longer does. GL_TEXTURE_BASE_LEVEL clamps sampling to what is resident.
+//
+// The full chain is built once per image and cached next to it as
+// `<image>.mips` (RGB8 levels, finest first), so streaming a level is a
+// seek and a read, done on a job worker. Give the streamer a JobSystem
+// meant for I/O (see jobs.h), not the one frame work is waited on through.
+//
+// Each frame, request() the finest mip every texture needs (requiredMip()
+// estimates it from the distance and UV density of what it's mapped on),
+// then update(): finished reads are uploaded, finest-needed last, within
+// the per-frame upload budget; new reads are queued; levels no longer
+// requested for EVICT_FRAMES frames are released.
+struct TextureStreamingStats {
+    GLuint textures;
+    GLsizeiptr residentBytes;
+    GLsizeiptr fullChainBytes;  // if every level were resident
+    GLuint backlogLevels;       // requested but not yet resident
+    GLsizeiptr backlogBytes;
+    GLuint readsInFlight;
+    GLsizeiptr uploadedBytes;   // since start
+    GLsizeiptr evictedBytes;    // since start
+};
+
+class TextureStreamer
+{
+public:
+    // Uploads stop for the frame once `uploadBudget` bytes went out (at
+    // least one level always does); stats are printed every
+    // `reportInterval` frames, 0 for never.
+    TextureStreamer(JobSystem& jobs, GLsizeiptr uploadBudget = 4 * 1024 * 1024,
+                    GLuint reportInterval = 300);
+    // Joins outstanding reads and deletes every streamed texture.
+    ~TextureStreamer();
+
+    // An RGB8 texture with its coarse levels resident, repeat-wrapped and
+    // trilinear filtered; 0 if the image can't be loaded. `label` must be a
+    // string literal (see trackTexture).
+    GLuint load(const std::string& path, const char* label);
+
+    // The mip level that maps one texel to at most one pixel, for a
+    // texture `width` texels wide on a surface at `distance` with
+    // `uvDensity` texture repeats per world unit. `projectionScale` is
+    // pixels per world unit at distance 1: viewport height / (2 tan(fov/2)).
+    static GLuint requiredMip(GLuint width, GLfloat distance, GLfloat uvDensity,
+                              GLfloat projectionScale);
+
+    // Ask for `texture` down to `mip` this frame (the finest of several
+    // requests wins). Textures not requested fall back to their coarse
+    // levels.
+    void request(GLuint texture, GLuint mip);
+    // Same, with requiredMip() of the texture's own width.
+    void request(GLuint texture, GLfloat distance, GLfloat uvDensity, GLfloat projectionScale);
+    void update();
+
+    TextureStreamingStats stats() const;
+    void printStats() const;
+
+private:
+    // Levels up to this size are loaded with the texture and never evicted.
+    static const GLuint RESIDENT_SIZE = 64;
+    static const GLuint EVICT_FRAMES = 120;
+    static const GLuint MAX_READS_IN_FLIGHT = 8;
+
+    struct StreamedTexture {
+        GLuint texture;
+        const char* label;
+        std::string cachePath;
+        GLuint width, height, levels;
+        std::vector<long> levelOffsets;
+        GLuint tailLevel;           // coarsest-resident boundary
+        GLuint baseLevel;           // finest resident level
+        GLuint requestedMip;        // this frame's request
+        GLuint targetMip;           // held request
+        GLuint targetFrame;         // frame the held request was last renewed
+        bool reading;
+        bool failed;                // a level couldn't be read
+    };
+    struct MipRead;
+
+    JobSystem& jobs;
+    GLsizeiptr uploadBudget;
+    GLuint reportInterval;
+    std::vector<StreamedTexture> textures;
+    std::map<GLuint, GLuint> textureIndices;
+    std::vector<MipRead*> reads;
+    GLuint frame;
+    GLsizeiptr uploadedBytes;
+    GLsizeiptr evictedBytes;
+
+    static void readLevel(void* data, GLuint begin, GLuint end);
+    GLsizeiptr levelBytes(const StreamedTexture& texture, GLuint level) const;
+    void uploadLevel(StreamedTexture& texture, GLuint level, const GLubyte* texels);
+    void setBaseLevel(StreamedTexture& texture, GLuint level);
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+};
+
+#endif // TEXTURESTREAMING_H
@@ -0,0 +1,214 @@
+#include "transform.h"
+
+#include <algorithm>
+#include <cmath>
+
+template <typename T>
+static void insertAt(std::vector<T>& v, GLuint index, const T& value)
+{
+    v.insert(v.begin() + index, value);
+}
+
+GLuint TransformHierarchy::addNode(GLuint parent, const glm::mat4& localMatrix)
+{
+    // The new node goes at the end of its parent's subtree, which keeps the
+    // arrays in pre-order. For depth-first construction this is the end of
+    // the arrays.
+    GLuint index = (parent == NO_PARENT)
+                 ? this->size()
+                 : parent + this->subtreeSizes[parent];
+
+    if (index < this->size()) {
+        // Shift references to every node that moves up by one.
+        for (GLuint i = 0; i < this->parents.size(); i++) {
+            if (this->parents[i] != NO_PARENT && this->parents[i] >= index) {
+                this->parents[i]++;
+            }
+        }
+        for (GLuint i = 0; i < this->dirtyNodes.size(); i++) {
+            if (this->dirtyNodes[i] >= index) {
+                this->dirtyNodes[i]++;
+            }
+        }
+    }
+
+    insertAt(this->parents, index, parent);
+    insertAt(this->subtreeSizes, index, (GLuint) 1);
+    insertAt(this->localMatrices, index, localMatrix);
+    insertAt(this->worldMatrixArray, index, localMatrix);
+    insertAt(this->boundX, index, 0.0f);
+    insertAt(this->boundY, index, 0.0f);
+    insertAt(this->boundZ, index, 0.0f);
+    insertAt(this->boundRadius, index, 0.0f);
+    insertAt(this->worldBoundX, index, 0.0f);
+    insertAt(this->worldBoundY, index, 0.0f);
+    insertAt(this->worldBoundZ, index, 0.0f);
+    insertAt(this->worldBoundRadius, index, 0.0f);
+    insertAt(this->dirty, index, (GLubyte) 0);
+
+    for (GLuint p = parent; p != NO_PARENT; p = this->parents[p]) {
+        this->subtreeSizes[p]++;
+    }
+
+    this->markDirty(index);
+    return index;
+}
+
+void TransformHierarchy::setLocalMatrix(GLuint node, const glm::mat4& localMatrix)
+{
+    this->localMatrices[node] = localMatrix;
+    this->markDirty(node);
+}
+
+void TransformHierarchy::setBoundingSphere(GLuint node, glm::vec3 center, GLfloat radius)
+{
+    this->boundX[node] = center.x;
+    this->boundY[node] = center.y;
+    this->boundZ[node] = center.z;
+    this->boundRadius[node] = radius;
+    this->markDirty(node);
+}
+
+void TransformHierarchy::markDirty(GLuint node)
+{
+    if (!this->dirty[node]) {
+        this->dirty[node] = 1;
+        this->dirtyNodes.push_back(node);
+    }
+}
+
+void TransformHierarchy::update()
+{
+    const std::vector<NodeRange>& ranges = this->collectDirtyRanges();
+    for (GLuint i = 0; i < ranges.size(); i++) {
+        this->updateRange(ranges[i]);
+    }
+}
+
+const std::vector<NodeRange>& TransformHierarchy::collectDirtyRanges()
+{
+    this->lastUpdatedRanges.clear();
+    if (this->dirtyNodes.empty()) {
+        return this->lastUpdatedRanges;
+    }
+
+    // Sorting puts every dirty node after its dirty ancestors, so a node
+    // already covered by an earlier subtree is skipped rather than redone.
+    std::sort(this->dirtyNodes.begin(), this->dirtyNodes.end());
+    GLuint coveredEnd = 0;
+    for (GLuint i = 0; i < this->dirtyNodes.size(); i++) {
+        GLuint begin = this->dirtyNodes[i];
+        if (begin < coveredEnd) {
+            continue;
+        }
+        GLuint end = begin + this->subtreeSizes[begin];
+        NodeRange range = { begin, end };
+        this->lastUpdatedRanges.push_back(range);
+        coveredEnd = end;
+    }
+    this->dirtyNodes.clear();
+    return this->lastUpdatedRanges;
+}
+
+void TransformHierarchy::updateRange(NodeRange range)
+{
+    // Pre-order guarantees parents are visited before their children.
+    for (GLuint node = range.begin; node < range.end; node++) {
+        this->updateNode(node);
+        this->dirty[node] = 0;
+    }
+}
+
+void TransformHierarchy::updateNode(GLuint node)
+{
+    GLuint parent = this->parents[node];
+    glm::mat4& world = this->worldMatrixArray[node];
+    if (parent == NO_PARENT) {
+        world = this->localMatrices[node];
+    }
+    else {
+        world = this->worldMatrixArray[parent] * this->localMatrices[node];
+    }
+
+    // World Bounds
+    if (this->boundRadius[node] > 0.0f) {
+        glm::vec4 center = world * glm::vec4(this->boundX[node],
+                                             this->boundY[node],
+                                             this->boundZ[node], 1.0f);
+        // Conservative radius: scale by the largest axis scale.
+        GLfloat sx = glm::dot(glm::vec3(world[0]), glm::vec3(world[0]));
+        GLfloat sy = glm::dot(glm::vec3(world[1]), glm::vec3(world[1]));
+        GLfloat sz = glm::dot(glm::vec3(world[2]), glm::vec3(world[2]));
+        GLfloat scale = std::sqrt(std::max(sx, std::max(sy, sz)));
+        this->worldBoundX[node] = center.x;
+        this->worldBoundY[node] = center.y;
+        this->worldBoundZ[node] = center.z;
+        this->worldBoundRadius[node] = this->boundRadius[node] * scale;
+    }
+}
+
+void TransformHierarchy::cull(const glm::mat4& viewProjection,
+                              GLuint first, GLuint last,
+                              std::vector<GLuint>& visible) const
+{
+    // Frustum planes from the rows of the view-projection matrix
+    // (Gribb & Hartmann). glm is column-major, so row i is m[*][i].
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                            viewProjection[2][i], viewProjection[3][i]);
+    }
+    glm::vec4 planes[6] = {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2]
+    };
+    for (int i = 0; i < 6; i++) {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    last = std::min(last, this->size());
+    for (GLuint node = first; node < last; node++) {
+        GLfloat radius = this->worldBoundRadius[node];
+        if (radius <= 0.0f) {
+            continue;
+        }
+        GLfloat x = this->worldBoundX[node];
+        GLfloat y = this->worldBoundY[node];
+        GLfloat z = this->worldBoundZ[node];
+        bool inside = true;
+        for (int i = 0; i < 6 && inside; i++) {
+            GLfloat distance = planes[i].x * x + planes[i].y * y + planes[i].z * z + planes[i].w;
+            inside = distance >= -radius;
+        }
+        if (inside) {
+            visible.push_back(node);
+        }
+    }
+}
+
+GLuint TransformHierarchy::size() const { return this->parents.size(); }
+
+GLuint TransformHierarchy::parent(GLuint node) const { return this->parents[node]; }
+
+GLuint TransformHierarchy::subtreeSize(GLuint node) const { return this->subtreeSizes[node]; }
+
+const glm::mat4& TransformHierarchy::localMatrix(GLuint node) const { return this->localMatrices[node]; }
+
+const glm::mat4& TransformHierarchy::worldMatrix(GLuint node) const { return this->worldMatrixArray[node]; }
+
+glm::vec4 TransformHierarchy::worldBounds(GLuint node) const
+{
+    return glm::vec4(this->worldBoundX[node], this->worldBoundY[node],
+                     this->worldBoundZ[node], this->worldBoundRadius[node]);
+}
+
+const glm::mat4* TransformHierarchy::worldMatrices() const
+{
+    return this->worldMatrixArray.empty() ? NULL : &this->worldMatrixArray[0];
+}
+
+const std::vector<NodeRange>& TransformHierarchy::updatedRanges() const
+{
+    return this->lastUpdatedRanges;
+}
@@ -0,0 +1,85 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Transform Hierarchy
+// ===================
+// Parent/child transforms stored as flat arrays in depth-first (pre-order)
+// order, so every node's subtree is the contiguous index range
+// [node, node + subtreeSize). Changing a node's local matrix only marks that
+// node dirty; update() then recomputes the dirty subtrees and nothing else.
+//
+// Nodes should be added depth-first (parent before children, siblings in
+// order) --- this is what Model and main.cpp do --- so that addNode is an
+// append. Adding a node into the middle of an existing subtree is supported,
+// but shifts the indices of every node after it.
+
+struct NodeRange {
+    GLuint begin;
+    GLuint end;
+};
+
+class TransformHierarchy
+{
+public:
+    static const GLuint NO_PARENT = 0xFFFFFFFF;
+
+    // Building
+    GLuint addNode(GLuint parent, const glm::mat4& localMatrix);
+    void setLocalMatrix(GLuint node, const glm::mat4& localMatrix);
+    void setBoundingSphere(GLuint node, glm::vec3 center, GLfloat radius);
+
+    // Recompute world matrices (and world bounds) of every dirty subtree.
+    void update();
+    // update() in two steps, for spreading the work over threads: collect
+    // the disjoint dirty subtrees, then call updateRange on each of them.
+    // Different ranges touch disjoint nodes and only read (clean) parents
+    // outside themselves, so they may be updated concurrently.
+    const std::vector<NodeRange>& collectDirtyRanges();
+    void updateRange(NodeRange range);
+
+    // Culling
+    // Appends the nodes in [first, last) whose world bounding sphere
+    // intersects the frustum of `viewProjection`. Nodes without bounds
+    // (radius 0) are never reported.
+    void cull(const glm::mat4& viewProjection,
+              GLuint first, GLuint last,
+              std::vector<GLuint>& visible) const;
+
+    // Accessors
+    GLuint size() const;
+    GLuint parent(GLuint node) const;
+    GLuint subtreeSize(GLuint node) const;
+    const glm::mat4& localMatrix(GLuint node) const;
+    const glm::mat4& worldMatrix(GLuint node) const;
+    // World bounding sphere as (center, radius); radius 0 if none.
+    glm::vec4 worldBounds(GLuint node) const;
+    // Contiguous world matrices, ready for an instance buffer upload.
+    const glm::mat4* worldMatrices() const;
+    // Index ranges recomputed by the last update(), for partial uploads.
+    const std::vector<NodeRange>& updatedRanges() const;
+
+private:
+    // Topology
+    std::vector<GLuint> parents;
+    std::vector<GLuint> subtreeSizes;
+    // Matrices
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> worldMatrixArray;
+    // Bounding Spheres (local centre + radius, world centre + radius)
+    std::vector<GLfloat> boundX, boundY, boundZ, boundRadius;
+    std::vector<GLfloat> worldBoundX, worldBoundY, worldBoundZ, worldBoundRadius;
+    // Dirty Tracking
+    std::vector<GLubyte> dirty;
+    std::vector<GLuint>  dirtyNodes;
+    std::vector<NodeRange> lastUpdatedRanges;
+
+    void markDirty(GLuint node);
+    void updateNode(GLuint node);
+};
+
+#endif // TRANSFORM_H